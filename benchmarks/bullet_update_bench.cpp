@@ -0,0 +1,64 @@
+#include <algorithm>
+#include <bullet_pool.hpp>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+// Updates a pool of N bullets with every kernel the CPU supports and reports
+// the median time of a single update. The target is 200k bullets in under a
+// millisecond on one core.
+namespace {
+void fillPool(BulletPool &pool, uint32_t count) {
+  std::mt19937 rng(1234);
+  std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+
+  pool.clear();
+  pool.setBounds({-1e6f, -1e6f, 1e6f, 1e6f});
+  for (uint32_t i = 0; i < count; i++) {
+    BulletDesc desc;
+    desc.x = 400.0f + unit(rng) * 300.0f;
+    desc.y = 400.0f + unit(rng) * 300.0f;
+    desc.vx = unit(rng) * 200.0f;
+    desc.vy = unit(rng) * 200.0f;
+    desc.angularVelocity = unit(rng);
+    desc.acceleration = unit(rng) * 50.0f;
+    pool.spawn(desc);
+  }
+}
+} // namespace
+
+int main(int argc, char **argv) {
+  const uint32_t bulletCount = argc > 1 ? std::atoi(argv[1]) : 200000;
+  const uint32_t iterations = argc > 2 ? std::atoi(argv[2]) : 500;
+
+  BulletPool pool(bulletCount);
+
+  for (BulletKernel kernel :
+       {BulletKernel::SCALAR, BulletKernel::SSE, BulletKernel::AVX2}) {
+    if (!pool.setKernel(kernel)) {
+      std::printf("%-6s unsupported on this CPU\n", bulletKernelName(kernel));
+      continue;
+    }
+
+    fillPool(pool, bulletCount);
+
+    std::vector<double> times;
+    times.reserve(iterations);
+    for (uint32_t i = 0; i < iterations; i++) {
+      auto start = std::chrono::steady_clock::now();
+      pool.update(1.0f / 60.0f);
+      std::chrono::duration<double, std::milli> time =
+          std::chrono::steady_clock::now() - start;
+      times.push_back(time.count());
+    }
+
+    std::sort(times.begin(), times.end());
+    double median = times[times.size() / 2];
+    std::printf("%-6s %u bullets: %.3f ms median, %.3f ms min, %.1f "
+                "bullets/us\n",
+                bulletKernelName(kernel), bulletCount, median, times.front(),
+                bulletCount / (median * 1000.0));
+  }
+}
@@ -0,0 +1,95 @@
+#include <algorithm>
+#include <bullet_pool.hpp>
+#include <chrono>
+#include <collision.hpp>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+// 100k bullets against the player and 500 enemies. Compares the grid with
+// the brute force O(N*M) loop it replaces, and reports the median time of a
+// rebuild and of the queries.
+namespace {
+constexpr float WIDTH = 1280.0f;
+constexpr float HEIGHT = 960.0f;
+
+uint32_t bruteForce(const BulletPool &pool,
+                    const std::vector<CollisionHitbox> &hitboxes) {
+  const BulletArrays &bullets = pool.arrays();
+  uint32_t contacts = 0;
+  for (const CollisionHitbox &hitbox : hitboxes) {
+    for (uint32_t i = 0; i < pool.size(); i++) {
+      float dx = bullets.x[i] - hitbox.x0;
+      float dy = bullets.y[i] - hitbox.y0;
+      float reach = bullets.radius[i] + hitbox.radius;
+      contacts += dx * dx + dy * dy <= reach * reach;
+    }
+  }
+  return contacts;
+}
+
+double median(std::vector<double> &times) {
+  std::sort(times.begin(), times.end());
+  return times[times.size() / 2];
+}
+} // namespace
+
+int main(int argc, char **argv) {
+  const uint32_t bulletCount = argc > 1 ? std::atoi(argv[1]) : 100000;
+  const uint32_t enemyCount = argc > 2 ? std::atoi(argv[2]) : 500;
+  const uint32_t iterations = 200;
+
+  std::mt19937 rng(42);
+  std::uniform_real_distribution<float> px(0.0f, WIDTH);
+  std::uniform_real_distribution<float> py(0.0f, HEIGHT);
+
+  BulletPool pool(bulletCount);
+  for (uint32_t i = 0; i < bulletCount; i++) {
+    BulletDesc desc;
+    desc.x = px(rng);
+    desc.y = py(rng);
+    desc.radius = 3.0f;
+    pool.spawn(desc);
+  }
+
+  std::vector<CollisionHitbox> hitboxes;
+  hitboxes.push_back({HitboxShape::CIRCLE, WIDTH / 2, HEIGHT - 100.0f, 0.0f,
+                      0.0f, 2.5f, 0});
+  for (uint32_t i = 0; i < enemyCount; i++) {
+    hitboxes.push_back({HitboxShape::CIRCLE, px(rng), py(rng), 0.0f, 0.0f,
+                        16.0f, i + 1});
+  }
+
+  CollisionGrid grid(0.0f, 0.0f, WIDTH, HEIGHT, 32.0f, bulletCount, 65536);
+
+  std::vector<double> buildTimes;
+  std::vector<double> queryTimes;
+  for (uint32_t i = 0; i < iterations; i++) {
+    auto start = std::chrono::steady_clock::now();
+    grid.build(pool);
+    auto built = std::chrono::steady_clock::now();
+    grid.clearContacts();
+    grid.query(hitboxes);
+    auto queried = std::chrono::steady_clock::now();
+
+    buildTimes.push_back(
+        std::chrono::duration<double, std::milli>(built - start).count());
+    queryTimes.push_back(
+        std::chrono::duration<double, std::milli>(queried - built).count());
+  }
+
+  auto bruteStart = std::chrono::steady_clock::now();
+  uint32_t bruteContacts = bruteForce(pool, hitboxes);
+  std::chrono::duration<double, std::milli> bruteTime =
+      std::chrono::steady_clock::now() - bruteStart;
+
+  std::printf("%u bullets, %u hitboxes\n", bulletCount,
+              static_cast<uint32_t>(hitboxes.size()));
+  std::printf("grid build:  %.3f ms median\n", median(buildTimes));
+  std::printf("grid query:  %.3f ms median (%zu contacts, %u dropped)\n",
+              median(queryTimes), grid.contacts().size(),
+              grid.droppedContacts());
+  std::printf("brute force: %.3f ms (%u contacts)\n", bruteTime.count(),
+              bruteContacts);
+}
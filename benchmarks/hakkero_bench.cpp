@@ -0,0 +1,619 @@
+#include <algorithm>
+#include <atomic>
+#include <bullet_pool.hpp>
+#include <bullet_render.hpp>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <logger.hpp>
+#include <new>
+#include <random>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include <vulkan_gpu_profiler.hpp>
+#include <vulkan_init.hpp>
+#include <vulkan_render.hpp>
+#include <vulkan_sprite.hpp>
+#include <vulkan_swapchain.hpp>
+#include <vulkan_texture.hpp>
+#include <vulkan_types.hpp>
+
+// Runs deterministic scripted scenes headless for a fixed number of frames
+// and prints percentiles of the frame time, the CPU time, the GPU time, the
+// submit to completion latency and the heap allocations per frame as JSON, so
+// runs of different commits can be diffed. Works on software drivers like
+// lavapipe.
+//
+// hakkero_bench [--scene all|bullets|sprites|resize] [--count N]
+//               [--frames N] [--warmup N] [--width W] [--height H]
+//               [--headless-surface] [--output file.json]
+
+namespace {
+// Only allocations of the thread that runs the frames are counted, the logger
+// thread allocates on its own schedule and would make the numbers noisy.
+thread_local uint64_t t_allocations = 0;
+
+void *countedAlloc(std::size_t size, std::size_t alignment) {
+  t_allocations++;
+  if (size == 0) {
+    size = 1;
+  }
+
+  void *memory = nullptr;
+  if (alignment <= alignof(std::max_align_t)) {
+    memory = std::malloc(size);
+  }
+
+  else {
+    memory = std::aligned_alloc(alignment,
+                                (size + alignment - 1) / alignment * alignment);
+  }
+
+  if (!memory) {
+    throw std::bad_alloc();
+  }
+  return memory;
+}
+} // namespace
+
+void *operator new(std::size_t size) {
+  return countedAlloc(size, alignof(std::max_align_t));
+}
+
+void *operator new[](std::size_t size) {
+  return countedAlloc(size, alignof(std::max_align_t));
+}
+
+void *operator new(std::size_t size, std::align_val_t alignment) {
+  return countedAlloc(size, static_cast<std::size_t>(alignment));
+}
+
+void *operator new[](std::size_t size, std::align_val_t alignment) {
+  return countedAlloc(size, static_cast<std::size_t>(alignment));
+}
+
+void operator delete(void *memory) noexcept { std::free(memory); }
+void operator delete[](void *memory) noexcept { std::free(memory); }
+void operator delete(void *memory, std::size_t) noexcept { std::free(memory); }
+void operator delete[](void *memory, std::size_t) noexcept {
+  std::free(memory);
+}
+void operator delete(void *memory, std::align_val_t) noexcept {
+  std::free(memory);
+}
+void operator delete[](void *memory, std::align_val_t) noexcept {
+  std::free(memory);
+}
+void operator delete(void *memory, std::size_t, std::align_val_t) noexcept {
+  std::free(memory);
+}
+void operator delete[](void *memory, std::size_t, std::align_val_t) noexcept {
+  std::free(memory);
+}
+
+namespace {
+using Clock = std::chrono::steady_clock;
+
+constexpr float DT = 1.0f / 60.0f;
+constexpr float UV_FULL[4] = {0.0f, 0.0f, 1.0f, 1.0f};
+
+struct BenchOptions {
+  std::string scene = "all";
+  uint32_t count = 20000;
+  uint32_t frames = 1000;
+  uint32_t warmup = 60;
+  uint32_t width = 1280;
+  uint32_t height = 720;
+  bool headlessSurface = false;
+  std::string output;
+};
+
+struct Percentiles {
+  double p50 = 0.0;
+  double p95 = 0.0;
+  double p99 = 0.0;
+  double max = 0.0;
+};
+
+struct SceneResult {
+  std::string name;
+  uint32_t count = 0;
+  uint32_t frames = 0;
+  Percentiles frameMs;
+  Percentiles cpuMs;
+  Percentiles gpuMs;
+  Percentiles latencyMs;
+  Percentiles allocations;
+};
+
+// Nearest rank, so every reported value is one that was actually measured.
+Percentiles percentiles(std::vector<double> values) {
+  Percentiles result;
+  if (values.empty()) {
+    return result;
+  }
+
+  std::sort(values.begin(), values.end());
+  auto rank = [&](double p) {
+    size_t index = static_cast<size_t>(std::ceil(p * values.size()));
+    return values[std::clamp<size_t>(index, 1, values.size()) - 1];
+  };
+
+  result.p50 = rank(0.50);
+  result.p95 = rank(0.95);
+  result.p99 = rank(0.99);
+  result.max = values.back();
+  return result;
+}
+
+// Waits for every submitted frame on its own thread, on the frame timeline or
+// on the slot's fence, and records how long after the submit the GPU finished
+// it. Offscreen targets are never
+// presented, so completion is the closest thing to the present we have.
+class LatencyTracker {
+public:
+  explicit LatencyTracker(uint32_t framesInFlight)
+      : pending_(framesInFlight) {}
+
+  ~LatencyTracker() { stop(); }
+
+  void start(size_t expectedFrames) {
+    latencies_.clear();
+    latencies_.reserve(expectedFrames);
+    running_ = true;
+    thread_ = std::thread([this] { run(); });
+  }
+
+  // Lets the waiter finish everything that was submitted, then wakes it one
+  // last time so it sees that it should exit.
+  void stop() {
+    if (!thread_.joinable()) {
+      return;
+    }
+
+    const uint64_t submitted = submitted_.load();
+    for (uint64_t done = completed_.load(); done < submitted;
+         done = completed_.load()) {
+      completed_.wait(done);
+    }
+
+    running_ = false;
+    submitted_.store(UINT64_MAX);
+    submitted_.notify_one();
+    thread_.join();
+  }
+
+  // beginFrame() resets the fence of the slot it reuses, so the waiter has to
+  // be done with it first. It is already signaled by then, so this is cheap.
+  void waitForSlot(uint64_t frame) {
+    const uint64_t slots = pending_.size();
+    if (frame < slots) {
+      return;
+    }
+
+    for (uint64_t done = completed_.load(); done <= frame - slots;
+         done = completed_.load()) {
+      completed_.wait(done);
+    }
+  }
+
+  void submitted(uint64_t frameNumber, VkFence fence, Clock::time_point time) {
+    uint64_t frame = submitted_.load();
+    pending_[frame % pending_.size()] = {frameNumber, fence, time};
+    submitted_.store(frame + 1);
+    submitted_.notify_one();
+  }
+
+  uint64_t submittedCount() const { return submitted_.load(); }
+  std::vector<double> &latencies() { return latencies_; }
+
+private:
+  struct Pending {
+    uint64_t frameNumber;
+    VkFence fence;
+    Clock::time_point time;
+  };
+
+  void run() {
+    VkDevice device = getVulkanDeviceStruct().logicalDevice;
+    VkSemaphore timeline = getWindowBackendStruct().frameTimeline;
+    while (true) {
+      uint64_t frame = completed_.load();
+      submitted_.wait(frame);
+      if (!running_) {
+        return;
+      }
+
+      Pending pending = pending_[frame % pending_.size()];
+      if (timeline != VK_NULL_HANDLE) {
+        const uint64_t value = pending.frameNumber + 1;
+        VkSemaphoreWaitInfo waitInfo{};
+        waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+        waitInfo.semaphoreCount = 1;
+        waitInfo.pSemaphores = &timeline;
+        waitInfo.pValues = &value;
+        vkWaitSemaphores(device, &waitInfo, UINT64_MAX);
+      }
+
+      else {
+        vkWaitForFences(device, 1, &pending.fence, VK_TRUE, UINT64_MAX);
+      }
+      std::chrono::duration<double, std::milli> latency =
+          Clock::now() - pending.time;
+      latencies_.push_back(latency.count());
+
+      completed_.store(frame + 1);
+      completed_.notify_one();
+    }
+  }
+
+  std::vector<Pending> pending_;
+  std::vector<double> latencies_;
+  std::atomic<uint64_t> submitted_{0};
+  std::atomic<uint64_t> completed_{0};
+  std::atomic<bool> running_{false};
+  std::thread thread_;
+};
+
+struct Scene {
+  const char *name;
+  void (*setup)(uint32_t count);
+  void (*update)(uint32_t frame, uint32_t count);
+};
+
+BulletPool *s_pool = nullptr;
+std::mt19937 s_rng;
+
+void spawnBullet(const VkExtent2D &extent) {
+  std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+
+  BulletDesc desc;
+  desc.x = extent.width * 0.5f;
+  desc.y = extent.height * 0.5f;
+  float angle = unit(s_rng) * 3.14159265f;
+  float speed = 80.0f + (unit(s_rng) + 1.0f) * 120.0f;
+  desc.vx = std::cos(angle) * speed;
+  desc.vy = std::sin(angle) * speed;
+  desc.angle = angle;
+  desc.angularVelocity = unit(s_rng) * 0.5f;
+  desc.acceleration = unit(s_rng) * 30.0f;
+  desc.lifetime = 2.0f + (unit(s_rng) + 1.0f) * 2.0f;
+  desc.size = 8.0f;
+  desc.color = packColor(255, 64, 128, 255);
+  s_pool->spawn(desc);
+}
+
+void setupBullets(uint32_t count) {
+  const VkExtent2D extent = getVulkanSwapchainStruct().extent;
+  s_rng.seed(1234);
+  s_pool->clear();
+  s_pool->setBounds({0.0f, 0.0f, static_cast<float>(extent.width),
+                     static_cast<float>(extent.height)});
+  for (uint32_t i = 0; i < count; i++) {
+    spawnBullet(extent);
+  }
+}
+
+// Bullets fly out of the center, whatever dies is respawned so the pool stays
+// at the requested size.
+void updateBullets(uint32_t /*frame*/, uint32_t count) {
+  const VkExtent2D extent = getVulkanSwapchainStruct().extent;
+  s_pool->update(DT);
+  while (s_pool->size() < count) {
+    spawnBullet(extent);
+  }
+  drawBullets(*s_pool, UV_FULL);
+}
+
+void setupSprites(uint32_t /*count*/) {}
+
+// A grid of spinning sprites filling the whole target.
+void updateSprites(uint32_t frame, uint32_t count) {
+  const VkExtent2D extent = getVulkanSwapchainStruct().extent;
+  const uint32_t columns =
+      std::max<uint32_t>(1, static_cast<uint32_t>(std::sqrt(count)));
+  const uint32_t rows = (count + columns - 1) / columns;
+  const float stepX = static_cast<float>(extent.width) / columns;
+  const float stepY = static_cast<float>(extent.height) / rows;
+
+  sprite_instance *sprites = reserveSprites(count);
+  if (!sprites) {
+    return;
+  }
+
+  for (uint32_t i = 0; i < count; i++) {
+    float angle = frame * DT + i * 0.01f;
+    sprites[i] = sprite_instance{{(i % columns + 0.5f) * stepX,
+                                  (i / columns + 0.5f) * stepY},
+                                 {stepX * 0.8f, stepY * 0.8f},
+                                 angle,
+                                 packColor(96, 160, 255, 255),
+                                 {0.0f, 0.0f, 1.0f, 1.0f},
+                                 WHITE_TEXTURE};
+  }
+}
+
+// The sprite scene while the target is resized every few frames, cycling
+// through a fixed set of sizes.
+constexpr VkExtent2D RESIZE_SIZES[] = {
+    {1280, 720}, {1920, 1080}, {640, 480}, {1600, 900}, {800, 800}};
+constexpr uint32_t RESIZE_INTERVAL = 10;
+
+void updateResize(uint32_t frame, uint32_t count) {
+  if (frame > 0 && frame % RESIZE_INTERVAL == 0) {
+    const VkExtent2D size =
+        RESIZE_SIZES[(frame / RESIZE_INTERVAL) % std::size(RESIZE_SIZES)];
+    resizeHeadless(size.width, size.height);
+  }
+  updateSprites(frame, count);
+}
+
+constexpr Scene SCENES[] = {
+    {"bullets", setupBullets, updateBullets},
+    {"sprites", setupSprites, updateSprites},
+    {"resize", setupSprites, updateResize},
+};
+
+SceneResult runScene(const Scene &scene, const BenchOptions &options) {
+  window_backend &vkWindow = getWindowBackendStruct();
+  vulkan_gpu_profiler &profiler = getVulkanGpuProfilerStruct();
+
+  resizeHeadless(options.width, options.height);
+  scene.setup(options.count);
+
+  std::vector<double> frameTimes;
+  std::vector<double> cpuTimes;
+  std::vector<double> gpuTimes;
+  std::vector<double> allocations;
+  frameTimes.reserve(options.frames);
+  gpuTimes.reserve(options.frames);
+  cpuTimes.reserve(options.frames);
+  allocations.reserve(options.frames);
+
+  const uint32_t totalFrames = options.warmup + options.frames;
+  const uint64_t warmupEnd = vkWindow.frameNumber + options.warmup;
+  LatencyTracker latency(vkWindow.maxFramesInFlight);
+  latency.start(totalFrames);
+
+  for (uint32_t frame = 0; frame < totalFrames; frame++) {
+    const uint64_t allocationsBefore = t_allocations;
+    const Clock::time_point start = Clock::now();
+
+    latency.waitForSlot(latency.submittedCount());
+    const uint64_t gpuFrameBefore = profiler.resultsFrame;
+    beginFrame();
+    const Clock::time_point begun = Clock::now();
+
+    // beginFrame() read back the timestamps of an older frame, warmup frames
+    // are skipped by their own number.
+    if (profiler.resultsFrame != gpuFrameBefore &&
+        profiler.resultsFrame >= warmupEnd) {
+      gpuTimes.push_back(profiler.frameMs);
+    }
+
+    scene.update(frame, options.count);
+
+    const uint32_t slot = vkWindow.currentFrame;
+    const uint64_t frameNumber = vkWindow.frameNumber;
+    drawFrame();
+    const Clock::time_point end = Clock::now();
+
+    // An out of date swapchain skips the submit, there is nothing to wait on.
+    if (vkWindow.frameNumber != frameNumber) {
+      VkFence fence = vkWindow.inFlightFences.empty()
+                          ? VK_NULL_HANDLE
+                          : vkWindow.inFlightFences[slot];
+      latency.submitted(frameNumber, fence, end);
+    }
+
+    if (frame < options.warmup) {
+      continue;
+    }
+
+    std::chrono::duration<double, std::milli> frameTime = end - start;
+    std::chrono::duration<double, std::milli> cpuTime = end - begun;
+    frameTimes.push_back(frameTime.count());
+    cpuTimes.push_back(cpuTime.count());
+    allocations.push_back(
+        static_cast<double>(t_allocations - allocationsBefore));
+  }
+
+  latency.stop();
+
+  std::vector<double> &latencies = latency.latencies();
+  const size_t skipped = std::min<size_t>(options.warmup, latencies.size());
+  latencies.erase(latencies.begin(), latencies.begin() + skipped);
+
+  SceneResult result;
+  result.name = scene.name;
+  result.count = options.count;
+  result.frames = options.frames;
+  result.frameMs = percentiles(std::move(frameTimes));
+  result.cpuMs = percentiles(std::move(cpuTimes));
+  result.gpuMs = percentiles(std::move(gpuTimes));
+  result.latencyMs = percentiles(std::move(latencies));
+  result.allocations = percentiles(std::move(allocations));
+  return result;
+}
+
+std::string jsonString(std::string_view text) {
+  std::string out = "\"";
+  for (char c : text) {
+    if (c == '"' || c == '\\') {
+      out += '\\';
+    }
+    out += c;
+  }
+  out += '"';
+  return out;
+}
+
+void writePercentiles(std::FILE *file, const char *name,
+                      const Percentiles &value, bool last = false) {
+  std::fprintf(file,
+               "      \"%s\": {\"p50\": %.4f, \"p95\": %.4f, \"p99\": %.4f, "
+               "\"max\": %.4f}%s\n",
+               name, value.p50, value.p95, value.p99, value.max,
+               last ? "" : ",");
+}
+
+void writeJson(std::FILE *file, const BenchOptions &options,
+               const std::vector<SceneResult> &results) {
+  VkPhysicalDeviceProperties properties;
+  vkGetPhysicalDeviceProperties(getVulkanDeviceStruct().vkPhysDevice,
+                                &properties);
+
+  std::fprintf(file, "{\n");
+  std::fprintf(file, "  \"device\": %s,\n",
+               jsonString(properties.deviceName).c_str());
+  std::fprintf(file, "  \"target\": \"%s\",\n",
+               getWindowBackendStruct().surface == VK_NULL_HANDLE
+                   ? "offscreen"
+                   : "headless_surface");
+  std::fprintf(file, "  \"width\": %u,\n  \"height\": %u,\n", options.width,
+               options.height);
+  std::fprintf(file, "  \"warmup\": %u,\n", options.warmup);
+  std::fprintf(file, "  \"scenes\": [\n");
+
+  for (size_t i = 0; i < results.size(); i++) {
+    const SceneResult &result = results[i];
+    std::fprintf(file, "    {\n");
+    std::fprintf(file, "      \"name\": %s,\n",
+                 jsonString(result.name).c_str());
+    std::fprintf(file, "      \"count\": %u,\n", result.count);
+    std::fprintf(file, "      \"frames\": %u,\n", result.frames);
+    writePercentiles(file, "frame_ms", result.frameMs);
+    writePercentiles(file, "cpu_ms", result.cpuMs);
+    writePercentiles(file, "gpu_ms", result.gpuMs);
+    writePercentiles(file, "latency_ms", result.latencyMs);
+    writePercentiles(file, "allocations", result.allocations, true);
+    std::fprintf(file, "    }%s\n", i + 1 < results.size() ? "," : "");
+  }
+
+  std::fprintf(file, "  ]\n}\n");
+}
+
+bool parseOptions(int argc, char **argv, BenchOptions &options) {
+  for (int i = 1; i < argc; i++) {
+    std::string_view arg = argv[i];
+    const char *value = i + 1 < argc ? argv[i + 1] : nullptr;
+
+    if (arg == "--headless-surface") {
+      options.headlessSurface = true;
+      continue;
+    }
+
+    if (!value) {
+      std::fprintf(stderr, "missing value for %s\n", argv[i]);
+      return false;
+    }
+    i++;
+
+    if (arg == "--scene") {
+      options.scene = value;
+    }
+
+    else if (arg == "--count") {
+      options.count = std::strtoul(value, nullptr, 10);
+    }
+
+    else if (arg == "--frames") {
+      options.frames = std::strtoul(value, nullptr, 10);
+    }
+
+    else if (arg == "--warmup") {
+      options.warmup = std::strtoul(value, nullptr, 10);
+    }
+
+    else if (arg == "--width") {
+      options.width = std::strtoul(value, nullptr, 10);
+    }
+
+    else if (arg == "--height") {
+      options.height = std::strtoul(value, nullptr, 10);
+    }
+
+    else if (arg == "--output") {
+      options.output = value;
+    }
+
+    else {
+      std::fprintf(stderr, "unknown option %s\n", argv[i - 1]);
+      return false;
+    }
+  }
+
+  if (options.frames == 0 || options.width == 0 || options.height == 0) {
+    std::fprintf(stderr, "frames, width and height must not be zero\n");
+    return false;
+  }
+  return true;
+}
+} // namespace
+
+int main(int argc, char **argv) {
+  BenchOptions options;
+  if (!parseOptions(argc, argv, options)) {
+    return 1;
+  }
+
+  std::vector<const Scene *> scenes;
+  for (const Scene &scene : SCENES) {
+    if (options.scene == "all" || options.scene == scene.name) {
+      scenes.push_back(&scene);
+    }
+  }
+
+  if (scenes.empty()) {
+    std::fprintf(stderr, "unknown scene %s\n", options.scene.c_str());
+    return 1;
+  }
+
+  // The numbers go to stdout, keep the console log down to real problems.
+  Logger::setConsoleLevel(LogLevel::WARN);
+
+  initializeVkStructs();
+  getWindowBackendStruct().useHeadlessSurface = options.headlessSurface;
+  getVulkanSpriteRendererStruct().maxInstancesPerFrame =
+      std::max<uint32_t>(options.count, 1);
+
+  VkApplicationInfo appInfo{};
+  appInfo.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
+  appInfo.pApplicationName = "Hakkero benchmark";
+
+  VkInstanceCreateInfo createInfo{};
+  createInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
+  createInfo.pApplicationInfo = &appInfo;
+
+  vkInitializeHeadless(createInfo, options.width, options.height);
+
+  BulletPool pool(std::max<uint32_t>(options.count, 1));
+  s_pool = &pool;
+
+  std::vector<SceneResult> results;
+  for (const Scene *scene : scenes) {
+    results.push_back(runScene(*scene, options));
+  }
+
+  std::FILE *file = stdout;
+  if (!options.output.empty()) {
+    file = std::fopen(options.output.c_str(), "w");
+    if (!file) {
+      std::fprintf(stderr, "failed to open %s\n", options.output.c_str());
+      vkShutdown();
+      return 1;
+    }
+  }
+
+  writeJson(file, options, results);
+  if (file != stdout) {
+    std::fclose(file);
+  }
+
+  s_pool = nullptr;
+  vkShutdown();
+}
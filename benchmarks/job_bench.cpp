@@ -0,0 +1,82 @@
+#include <algorithm>
+#include <bullet_pool.hpp>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <job_system.hpp>
+#include <logger.hpp>
+#include <random>
+#include <thread>
+#include <vector>
+
+// Updates a pool of N bullets on the job system with 1 to M threads and
+// reports how the median update time scales. The target is a near linear
+// speedup up to 8 cores.
+namespace {
+void fillPool(BulletPool &pool, uint32_t count) {
+  std::mt19937 rng(1234);
+  std::uniform_real_distribution<float> unit(-1.0f, 1.0f);
+
+  pool.clear();
+  pool.setBounds({-1e6f, -1e6f, 1e6f, 1e6f});
+  for (uint32_t i = 0; i < count; i++) {
+    BulletDesc desc;
+    desc.x = 400.0f + unit(rng) * 300.0f;
+    desc.y = 400.0f + unit(rng) * 300.0f;
+    desc.vx = unit(rng) * 200.0f;
+    desc.vy = unit(rng) * 200.0f;
+    desc.angularVelocity = unit(rng);
+    desc.acceleration = unit(rng) * 50.0f;
+    pool.spawn(desc);
+  }
+}
+
+double medianUpdate(BulletPool &pool, uint32_t iterations, uint32_t grain) {
+  std::vector<double> times;
+  times.reserve(iterations);
+  for (uint32_t i = 0; i < iterations; i++) {
+    auto start = std::chrono::steady_clock::now();
+    pool.updateParallel(1.0f / 60.0f, grain);
+    std::chrono::duration<double, std::milli> time =
+        std::chrono::steady_clock::now() - start;
+    times.push_back(time.count());
+  }
+
+  std::sort(times.begin(), times.end());
+  return times[times.size() / 2];
+}
+} // namespace
+
+int main(int argc, char **argv) {
+  const uint32_t bulletCount = argc > 1 ? std::atoi(argv[1]) : 1000000;
+  const uint32_t iterations = argc > 2 ? std::atoi(argv[2]) : 200;
+  const uint32_t maxThreads =
+      argc > 3 ? std::atoi(argv[3])
+               : std::max(1u, std::thread::hardware_concurrency());
+  const uint32_t grain = argc > 4 ? std::atoi(argv[4]) : 16384;
+
+  Logger::setConsoleLevel(LogLevel::WARN);
+
+  BulletPool pool(bulletCount);
+  pool.setKernel(BulletKernel::AUTO);
+  std::printf("%u bullets, %s kernel, grain %u, %u hardware threads\n",
+              bulletCount, bulletKernelName(pool.kernel()), grain,
+              std::thread::hardware_concurrency());
+
+  double baseline = 0.0;
+  for (uint32_t threads = 1; threads <= maxThreads; threads++) {
+    JobSystem::init(threads - 1);
+    fillPool(pool, bulletCount);
+    double median = medianUpdate(pool, iterations, grain);
+    JobSystem::shutdown();
+
+    if (threads == 1) {
+      baseline = median;
+    }
+
+    std::printf("%2u threads: %.3f ms median, %.2fx speedup, %.0f%% "
+                "efficiency\n",
+                threads, median, baseline / median,
+                100.0 * baseline / (median * threads));
+  }
+}
@@ -0,0 +1,74 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <format>
+#include <logger.hpp>
+#include <thread>
+#include <vector>
+
+// Log calls per second from several threads at once. The console only shows
+// warnings during the run, everything still goes to the log file. Pass
+// "binary" as the third argument to use the binary file format.
+namespace {
+void run(LogOverflowPolicy policy, bool deferred, uint32_t threadCount,
+         uint32_t messagesPerThread) {
+  Logger::setOverflowPolicy(policy);
+  uint64_t droppedBefore = Logger::droppedCount();
+
+  auto start = std::chrono::steady_clock::now();
+  std::vector<std::thread> threads;
+  for (uint32_t t = 0; t < threadCount; t++) {
+    threads.emplace_back([deferred, messagesPerThread, t] {
+      for (uint32_t i = 0; i < messagesPerThread; i++) {
+        if (deferred) {
+          LOG_INFOF("Thread {} spawned bullet wave {} at {:.2f} ms.", t, i,
+                    i * 0.25);
+        }
+
+        else {
+          LOG_INFO("Spawned a bullet wave for the current pattern step.");
+        }
+      }
+    });
+  }
+
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+  auto produced = std::chrono::steady_clock::now();
+  Logger::flush();
+  auto written = std::chrono::steady_clock::now();
+
+  double producerSeconds =
+      std::chrono::duration<double>(produced - start).count();
+  double totalSeconds = std::chrono::duration<double>(written - start).count();
+  uint64_t total = static_cast<uint64_t>(threadCount) * messagesPerThread;
+
+  std::printf("%-5s %-8s %u threads: %.2f M calls/s, %.2f M written/s, %llu "
+              "dropped\n",
+              policy == LogOverflowPolicy::DROP ? "drop" : "block",
+              deferred ? "deferred" : "text", threadCount, total / producerSeconds / 1e6,
+              total / totalSeconds / 1e6,
+              static_cast<unsigned long long>(Logger::droppedCount() -
+                                              droppedBefore));
+}
+} // namespace
+
+int main(int argc, char **argv) {
+  const uint32_t threadCount = argc > 1 ? std::atoi(argv[1]) : 8;
+  const uint32_t messagesPerThread = argc > 2 ? std::atoi(argv[2]) : 250000;
+  if (argc > 3 && std::strcmp(argv[3], "binary") == 0) {
+    Logger::setFileFormat(LogFileFormat::BINARY);
+  }
+
+  // Start the logging thread outside of the measurement
+  LOG_INFO("Logger benchmark starting.");
+  Logger::flush();
+  Logger::setConsoleLevel(LogLevel::WARN);
+
+  for (bool deferred : {false, true}) {
+    run(LogOverflowPolicy::BLOCK, deferred, threadCount, messagesPerThread);
+    run(LogOverflowPolicy::DROP, deferred, threadCount, messagesPerThread);
+  }
+}
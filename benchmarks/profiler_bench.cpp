@@ -0,0 +1,56 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <profiler.hpp>
+#include <thread>
+#include <vector>
+
+// Cost of a single zone, with no capture running and while capturing from one
+// and from several threads at once. The target is under 20 ns per zone.
+namespace {
+double run(uint32_t threadCount, uint32_t zonesPerThread) {
+  auto start = std::chrono::steady_clock::now();
+  std::vector<std::thread> threads;
+  for (uint32_t t = 0; t < threadCount; t++) {
+    threads.emplace_back([zonesPerThread] {
+      for (uint32_t i = 0; i < zonesPerThread; i++) {
+        ProfileZone zone("bench zone");
+      }
+    });
+  }
+
+  for (std::thread &thread : threads) {
+    thread.join();
+  }
+
+  std::chrono::duration<double, std::nano> time =
+      std::chrono::steady_clock::now() - start;
+  return time.count() / zonesPerThread;
+}
+} // namespace
+
+int main(int argc, char **argv) {
+  const uint32_t zonesPerThread = argc > 1 ? std::atoi(argv[1]) : 200000;
+  const uint32_t threadCount = argc > 2 ? std::atoi(argv[2]) : 4;
+  const char *tracePath = argc > 3 ? argv[3] : "/dev/null";
+
+  Profiler::setThreadCapacity(zonesPerThread);
+
+  std::printf("idle:      %.2f ns/zone\n", run(1, zonesPerThread));
+
+  Profiler::beginCapture();
+  double single = run(1, zonesPerThread);
+  double multi = run(threadCount, zonesPerThread);
+
+  auto writeStart = std::chrono::steady_clock::now();
+  Profiler::endCapture(tracePath);
+  std::chrono::duration<double, std::milli> writeTime =
+      std::chrono::steady_clock::now() - writeStart;
+
+  std::printf("capturing: %.2f ns/zone\n", single);
+  std::printf("%u threads: %.2f ns/zone per thread\n", threadCount, multi);
+  std::printf("dropped:   %llu zones\n",
+              static_cast<unsigned long long>(Profiler::droppedCount()));
+  std::printf("trace:     %s written in %.1f ms\n", tracePath,
+              writeTime.count());
+}
@@ -0,0 +1,93 @@
+#define GLFW_INCLUDE_VULKAN
+#include <GLFW/glfw3.h>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <stdexcept>
+#include <vulkan_init.hpp>
+#include <vulkan_instance.hpp>
+#include <vulkan_render.hpp>
+#include <vulkan_sprite.hpp>
+#include <vulkan_texture.hpp>
+#include <vulkan_types.hpp>
+
+// Draws N bullets every frame and reports how many bullets per millisecond
+// the instanced sprite path sustains, both for filling the instance buffer
+// alone and for the whole frame.
+int main(int argc, char **argv) {
+  const uint32_t bulletCount = argc > 1 ? std::atoi(argv[1]) : 50000;
+  const uint32_t frameCount = argc > 2 ? std::atoi(argv[2]) : 1000;
+
+  initializeVkStructs();
+  vulkan_context &context = getVulkanContextStruct();
+  vulkan_device &vkDeviceStruct = getVulkanDeviceStruct();
+  getVulkanSpriteRendererStruct().maxInstancesPerFrame = bulletCount;
+
+  if (!glfwInit()) {
+    throw std::runtime_error("Failed to initialize GLFW.");
+  }
+
+  glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
+  glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+
+  VkApplicationInfo appInfo{};
+  appInfo.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
+  appInfo.pApplicationName = "Hakkero sprite benchmark";
+
+  getInstanceExtensions();
+
+  VkInstanceCreateInfo createInfo{};
+  createInfo.sType = VK_STRUCTURE_TYPE_INSTANCE_CREATE_INFO;
+  createInfo.pApplicationInfo = &appInfo;
+  createInfo.ppEnabledExtensionNames = context.instanceExtensions.data();
+  createInfo.enabledExtensionCount = context.instanceExtensions.size();
+
+  GLFWwindow *window =
+      glfwCreateWindow(800, 800, appInfo.pApplicationName, nullptr, nullptr);
+
+  vkDeviceStruct.deviceExtensions = {VK_KHR_SWAPCHAIN_EXTENSION_NAME};
+  vkInitialize(window, createInfo);
+
+  using clock = std::chrono::steady_clock;
+  std::chrono::duration<double, std::milli> fillTime{0};
+  auto start = clock::now();
+
+  for (uint32_t frame = 0; frame < frameCount; frame++) {
+    glfwPollEvents();
+    beginFrame();
+
+    auto fillStart = clock::now();
+    sprite_instance *bullets = reserveSprites(bulletCount);
+    for (uint32_t i = 0; i < bulletCount; i++) {
+      float angle = i * 0.001f + frame * 0.01f;
+      float radius = 50.0f + (i % 350);
+      bullets[i].position[0] = 400.0f + std::cos(angle) * radius;
+      bullets[i].position[1] = 400.0f + std::sin(angle) * radius;
+      bullets[i].scale[0] = 6.0f;
+      bullets[i].scale[1] = 6.0f;
+      bullets[i].rotation = angle;
+      bullets[i].color = packColor(255, 64, 128, 255);
+      bullets[i].uvRect[0] = 0.0f;
+      bullets[i].uvRect[1] = 0.0f;
+      bullets[i].uvRect[2] = 1.0f;
+      bullets[i].uvRect[3] = 1.0f;
+      bullets[i].texture = WHITE_TEXTURE;
+    }
+    fillTime += clock::now() - fillStart;
+
+    drawFrame();
+  }
+
+  std::chrono::duration<double, std::milli> totalTime = clock::now() - start;
+  double bullets = static_cast<double>(bulletCount) * frameCount;
+
+  std::printf("bullets per frame: %u, frames: %u\n", bulletCount, frameCount);
+  std::printf("fill:  %.1f bullets/ms\n", bullets / fillTime.count());
+  std::printf("frame: %.1f bullets/ms (%.3f ms/frame)\n",
+              bullets / totalTime.count(), totalTime.count() / frameCount);
+
+  vkShutdown();
+  glfwDestroyWindow(window);
+  glfwTerminate();
+}
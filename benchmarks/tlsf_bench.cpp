@@ -0,0 +1,237 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+#include <vulkan_tlsf.hpp>
+
+// Runs random allocations and frees of mixed sizes and alignments against one
+// TLSF block. Every step checks that the live ranges are aligned, inside the
+// block and never overlap. Freeing everything at the end has to merge the
+// block back into a single free range. Blocks of exactly one allocation's
+// size, like dedicated ones, are checked as well. Exits with 1 on any
+// violation, then reports the allocate and free throughput without the
+// checks.
+namespace {
+struct Allocation {
+  uint32_t node;
+  uint64_t size;
+  uint64_t alignment;
+};
+
+struct Range {
+  uint64_t offset;
+  uint64_t size;
+};
+
+uint64_t randomSize(std::mt19937_64 &rng) {
+  // Mostly small, sometimes large, like buffers next to images.
+  std::uniform_int_distribution<int> bucket(0, 9);
+  std::uniform_int_distribution<uint64_t> small(1, 4096);
+  std::uniform_int_distribution<uint64_t> large(4096, 4u << 20);
+  return bucket(rng) < 8 ? small(rng) : large(rng);
+}
+
+uint64_t randomAlignment(std::mt19937_64 &rng) {
+  std::uniform_int_distribution<int> shift(0, 16);
+  return 1ull << shift(rng);
+}
+
+bool checkLiveRanges(const vulkan_tlsf &tlsf,
+                     const std::vector<Allocation> &live) {
+  std::vector<Range> ranges;
+  ranges.reserve(live.size());
+  for (const Allocation &allocation : live) {
+    const vulkan_tlsf_node &node = tlsf.nodes[allocation.node];
+    if (node.free || node.size < allocation.size ||
+        node.offset % allocation.alignment != 0 ||
+        node.offset + node.size > tlsf.size) {
+      std::fprintf(stderr,
+                   "Bad range %llu+%llu for %llu bytes aligned to %llu\n",
+                   static_cast<unsigned long long>(node.offset),
+                   static_cast<unsigned long long>(node.size),
+                   static_cast<unsigned long long>(allocation.size),
+                   static_cast<unsigned long long>(allocation.alignment));
+      return false;
+    }
+    ranges.push_back({node.offset, node.size});
+  }
+
+  std::sort(ranges.begin(), ranges.end(),
+            [](const Range &a, const Range &b) { return a.offset < b.offset; });
+  for (size_t i = 1; i < ranges.size(); i++) {
+    if (ranges[i - 1].offset + ranges[i - 1].size > ranges[i].offset) {
+      std::fprintf(stderr, "Ranges at %llu and %llu overlap\n",
+                   static_cast<unsigned long long>(ranges[i - 1].offset),
+                   static_cast<unsigned long long>(ranges[i].offset));
+      return false;
+    }
+  }
+  return true;
+}
+
+// The whole block is one free range again and nothing else is left.
+bool checkCoalesced(const vulkan_tlsf &tlsf) {
+  uint32_t freeRanges = 0;
+  uint32_t usedRanges = 0;
+  for (uint32_t i = 0; i < tlsf.nodes.size(); i++) {
+    const vulkan_tlsf_node &node = tlsf.nodes[i];
+    if (node.size == 0) {
+      continue;
+    }
+    freeRanges += node.free;
+    usedRanges += !node.free;
+  }
+
+  if (tlsf.allocationCount != 0 || tlsf.usedBytes != 0 || usedRanges != 0 ||
+      freeRanges != 1 || tlsfLargestFreeRange(tlsf) != tlsf.size) {
+    std::fprintf(stderr,
+                 "Not coalesced: %u allocations, %llu bytes used, %u used and "
+                 "%u free ranges, largest free range %llu of %llu\n",
+                 tlsf.allocationCount,
+                 static_cast<unsigned long long>(tlsf.usedBytes), usedRanges,
+                 freeRanges,
+                 static_cast<unsigned long long>(tlsfLargestFreeRange(tlsf)),
+                 static_cast<unsigned long long>(tlsf.size));
+    return false;
+  }
+  return true;
+}
+
+// A dedicated block is sized to the request, tlsfAllocateWhole() has to fill
+// it however awkward the size.
+bool checkWholeBlocks() {
+  const uint64_t blockSize = 64ull << 20;
+  const uint64_t sizes[] = {1,
+                            1000,
+                            4097,
+                            34603008,
+                            41947136,
+                            blockSize / 2 + 1,
+                            blockSize / 2 + 16,
+                            blockSize / 2 + 4097,
+                            blockSize - 1};
+
+  for (uint64_t size : sizes) {
+    const uint64_t aligned =
+        (size + TLSF_MIN_ALIGNMENT - 1) & ~(TLSF_MIN_ALIGNMENT - 1);
+    vulkan_tlsf tlsf;
+    tlsfInit(tlsf, aligned);
+
+    for (int round = 0; round < 2; round++) {
+      const uint32_t node = tlsfAllocateWhole(tlsf);
+      if (node == TLSF_NONE || tlsf.nodes[node].offset != 0 ||
+          tlsf.nodes[node].size < size ||
+          tlsfAllocateWhole(tlsf) != TLSF_NONE) {
+        std::fprintf(stderr, "A block of %llu bytes could not be filled\n",
+                     static_cast<unsigned long long>(size));
+        return false;
+      }
+
+      tlsfFree(tlsf, node);
+      if (!checkCoalesced(tlsf)) {
+        return false;
+      }
+    }
+
+    // Not while something else lives in the block.
+    const uint32_t small = tlsfAllocate(tlsf, 1, 1);
+    if (small != TLSF_NONE && tlsfAllocateWhole(tlsf) != TLSF_NONE) {
+      std::fprintf(stderr, "A used block of %llu bytes was handed out whole\n",
+                   static_cast<unsigned long long>(size));
+      return false;
+    }
+  }
+  return true;
+}
+
+// Allocates while below the target count, otherwise frees a random range,
+// with some noise so the count drifts up and down.
+template <typename Check>
+uint64_t churn(vulkan_tlsf &tlsf, std::vector<Allocation> &live,
+               std::mt19937_64 &rng, uint32_t steps, uint32_t target,
+               Check &&check) {
+  std::uniform_int_distribution<uint32_t> noise(0, target / 4);
+  uint64_t failed = 0;
+  for (uint32_t step = 0; step < steps; step++) {
+    if (!live.empty() && live.size() + noise(rng) >= target) {
+      std::uniform_int_distribution<size_t> pick(0, live.size() - 1);
+      const size_t index = pick(rng);
+      tlsfFree(tlsf, live[index].node);
+      live[index] = live.back();
+      live.pop_back();
+    }
+
+    else {
+      const uint64_t size = randomSize(rng);
+      const uint64_t alignment = randomAlignment(rng);
+      const uint32_t node = tlsfAllocate(tlsf, size, alignment);
+      if (node == TLSF_NONE) {
+        failed++;
+      }
+
+      else {
+        live.push_back({node, size, alignment});
+      }
+    }
+
+    if (!check()) {
+      std::fprintf(stderr, "Failed at step %u\n", step);
+      std::exit(1);
+    }
+  }
+  return failed;
+}
+} // namespace
+
+int main(int argc, char **argv) {
+  const uint32_t steps = argc > 1 ? std::atoi(argv[1]) : 200000;
+  const uint32_t target = argc > 2 ? std::atoi(argv[2]) : 512;
+  const uint64_t blockSize = 256ull << 20;
+
+  if (!checkWholeBlocks()) {
+    return 1;
+  }
+  std::printf("Exactly sized blocks were filled by one allocation\n");
+
+  std::mt19937_64 rng(1234);
+  vulkan_tlsf tlsf;
+  tlsfInit(tlsf, blockSize);
+  std::vector<Allocation> live;
+
+  // Checking every step is quadratic-ish, so the checked run is shorter.
+  const uint32_t checkedSteps = std::min(steps, 20000u);
+  const uint64_t checkedFailures =
+      churn(tlsf, live, rng, checkedSteps, target,
+            [&] { return checkLiveRanges(tlsf, live); });
+
+  for (const Allocation &allocation : live) {
+    tlsfFree(tlsf, allocation.node);
+  }
+  live.clear();
+  if (!checkCoalesced(tlsf)) {
+    return 1;
+  }
+  std::printf("%u checked steps passed (%llu allocations did not fit), the "
+              "block coalesced back into one range\n",
+              checkedSteps, static_cast<unsigned long long>(checkedFailures));
+
+  const auto start = std::chrono::steady_clock::now();
+  const uint64_t failures =
+      churn(tlsf, live, rng, steps, target, [] { return true; });
+  std::chrono::duration<double, std::nano> elapsed =
+      std::chrono::steady_clock::now() - start;
+
+  for (const Allocation &allocation : live) {
+    tlsfFree(tlsf, allocation.node);
+  }
+  if (!checkCoalesced(tlsf)) {
+    return 1;
+  }
+
+  std::printf("%u steps with about %u live ranges: %.1f ns per allocate or "
+              "free, %llu allocations did not fit\n",
+              steps, target, elapsed.count() / steps,
+              static_cast<unsigned long long>(failures));
+}
@@ -0,0 +1,209 @@
+#include "asset_archive.hpp"
+#include "logger.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <format>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <utility>
+
+#ifdef HAKKERO_ZSTD
+#include <zstd.h>
+#endif
+
+namespace {
+AssetArchive s_archive;
+
+[[noreturn]] void fail(const std::string &message) {
+  LOG_ERROR(message);
+  throw std::runtime_error(message);
+}
+} // namespace
+
+AssetArchive::AssetArchive(const std::string &path) : path_(path) {
+  int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    fail(std::format("Failed to open the asset archive: {}", path));
+  }
+
+  struct stat info{};
+  if (::fstat(fd, &info) != 0 ||
+      static_cast<size_t>(info.st_size) < sizeof(AssetArchiveHeader)) {
+    ::close(fd);
+    fail(std::format("The asset archive is truncated: {}", path));
+  }
+
+  // The mapping stays valid after closing the descriptor.
+  mappedSize_ = static_cast<size_t>(info.st_size);
+  void *mapping = ::mmap(nullptr, mappedSize_, PROT_READ, MAP_PRIVATE, fd, 0);
+  ::close(fd);
+  if (mapping == MAP_FAILED) {
+    fail(std::format("Failed to map the asset archive: {}", path));
+  }
+  data_ = static_cast<const std::byte *>(mapping);
+
+  // Every check is written so that a hostile offset can not wrap around.
+  header_ = reinterpret_cast<const AssetArchiveHeader *>(data_);
+  const bool entriesInside =
+      header_->entriesOffset <= mappedSize_ &&
+      header_->entriesOffset % alignof(AssetArchiveEntry) == 0 &&
+      header_->entryCount <= (mappedSize_ - header_->entriesOffset) /
+                                 sizeof(AssetArchiveEntry);
+  const bool namesInside = header_->namesOffset <= mappedSize_ &&
+                           header_->namesSize <=
+                               mappedSize_ - header_->namesOffset;
+  if (std::memcmp(header_->magic, ASSET_ARCHIVE_MAGIC,
+                  sizeof(ASSET_ARCHIVE_MAGIC)) != 0 ||
+      header_->version != ASSET_ARCHIVE_VERSION ||
+      header_->fileSize != mappedSize_ || !entriesInside || !namesInside) {
+    close();
+    fail(std::format("Not a valid version {} asset archive: {}",
+                     ASSET_ARCHIVE_VERSION, path));
+  }
+
+  entries_ = reinterpret_cast<const AssetArchiveEntry *>(
+      data_ + header_->entriesOffset);
+  names_ = reinterpret_cast<const char *>(data_ + header_->namesOffset);
+
+  for (uint32_t i = 0; i < header_->entryCount; i++) {
+    const AssetArchiveEntry &entry = entries_[i];
+    if (entry.offset > mappedSize_ ||
+        entry.storedSize > mappedSize_ - entry.offset ||
+        static_cast<uint64_t>(entry.nameOffset) + entry.nameLength >
+            header_->namesSize) {
+      close();
+      fail(std::format("Asset {} points outside of the archive: {}", i, path));
+    }
+
+    // view() hands out the mapping as-is, callers rely on the alignment.
+    if (entry.offset % ASSET_BLOB_ALIGNMENT != 0) {
+      close();
+      fail(std::format("Asset {} is not aligned to {} bytes: {}", i,
+                       ASSET_BLOB_ALIGNMENT, path));
+    }
+
+    if (entry.compression == AssetCompression::NONE &&
+        entry.size != entry.storedSize) {
+      close();
+      fail(std::format("Asset {} is uncompressed but its sizes differ: {}", i,
+                       path));
+    }
+
+    // find() does a binary search over the index.
+    if (i > 0 && entries_[i - 1].hash > entry.hash) {
+      close();
+      fail(std::format("The asset index is not sorted by hash: {}", path));
+    }
+  }
+
+  LOG_INFOF("Mapped the asset archive {} with {} assets.", path,
+            header_->entryCount);
+}
+
+AssetArchive::~AssetArchive() { close(); }
+
+AssetArchive::AssetArchive(AssetArchive &&other) noexcept {
+  *this = std::move(other);
+}
+
+AssetArchive &AssetArchive::operator=(AssetArchive &&other) noexcept {
+  if (this != &other) {
+    close();
+    path_ = std::move(other.path_);
+    data_ = std::exchange(other.data_, nullptr);
+    mappedSize_ = std::exchange(other.mappedSize_, 0);
+    header_ = std::exchange(other.header_, nullptr);
+    entries_ = std::exchange(other.entries_, nullptr);
+    names_ = std::exchange(other.names_, nullptr);
+  }
+  return *this;
+}
+
+void AssetArchive::close() {
+  if (data_ != nullptr) {
+    ::munmap(const_cast<std::byte *>(data_), mappedSize_);
+  }
+
+  data_ = nullptr;
+  mappedSize_ = 0;
+  header_ = nullptr;
+  entries_ = nullptr;
+  names_ = nullptr;
+}
+
+const AssetArchiveEntry *AssetArchive::find(std::string_view name) const {
+  if (header_ == nullptr) {
+    return nullptr;
+  }
+
+  const uint64_t hash = hashAssetName(name);
+  const AssetArchiveEntry *end = entries_ + header_->entryCount;
+  const AssetArchiveEntry *entry = std::lower_bound(
+      entries_, end, hash, [](const AssetArchiveEntry &entry, uint64_t hash) {
+        return entry.hash < hash;
+      });
+
+  // Names that share a hash sit next to each other.
+  for (; entry != end && entry->hash == hash; entry++) {
+    if (std::string_view(names_ + entry->nameOffset, entry->nameLength) ==
+        name) {
+      return entry;
+    }
+  }
+  return nullptr;
+}
+
+bool AssetArchive::contains(std::string_view name) const {
+  return find(name) != nullptr;
+}
+
+std::span<const std::byte> AssetArchive::view(std::string_view name) const {
+  const AssetArchiveEntry *entry = find(name);
+  if (entry == nullptr) {
+    fail(std::format("The asset {} is not in {}.", name, path_));
+  }
+
+  if (entry->compression != AssetCompression::NONE) {
+    fail(std::format("The asset {} is compressed, use read() for it.", name));
+  }
+
+  return {data_ + entry->offset, static_cast<size_t>(entry->size)};
+}
+
+std::vector<std::byte> AssetArchive::read(std::string_view name) const {
+  const AssetArchiveEntry *entry = find(name);
+  if (entry == nullptr) {
+    fail(std::format("The asset {} is not in {}.", name, path_));
+  }
+
+  const std::byte *stored = data_ + entry->offset;
+  if (entry->compression == AssetCompression::NONE) {
+    return {stored, stored + entry->size};
+  }
+
+#ifdef HAKKERO_ZSTD
+  if (entry->compression == AssetCompression::ZSTD) {
+    std::vector<std::byte> asset(entry->size);
+    const size_t written = ZSTD_decompress(asset.data(), asset.size(), stored,
+                                           entry->storedSize);
+    if (ZSTD_isError(written) || written != entry->size) {
+      fail(std::format("Failed to decompress the asset {}.", name));
+    }
+    return asset;
+  }
+#endif
+
+  fail(std::format("The asset {} uses a compression this build does not "
+                   "support.",
+                   name));
+}
+
+void mountAssetArchive(const std::string &path) {
+  s_archive = AssetArchive(path);
+}
+
+AssetArchive &getAssetArchive() { return s_archive; }
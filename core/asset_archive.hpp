@@ -0,0 +1,119 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/// On-disk layout of a .hkpak archive, written by hakkero-assetpack. All
+/// integers are little endian.
+///
+///   AssetArchiveHeader
+///   AssetArchiveEntry[entryCount], sorted by hash
+///   names, not null terminated
+///   blobs, each starting on a multiple of ASSET_BLOB_ALIGNMENT
+constexpr char ASSET_ARCHIVE_MAGIC[8] = {'H', 'K', 'A', 'S',
+                                         'S', 'E', 'T', 'S'};
+constexpr uint32_t ASSET_ARCHIVE_VERSION = 1;
+
+/// @brief Every blob starts on a cache line, so the mapping can be handed out
+/// as-is to anything with alignment requirements (SPIR-V needs 4 bytes).
+constexpr uint64_t ASSET_BLOB_ALIGNMENT = 64;
+
+enum class AssetCompression : uint32_t { NONE = 0, ZSTD = 1 };
+
+struct AssetArchiveHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t entryCount;
+  uint64_t entriesOffset;
+  uint64_t namesOffset;
+  uint64_t namesSize;
+  uint64_t fileSize;
+  uint8_t reserved[16];
+};
+static_assert(sizeof(AssetArchiveHeader) == 64);
+
+struct AssetArchiveEntry {
+  /// @brief hashAssetName() of the name, the index is sorted by it.
+  uint64_t hash;
+
+  /// @brief Offset of the blob from the start of the file.
+  uint64_t offset;
+
+  /// @brief Bytes stored in the archive, and the size once decompressed.
+  uint64_t storedSize;
+  uint64_t size;
+
+  /// @brief The name in the names block. Compared on lookup, so hash
+  /// collisions are harmless.
+  uint32_t nameOffset;
+  uint32_t nameLength;
+
+  AssetCompression compression;
+  uint32_t reserved;
+};
+static_assert(sizeof(AssetArchiveEntry) == 48);
+
+/// @brief 64-bit FNV-1a. Names use '/' as the separator, e.g.
+/// "shaders/sprite.vert.spv".
+constexpr uint64_t hashAssetName(std::string_view name) {
+  uint64_t hash = 0xcbf29ce484222325ull;
+  for (char c : name) {
+    hash ^= static_cast<uint8_t>(c);
+    hash *= 0x100000001b3ull;
+  }
+  return hash;
+}
+
+/// A read-only .hkpak archive mapped into memory. Opening it is one mmap,
+/// lookups are a binary search over the index and uncompressed assets are
+/// handed out as views into the mapping without copying.
+class AssetArchive {
+public:
+  AssetArchive() = default;
+
+  /// @brief Maps the archive, throws if it can't be opened or is malformed.
+  explicit AssetArchive(const std::string &path);
+  ~AssetArchive();
+
+  AssetArchive(const AssetArchive &) = delete;
+  AssetArchive &operator=(const AssetArchive &) = delete;
+  AssetArchive(AssetArchive &&other) noexcept;
+  AssetArchive &operator=(AssetArchive &&other) noexcept;
+
+  bool isOpen() const { return data_ != nullptr; }
+  bool contains(std::string_view name) const;
+
+  /// @brief The asset's bytes inside the mapping, valid as long as the
+  /// archive is open. Throws if the asset is missing or compressed.
+  std::span<const std::byte> view(std::string_view name) const;
+
+  /// @brief A copy of the asset, decompressed if needed. Throws if the asset
+  /// is missing.
+  std::vector<std::byte> read(std::string_view name) const;
+
+  uint32_t size() const { return header_ ? header_->entryCount : 0; }
+  const std::string &path() const { return path_; }
+
+private:
+  const AssetArchiveEntry *find(std::string_view name) const;
+  void close();
+
+  std::string path_;
+  const std::byte *data_ = nullptr;
+  size_t mappedSize_ = 0;
+  const AssetArchiveHeader *header_ = nullptr;
+  const AssetArchiveEntry *entries_ = nullptr;
+  const char *names_ = nullptr;
+};
+
+/// @brief Opens the archive the engine loads its own assets from. Call it
+/// before vkInitialize(), without one the shaders are read from the build
+/// tree.
+void mountAssetArchive(const std::string &path);
+
+/// @brief The mounted archive, not open if nothing was mounted.
+AssetArchive &getAssetArchive();
@@ -0,0 +1,241 @@
+#include "job_system.hpp"
+#include "logger.hpp"
+#include "profiler.hpp"
+
+#include <format>
+
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+std::atomic<bool> JobSystem::running_{false};
+std::vector<std::thread> JobSystem::workers_;
+std::unique_ptr<JobDeque[]> JobSystem::deques_;
+uint32_t JobSystem::dequeCount_ = 0;
+std::mutex JobSystem::injectMutex_;
+std::vector<Job *> JobSystem::injected_;
+std::atomic<uint32_t> JobSystem::injectedCount_{0};
+std::atomic<uint32_t> JobSystem::wakeEpoch_{0};
+std::atomic<uint32_t> JobSystem::sleepingWorkers_{0};
+thread_local uint32_t JobSystem::threadIndex_ = 0;
+thread_local bool JobSystem::ownsDeque_ = false;
+thread_local std::unique_ptr<Job[]> JobSystem::jobRing_;
+thread_local uint32_t JobSystem::jobRingNext_ = 0;
+thread_local uint32_t JobSystem::stealSeed_ = 0x9e3779b9u;
+
+namespace {
+// Rounds a worker looks for work before it goes to sleep
+constexpr uint32_t SPIN_ROUNDS = 64;
+} // namespace
+
+void JobSystem::init(uint32_t workerCount) {
+  if (initialized()) {
+    LOG_WARN("The job system is already running.");
+    return;
+  }
+
+  const uint32_t cores = std::max(1u, std::thread::hardware_concurrency());
+  if (workerCount == AUTO_WORKERS) {
+    workerCount = cores - 1;
+  }
+
+  dequeCount_ = workerCount + 1;
+  deques_ = std::make_unique<JobDeque[]>(dequeCount_);
+  threadIndex_ = 0;
+  ownsDeque_ = true;
+  running_.store(true, std::memory_order_release);
+
+  // The main thread usually runs on the first core, so the workers start at
+  // the second one.
+  workers_.reserve(workerCount);
+  for (uint32_t i = 1; i <= workerCount; i++) {
+    workers_.emplace_back(&JobSystem::workerLoop, i);
+    pinThread(workers_.back(), i % cores);
+  }
+
+  LOG_INFOF("Started the job system with {} workers on {} cores.", workerCount,
+            cores);
+}
+
+void JobSystem::shutdown() {
+  if (!initialized()) {
+    return;
+  }
+
+  running_.store(false, std::memory_order_release);
+  wakeEpoch_.fetch_add(1, std::memory_order_seq_cst);
+  wakeEpoch_.notify_all();
+
+  // Workers drain every deque before they exit
+  for (std::thread &worker : workers_) {
+    worker.join();
+  }
+  workers_.clear();
+
+  // Whatever was pushed while they were leaving
+  while (Job *job = findJob()) {
+    execute(job);
+  }
+
+  deques_.reset();
+  dequeCount_ = 0;
+  ownsDeque_ = false;
+}
+
+uint32_t JobSystem::threadCount() {
+  return initialized() ? dequeCount_ : 1;
+}
+
+Job *JobSystem::allocateJob() {
+  if (!jobRing_) {
+    jobRing_ = std::make_unique<Job[]>(JOB_RING_SIZE);
+  }
+
+  return &jobRing_[jobRingNext_++ & (JOB_RING_SIZE - 1)];
+}
+
+void JobSystem::submit(Job *job) {
+  if (ownsDeque_) {
+    // A full deque means the others are far behind, running the job right
+    // away is the cheapest way to catch up.
+    if (!deques_[threadIndex_].push(job)) {
+      execute(job);
+      return;
+    }
+  }
+
+  else {
+    std::lock_guard lock(injectMutex_);
+    injected_.push_back(job);
+    injectedCount_.fetch_add(1, std::memory_order_release);
+  }
+
+  // Pairs with the increment in workerLoop(): either the worker sees the new
+  // job, or we see that it is asleep and wake it up.
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (sleepingWorkers_.load(std::memory_order_relaxed) > 0) {
+    wakeEpoch_.fetch_add(1, std::memory_order_relaxed);
+    wakeEpoch_.notify_one();
+  }
+}
+
+void JobSystem::execute(Job *job) {
+  if (job->dependency && !job->dependency->done()) {
+    wait(*job->dependency);
+  }
+
+  JobCounter *counter = job->counter;
+  job->invoke(*job);
+  if (counter) {
+    counter->pending.fetch_sub(1, std::memory_order_acq_rel);
+  }
+}
+
+Job *JobSystem::findJob() {
+  if (dequeCount_ == 0) {
+    return nullptr;
+  }
+
+  if (ownsDeque_) {
+    if (Job *job = deques_[threadIndex_].pop()) {
+      return job;
+    }
+  }
+
+  // Start at a random victim so the thieves spread out
+  stealSeed_ ^= stealSeed_ << 13;
+  stealSeed_ ^= stealSeed_ >> 17;
+  stealSeed_ ^= stealSeed_ << 5;
+  const uint32_t first = stealSeed_ % dequeCount_;
+  for (uint32_t i = 0; i < dequeCount_; i++) {
+    const uint32_t victim = (first + i) % dequeCount_;
+    if (ownsDeque_ && victim == threadIndex_) {
+      continue;
+    }
+
+    if (Job *job = deques_[victim].steal()) {
+      return job;
+    }
+  }
+
+  if (injectedCount_.load(std::memory_order_acquire) > 0) {
+    std::lock_guard lock(injectMutex_);
+    if (!injected_.empty()) {
+      Job *job = injected_.back();
+      injected_.pop_back();
+      injectedCount_.fetch_sub(1, std::memory_order_relaxed);
+      return job;
+    }
+  }
+  return nullptr;
+}
+
+void JobSystem::wait(JobCounter &counter) {
+  while (!counter.done()) {
+    if (Job *job = findJob()) {
+      execute(job);
+    }
+
+    else {
+      std::this_thread::yield();
+    }
+  }
+}
+
+void JobSystem::workerLoop(uint32_t index) {
+  threadIndex_ = index;
+  ownsDeque_ = true;
+  stealSeed_ = (index + 1) * 0x9e3779b9u;
+  HK_THREAD_NAME(std::format("Worker {}", index));
+
+  uint32_t idleRounds = 0;
+  while (true) {
+    if (Job *job = findJob()) {
+      HK_ZONE("Job");
+      execute(job);
+      idleRounds = 0;
+      continue;
+    }
+
+    if (!running_.load(std::memory_order_acquire)) {
+      break;
+    }
+
+    if (++idleRounds < SPIN_ROUNDS) {
+      std::this_thread::yield();
+      continue;
+    }
+
+    sleepingWorkers_.fetch_add(1, std::memory_order_seq_cst);
+    const uint32_t epoch = wakeEpoch_.load(std::memory_order_seq_cst);
+    Job *job = findJob();
+    if (!job && running_.load(std::memory_order_acquire)) {
+      wakeEpoch_.wait(epoch, std::memory_order_seq_cst);
+    }
+    sleepingWorkers_.fetch_sub(1, std::memory_order_relaxed);
+
+    if (job) {
+      HK_ZONE("Job");
+      execute(job);
+    }
+    idleRounds = 0;
+  }
+
+  ownsDeque_ = false;
+}
+
+void JobSystem::pinThread(std::thread &thread, uint32_t core) {
+#ifdef __linux__
+  cpu_set_t cpus;
+  CPU_ZERO(&cpus);
+  CPU_SET(core, &cpus);
+  if (pthread_setaffinity_np(thread.native_handle(), sizeof(cpus), &cpus) !=
+      0) {
+    LOG_DEBUGF("Could not pin a worker to core {}.", core);
+  }
+#else
+  (void)thread;
+  (void)core;
+#endif
+}
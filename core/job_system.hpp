@@ -0,0 +1,235 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/// Counts the unfinished jobs that were started with it. Wait on it with
+/// JobSystem::wait(), which runs other jobs in the meantime.
+struct JobCounter {
+  std::atomic<uint32_t> pending{0};
+
+  bool done() const { return pending.load(std::memory_order_acquire) == 0; }
+};
+
+/// A unit of work. The callable is stored inline so starting a job never
+/// allocates.
+struct Job {
+  static constexpr size_t STORAGE_SIZE = 48;
+
+  void (*invoke)(Job &job) = nullptr;
+  JobCounter *counter = nullptr;
+  JobCounter *dependency = nullptr;
+  alignas(16) unsigned char storage[STORAGE_SIZE];
+};
+
+/// Chase-Lev work-stealing deque (Lê et al., "Correct and Efficient
+/// Work-Stealing for Weak Memory Models"). The owning thread pushes and pops
+/// at the bottom, every other thread steals from the top. Fixed capacity,
+/// push() fails instead of growing.
+class JobDeque {
+public:
+  static constexpr int64_t CAPACITY = 4096;
+
+  bool push(Job *job) {
+    const int64_t bottom = bottom_.load(std::memory_order_relaxed);
+    const int64_t top = top_.load(std::memory_order_acquire);
+    if (bottom - top >= CAPACITY) {
+      return false;
+    }
+
+    jobs_[bottom & (CAPACITY - 1)].store(job, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    bottom_.store(bottom + 1, std::memory_order_relaxed);
+    return true;
+  }
+
+  Job *pop() {
+    const int64_t bottom = bottom_.load(std::memory_order_relaxed) - 1;
+    bottom_.store(bottom, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    int64_t top = top_.load(std::memory_order_relaxed);
+
+    if (top > bottom) {
+      bottom_.store(bottom + 1, std::memory_order_relaxed);
+      return nullptr;
+    }
+
+    Job *job = jobs_[bottom & (CAPACITY - 1)].load(std::memory_order_relaxed);
+    if (top == bottom) {
+      // Last job, race the thieves for it
+      if (!top_.compare_exchange_strong(top, top + 1,
+                                        std::memory_order_seq_cst,
+                                        std::memory_order_relaxed)) {
+        job = nullptr;
+      }
+      bottom_.store(bottom + 1, std::memory_order_relaxed);
+    }
+    return job;
+  }
+
+  Job *steal() {
+    int64_t top = top_.load(std::memory_order_acquire);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    const int64_t bottom = bottom_.load(std::memory_order_acquire);
+    if (top >= bottom) {
+      return nullptr;
+    }
+
+    Job *job = jobs_[top & (CAPACITY - 1)].load(std::memory_order_relaxed);
+    if (!top_.compare_exchange_strong(top, top + 1, std::memory_order_seq_cst,
+                                      std::memory_order_relaxed)) {
+      return nullptr;
+    }
+    return job;
+  }
+
+  bool empty() const {
+    return top_.load(std::memory_order_relaxed) >=
+           bottom_.load(std::memory_order_relaxed);
+  }
+
+private:
+  alignas(64) std::atomic<int64_t> top_{0};
+  alignas(64) std::atomic<int64_t> bottom_{0};
+  alignas(64) std::atomic<Job *> jobs_[CAPACITY];
+};
+
+/// Fixed pool of worker threads with one deque each. Idle workers steal from
+/// the others. The thread that called init() gets a deque too, and helps
+/// with the work while it waits on a counter.
+///
+/// Jobs come from a ring per submitting thread, so a thread must not have
+/// more than JOB_RING_SIZE jobs alive at once.
+class JobSystem {
+public:
+  static constexpr uint32_t JOB_RING_SIZE = 4096;
+  static constexpr uint32_t AUTO_WORKERS = UINT32_MAX;
+
+  /// @brief Starts the workers. AUTO_WORKERS uses one worker per hardware
+  /// thread except the calling one, 0 runs every job on the calling thread.
+  /// Workers are pinned to cores where the platform allows.
+  static void init(uint32_t workerCount = AUTO_WORKERS);
+
+  /// @brief Finishes the queued jobs and joins the workers.
+  static void shutdown();
+
+  static bool initialized() { return running_.load(std::memory_order_relaxed); }
+
+  /// @brief Number of threads that run jobs, the main thread included. 1 if
+  /// the system is not running.
+  static uint32_t threadCount();
+
+  /// @brief 0 for the main thread and threads outside the pool, 1 and up
+  /// for the workers.
+  static uint32_t threadIndex() { return threadIndex_; }
+
+  /// @brief Queues `function()`. `counter`, if given, is incremented now and
+  /// decremented when the job finished. A job with a `dependency` waits for
+  /// it before running, helping with other jobs meanwhile. Runs inline if the
+  /// system is not initialized.
+  template <typename F>
+  static void run(F &&function, JobCounter *counter = nullptr,
+                  JobCounter *dependency = nullptr) {
+    using Function = std::decay_t<F>;
+    static_assert(sizeof(Function) <= Job::STORAGE_SIZE,
+                  "The job captures too much, capture a pointer instead");
+    static_assert(alignof(Function) <= 16);
+
+    if (!initialized()) {
+      if (dependency) {
+        wait(*dependency);
+      }
+      function();
+      return;
+    }
+
+    Job *job = allocateJob();
+    new (job->storage) Function(std::forward<F>(function));
+    job->invoke = [](Job &self) {
+      Function *stored = std::launder(reinterpret_cast<Function *>(self.storage));
+      (*stored)();
+      stored->~Function();
+    };
+    job->counter = counter;
+    job->dependency = dependency;
+
+    if (counter) {
+      counter->pending.fetch_add(1, std::memory_order_relaxed);
+    }
+    submit(job);
+  }
+
+  /// @brief Runs jobs until the counter reaches zero.
+  static void wait(JobCounter &counter);
+
+  /// @brief Calls `function(begin, end)` on chunks of [begin, end) in
+  /// parallel and returns when all of them are done. Chunks are at least
+  /// `grain` items long, and start at a multiple of `alignment`, which keeps
+  /// SIMD loops and cache lines of neighbouring chunks apart.
+  template <typename F>
+  static void parallelFor(uint32_t begin, uint32_t end, uint32_t grain,
+                          F &&function, uint32_t alignment = 16) {
+    if (begin >= end) {
+      return;
+    }
+
+    const uint32_t count = end - begin;
+    const uint32_t threads = threadCount();
+
+    // A few chunks per thread, so stealing can even out uneven chunks
+    uint32_t chunk = std::max(grain, (count + threads * 4 - 1) / (threads * 4));
+    chunk = (chunk + alignment - 1) / alignment * alignment;
+    if (threads == 1 || chunk >= count) {
+      function(begin, end);
+      return;
+    }
+
+    JobCounter counter;
+    for (uint32_t first = begin + chunk; first < end; first += chunk) {
+      const uint32_t last = end - first > chunk ? first + chunk : end;
+      run([&function, first, last] { function(first, last); }, &counter);
+    }
+
+    // The first chunk is ours
+    function(begin, begin + chunk);
+    wait(counter);
+  }
+
+private:
+  static Job *allocateJob();
+  static void submit(Job *job);
+  static void execute(Job *job);
+  static Job *findJob();
+  static void workerLoop(uint32_t index);
+  static void pinThread(std::thread &thread, uint32_t core);
+
+  static std::atomic<bool> running_;
+  static std::vector<std::thread> workers_;
+
+  // deques_[0] belongs to the thread that called init()
+  static std::unique_ptr<JobDeque[]> deques_;
+  static uint32_t dequeCount_;
+
+  // Jobs from threads outside the pool
+  static std::mutex injectMutex_;
+  static std::vector<Job *> injected_;
+  static std::atomic<uint32_t> injectedCount_;
+
+  // Sleeping workers are woken through the epoch
+  static std::atomic<uint32_t> wakeEpoch_;
+  static std::atomic<uint32_t> sleepingWorkers_;
+
+  static thread_local uint32_t threadIndex_;
+  static thread_local bool ownsDeque_;
+  static thread_local std::unique_ptr<Job[]> jobRing_;
+  static thread_local uint32_t jobRingNext_;
+  static thread_local uint32_t stealSeed_;
+};
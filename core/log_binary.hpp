@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstdint>
+
+// Layout of the binary log files (.hklog). Fields are written one after the
+// other without padding, in the byte order of the machine that wrote them.
+// tools/logdump turns them back into text.
+
+constexpr char LOG_BINARY_MAGIC[4] = {'H', 'K', 'L', 'G'};
+constexpr uint32_t LOG_BINARY_VERSION = 1;
+
+struct LogBinaryHeader {
+  char magic[4];
+  uint32_t version;
+
+  /// @brief steady_clock ticks and system_clock nanoseconds sampled together
+  /// when the log was opened, used to turn record ticks into wall time.
+  int64_t steadyAnchor;
+  int64_t systemAnchorNs;
+
+  /// @brief steady_clock::period of the writer.
+  int64_t tickNum;
+  int64_t tickDen;
+};
+
+enum class LogEntryType : uint8_t {
+  // u32 id, u32 line, u32 file length, u32 format length, file, format
+  FORMAT = 1,
+  // u8 level, i64 ticks, u32 format id, u32 argument bytes, arguments
+  MESSAGE = 2,
+  // u8 level, i64 ticks, u32 length, text
+  TEXT = 3,
+};
+
+/// Every argument of a MESSAGE starts with one of these.
+enum class LogArgTag : uint8_t {
+  INT = 'i',     // i64
+  UINT = 'u',    // u64
+  FLOAT = 'f',   // f32
+  DOUBLE = 'd',  // f64
+  BOOL = 'b',    // u8
+  CHAR = 'c',    // u8
+  STRING = 's',  // u32 length, bytes
+  POINTER = 'p', // u64
+};
@@ -1,30 +1,60 @@
 #include "logger.hpp"
+#include "profiler.hpp"
 #include "time_utils.hpp"
 
+#include <algorithm>
 #include <csignal>
 #include <filesystem>
+#include <format>
 #include <iostream>
+#include <fcntl.h>
 #include <stdexcept>
+#include <unistd.h>
 
 // Static member initialization
-std::mutex Logger::queueMutex_;
-std::condition_variable Logger::queueCV_;
-std::queue<Logger::LogMessage> Logger::messageQueue_;
+std::unique_ptr<Logger::LogRecord[]> Logger::ring_;
+alignas(64) std::atomic<uint64_t> Logger::enqueuePos_{0};
+alignas(64) std::atomic<uint64_t> Logger::dequeuePos_{0};
+std::atomic<uint64_t> Logger::droppedCount_{0};
+std::atomic<LogOverflowPolicy> Logger::overflowPolicy_{
+    LogOverflowPolicy::BLOCK};
+std::atomic<LogLevel> Logger::consoleLevel_{LogLevel::INFO};
+std::atomic<LogFileFormat> Logger::fileFormat_{LogFileFormat::TEXT};
+
+std::mutex Logger::formatMutex_;
+std::vector<Logger::FormatInfo> Logger::formats_;
+
+std::atomic<uint32_t> Logger::wakeEpoch_{0};
+std::atomic<bool> Logger::writerSleeping_{false};
 std::atomic<bool> Logger::shutdownRequested_{false};
+std::atomic<uint64_t> Logger::flushRequests_{0};
+std::atomic<uint64_t> Logger::flushesDone_{0};
 
-std::mutex Logger::fileMutex_;
 std::string Logger::fileName_;
 std::unique_ptr<std::ofstream> Logger::logFile_;
-
-std::mutex Logger::consoleMutex_;
+int Logger::binaryFile_ = -1;
+bool Logger::binaryFormat_ = false;
+uint32_t Logger::writtenFormats_ = 0;
+std::string Logger::consoleBuffer_;
+std::string Logger::fileBuffer_;
+bool Logger::unflushed_ = false;
+std::chrono::steady_clock::time_point Logger::steadyAnchor_;
+std::chrono::system_clock::time_point Logger::systemAnchor_;
+
+std::mutex Logger::initMutex_;
 std::thread Logger::loggingThread_;
 std::atomic<bool> Logger::initialized_{false};
+bool Logger::crashHandlerRegistered_ = false;
 
+constexpr size_t Logger::RING_CAPACITY;
 constexpr size_t Logger::MAX_BATCH_SIZE;
-constexpr size_t Logger::MAX_QUEUE_SIZE;
+constexpr size_t Logger::BINARY_WRITE_SIZE;
+
+static_assert(sizeof(Logger::LogRecord) == 256);
 
 void Logger::init() {
-  if (initialized_.exchange(true)) {
+  std::lock_guard<std::mutex> initLock(initMutex_);
+  if (initialized_.load(std::memory_order_relaxed)) {
     return;
   }
 
@@ -48,10 +78,36 @@ void Logger::init() {
     throw std::runtime_error("Failed to count log files");
   }
 
-  fileName_ = std::format("logs/{}/{}.log", date, count);
+  binaryFormat_ = fileFormat_.load() == LogFileFormat::BINARY;
+  writtenFormats_ = 0;
+  fileName_ = std::format("logs/{}/{}.{}", date, count,
+                          binaryFormat_ ? "hklog" : "log");
+
+  // Records carry raw steady_clock ticks, the logging thread turns them into
+  // wall clock time relative to this pair.
+  steadyAnchor_ = std::chrono::steady_clock::now();
+  systemAnchor_ = std::chrono::system_clock::now();
+
+  if (!ring_) {
+    ring_ = std::make_unique<LogRecord[]>(RING_CAPACITY);
+  }
+
+  for (size_t i = 0; i < RING_CAPACITY; i++) {
+    ring_[i].sequence.store(i, std::memory_order_relaxed);
+  }
+  enqueuePos_.store(0, std::memory_order_relaxed);
+  dequeuePos_.store(0, std::memory_order_relaxed);
+  shutdownRequested_ = false;
 
   // Start the logging thread
   loggingThread_ = std::thread(&Logger::loggingThreadWorker);
+
+  if (!crashHandlerRegistered_) {
+    registerCrashHandler();
+    crashHandlerRegistered_ = true;
+  }
+
+  initialized_.store(true, std::memory_order_release);
 }
 
 void Logger::shutdown() {
@@ -59,112 +115,466 @@ void Logger::shutdown() {
     return;
 
   shutdownRequested_ = true;
-  queueCV_.notify_all();
+  wakeEpoch_.fetch_add(1);
+  wakeEpoch_.notify_one();
 
   if (loggingThread_.joinable()) {
     loggingThread_.join();
   }
 
-  std::unique_lock<std::mutex> fileLock(fileMutex_, std::try_to_lock);
-  if (fileLock && logFile_) {
+  if (logFile_) {
     logFile_->flush();
     logFile_->close();
+    logFile_.reset();
+  }
+
+  if (binaryFile_ != -1) {
+    ::close(binaryFile_);
+    binaryFile_ = -1;
   }
 
   initialized_ = false;
 }
 
-void Logger::log(LogLevel level, const std::string &message) {
-  if (!initialized_) {
+void Logger::setOverflowPolicy(LogOverflowPolicy policy) {
+  overflowPolicy_.store(policy, std::memory_order_relaxed);
+}
+
+void Logger::setConsoleLevel(LogLevel level) {
+  consoleLevel_.store(level, std::memory_order_relaxed);
+}
+
+void Logger::setFileFormat(LogFileFormat format) {
+  fileFormat_.store(format);
+}
+
+uint32_t Logger::registerFormat(std::string_view fmt, const char *file,
+                                uint32_t line) {
+  std::lock_guard<std::mutex> formatLock(formatMutex_);
+  formats_.push_back({fmt, file, line});
+  return static_cast<uint32_t>(formats_.size() - 1);
+}
+
+uint64_t Logger::droppedCount() {
+  return droppedCount_.load(std::memory_order_relaxed);
+}
+
+Logger::LogRecord *Logger::acquireRecord(LogLevel level) {
+  bool mayDrop = level < LogLevel::ERROR &&
+                 overflowPolicy_.load(std::memory_order_relaxed) ==
+                     LogOverflowPolicy::DROP;
+
+  uint64_t pos = enqueuePos_.load(std::memory_order_relaxed);
+  while (true) {
+    LogRecord &record = ring_[pos & (RING_CAPACITY - 1)];
+    uint64_t sequence = record.sequence.load(std::memory_order_acquire);
+    int64_t diff = static_cast<int64_t>(sequence) - static_cast<int64_t>(pos);
+
+    if (diff == 0) {
+      if (enqueuePos_.compare_exchange_weak(pos, pos + 1,
+                                            std::memory_order_relaxed)) {
+        return &record;
+      }
+    }
+
+    else if (diff < 0) {
+      // The slot from the previous lap hasn't been consumed yet, the ring is
+      // full.
+      if (mayDrop) {
+        droppedCount_.fetch_add(1, std::memory_order_relaxed);
+        return nullptr;
+      }
+
+      std::this_thread::yield();
+      pos = enqueuePos_.load(std::memory_order_relaxed);
+    }
+
+    else {
+      pos = enqueuePos_.load(std::memory_order_relaxed);
+    }
+  }
+}
+
+void Logger::publishRecord(LogRecord *record) {
+  uint64_t pos = record->sequence.load(std::memory_order_relaxed);
+  record->sequence.store(pos + 1, std::memory_order_release);
+
+  // Pairs with the fence in loggingThreadWorker, either the writer sees the
+  // record or we see that it went to sleep.
+  std::atomic_thread_fence(std::memory_order_seq_cst);
+  if (writerSleeping_.load(std::memory_order_relaxed)) {
+    wakeEpoch_.fetch_add(1, std::memory_order_relaxed);
+    wakeEpoch_.notify_one();
+  }
+}
+
+Logger::LogRecord *Logger::beginRecord(LogLevel level) {
+  if (!initialized_.load(std::memory_order_acquire)) {
     init();
-    registerCrashHandler();
   }
 
-  // Console output
-  {
-    std::lock_guard<std::mutex> consoleLock(consoleMutex_);
-    if (level <= LogLevel::FATAL) {
-      std::cerr << logLevelToColor(level) << "[" << logLevelToString(level)
-                << "]"
-                << "\033[0m: " << message << '\n';
-    }
+  LogRecord *record = acquireRecord(level);
+  if (!record) {
+    return nullptr;
   }
 
-  // Queue the message for file writing
-  LogMessage logMsg{
-      level, message,
-      TimeUtils::formatAsHourMinSec(TimeUtils::captureCurrentTime())};
+  record->ticks = std::chrono::steady_clock::now().time_since_epoch().count();
+  record->level = level;
+  record->length = 0;
+  record->longText = nullptr;
+  record->format = nullptr;
+  record->encode = nullptr;
+  record->destroy = nullptr;
+  return record;
+}
 
-  {
-    std::unique_lock<std::mutex> queueLock(queueMutex_);
+void Logger::log(LogLevel level, std::string_view message) {
+  LogRecord *record = beginRecord(level);
+  if (!record) {
+    return;
+  }
 
-    // Prevent queue from growing indefinitely
-    if (messageQueue_.size() >= MAX_QUEUE_SIZE)
-      queueCV_.wait(queueLock,
-                    [] { return messageQueue_.size() < MAX_QUEUE_SIZE; });
+  record->length = static_cast<uint32_t>(message.size());
+  if (message.size() <= sizeof(record->payload)) {
+    std::memcpy(record->payload, message.data(), message.size());
+  }
 
-    messageQueue_.push(std::move(logMsg));
+  else {
+    // Rare, mostly validation layer output
+    record->longText = new char[message.size()];
+    std::memcpy(record->longText, message.data(), message.size());
   }
 
-  queueCV_.notify_one();
+  publishRecord(record);
 }
 
-void Logger::loggingThreadWorker() {
-  std::vector<LogMessage> batch;
-  batch.reserve(MAX_BATCH_SIZE);
-
-  while (!shutdownRequested_ || !messageQueue_.empty()) {
-    // Wait for messages or shutdown
-    {
-      std::unique_lock<std::mutex> lock(queueMutex_);
-      queueCV_.wait(
-          lock, [] { return !messageQueue_.empty() || shutdownRequested_; });
-    }
-
-    // Process messages in batches
-    while (true) {
-      // Grab a batch of messages
-      {
-        std::lock_guard<std::mutex> lock(queueMutex_);
-        while (!messageQueue_.empty() && batch.size() < MAX_BATCH_SIZE) {
-          batch.push_back(std::move(messageQueue_.front()));
-          messageQueue_.pop();
-        }
-      }
+void Logger::flush() {
+  if (!initialized_.load(std::memory_order_acquire)) {
+    return;
+  }
 
-      if (batch.empty())
-        break;
+  uint64_t target = enqueuePos_.load(std::memory_order_acquire);
+  while (dequeuePos_.load(std::memory_order_acquire) < target) {
+    wakeEpoch_.fetch_add(1, std::memory_order_relaxed);
+    wakeEpoch_.notify_one();
+    std::this_thread::yield();
+  }
+
+  // Dequeued isn't written yet, partial batches wait for the flush interval
+  const uint64_t ticket =
+      flushRequests_.fetch_add(1, std::memory_order_acq_rel) + 1;
+  while (flushesDone_.load(std::memory_order_acquire) < ticket &&
+         initialized_.load(std::memory_order_acquire)) {
+    wakeEpoch_.fetch_add(1, std::memory_order_relaxed);
+    wakeEpoch_.notify_one();
+    std::this_thread::yield();
+  }
+}
+
+void Logger::writeFileText(LogLevel level, std::chrono::steady_clock::rep ticks,
+                           std::string_view message) {
+  static std::chrono::system_clock::rep lastSecond = -1;
+  static std::string timestamp;
+
+  if (binaryFormat_) {
+    fileBuffer_ += static_cast<char>(LogEntryType::TEXT);
+    LogDetail::appendRaw(fileBuffer_, static_cast<uint8_t>(level));
+    LogDetail::appendRaw(fileBuffer_, static_cast<int64_t>(ticks));
+    LogDetail::appendString(fileBuffer_, message);
+    return;
+  }
 
-      // Process the batch
-      processBatch(batch);
-      batch.clear();
+  auto elapsed = std::chrono::steady_clock::duration(ticks) -
+                 steadyAnchor_.time_since_epoch();
+  auto wallTime =
+      systemAnchor_ +
+      std::chrono::duration_cast<std::chrono::system_clock::duration>(elapsed);
+
+  // Formatting the wall clock time is by far the most expensive part, so it
+  // is done once per second.
+  auto second =
+      std::chrono::floor<std::chrono::seconds>(wallTime).time_since_epoch();
+  if (second.count() != lastSecond) {
+    lastSecond = second.count();
+    timestamp = TimeUtils::formatAsHourMinSec(TimeUtils::fromTimePoint(
+        std::chrono::system_clock::time_point(second)));
+  }
+
+  fileBuffer_ += '[';
+  fileBuffer_ += timestamp;
+  fileBuffer_ += "] [";
+  fileBuffer_ += logLevelToString(level);
+  fileBuffer_ += "]: ";
+  fileBuffer_ += message;
+  fileBuffer_ += '\n';
+}
+
+void Logger::writeBinaryMessage(LogRecord &record) {
+  // Format strings are written once per file, right before their first use
+  if (record.formatId >= writtenFormats_) {
+    std::lock_guard<std::mutex> formatLock(formatMutex_);
+    for (; writtenFormats_ < formats_.size(); writtenFormats_++) {
+      const FormatInfo &info = formats_[writtenFormats_];
+      std::string_view file = info.file;
+      fileBuffer_ += static_cast<char>(LogEntryType::FORMAT);
+      LogDetail::appendRaw(fileBuffer_, writtenFormats_);
+      LogDetail::appendRaw(fileBuffer_, info.line);
+      LogDetail::appendRaw(fileBuffer_, static_cast<uint32_t>(file.size()));
+      LogDetail::appendRaw(fileBuffer_,
+                           static_cast<uint32_t>(info.format.size()));
+      fileBuffer_ += file;
+      fileBuffer_ += info.format;
     }
   }
+
+  size_t start = fileBuffer_.size();
+  fileBuffer_ += static_cast<char>(LogEntryType::MESSAGE);
+  LogDetail::appendRaw(fileBuffer_, static_cast<uint8_t>(record.level));
+  LogDetail::appendRaw(fileBuffer_, static_cast<int64_t>(record.ticks));
+  LogDetail::appendRaw(fileBuffer_, record.formatId);
+  size_t sizeOffset = fileBuffer_.size();
+  LogDetail::appendRaw(fileBuffer_, uint32_t{0});
+
+  try {
+    record.encode(fileBuffer_, record.payload);
+  } catch (const std::exception &error) {
+    fileBuffer_.resize(start);
+    writeFileText(record.level, record.ticks,
+                  std::format("<format error: {}>", error.what()));
+    return;
+  }
+
+  uint32_t argBytes =
+      static_cast<uint32_t>(fileBuffer_.size() - sizeOffset - sizeof(argBytes));
+  std::memcpy(fileBuffer_.data() + sizeOffset, &argBytes, sizeof(argBytes));
 }
 
-void Logger::processBatch(const std::vector<LogMessage> &batch) {
-  std::lock_guard<std::mutex> fileLock(fileMutex_);
+void Logger::writeRecord(LogRecord &record) {
+  static std::string formatted;
+
+  bool toConsole =
+      record.level >= consoleLevel_.load(std::memory_order_relaxed);
+  std::string_view message;
+
+  if (record.format) {
+    // The binary file only needs the arguments, text is only built when
+    // something is going to read it.
+    if (toConsole || !binaryFormat_) {
+      formatted.clear();
+      try {
+        record.format(formatted, record.payload);
+      } catch (const std::exception &error) {
+        formatted = std::format("<format error: {}>", error.what());
+      }
+      message = formatted;
+    }
 
-  // Lazy file opening
-  if (!logFile_) {
+    if (binaryFormat_) {
+      writeBinaryMessage(record);
+    }
+
+    else {
+      writeFileText(record.level, record.ticks, message);
+    }
+
+    record.destroy(record.payload);
+  }
+
+  else {
+    message = {record.longText ? record.longText
+                               : reinterpret_cast<char *>(record.payload),
+               record.length};
+    writeFileText(record.level, record.ticks, message);
+  }
+
+  if (toConsole) {
+    consoleBuffer_ += logLevelToColor(record.level);
+    consoleBuffer_ += '[';
+    consoleBuffer_ += logLevelToString(record.level);
+    consoleBuffer_ += "]\033[0m: ";
+    consoleBuffer_ += message;
+    consoleBuffer_ += '\n';
+  }
+}
+
+void Logger::openLogFile() {
+  if (!binaryFormat_) {
     logFile_ = std::make_unique<std::ofstream>(fileName_, std::ios::app);
     if (!logFile_->is_open()) {
       throw std::runtime_error("Failed to open log file: " + fileName_);
     }
+    return;
+  }
+
+  binaryFile_ = ::open(fileName_.c_str(), O_WRONLY | O_CREAT | O_APPEND, 0644);
+  if (binaryFile_ == -1) {
+    throw std::runtime_error("Failed to open log file: " + fileName_);
+  }
+
+  LogBinaryHeader header{};
+  std::memcpy(header.magic, LOG_BINARY_MAGIC, sizeof(header.magic));
+  header.version = LOG_BINARY_VERSION;
+  header.steadyAnchor = steadyAnchor_.time_since_epoch().count();
+  header.systemAnchorNs = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                              systemAnchor_.time_since_epoch())
+                              .count();
+  header.tickNum = std::chrono::steady_clock::period::num;
+  header.tickDen = std::chrono::steady_clock::period::den;
+  fileBuffer_.insert(0, reinterpret_cast<const char *>(&header),
+                     sizeof(header));
+}
+
+namespace {
+void writeAll(int fd, const char *data, size_t size) {
+  while (size > 0) {
+    ssize_t written = ::write(fd, data, size);
+    if (written == -1) {
+      if (errno == EINTR)
+        continue;
+      throw std::runtime_error("Failed to write the log file");
+    }
+    data += written;
+    size -= static_cast<size_t>(written);
+  }
+}
+} // namespace
+
+void Logger::writeBatch(bool force) {
+  HK_ZONE("Logger::writeBatch");
+  if (!consoleBuffer_.empty()) {
+    std::cerr.write(consoleBuffer_.data(), consoleBuffer_.size());
+    consoleBuffer_.clear();
+  }
+
+  if (!fileBuffer_.empty()) {
+    // Lazy file opening
+    if (!logFile_ && binaryFile_ == -1) {
+      openLogFile();
+    }
+    unflushed_ = true;
+  }
+
+  if (!unflushed_) {
+    return;
   }
 
-  // Write the batch
-  for (const auto &msg : batch) {
-    *logFile_ << "[" << msg.timestamp << "] [" << logLevelToString(msg.level)
-              << "]: " << msg.message << "\n";
+  if (binaryFormat_) {
+    // A few large writes instead of one per batch, unless something needs to
+    // hit the disk now.
+    if (force || fileBuffer_.size() >= BINARY_WRITE_SIZE) {
+      writeAll(binaryFile_, fileBuffer_.data(), fileBuffer_.size());
+      fileBuffer_.clear();
+    }
+    unflushed_ = !fileBuffer_.empty();
+    return;
   }
 
-  // Flush if there are any messages equal to and above ERROR log level
-  if (std::any_of(batch.begin(), batch.end(), [](const LogMessage &msg) {
-        return msg.level >= LogLevel::ERROR;
-      })) {
+  logFile_->write(fileBuffer_.data(), fileBuffer_.size());
+  fileBuffer_.clear();
+
+  // Partial batches stay in the stream's buffer until something forces them
+  // out, errors, the flush interval, flush() or shutdown.
+  if (force) {
     logFile_->flush();
   }
+  unflushed_ = !force;
+}
+
+size_t Logger::drainRing() {
+  uint64_t pos = dequeuePos_.load(std::memory_order_relaxed);
+  size_t count = 0;
+  bool flushFile = false;
+
+  while (count < MAX_BATCH_SIZE) {
+    LogRecord &record = ring_[pos & (RING_CAPACITY - 1)];
+    if (record.sequence.load(std::memory_order_acquire) != pos + 1) {
+      break;
+    }
+
+    writeRecord(record);
+    flushFile |= record.level >= LogLevel::ERROR;
+    delete[] record.longText;
+
+    record.sequence.store(pos + RING_CAPACITY, std::memory_order_release);
+    pos++;
+    count++;
+    dequeuePos_.store(pos, std::memory_order_release);
+  }
+
+  if (count > 0) {
+    writeBatch(flushFile);
+  }
+
+  return count;
+}
+
+void Logger::loggingThreadWorker() {
+  HK_THREAD_NAME("Logger");
+  uint64_t reportedDrops = 0;
+  auto lastFlush = std::chrono::steady_clock::now();
+
+  while (true) {
+    // Read before draining, the records a flush() waits for were published
+    // before its request.
+    const uint64_t requests = flushRequests_.load(std::memory_order_acquire);
+    if (drainRing() > 0) {
+      continue;
+    }
+
+    uint64_t drops = droppedCount_.load(std::memory_order_relaxed);
+    if (drops != reportedDrops) {
+      writeFileText(
+          LogLevel::WARN,
+          std::chrono::steady_clock::now().time_since_epoch().count(),
+          std::format("{} messages dropped, the log ring was full.",
+                      drops - reportedDrops));
+      writeBatch(false);
+      reportedDrops = drops;
+    }
+
+    if (shutdownRequested_) {
+      // Producers may still have been mid-publish on the previous pass
+      while (drainRing() > 0) {
+      }
+      writeBatch(true);
+      flushesDone_.store(flushRequests_.load(std::memory_order_acquire),
+                         std::memory_order_release);
+      break;
+    }
+
+    // Idle alone doesn't force a write, under steady logging that would be
+    // one flush per batch. Partial batches accumulate until the interval is
+    // up or someone calls flush().
+    const auto now = std::chrono::steady_clock::now();
+    if (requests != flushesDone_.load(std::memory_order_relaxed) ||
+        (unflushed_ && now - lastFlush >= FLUSH_INTERVAL)) {
+      writeBatch(true);
+      lastFlush = now;
+      flushesDone_.store(requests, std::memory_order_release);
+    }
+
+    // Buffered output has to make the interval, so no deep sleep until it
+    // is out.
+    if (unflushed_) {
+      std::this_thread::sleep_for(IDLE_POLL);
+      continue;
+    }
+
+    // Wait for messages, a flush or shutdown
+    uint32_t epoch = wakeEpoch_.load(std::memory_order_relaxed);
+    writerSleeping_.store(true, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    uint64_t pos = dequeuePos_.load(std::memory_order_relaxed);
+    bool pending = ring_[pos & (RING_CAPACITY - 1)].sequence.load(
+                       std::memory_order_acquire) == pos + 1;
+    pending |= flushRequests_.load(std::memory_order_relaxed) != requests;
+    if (!pending && !shutdownRequested_) {
+      wakeEpoch_.wait(epoch);
+    }
+
+    writerSleeping_.store(false, std::memory_order_relaxed);
+  }
 }
 
 void Logger::registerCrashHandler() {
@@ -1,20 +1,51 @@
 #pragma once
 
+#include "log_binary.hpp"
+
 #include <atomic>
-#include <condition_variable>
+#include <chrono>
+#include <cstdint>
 #include <cstring>
+#include <format>
 #include <fstream>
+#include <iterator>
 #include <memory>
 #include <mutex>
-#include <queue>
+#include <new>
 #include <string>
+#include <string_view>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <utility>
 #include <vector>
 
 namespace StderrWrite {
 void writeStderr(const char *msg) noexcept;
 } // namespace StderrWrite
 
-enum class LogLevel { INFO, WARN, ERROR, FATAL, DEBUG };
+enum class LogLevel { DEBUG, INFO, WARN, ERROR, FATAL };
+
+// Messages below this level are compiled out, arguments included. Set it with
+// -DHAKKERO_LOG_MIN_LEVEL=<0-4>, 0 being DEBUG.
+#ifndef HAKKERO_LOG_MIN_LEVEL
+#ifdef NDEBUG
+#define HAKKERO_LOG_MIN_LEVEL 1
+#else
+#define HAKKERO_LOG_MIN_LEVEL 0
+#endif
+#endif
+
+constexpr LogLevel LOG_MIN_LEVEL =
+    static_cast<LogLevel>(HAKKERO_LOG_MIN_LEVEL);
+
+/// What a producer does when the ring is full. ERROR and FATAL messages
+/// always block, so they can never be lost.
+enum class LogOverflowPolicy { DROP, BLOCK };
+
+/// BINARY writes format ids and raw arguments instead of text, which keeps
+/// the cost flat under heavy logging. Decode it with hakkero-logdump.
+enum class LogFileFormat { TEXT, BINARY };
 
 constexpr std::string_view logLevelToString(LogLevel level) noexcept {
   switch (level) {
@@ -50,49 +81,308 @@ constexpr std::string_view logLevelToColor(LogLevel level) noexcept {
   }
 }
 
-#define LOG_INFO(msg) Logger::log(LogLevel::INFO, msg)
-#define LOG_WARN(msg) Logger::log(LogLevel::WARN, msg)
-#define LOG_ERROR(msg) Logger::log(LogLevel::ERROR, msg)
-#define LOG_FATAL(msg) Logger::log(LogLevel::FATAL, msg)
-#define LOG_DEBUG(msg) Logger::log(LogLevel::DEBUG, msg)
+// `if constexpr` drops the whole call, so a disabled LOG_DEBUG(std::format())
+// costs nothing.
+#define HAKKERO_LOG(level, ...)                                                \
+  do {                                                                         \
+    if constexpr (level >= LOG_MIN_LEVEL) {                                    \
+      Logger::log(level, __VA_ARGS__);                                         \
+    }                                                                          \
+  } while (0)
+
+#define LOG_INFO(msg) HAKKERO_LOG(LogLevel::INFO, msg)
+#define LOG_WARN(msg) HAKKERO_LOG(LogLevel::WARN, msg)
+#define LOG_ERROR(msg) HAKKERO_LOG(LogLevel::ERROR, msg)
+#define LOG_FATAL(msg) HAKKERO_LOG(LogLevel::FATAL, msg)
+#define LOG_DEBUG(msg) HAKKERO_LOG(LogLevel::DEBUG, msg)
+
+// Deferred formatting, the arguments are copied into the ring and std::format
+// runs on the logging thread. Pointers are copied as pointers, C strings and
+// string views are the exception and are copied as std::string.
+//
+// Every call site registers its format string once, the binary log refers to
+// it by that id.
+#define HAKKERO_LOGF(level, fmt, ...)                                          \
+  do {                                                                         \
+    if constexpr (level >= LOG_MIN_LEVEL) {                                    \
+      static const uint32_t hkFormatId =                                       \
+          Logger::registerFormat(fmt, __FILE__, __LINE__);                     \
+      Logger::log(level, hkFormatId, fmt __VA_OPT__(, ) __VA_ARGS__);          \
+    }                                                                          \
+  } while (0)
+
+#define LOG_INFOF(...) HAKKERO_LOGF(LogLevel::INFO, __VA_ARGS__)
+#define LOG_WARNF(...) HAKKERO_LOGF(LogLevel::WARN, __VA_ARGS__)
+#define LOG_ERRORF(...) HAKKERO_LOGF(LogLevel::ERROR, __VA_ARGS__)
+#define LOG_FATALF(...) HAKKERO_LOGF(LogLevel::FATAL, __VA_ARGS__)
+#define LOG_DEBUGF(...) HAKKERO_LOGF(LogLevel::DEBUG, __VA_ARGS__)
+
+namespace LogDetail {
+// What a deferred argument is stored as
+template <typename T> struct Stored {
+  using type = std::decay_t<T>;
+};
+template <> struct Stored<const char *> {
+  using type = std::string;
+};
+template <> struct Stored<char *> {
+  using type = std::string;
+};
+template <> struct Stored<std::string_view> {
+  using type = std::string;
+};
+
+template <typename T>
+using StoredT = typename Stored<std::decay_t<T>>::type;
+
+template <typename T> void appendRaw(std::string &out, const T &value) {
+  out.append(reinterpret_cast<const char *>(&value), sizeof(value));
+}
+
+inline void appendString(std::string &out, std::string_view value) {
+  appendRaw(out, static_cast<uint32_t>(value.size()));
+  out.append(value);
+}
+
+// Tagged encoding of one argument for the binary log, anything that isn't a
+// plain number, string or pointer is formatted and stored as a string.
+template <typename T> void encodeArg(std::string &out, const T &value) {
+  if constexpr (std::is_same_v<T, bool>) {
+    out += static_cast<char>(LogArgTag::BOOL);
+    appendRaw(out, static_cast<uint8_t>(value));
+  }
+
+  else if constexpr (std::is_same_v<T, char>) {
+    out += static_cast<char>(LogArgTag::CHAR);
+    out += value;
+  }
+
+  else if constexpr (std::is_integral_v<T> && std::is_signed_v<T>) {
+    out += static_cast<char>(LogArgTag::INT);
+    appendRaw(out, static_cast<int64_t>(value));
+  }
+
+  else if constexpr (std::is_integral_v<T>) {
+    out += static_cast<char>(LogArgTag::UINT);
+    appendRaw(out, static_cast<uint64_t>(value));
+  }
+
+  else if constexpr (std::is_same_v<T, float>) {
+    out += static_cast<char>(LogArgTag::FLOAT);
+    appendRaw(out, value);
+  }
+
+  else if constexpr (std::is_floating_point_v<T>) {
+    out += static_cast<char>(LogArgTag::DOUBLE);
+    appendRaw(out, static_cast<double>(value));
+  }
+
+  else if constexpr (std::is_same_v<T, std::string>) {
+    out += static_cast<char>(LogArgTag::STRING);
+    appendString(out, value);
+  }
+
+  else if constexpr (std::is_pointer_v<T> ||
+                    std::is_same_v<T, std::nullptr_t>) {
+    out += static_cast<char>(LogArgTag::POINTER);
+    const void *address = value;
+    appendRaw(out, static_cast<uint64_t>(reinterpret_cast<uintptr_t>(address)));
+  }
+
+  else {
+    out += static_cast<char>(LogArgTag::STRING);
+    appendString(out, std::format("{}", value));
+  }
+}
+
+template <typename... Args> struct DeferredFormat {
+  std::string_view format;
+  std::tuple<Args...> args;
+
+  static void write(std::string &out, void *self) {
+    auto *deferred = static_cast<DeferredFormat *>(self);
+    std::apply(
+        [&](const Args &...values) {
+          std::vformat_to(std::back_inserter(out), deferred->format,
+                          std::make_format_args(values...));
+        },
+        deferred->args);
+  }
+
+  static void encode(std::string &out, void *self) {
+    auto *deferred = static_cast<DeferredFormat *>(self);
+    std::apply([&](const Args &...values) { (encodeArg(out, values), ...); },
+               deferred->args);
+  }
+
+  static void destroy(void *self) {
+    static_cast<DeferredFormat *>(self)->~DeferredFormat();
+  }
+};
+} // namespace LogDetail
 
 class Logger {
 public:
-  struct LogMessage {
+  /// One slot of the ring. Messages that don't fit into `text` are copied to
+  /// the heap and freed by the logging thread.
+  ///
+  /// A record holds either text, or deferred format arguments when `format`
+  /// is set. Either of them goes to the heap when it doesn't fit into
+  /// `payload`.
+  struct alignas(64) LogRecord {
+    std::atomic<uint64_t> sequence;
+    std::chrono::steady_clock::rep ticks;
     LogLevel level;
-    std::string message;
-    std::string timestamp;
+    uint32_t length;
+    char *longText;
+    void (*format)(std::string &out, void *args);
+    void (*encode)(std::string &out, void *args);
+    void (*destroy)(void *args);
+    uint32_t formatId;
+    alignas(16) unsigned char payload[256 - 64];
   };
 
-  static void log(LogLevel level, const std::string &message);
+  /// @brief Copies the message into the ring. Never takes a lock, never
+  /// formats and never touches the console or the file.
+  static void log(LogLevel level, std::string_view message);
+
+  /// @brief Same as above, but only the arguments are copied and the
+  /// formatting happens on the logging thread. `formatId` comes from
+  /// registerFormat(), use the LOG_*F macros.
+  template <typename... Args>
+  static void log(LogLevel level, uint32_t formatId,
+                  std::format_string<std::type_identity_t<Args>...> fmt,
+                  Args &&...args) {
+    logDeferred<LogDetail::StoredT<Args>...>(level, formatId, fmt.get(),
+                                            std::forward<Args>(args)...);
+  }
+
+  /// @brief Assigns an id to a call site's format string. The string must
+  /// outlive the logger, which is the case for literals.
+  static uint32_t registerFormat(std::string_view fmt, const char *file,
+                                 uint32_t line);
+
+  static void setOverflowPolicy(LogOverflowPolicy policy);
+
+  /// @brief Takes effect when the log file is created, so call it before the
+  /// first message.
+  static void setFileFormat(LogFileFormat format);
+
+  /// @brief Lowest level that is also printed to the console, everything is
+  /// written to the file.
+  static void setConsoleLevel(LogLevel level);
+
+  /// @brief Messages dropped because the ring was full, since startup.
+  static uint64_t droppedCount();
+
+  /// @brief Blocks until everything logged before the call has been written.
+  static void flush();
 
 private:
+  struct FormatInfo {
+    std::string_view format;
+    const char *file;
+    uint32_t line;
+  };
+
+  template <typename... Stored, typename... Args>
+  static void logDeferred(LogLevel level, uint32_t formatId,
+                          std::string_view fmt, Args &&...args) {
+    using Deferred = LogDetail::DeferredFormat<Stored...>;
+
+    LogRecord *record = beginRecord(level);
+    if (!record) {
+      return;
+    }
+
+    record->formatId = formatId;
+
+    if constexpr (sizeof(Deferred) <= sizeof(record->payload) &&
+                  alignof(Deferred) <= 16) {
+      new (record->payload) Deferred{fmt, {std::forward<Args>(args)...}};
+      record->format = &Deferred::write;
+      record->encode = &Deferred::encode;
+      record->destroy = &Deferred::destroy;
+    }
+
+    else {
+      // Too big for the record, keep a pointer to a heap copy instead
+      Deferred *deferred = new Deferred{fmt, {std::forward<Args>(args)...}};
+      std::memcpy(record->payload, &deferred, sizeof(deferred));
+      record->format = [](std::string &out, void *self) {
+        Deferred::write(out, *static_cast<Deferred **>(self));
+      };
+      record->encode = [](std::string &out, void *self) {
+        Deferred::encode(out, *static_cast<Deferred **>(self));
+      };
+      record->destroy = [](void *self) {
+        delete *static_cast<Deferred **>(self);
+      };
+    }
+
+    publishRecord(record);
+  }
+
+  static LogRecord *beginRecord(LogLevel level);
+  static LogRecord *acquireRecord(LogLevel level);
+  static void publishRecord(LogRecord *record);
+  static size_t drainRing();
+  static void writeRecord(LogRecord &record);
+  static void writeBinaryMessage(LogRecord &record);
+  static void writeFileText(LogLevel level,
+                            std::chrono::steady_clock::rep ticks,
+                            std::string_view message);
+  static void writeBatch(bool force);
+  static void openLogFile();
   static void loggingThreadWorker();
-  static void processBatch(const std::vector<LogMessage> &batch);
   static void crashHandler(int signal);
   static void registerCrashHandler();
   static void init();
   static void shutdown();
 
-  // Queue management
-  static std::mutex queueMutex_;
-  static std::condition_variable queueCV_;
-  static std::queue<LogMessage> messageQueue_;
+  // Ring buffer, Vyukov style bounded queue with one consumer
+  static std::unique_ptr<LogRecord[]> ring_;
+  alignas(64) static std::atomic<uint64_t> enqueuePos_;
+  alignas(64) static std::atomic<uint64_t> dequeuePos_;
+  static std::atomic<uint64_t> droppedCount_;
+  static std::atomic<LogOverflowPolicy> overflowPolicy_;
+  static std::atomic<LogLevel> consoleLevel_;
+  static std::atomic<LogFileFormat> fileFormat_;
+
+  // Format strings of the LOG_*F call sites, indexed by id
+  static std::mutex formatMutex_;
+  static std::vector<FormatInfo> formats_;
+
+  // Logging thread wake up
+  static std::atomic<uint32_t> wakeEpoch_;
+  static std::atomic<bool> writerSleeping_;
   static std::atomic<bool> shutdownRequested_;
+  static std::atomic<uint64_t> flushRequests_;
+  static std::atomic<uint64_t> flushesDone_;
 
-  // File management
-  static std::mutex fileMutex_;
+  // Output, only touched by the logging thread
   static std::string fileName_;
   static std::unique_ptr<std::ofstream> logFile_;
-
-  // Console logging
-  static std::mutex consoleMutex_;
+  static int binaryFile_;
+  static bool binaryFormat_;
+  static uint32_t writtenFormats_;
+  static std::string consoleBuffer_;
+  static std::string fileBuffer_;
+  static bool unflushed_; // Written since the last forced writeBatch()
+  static std::chrono::steady_clock::time_point steadyAnchor_;
+  static std::chrono::system_clock::time_point systemAnchor_;
 
   // Thread management
+  static std::mutex initMutex_;
   static std::thread loggingThread_;
   static std::atomic<bool> initialized_;
+  static bool crashHandlerRegistered_;
 
   // Configuration
-  static constexpr size_t MAX_BATCH_SIZE = 100;   // Messages per batch
-  static constexpr size_t MAX_QUEUE_SIZE = 10000; // Prevent memory exhaustion
+  static constexpr size_t RING_CAPACITY = 8192; // Power of two
+  static constexpr size_t MAX_BATCH_SIZE = 256; // Records per write
+  static constexpr size_t BINARY_WRITE_SIZE = 1 << 20; // Bytes per write()
+  // How long output may sit in the buffers while the writer is idle
+  static constexpr std::chrono::milliseconds FLUSH_INTERVAL{250};
+  static constexpr std::chrono::milliseconds IDLE_POLL{2};
 };
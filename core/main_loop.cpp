@@ -0,0 +1,69 @@
+#include "main_loop.hpp"
+#include "profiler.hpp"
+#include "vulkan_frame_pacing.hpp"
+#include "vulkan_render.hpp"
+
+#include <GLFW/glfw3.h>
+#include <algorithm>
+#include <cmath>
+
+FixedTimestep::FixedTimestep(double tickRate, uint32_t maxTicksPerFrame)
+    : step_(std::llround(1e9 / tickRate)),
+      maxTicksPerFrame_(std::max(maxTicksPerFrame, 1u)),
+      dt_(static_cast<float>(std::chrono::duration<double>(step_).count())) {}
+
+uint32_t FixedTimestep::advance(Clock::time_point now) {
+  if (!last_) {
+    last_ = now;
+    return 0;
+  }
+
+  accumulator_ +=
+      std::chrono::duration_cast<std::chrono::nanoseconds>(now - *last_);
+  last_ = now;
+
+  const int64_t due = accumulator_ / step_;
+  if (due > maxTicksPerFrame_) {
+    droppedTicks_ += due - maxTicksPerFrame_;
+    accumulator_ %= step_;
+    ticks_ += maxTicksPerFrame_;
+    return maxTicksPerFrame_;
+  }
+
+  accumulator_ -= due * step_;
+  ticks_ += due;
+  return static_cast<uint32_t>(due);
+}
+
+float FixedTimestep::alpha() const {
+  return static_cast<float>(static_cast<double>(accumulator_.count()) /
+                            static_cast<double>(step_.count()));
+}
+
+void FixedTimestep::reset() {
+  accumulator_ = std::chrono::nanoseconds(0);
+  last_.reset();
+}
+
+void runMainLoop(GLFWwindow *window, FixedTimestep &timestep,
+                 const MainLoopCallbacks &callbacks) {
+  while (!glfwWindowShouldClose(window)) {
+    waitForInputSample();
+    glfwPollEvents();
+
+    const uint32_t ticks = timestep.advance();
+    if (callbacks.tick) {
+      HK_ZONE("simulation");
+      for (uint32_t i = 0; i < ticks; i++) {
+        callbacks.tick(timestep.dt());
+      }
+    }
+
+    beginFrame();
+    if (callbacks.render) {
+      HK_ZONE("render");
+      callbacks.render(timestep.alpha());
+    }
+    drawFrame();
+  }
+}
@@ -0,0 +1,61 @@
+#pragma once
+
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <optional>
+
+struct GLFWwindow;
+
+/// Fixed step accumulator that decouples the simulation rate from the render
+/// rate. Time is counted in integer nanoseconds, so the same frame times
+/// always produce the same ticks.
+class FixedTimestep {
+public:
+  using Clock = std::chrono::steady_clock;
+
+  explicit FixedTimestep(double tickRate = 60.0, uint32_t maxTicksPerFrame = 8);
+
+  /// @brief Adds the time since the previous call and returns how many ticks
+  /// are due. The first call only starts the clock. Anything beyond
+  /// maxTicksPerFrame is dropped, so a machine that can't keep up runs the game
+  /// slower instead of falling further behind every frame.
+  uint32_t advance(Clock::time_point now = Clock::now());
+
+  /// @brief How far the time left over is into the next tick, in [0, 1).
+  /// Render lerp(previous, current, alpha) to hide the tick rate.
+  float alpha() const;
+
+  /// @brief Length of a tick in seconds.
+  float dt() const { return dt_; }
+
+  uint64_t ticks() const { return ticks_; }
+  uint64_t droppedTicks() const { return droppedTicks_; }
+
+  /// @brief Forgets the time accumulated so far, e.g. after a loading screen.
+  void reset();
+
+private:
+  std::chrono::nanoseconds step_;
+  std::chrono::nanoseconds accumulator_{0};
+  std::optional<Clock::time_point> last_;
+  uint32_t maxTicksPerFrame_;
+  float dt_;
+  uint64_t ticks_ = 0;
+  uint64_t droppedTicks_ = 0;
+};
+
+struct MainLoopCallbacks {
+  /// @brief Runs once per simulation tick, with the fixed step in seconds.
+  std::function<void(float dt)> tick;
+
+  /// @brief Runs once per rendered frame after beginFrame(). alpha is how far
+  /// the frame lies between the last two ticks.
+  std::function<void(float alpha)> render;
+};
+
+/// @brief Runs until the window should close. Every frame it samples input
+/// late with waitForInputSample(), runs the ticks that are due, then renders
+/// and draws the frame.
+void runMainLoop(GLFWwindow *window, FixedTimestep &timestep,
+                 const MainLoopCallbacks &callbacks);
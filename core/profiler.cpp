@@ -0,0 +1,137 @@
+#include "profiler.hpp"
+#include "logger.hpp"
+
+#include <chrono>
+#include <format>
+#include <fstream>
+
+std::atomic<bool> Profiler::capturing_{false};
+std::atomic<uint32_t> Profiler::capture_{0};
+std::atomic<uint32_t> Profiler::threadCapacity_{1 << 16};
+std::atomic<uint64_t> Profiler::droppedCount_{0};
+std::mutex Profiler::captureMutex_;
+std::mutex Profiler::threadsMutex_;
+std::vector<std::unique_ptr<ProfileThreadBuffer>> Profiler::threads_;
+thread_local ProfileThreadBuffer *Profiler::threadBuffer_ = nullptr;
+uint64_t Profiler::captureStartTicks_ = 0;
+int64_t Profiler::captureStartNs_ = 0;
+
+namespace {
+int64_t steadyNs() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+std::string jsonEscape(std::string_view text) {
+  std::string out;
+  out.reserve(text.size());
+  for (char c : text) {
+    if (c == '"' || c == '\\') {
+      out += '\\';
+    }
+    out += c;
+  }
+  return out;
+}
+} // namespace
+
+ProfileThreadBuffer *Profiler::registerThread() {
+  auto buffer = std::make_unique<ProfileThreadBuffer>();
+  buffer->capacity = threadCapacity_.load(std::memory_order_relaxed);
+  buffer->events = std::make_unique<ProfileEvent[]>(buffer->capacity);
+
+  std::lock_guard lock(threadsMutex_);
+  buffer->threadId = static_cast<uint32_t>(threads_.size()) + 1;
+  buffer->name = std::format("Thread {}", buffer->threadId);
+  threadBuffer_ = buffer.get();
+  threads_.push_back(std::move(buffer));
+  return threadBuffer_;
+}
+
+void Profiler::beginCapture() {
+  std::lock_guard lock(captureMutex_);
+
+  captureStartNs_ = steadyNs();
+  captureStartTicks_ = now();
+  capture_.fetch_add(1, std::memory_order_relaxed);
+  capturing_.store(true, std::memory_order_relaxed);
+}
+
+bool Profiler::endCapture(const std::string &path) {
+  std::lock_guard lock(captureMutex_);
+
+  capturing_.store(false, std::memory_order_relaxed);
+  const uint64_t endTicks = now();
+  const int64_t endNs = steadyNs();
+
+  // On x86-64 the ticks are TSC cycles, measure their rate over the capture
+  // instead of trusting a nominal frequency.
+  const double nsPerTick =
+      endTicks > captureStartTicks_
+          ? static_cast<double>(endNs - captureStartNs_) /
+                static_cast<double>(endTicks - captureStartTicks_)
+          : 1.0;
+  const uint32_t capture = capture_.load(std::memory_order_relaxed);
+
+  std::ofstream file(path, std::ios::trunc);
+  if (!file) {
+    LOG_ERRORF("Failed to open {} for the profiler trace.", path);
+    return false;
+  }
+
+  auto toUs = [&](uint64_t ticks) {
+    const int64_t sinceStart = static_cast<int64_t>(ticks - captureStartTicks_);
+    return static_cast<double>(sinceStart) * nsPerTick / 1000.0;
+  };
+
+  file << "{\"traceEvents\":[\n";
+  bool first = true;
+  size_t written = 0;
+
+  std::lock_guard threadsLock(threadsMutex_);
+  for (const std::unique_ptr<ProfileThreadBuffer> &buffer : threads_) {
+    const uint32_t count = buffer->count.load(std::memory_order_acquire);
+    if (buffer->capture.load(std::memory_order_relaxed) != capture) {
+      continue;
+    }
+
+    file << std::format("{}{{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+                        "\"tid\":{},\"args\":{{\"name\":\"{}\"}}}}",
+                        first ? "" : ",\n", buffer->threadId,
+                        jsonEscape(buffer->name));
+    first = false;
+
+    for (uint32_t i = 0; i < count; i++) {
+      const ProfileEvent &event = buffer->events[i];
+      file << std::format(",\n{{\"name\":\"{}\",\"cat\":\"cpu\",\"ph\":\"X\","
+                          "\"pid\":1,\"tid\":{},\"ts\":{:.3f},\"dur\":{:.3f}}}",
+                          jsonEscape(event.name), buffer->threadId,
+                          toUs(event.start),
+                          toUs(event.end) - toUs(event.start));
+    }
+    written += count;
+  }
+  file << "\n]}\n";
+
+  LOG_INFOF("Wrote {} profiler zones to {}.", written, path);
+  return static_cast<bool>(file);
+}
+
+void Profiler::setThreadName(std::string_view name) {
+  ProfileThreadBuffer *buffer = threadBuffer_;
+  if (!buffer) {
+    buffer = registerThread();
+  }
+
+  std::lock_guard lock(threadsMutex_);
+  buffer->name = name;
+}
+
+void Profiler::setThreadCapacity(uint32_t events) {
+  threadCapacity_.store(events, std::memory_order_relaxed);
+}
+
+uint64_t Profiler::droppedCount() {
+  return droppedCount_.load(std::memory_order_relaxed);
+}
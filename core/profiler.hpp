@@ -0,0 +1,162 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#include <x86intrin.h>
+#else
+#include <chrono>
+#endif
+
+// HK_ZONE compiles to nothing unless this is 1. Set it with
+// -DHAKKERO_PROFILE=<0|1>, it defaults to on for builds without NDEBUG.
+#ifndef HAKKERO_PROFILE
+#ifdef NDEBUG
+#define HAKKERO_PROFILE 0
+#else
+#define HAKKERO_PROFILE 1
+#endif
+#endif
+
+/// One finished zone. Zones are recorded when they end, so a single write
+/// covers both the begin and the end.
+struct ProfileEvent {
+  const char *name;
+  uint64_t start;
+  uint64_t end;
+};
+
+/// Events of one thread. Only the owning thread writes, and it publishes
+/// every event by bumping `count`, so the writer of the trace can read
+/// everything below it without a lock.
+struct ProfileThreadBuffer {
+  std::unique_ptr<ProfileEvent[]> events;
+  uint32_t capacity = 0;
+  std::atomic<uint32_t> count{0};
+  std::atomic<uint32_t> capture{0};
+  uint32_t threadId = 0;
+  std::string name;
+};
+
+class Profiler {
+public:
+  /// @brief Starts recording zones, clearing whatever the previous capture
+  /// left behind.
+  static void beginCapture();
+
+  /// @brief Stops recording and writes every zone of the capture to `path`
+  /// as Chrome trace JSON, which chrome://tracing and Perfetto both open.
+  static bool endCapture(const std::string &path);
+
+  static bool capturing() {
+    return capturing_.load(std::memory_order_relaxed);
+  }
+
+  /// @brief Name of the calling thread in the trace.
+  static void setThreadName(std::string_view name);
+
+  /// @brief Events every thread can hold per capture, the rest is dropped.
+  /// Only affects threads that did not record anything yet.
+  static void setThreadCapacity(uint32_t events);
+
+  /// @brief Zones dropped because a thread buffer was full, since startup.
+  static uint64_t droppedCount();
+
+  /// @brief Raw timestamp in profiler ticks. The TSC on x86-64, steady_clock
+  /// elsewhere.
+  static uint64_t now() {
+#if defined(__x86_64__) || defined(_M_X64)
+    return __rdtsc();
+#else
+    return std::chrono::steady_clock::now().time_since_epoch().count();
+#endif
+  }
+
+  static void record(const char *name, uint64_t start, uint64_t end) {
+    ProfileThreadBuffer *buffer = threadBuffer_;
+    if (!buffer) {
+      buffer = registerThread();
+    }
+
+    // The owner resets its own buffer on the first zone of a new capture,
+    // nobody else ever writes to it.
+    const uint32_t capture = capture_.load(std::memory_order_relaxed);
+    if (buffer->capture.load(std::memory_order_relaxed) != capture) {
+      buffer->count.store(0, std::memory_order_relaxed);
+      buffer->capture.store(capture, std::memory_order_relaxed);
+    }
+
+    const uint32_t index = buffer->count.load(std::memory_order_relaxed);
+    if (index == buffer->capacity) {
+      droppedCount_.fetch_add(1, std::memory_order_relaxed);
+      return;
+    }
+
+    buffer->events[index] = {name, start, end};
+    buffer->count.store(index + 1, std::memory_order_release);
+  }
+
+private:
+  static ProfileThreadBuffer *registerThread();
+
+  static std::atomic<bool> capturing_;
+  static std::atomic<uint32_t> capture_;
+  static std::atomic<uint32_t> threadCapacity_;
+  static std::atomic<uint64_t> droppedCount_;
+
+  // Serializes beginCapture() and endCapture()
+  static std::mutex captureMutex_;
+
+  // Every thread that ever recorded a zone. Buffers outlive their threads
+  // so zones of threads that already exited still end up in the trace.
+  static std::mutex threadsMutex_;
+  static std::vector<std::unique_ptr<ProfileThreadBuffer>> threads_;
+  static thread_local ProfileThreadBuffer *threadBuffer_;
+
+  // Both clocks sampled when the capture began, to convert ticks to time
+  static uint64_t captureStartTicks_;
+  static int64_t captureStartNs_;
+};
+
+/// Measures the scope it lives in. Costs a relaxed load when no capture is
+/// running.
+class ProfileZone {
+public:
+  explicit ProfileZone(const char *name) {
+    if (Profiler::capturing()) {
+      name_ = name;
+      start_ = Profiler::now();
+    }
+  }
+
+  ~ProfileZone() {
+    if (name_) {
+      Profiler::record(name_, start_, Profiler::now());
+    }
+  }
+
+  ProfileZone(const ProfileZone &) = delete;
+  ProfileZone &operator=(const ProfileZone &) = delete;
+
+private:
+  const char *name_ = nullptr;
+  uint64_t start_ = 0;
+};
+
+#define HK_PROFILE_CONCAT_IMPL(a, b) a##b
+#define HK_PROFILE_CONCAT(a, b) HK_PROFILE_CONCAT_IMPL(a, b)
+
+#if HAKKERO_PROFILE
+/// The name must outlive the capture, string literals are what you want.
+#define HK_ZONE(name) ProfileZone HK_PROFILE_CONCAT(hkZone, __LINE__)(name)
+#define HK_THREAD_NAME(name) Profiler::setThreadName(name)
+#else
+#define HK_ZONE(name) ((void)0)
+#define HK_THREAD_NAME(name) ((void)0)
+#endif
@@ -0,0 +1,93 @@
+#include "bullet_kernels.hpp"
+
+#if defined(__x86_64__) || defined(_M_X64)
+#include <immintrin.h>
+#endif
+
+void updateBulletsScalar(BulletArrays &bullets, uint32_t begin, uint32_t end,
+                         float dt, const BulletBounds &bounds) {
+  for (uint32_t i = begin; i < end; i++) {
+    updateBullet(bullets, i, dt, bounds);
+  }
+}
+
+#if defined(__x86_64__) || defined(_M_X64)
+// SSE2 is part of x86-64, so this one needs no extra compiler flags.
+void updateBulletsSSE(BulletArrays &b, uint32_t begin, uint32_t end, float dt,
+                      const BulletBounds &bounds) {
+  const __m128 vdt = _mm_set1_ps(dt);
+  const __m128 one = _mm_set1_ps(1.0f);
+  const __m128 zero = _mm_setzero_ps();
+  const __m128 half = _mm_set1_ps(0.5f);
+  const __m128 inv6 = _mm_set1_ps(1.0f / 6.0f);
+  const __m128 inv24 = _mm_set1_ps(1.0f / 24.0f);
+  const __m128 inv120 = _mm_set1_ps(1.0f / 120.0f);
+  const __m128 minSpeed = _mm_set1_ps(BULLET_MIN_SPEED);
+  const __m128 minX = _mm_set1_ps(bounds.minX);
+  const __m128 minY = _mm_set1_ps(bounds.minY);
+  const __m128 maxX = _mm_set1_ps(bounds.maxX);
+  const __m128 maxY = _mm_set1_ps(bounds.maxY);
+  const __m128i deadBit = _mm_set1_epi32(BULLET_DEAD);
+  const __m128i noCullBit = _mm_set1_epi32(BULLET_NO_CULL);
+
+  uint32_t i = begin;
+  for (; i + 4 <= end; i += 4) {
+    __m128 theta = _mm_mul_ps(_mm_loadu_ps(b.angularVelocity + i), vdt);
+    __m128 t2 = _mm_mul_ps(theta, theta);
+    __m128 c = _mm_sub_ps(
+        one, _mm_mul_ps(t2, _mm_sub_ps(half, _mm_mul_ps(t2, inv24))));
+    __m128 s = _mm_mul_ps(
+        theta,
+        _mm_sub_ps(one,
+                   _mm_mul_ps(t2, _mm_sub_ps(inv6, _mm_mul_ps(t2, inv120)))));
+
+    __m128 oldVx = _mm_loadu_ps(b.vx + i);
+    __m128 oldVy = _mm_loadu_ps(b.vy + i);
+    __m128 vx = _mm_sub_ps(_mm_mul_ps(oldVx, c), _mm_mul_ps(oldVy, s));
+    __m128 vy = _mm_add_ps(_mm_mul_ps(oldVx, s), _mm_mul_ps(oldVy, c));
+
+    __m128 speed =
+        _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(vx, vx), _mm_mul_ps(vy, vy)));
+    __m128 factor = _mm_add_ps(
+        one, _mm_div_ps(_mm_mul_ps(_mm_loadu_ps(b.acceleration + i), vdt),
+                        _mm_max_ps(speed, minSpeed)));
+    factor = _mm_max_ps(factor, zero);
+    __m128 moving = _mm_cmpgt_ps(speed, minSpeed);
+    factor = _mm_or_ps(_mm_and_ps(moving, factor), _mm_andnot_ps(moving, one));
+    vx = _mm_mul_ps(vx, factor);
+    vy = _mm_mul_ps(vy, factor);
+
+    __m128 x = _mm_add_ps(_mm_loadu_ps(b.x + i), _mm_mul_ps(vx, vdt));
+    __m128 y = _mm_add_ps(_mm_loadu_ps(b.y + i), _mm_mul_ps(vy, vdt));
+    __m128 lifetime = _mm_sub_ps(_mm_loadu_ps(b.lifetime + i), vdt);
+
+    _mm_storeu_ps(b.vx + i, vx);
+    _mm_storeu_ps(b.vy + i, vy);
+    _mm_storeu_ps(b.x + i, x);
+    _mm_storeu_ps(b.y + i, y);
+    _mm_storeu_ps(b.angle + i, _mm_add_ps(_mm_loadu_ps(b.angle + i), theta));
+    _mm_storeu_ps(b.lifetime + i, lifetime);
+
+    __m128 outside = _mm_or_ps(
+        _mm_or_ps(_mm_cmplt_ps(x, minX), _mm_cmpgt_ps(x, maxX)),
+        _mm_or_ps(_mm_cmplt_ps(y, minY), _mm_cmpgt_ps(y, maxY)));
+    __m128 expired = _mm_cmple_ps(lifetime, zero);
+
+    __m128i flags = _mm_loadu_si128(reinterpret_cast<__m128i *>(b.flags + i));
+    __m128i cullable = _mm_cmpeq_epi32(_mm_and_si128(flags, noCullBit),
+                                       _mm_setzero_si128());
+    __m128i dead = _mm_or_si128(
+        _mm_castps_si128(expired),
+        _mm_and_si128(_mm_castps_si128(outside), cullable));
+    flags = _mm_or_si128(flags, _mm_and_si128(dead, deadBit));
+    _mm_storeu_si128(reinterpret_cast<__m128i *>(b.flags + i), flags);
+  }
+
+  updateBulletsScalar(b, i, end, dt, bounds);
+}
+#else
+void updateBulletsSSE(BulletArrays &bullets, uint32_t begin, uint32_t end,
+                      float dt, const BulletBounds &bounds) {
+  updateBulletsScalar(bullets, begin, end, dt, bounds);
+}
+#endif
@@ -0,0 +1,58 @@
+#pragma once
+
+#include "bullet_pool.hpp"
+
+#include <algorithm>
+#include <cmath>
+
+/// Update kernels of BulletPool. Every kernel performs exactly the same
+/// sequence of IEEE operations (no FMA, no approximate reciprocals), so all of
+/// them produce bit identical results and replays stay deterministic no matter
+/// which one the CPU picks.
+
+void updateBulletsScalar(BulletArrays &bullets, uint32_t begin, uint32_t end,
+                         float dt, const BulletBounds &bounds);
+void updateBulletsSSE(BulletArrays &bullets, uint32_t begin, uint32_t end,
+                      float dt, const BulletBounds &bounds);
+void updateBulletsAVX2(BulletArrays &bullets, uint32_t begin, uint32_t end,
+                       float dt, const BulletBounds &bounds);
+
+/// Speeds below this don't have a direction to accelerate along.
+constexpr float BULLET_MIN_SPEED = 1e-6f;
+
+inline void updateBullet(BulletArrays &b, uint32_t i, float dt,
+                         const BulletBounds &bounds) {
+  // Rotate the velocity with a polynomial sin/cos. The per-tick angle is tiny,
+  // so this is exact to float precision and vectorizes unlike std::sin.
+  float theta = b.angularVelocity[i] * dt;
+  float t2 = theta * theta;
+  float c = 1.0f - t2 * (0.5f - t2 * (1.0f / 24.0f));
+  float s = theta * (1.0f - t2 * ((1.0f / 6.0f) - t2 * (1.0f / 120.0f)));
+
+  float vx = b.vx[i] * c - b.vy[i] * s;
+  float vy = b.vx[i] * s + b.vy[i] * c;
+
+  float speed = std::sqrt(vx * vx + vy * vy);
+  float factor = 1.0f + (b.acceleration[i] * dt) /
+                            std::max(speed, BULLET_MIN_SPEED);
+  factor = speed > BULLET_MIN_SPEED ? std::max(factor, 0.0f) : 1.0f;
+  vx = vx * factor;
+  vy = vy * factor;
+
+  float x = b.x[i] + vx * dt;
+  float y = b.y[i] + vy * dt;
+  float lifetime = b.lifetime[i] - dt;
+
+  b.vx[i] = vx;
+  b.vy[i] = vy;
+  b.x[i] = x;
+  b.y[i] = y;
+  b.angle[i] = b.angle[i] + theta;
+  b.lifetime[i] = lifetime;
+
+  bool outside = x < bounds.minX || x > bounds.maxX || y < bounds.minY ||
+                 y > bounds.maxY;
+  if (lifetime <= 0.0f || (outside && !(b.flags[i] & BULLET_NO_CULL))) {
+    b.flags[i] |= BULLET_DEAD;
+  }
+}
@@ -0,0 +1,92 @@
+#include "bullet_kernels.hpp"
+
+// This file is the only one built with -mavx2. It is only ever called after
+// checking the CPU supports it, see isBulletKernelSupported().
+#if defined(__x86_64__) || defined(_M_X64)
+#include <immintrin.h>
+
+void updateBulletsAVX2(BulletArrays &b, uint32_t begin, uint32_t end,
+                       float dt, const BulletBounds &bounds) {
+  const __m256 vdt = _mm256_set1_ps(dt);
+  const __m256 one = _mm256_set1_ps(1.0f);
+  const __m256 zero = _mm256_setzero_ps();
+  const __m256 half = _mm256_set1_ps(0.5f);
+  const __m256 inv6 = _mm256_set1_ps(1.0f / 6.0f);
+  const __m256 inv24 = _mm256_set1_ps(1.0f / 24.0f);
+  const __m256 inv120 = _mm256_set1_ps(1.0f / 120.0f);
+  const __m256 minSpeed = _mm256_set1_ps(BULLET_MIN_SPEED);
+  const __m256 minX = _mm256_set1_ps(bounds.minX);
+  const __m256 minY = _mm256_set1_ps(bounds.minY);
+  const __m256 maxX = _mm256_set1_ps(bounds.maxX);
+  const __m256 maxY = _mm256_set1_ps(bounds.maxY);
+  const __m256i deadBit = _mm256_set1_epi32(BULLET_DEAD);
+  const __m256i noCullBit = _mm256_set1_epi32(BULLET_NO_CULL);
+
+  uint32_t i = begin;
+  for (; i + 8 <= end; i += 8) {
+    __m256 theta = _mm256_mul_ps(_mm256_loadu_ps(b.angularVelocity + i), vdt);
+    __m256 t2 = _mm256_mul_ps(theta, theta);
+    __m256 c = _mm256_sub_ps(
+        one,
+        _mm256_mul_ps(t2, _mm256_sub_ps(half, _mm256_mul_ps(t2, inv24))));
+    __m256 s = _mm256_mul_ps(
+        theta,
+        _mm256_sub_ps(one, _mm256_mul_ps(t2, _mm256_sub_ps(
+                                                 inv6, _mm256_mul_ps(
+                                                           t2, inv120)))));
+
+    __m256 oldVx = _mm256_loadu_ps(b.vx + i);
+    __m256 oldVy = _mm256_loadu_ps(b.vy + i);
+    __m256 vx = _mm256_sub_ps(_mm256_mul_ps(oldVx, c), _mm256_mul_ps(oldVy, s));
+    __m256 vy = _mm256_add_ps(_mm256_mul_ps(oldVx, s), _mm256_mul_ps(oldVy, c));
+
+    __m256 speed = _mm256_sqrt_ps(
+        _mm256_add_ps(_mm256_mul_ps(vx, vx), _mm256_mul_ps(vy, vy)));
+    __m256 factor = _mm256_add_ps(
+        one,
+        _mm256_div_ps(_mm256_mul_ps(_mm256_loadu_ps(b.acceleration + i), vdt),
+                      _mm256_max_ps(speed, minSpeed)));
+    factor = _mm256_max_ps(factor, zero);
+    __m256 moving = _mm256_cmp_ps(speed, minSpeed, _CMP_GT_OQ);
+    factor = _mm256_blendv_ps(one, factor, moving);
+    vx = _mm256_mul_ps(vx, factor);
+    vy = _mm256_mul_ps(vy, factor);
+
+    __m256 x = _mm256_add_ps(_mm256_loadu_ps(b.x + i), _mm256_mul_ps(vx, vdt));
+    __m256 y = _mm256_add_ps(_mm256_loadu_ps(b.y + i), _mm256_mul_ps(vy, vdt));
+    __m256 lifetime = _mm256_sub_ps(_mm256_loadu_ps(b.lifetime + i), vdt);
+
+    _mm256_storeu_ps(b.vx + i, vx);
+    _mm256_storeu_ps(b.vy + i, vy);
+    _mm256_storeu_ps(b.x + i, x);
+    _mm256_storeu_ps(b.y + i, y);
+    _mm256_storeu_ps(b.angle + i,
+                     _mm256_add_ps(_mm256_loadu_ps(b.angle + i), theta));
+    _mm256_storeu_ps(b.lifetime + i, lifetime);
+
+    __m256 outside =
+        _mm256_or_ps(_mm256_or_ps(_mm256_cmp_ps(x, minX, _CMP_LT_OQ),
+                                  _mm256_cmp_ps(x, maxX, _CMP_GT_OQ)),
+                     _mm256_or_ps(_mm256_cmp_ps(y, minY, _CMP_LT_OQ),
+                                  _mm256_cmp_ps(y, maxY, _CMP_GT_OQ)));
+    __m256 expired = _mm256_cmp_ps(lifetime, zero, _CMP_LE_OQ);
+
+    __m256i flags =
+        _mm256_loadu_si256(reinterpret_cast<__m256i *>(b.flags + i));
+    __m256i cullable = _mm256_cmpeq_epi32(
+        _mm256_and_si256(flags, noCullBit), _mm256_setzero_si256());
+    __m256i dead = _mm256_or_si256(
+        _mm256_castps_si256(expired),
+        _mm256_and_si256(_mm256_castps_si256(outside), cullable));
+    flags = _mm256_or_si256(flags, _mm256_and_si256(dead, deadBit));
+    _mm256_storeu_si256(reinterpret_cast<__m256i *>(b.flags + i), flags);
+  }
+
+  updateBulletsScalar(b, i, end, dt, bounds);
+}
+#else
+void updateBulletsAVX2(BulletArrays &bullets, uint32_t begin, uint32_t end,
+                       float dt, const BulletBounds &bounds) {
+  updateBulletsScalar(bullets, begin, end, dt, bounds);
+}
+#endif
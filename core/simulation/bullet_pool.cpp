@@ -0,0 +1,217 @@
+#include "bullet_pool.hpp"
+#include "bullet_kernels.hpp"
+#include "job_system.hpp"
+#include "profiler.hpp"
+
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
+#include <new>
+
+namespace {
+constexpr size_t COLUMN_ALIGNMENT = 64;
+constexpr size_t COLUMN_COUNT = sizeof(BulletArrays) / sizeof(void *);
+
+using UpdateKernel = void (*)(BulletArrays &, uint32_t, uint32_t, float,
+                              const BulletBounds &);
+
+UpdateKernel kernelFunction(BulletKernel kernel) {
+  switch (kernel) {
+  case BulletKernel::AVX2:
+    return updateBulletsAVX2;
+  case BulletKernel::SSE:
+    return updateBulletsSSE;
+  case BulletKernel::SCALAR:
+  default:
+    return updateBulletsScalar;
+  }
+}
+} // namespace
+
+const char *bulletKernelName(BulletKernel kernel) {
+  switch (kernel) {
+  case BulletKernel::AUTO:
+    return "auto";
+  case BulletKernel::SCALAR:
+    return "scalar";
+  case BulletKernel::SSE:
+    return "sse";
+  case BulletKernel::AVX2:
+    return "avx2";
+  default:
+    return "unknown";
+  }
+}
+
+bool isBulletKernelSupported(BulletKernel kernel) {
+  switch (kernel) {
+  case BulletKernel::AUTO:
+  case BulletKernel::SCALAR:
+    return true;
+#if defined(__x86_64__) || defined(_M_X64)
+  case BulletKernel::SSE:
+    return true;
+  case BulletKernel::AVX2:
+    return __builtin_cpu_supports("avx2");
+#endif
+  default:
+    return false;
+  }
+}
+
+BulletPool::BulletPool(uint32_t capacity) : capacity_(capacity) {
+  // One allocation for every column, each one starting on a cache line.
+  size_t columnBytes = (static_cast<size_t>(capacity) * sizeof(float) +
+                        COLUMN_ALIGNMENT - 1) &
+                       ~(COLUMN_ALIGNMENT - 1);
+  columnBytes = columnBytes == 0 ? COLUMN_ALIGNMENT : columnBytes;
+
+  storage_ = std::aligned_alloc(COLUMN_ALIGNMENT, columnBytes * COLUMN_COUNT);
+  if (storage_ == nullptr) {
+    throw std::bad_alloc();
+  }
+
+  char *column = static_cast<char *>(storage_);
+  auto next = [&]() {
+    void *current = column;
+    column += columnBytes;
+    return current;
+  };
+
+  arrays_.x = static_cast<float *>(next());
+  arrays_.y = static_cast<float *>(next());
+  arrays_.vx = static_cast<float *>(next());
+  arrays_.vy = static_cast<float *>(next());
+  arrays_.angle = static_cast<float *>(next());
+  arrays_.angularVelocity = static_cast<float *>(next());
+  arrays_.acceleration = static_cast<float *>(next());
+  arrays_.lifetime = static_cast<float *>(next());
+  arrays_.radius = static_cast<float *>(next());
+  arrays_.size = static_cast<float *>(next());
+  arrays_.color = static_cast<uint32_t *>(next());
+  arrays_.flags = static_cast<uint32_t *>(next());
+  arrays_.prevX = static_cast<float *>(next());
+  arrays_.prevY = static_cast<float *>(next());
+
+  setKernel(BulletKernel::AUTO);
+}
+
+BulletPool::~BulletPool() { std::free(storage_); }
+
+bool BulletPool::setKernel(BulletKernel kernel) {
+  if (!isBulletKernelSupported(kernel)) {
+    return false;
+  }
+
+  if (kernel == BulletKernel::AUTO) {
+    kernel = isBulletKernelSupported(BulletKernel::AVX2) ? BulletKernel::AVX2
+             : isBulletKernelSupported(BulletKernel::SSE) ? BulletKernel::SSE
+                                                           : BulletKernel::SCALAR;
+  }
+
+  kernel_ = kernel;
+  return true;
+}
+
+uint32_t BulletPool::spawn(const BulletDesc &desc) {
+  if (count_ == capacity_) {
+    return UINT32_MAX;
+  }
+
+  uint32_t i = count_++;
+  arrays_.x[i] = desc.x;
+  arrays_.y[i] = desc.y;
+  arrays_.vx[i] = desc.vx;
+  arrays_.vy[i] = desc.vy;
+  arrays_.angle[i] = desc.angle;
+  arrays_.angularVelocity[i] = desc.angularVelocity;
+  arrays_.acceleration[i] = desc.acceleration;
+  arrays_.lifetime[i] = desc.lifetime;
+  arrays_.radius[i] = desc.radius;
+  arrays_.size[i] = desc.size;
+  arrays_.color[i] = desc.color;
+  arrays_.flags[i] = desc.flags & ~BULLET_DEAD;
+  arrays_.prevX[i] = desc.x;
+  arrays_.prevY[i] = desc.y;
+  return i;
+}
+
+void BulletPool::update(float dt) {
+  HK_ZONE("BulletPool::update");
+  integrate(0, count_, dt);
+  compact();
+}
+
+void BulletPool::updateParallel(float dt, uint32_t grain) {
+  HK_ZONE("BulletPool::updateParallel");
+  std::atomic<uint32_t> firstDead{count_};
+
+  // Chunks start on multiples of 16, so no two chunks share a cache line of
+  // any column and the SIMD kernels stay aligned.
+  JobSystem::parallelFor(
+      0, count_, grain,
+      [this, dt, &firstDead](uint32_t begin, uint32_t end) {
+        HK_ZONE("integrate");
+        integrate(begin, end, dt);
+
+        // The chunk's flags are still in cache, finding the first dead bullet
+        // here lets compact() skip the living prefix.
+        for (uint32_t i = begin; i < end; i++) {
+          if (arrays_.flags[i] & BULLET_DEAD) {
+            uint32_t current = firstDead.load(std::memory_order_relaxed);
+            while (i < current && !firstDead.compare_exchange_weak(
+                                      current, i, std::memory_order_relaxed)) {
+            }
+            break;
+          }
+        }
+      },
+      16);
+
+  compactFrom(firstDead.load(std::memory_order_relaxed));
+}
+
+void BulletPool::integrate(uint32_t begin, uint32_t end, float dt) {
+  end = end < count_ ? end : count_;
+  if (begin >= end) {
+    return;
+  }
+
+  const size_t bytes = static_cast<size_t>(end - begin) * sizeof(float);
+  std::memcpy(arrays_.prevX + begin, arrays_.x + begin, bytes);
+  std::memcpy(arrays_.prevY + begin, arrays_.y + begin, bytes);
+  kernelFunction(kernel_)(arrays_, begin, end, dt, bounds_);
+}
+
+void BulletPool::compactFrom(uint32_t first) {
+  uint32_t i = first;
+  while (i < count_) {
+    // The bullet moved in from the back may be dead as well, so look at the
+    // same slot again.
+    if (arrays_.flags[i] & BULLET_DEAD) {
+      count_--;
+      moveBullet(count_, i);
+    }
+
+    else {
+      i++;
+    }
+  }
+}
+
+void BulletPool::moveBullet(uint32_t from, uint32_t to) {
+  arrays_.x[to] = arrays_.x[from];
+  arrays_.y[to] = arrays_.y[from];
+  arrays_.vx[to] = arrays_.vx[from];
+  arrays_.vy[to] = arrays_.vy[from];
+  arrays_.angle[to] = arrays_.angle[from];
+  arrays_.angularVelocity[to] = arrays_.angularVelocity[from];
+  arrays_.acceleration[to] = arrays_.acceleration[from];
+  arrays_.lifetime[to] = arrays_.lifetime[from];
+  arrays_.radius[to] = arrays_.radius[from];
+  arrays_.size[to] = arrays_.size[from];
+  arrays_.color[to] = arrays_.color[from];
+  arrays_.flags[to] = arrays_.flags[from];
+  arrays_.prevX[to] = arrays_.prevX[from];
+  arrays_.prevY[to] = arrays_.prevY[from];
+}
@@ -0,0 +1,137 @@
+#pragma once
+
+#include <cstdint>
+
+enum BulletFlags : uint32_t {
+  /// @brief Set by the update kernels, the bullet is removed by compact().
+  BULLET_DEAD = 1u << 0,
+
+  /// @brief The bullet survives leaving the pool bounds.
+  BULLET_NO_CULL = 1u << 1,
+};
+
+struct BulletDesc {
+  float x = 0.0f;
+  float y = 0.0f;
+  float vx = 0.0f;
+  float vy = 0.0f;
+
+  /// @brief Orientation of the sprite in radians.
+  float angle = 0.0f;
+
+  /// @brief Rotation of the velocity (and the sprite) in radians per second.
+  float angularVelocity = 0.0f;
+
+  /// @brief Change of speed along the direction of travel in pixels per
+  /// second squared. Negative values brake, but never reverse the bullet.
+  float acceleration = 0.0f;
+
+  /// @brief Seconds until the bullet despawns.
+  float lifetime = 1e30f;
+
+  /// @brief Radius of the hitbox in pixels.
+  float radius = 4.0f;
+
+  /// @brief Size of the sprite in pixels.
+  float size = 8.0f;
+
+  /// @brief Packed RGBA8 color, red in the lowest byte.
+  uint32_t color = 0xffffffff;
+
+  uint32_t flags = 0;
+};
+
+/// @brief Raw pointers to the columns of a pool. Every column is 64-byte
+/// aligned and holds capacity elements.
+struct BulletArrays {
+  float *x;
+  float *y;
+  float *vx;
+  float *vy;
+  float *angle;
+  float *angularVelocity;
+  float *acceleration;
+  float *lifetime;
+  float *radius;
+  float *size;
+  uint32_t *color;
+  uint32_t *flags;
+
+  /// @brief Position before the last integrate(), so the renderer can
+  /// interpolate between two ticks.
+  float *prevX;
+  float *prevY;
+};
+
+/// @brief Bullets outside of this rectangle die unless BULLET_NO_CULL is set.
+struct BulletBounds {
+  float minX = -1e30f;
+  float minY = -1e30f;
+  float maxX = 1e30f;
+  float maxY = 1e30f;
+};
+
+enum class BulletKernel { AUTO, SCALAR, SSE, AVX2 };
+
+const char *bulletKernelName(BulletKernel kernel);
+
+/// @brief Returns whether the CPU we are running on can execute the kernel.
+bool isBulletKernelSupported(BulletKernel kernel);
+
+/// Bullets stored as structure-of-arrays so the update kernels can process
+/// 4 or 8 of them per instruction. Dead bullets are swap-removed, so indices
+/// are not stable across compact() calls.
+class BulletPool {
+public:
+  explicit BulletPool(uint32_t capacity);
+  ~BulletPool();
+
+  BulletPool(const BulletPool &) = delete;
+  BulletPool &operator=(const BulletPool &) = delete;
+
+  /// @brief Returns the index of the new bullet or UINT32_MAX if the pool is
+  /// full.
+  uint32_t spawn(const BulletDesc &desc);
+
+  /// @brief Moves every bullet and removes the dead ones.
+  void update(float dt);
+
+  /// @brief update() with the bullets split into chunks of at least `grain`
+  /// that run on the job system. Only compact() stays on the calling thread.
+  void updateParallel(float dt, uint32_t grain = 16384);
+
+  /// @brief Moves the bullets in [begin, end) and flags the ones that died.
+  /// The old positions are kept in prevX and prevY. Ranges may be processed in
+  /// parallel, as long as they don't overlap.
+  void integrate(uint32_t begin, uint32_t end, float dt);
+
+  /// @brief Swap-removes every bullet flagged as dead.
+  void compact() { compactFrom(0); }
+
+  void clear() { count_ = 0; }
+
+  void setBounds(const BulletBounds &bounds) { bounds_ = bounds; }
+  const BulletBounds &bounds() const { return bounds_; }
+
+  /// @brief Forces a specific kernel, AUTO picks the widest one the CPU
+  /// supports. Returns false if the kernel is not supported.
+  bool setKernel(BulletKernel kernel);
+  BulletKernel kernel() const { return kernel_; }
+
+  uint32_t size() const { return count_; }
+  uint32_t capacity() const { return capacity_; }
+  const BulletArrays &arrays() const { return arrays_; }
+  BulletArrays &arrays() { return arrays_; }
+
+private:
+  /// @brief compact() for pools where no bullet below `first` is dead.
+  void compactFrom(uint32_t first);
+  void moveBullet(uint32_t from, uint32_t to);
+
+  BulletArrays arrays_;
+  BulletBounds bounds_;
+  BulletKernel kernel_ = BulletKernel::SCALAR;
+  void *storage_ = nullptr;
+  uint32_t count_ = 0;
+  uint32_t capacity_ = 0;
+};
@@ -0,0 +1,56 @@
+#include "bullet_render.hpp"
+#include "job_system.hpp"
+#include "vulkan_sprite.hpp"
+#include "vulkan_types.hpp"
+
+#include <algorithm>
+
+namespace {
+// Below this many bullets a chunk costs more to hand out than to write
+constexpr uint32_t BULLET_WRITE_GRAIN = 8192;
+} // namespace
+
+uint32_t drawBullets(const BulletPool &pool, const float uvRect[4],
+                     uint32_t texture, float alpha, VkPipeline pipeline) {
+  vulkan_sprite_renderer &renderer = getVulkanSpriteRendererStruct();
+
+  uint32_t count = std::min(pool.size(), renderer.maxInstancesPerFrame -
+                                             renderer.instanceCount);
+  if (count == 0) {
+    return 0;
+  }
+
+  // The instance memory is write-combined on most GPUs, so write every field
+  // exactly once, in order, and never read it back.
+  sprite_instance *instances = reserveSprites(count, pipeline);
+  const BulletArrays &bullets = pool.arrays();
+
+  // Written so alpha == 1 gives exactly the current position.
+  const float prevWeight = 1.0f - alpha;
+
+  // Large pools are split over the job system, every chunk writes its own
+  // range of instances.
+  JobSystem::parallelFor(
+      0, count, BULLET_WRITE_GRAIN,
+      [instances, &bullets, uvRect, texture, alpha,
+       prevWeight](uint32_t begin, uint32_t end) {
+        for (uint32_t i = begin; i < end; i++) {
+          sprite_instance &instance = instances[i];
+          instance.position[0] =
+              bullets.x[i] * alpha + bullets.prevX[i] * prevWeight;
+          instance.position[1] =
+              bullets.y[i] * alpha + bullets.prevY[i] * prevWeight;
+          instance.scale[0] = bullets.size[i];
+          instance.scale[1] = bullets.size[i];
+          instance.rotation = bullets.angle[i];
+          instance.color = bullets.color[i];
+          instance.uvRect[0] = uvRect[0];
+          instance.uvRect[1] = uvRect[1];
+          instance.uvRect[2] = uvRect[2];
+          instance.uvRect[3] = uvRect[3];
+          instance.texture = texture;
+        }
+      });
+
+  return count;
+}
@@ -0,0 +1,18 @@
+#pragma once
+
+#include "bullet_pool.hpp"
+
+#include <cstdint>
+#include <vulkan/vulkan.h>
+
+/// @brief Writes every bullet of the pool straight into the mapped sprite
+/// instance buffer of the current frame, as one batch sampling texture.
+/// Returns how many bullets were drawn, which is less than pool.size() if the
+/// frame ran out of instances.
+///
+/// alpha below 1 draws the bullets that far between their position before
+/// and after the last update, see FixedTimestep::alpha(). pipeline is passed
+/// on to reserveSprites(), e.g. a blend mode variant from requestPipeline().
+uint32_t drawBullets(const BulletPool &pool, const float uvRect[4],
+                     uint32_t texture = 0, float alpha = 1.0f,
+                     VkPipeline pipeline = VK_NULL_HANDLE);
@@ -0,0 +1,300 @@
+#include "collision.hpp"
+#include "job_system.hpp"
+#include "profiler.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cmath>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#include <immintrin.h>
+#endif
+
+CollisionGrid::CollisionGrid(float minX, float minY, float maxX, float maxY,
+                             float cellSize, uint32_t maxItems,
+                             uint32_t maxContacts)
+    : minX_(minX), minY_(minY), invCellSize_(1.0f / cellSize),
+      width_(std::max(1u, static_cast<uint32_t>(
+                              std::ceil((maxX - minX) / cellSize)))),
+      height_(std::max(1u, static_cast<uint32_t>(
+                               std::ceil((maxY - minY) / cellSize)))),
+      maxItems_(maxItems) {
+  cellStart_.resize(static_cast<size_t>(width_) * height_ + 1);
+  cellCursor_.resize(static_cast<size_t>(width_) * height_);
+  itemCell_.resize(maxItems);
+  sortedX_.resize(maxItems);
+  sortedY_.resize(maxItems);
+  sortedRadius_.resize(maxItems);
+  sortedItem_.resize(maxItems);
+  contacts_.resize(maxContacts);
+}
+
+uint32_t CollisionGrid::cellX(float x) const {
+  float cell = std::clamp((x - minX_) * invCellSize_, 0.0f,
+                          static_cast<float>(width_ - 1));
+  return static_cast<uint32_t>(cell);
+}
+
+uint32_t CollisionGrid::cellY(float y) const {
+  float cell = std::clamp((y - minY_) * invCellSize_, 0.0f,
+                          static_cast<float>(height_ - 1));
+  return static_cast<uint32_t>(cell);
+}
+
+void CollisionGrid::build(const float *x, const float *y, const float *radius,
+                          uint32_t count) {
+  HK_ZONE("CollisionGrid::build");
+  itemCount_ = std::min(count, maxItems_);
+  maxRadius_ = 0.0f;
+  std::fill(cellStart_.begin(), cellStart_.end(), 0);
+
+  // Count the items of every cell, shifted by one so the prefix sum below
+  // directly turns the counts into start offsets.
+  for (uint32_t i = 0; i < itemCount_; i++) {
+    uint32_t cell = cellY(y[i]) * width_ + cellX(x[i]);
+    itemCell_[i] = cell;
+    cellStart_[cell + 1]++;
+    maxRadius_ = std::max(maxRadius_, radius[i]);
+  }
+
+  for (size_t cell = 1; cell < cellStart_.size(); cell++) {
+    cellStart_[cell] += cellStart_[cell - 1];
+  }
+
+  std::copy(cellStart_.begin(), cellStart_.end() - 1, cellCursor_.begin());
+
+  for (uint32_t i = 0; i < itemCount_; i++) {
+    uint32_t slot = cellCursor_[itemCell_[i]]++;
+    sortedX_[slot] = x[i];
+    sortedY_[slot] = y[i];
+    sortedRadius_[slot] = radius[i];
+    sortedItem_[slot] = i;
+  }
+}
+
+void CollisionGrid::build(const BulletPool &pool) {
+  const BulletArrays &bullets = pool.arrays();
+  build(bullets.x, bullets.y, bullets.radius, pool.size());
+}
+
+void CollisionGrid::query(std::span<const CollisionHitbox> hitboxes) {
+  HK_ZONE("CollisionGrid::query");
+  if (itemCount_ == 0) {
+    return;
+  }
+
+  ContactSink sink{contacts_.data(), static_cast<uint32_t>(contacts_.size()),
+                   contactCount_, droppedContacts_};
+  queryRange(hitboxes, sink);
+  contactCount_ = sink.count;
+  droppedContacts_ = sink.dropped;
+}
+
+void CollisionGrid::queryParallel(std::span<const CollisionHitbox> hitboxes,
+                                  uint32_t grain) {
+  HK_ZONE("CollisionGrid::queryParallel");
+  if (itemCount_ == 0 || hitboxes.empty()) {
+    return;
+  }
+
+  grain = std::max(grain, 1u);
+  const uint32_t hitboxCount = static_cast<uint32_t>(hitboxes.size());
+  const uint32_t groupCount =
+      std::min((hitboxCount + grain - 1) / grain, JobSystem::threadCount() * 2);
+  if (groupCount <= 1) {
+    query(hitboxes);
+    return;
+  }
+
+  // Every group may fill what is left of the real buffer on its own, the
+  // merge below drops whatever does not fit in the end.
+  const uint32_t room = static_cast<uint32_t>(contacts_.size()) - contactCount_;
+  if (groupContacts_.size() < groupCount) {
+    groupContacts_.resize(groupCount);
+    groupSinks_.resize(groupCount);
+  }
+
+  for (uint32_t group = 0; group < groupCount; group++) {
+    if (groupContacts_[group].size() < room) {
+      groupContacts_[group].resize(room);
+    }
+    groupSinks_[group] = {groupContacts_[group].data(), room, 0, 0};
+  }
+
+  const uint32_t perGroup = (hitboxCount + groupCount - 1) / groupCount;
+  JobSystem::parallelFor(
+      0, groupCount, 1,
+      [this, hitboxes, perGroup](uint32_t begin, uint32_t end) {
+        for (uint32_t group = begin; group < end; group++) {
+          const size_t first = static_cast<size_t>(group) * perGroup;
+          if (first < hitboxes.size()) {
+            queryRange(hitboxes.subspan(
+                           first, std::min<size_t>(perGroup,
+                                                   hitboxes.size() - first)),
+                       groupSinks_[group]);
+          }
+        }
+      },
+      1);
+
+  // Merging in group order keeps the contacts sorted like query() would.
+  for (uint32_t group = 0; group < groupCount; group++) {
+    const ContactSink &sink = groupSinks_[group];
+    const uint32_t copied =
+        std::min(sink.count,
+                 static_cast<uint32_t>(contacts_.size()) - contactCount_);
+    std::copy_n(sink.contacts, copied, contacts_.begin() + contactCount_);
+    contactCount_ += copied;
+    droppedContacts_ += sink.count - copied + sink.dropped;
+  }
+}
+
+void CollisionGrid::queryRange(std::span<const CollisionHitbox> hitboxes,
+                               ContactSink &sink) const {
+  for (const CollisionHitbox &hitbox : hitboxes) {
+    if (hitbox.shape == HitboxShape::CAPSULE) {
+      queryCapsule(hitbox, sink);
+    }
+
+    else {
+      queryCircle(hitbox, sink);
+    }
+  }
+}
+
+void CollisionGrid::queryCircle(const CollisionHitbox &hitbox,
+                                ContactSink &sink) const {
+  // Items are binned by their center, so grow the search by the largest item.
+  float reach = hitbox.radius + maxRadius_;
+  uint32_t x0 = cellX(hitbox.x0 - reach);
+  uint32_t x1 = cellX(hitbox.x0 + reach);
+  uint32_t y0 = cellY(hitbox.y0 - reach);
+  uint32_t y1 = cellY(hitbox.y0 + reach);
+
+  for (uint32_t row = y0; row <= y1; row++) {
+    testCircle(cellStart_[row * width_ + x0],
+               cellStart_[row * width_ + x1 + 1], hitbox, sink);
+  }
+}
+
+void CollisionGrid::queryCapsule(const CollisionHitbox &hitbox,
+                                 ContactSink &sink) const {
+  float reach = hitbox.radius + maxRadius_;
+  uint32_t x0 = cellX(std::min(hitbox.x0, hitbox.x1) - reach);
+  uint32_t x1 = cellX(std::max(hitbox.x0, hitbox.x1) + reach);
+  uint32_t y0 = cellY(std::min(hitbox.y0, hitbox.y1) - reach);
+  uint32_t y1 = cellY(std::max(hitbox.y0, hitbox.y1) + reach);
+
+  for (uint32_t row = y0; row <= y1; row++) {
+    testCapsule(cellStart_[row * width_ + x0],
+                cellStart_[row * width_ + x1 + 1], hitbox, sink);
+  }
+}
+
+void CollisionGrid::emit(uint32_t sortedIndex, uint32_t hitbox,
+                         ContactSink &sink) const {
+  if (sink.count == sink.capacity) {
+    sink.dropped++;
+    return;
+  }
+
+  sink.contacts[sink.count++] = {sortedItem_[sortedIndex], hitbox};
+}
+
+void CollisionGrid::testCircle(uint32_t begin, uint32_t end,
+                               const CollisionHitbox &hitbox,
+                               ContactSink &sink) const {
+  const float *xs = sortedX_.data();
+  const float *ys = sortedY_.data();
+  const float *rs = sortedRadius_.data();
+  uint32_t i = begin;
+
+#if defined(__x86_64__) || defined(_M_X64)
+  const __m128 cx = _mm_set1_ps(hitbox.x0);
+  const __m128 cy = _mm_set1_ps(hitbox.y0);
+  const __m128 r = _mm_set1_ps(hitbox.radius);
+
+  for (; i + 4 <= end; i += 4) {
+    __m128 dx = _mm_sub_ps(_mm_loadu_ps(xs + i), cx);
+    __m128 dy = _mm_sub_ps(_mm_loadu_ps(ys + i), cy);
+    __m128 reach = _mm_add_ps(_mm_loadu_ps(rs + i), r);
+    __m128 distSq = _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy));
+
+    // Hits are rare, so the common case is a single compare and branch for
+    // four items.
+    uint32_t hits = static_cast<uint32_t>(
+        _mm_movemask_ps(_mm_cmple_ps(distSq, _mm_mul_ps(reach, reach))));
+    while (hits) {
+      emit(i + std::countr_zero(hits), hitbox.id, sink);
+      hits &= hits - 1;
+    }
+  }
+#endif
+
+  for (; i < end; i++) {
+    float dx = xs[i] - hitbox.x0;
+    float dy = ys[i] - hitbox.y0;
+    float reach = rs[i] + hitbox.radius;
+    if (dx * dx + dy * dy <= reach * reach) {
+      emit(i, hitbox.id, sink);
+    }
+  }
+}
+
+void CollisionGrid::testCapsule(uint32_t begin, uint32_t end,
+                                const CollisionHitbox &hitbox,
+                                ContactSink &sink) const {
+  const float *xs = sortedX_.data();
+  const float *ys = sortedY_.data();
+  const float *rs = sortedRadius_.data();
+
+  // Distance to the closest point of the segment, t is clamped to [0, 1].
+  float abx = hitbox.x1 - hitbox.x0;
+  float aby = hitbox.y1 - hitbox.y0;
+  float lengthSq = abx * abx + aby * aby;
+  float invLengthSq = lengthSq > 0.0f ? 1.0f / lengthSq : 0.0f;
+  uint32_t i = begin;
+
+#if defined(__x86_64__) || defined(_M_X64)
+  const __m128 ax = _mm_set1_ps(hitbox.x0);
+  const __m128 ay = _mm_set1_ps(hitbox.y0);
+  const __m128 vabx = _mm_set1_ps(abx);
+  const __m128 vaby = _mm_set1_ps(aby);
+  const __m128 invLen = _mm_set1_ps(invLengthSq);
+  const __m128 r = _mm_set1_ps(hitbox.radius);
+  const __m128 zero = _mm_setzero_ps();
+  const __m128 one = _mm_set1_ps(1.0f);
+
+  for (; i + 4 <= end; i += 4) {
+    __m128 apx = _mm_sub_ps(_mm_loadu_ps(xs + i), ax);
+    __m128 apy = _mm_sub_ps(_mm_loadu_ps(ys + i), ay);
+    __m128 t = _mm_mul_ps(
+        _mm_add_ps(_mm_mul_ps(apx, vabx), _mm_mul_ps(apy, vaby)), invLen);
+    t = _mm_min_ps(_mm_max_ps(t, zero), one);
+
+    __m128 dx = _mm_sub_ps(apx, _mm_mul_ps(vabx, t));
+    __m128 dy = _mm_sub_ps(apy, _mm_mul_ps(vaby, t));
+    __m128 reach = _mm_add_ps(_mm_loadu_ps(rs + i), r);
+    __m128 distSq = _mm_add_ps(_mm_mul_ps(dx, dx), _mm_mul_ps(dy, dy));
+
+    uint32_t hits = static_cast<uint32_t>(
+        _mm_movemask_ps(_mm_cmple_ps(distSq, _mm_mul_ps(reach, reach))));
+    while (hits) {
+      emit(i + std::countr_zero(hits), hitbox.id, sink);
+      hits &= hits - 1;
+    }
+  }
+#endif
+
+  for (; i < end; i++) {
+    float apx = xs[i] - hitbox.x0;
+    float apy = ys[i] - hitbox.y0;
+    float t = std::clamp((apx * abx + apy * aby) * invLengthSq, 0.0f, 1.0f);
+    float dx = apx - abx * t;
+    float dy = apy - aby * t;
+    float reach = rs[i] + hitbox.radius;
+    if (dx * dx + dy * dy <= reach * reach) {
+      emit(i, hitbox.id, sink);
+    }
+  }
+}
@@ -0,0 +1,129 @@
+#pragma once
+
+#include "bullet_pool.hpp"
+
+#include <cstdint>
+#include <span>
+#include <vector>
+
+enum class HitboxShape { CIRCLE, CAPSULE };
+
+struct CollisionHitbox {
+  HitboxShape shape = HitboxShape::CIRCLE;
+
+  /// @brief Center of a circle, or the first end of a capsule's segment.
+  float x0 = 0.0f;
+  float y0 = 0.0f;
+
+  /// @brief Second end of a capsule's segment, ignored for circles.
+  float x1 = 0.0f;
+  float y1 = 0.0f;
+
+  float radius = 0.0f;
+
+  /// @brief Copied into every contact this hitbox produces.
+  uint32_t id = 0;
+};
+
+struct CollisionContact {
+  /// @brief Index of the item as passed to build(), for a pool this is the
+  /// bullet index until the next compact().
+  uint32_t item;
+
+  /// @brief CollisionHitbox::id of the hitbox that was hit.
+  uint32_t hitbox;
+};
+
+/// Uniform grid over many small circles (bullets, player shots) that is
+/// queried with a few hitboxes (player, enemies). It is rebuilt from scratch
+/// every tick with a counting sort, which leaves the items of every grid row
+/// contiguous in memory, so the narrow phase is a linear SIMD scan.
+///
+/// Items outside the covered area are clamped into the border cells, so they
+/// are still found, just less efficiently.
+class CollisionGrid {
+public:
+  CollisionGrid(float minX, float minY, float maxX, float maxY, float cellSize,
+                uint32_t maxItems, uint32_t maxContacts);
+
+  /// @brief Sorts the items into the grid. Items past maxItems are ignored.
+  void build(const float *x, const float *y, const float *radius,
+             uint32_t count);
+  void build(const BulletPool &pool);
+
+  /// @brief Tests every hitbox against the grid and appends the overlaps to
+  /// the contact buffer.
+  void query(std::span<const CollisionHitbox> hitboxes);
+
+  /// @brief query() with the hitboxes split into groups of at least `grain`
+  /// that run on the job system. The contacts end up in the same order as
+  /// with query().
+  void queryParallel(std::span<const CollisionHitbox> hitboxes,
+                     uint32_t grain = 8);
+
+  std::span<const CollisionContact> contacts() const {
+    return {contacts_.data(), contactCount_};
+  }
+
+  /// @brief Contacts that did not fit into the buffer since the last clear.
+  uint32_t droppedContacts() const { return droppedContacts_; }
+
+  void clearContacts() {
+    contactCount_ = 0;
+    droppedContacts_ = 0;
+  }
+
+  uint32_t itemCount() const { return itemCount_; }
+
+private:
+  /// Where the narrow phase writes its contacts, either the grid's own buffer
+  /// or the buffer of one parallel group.
+  struct ContactSink {
+    CollisionContact *contacts;
+    uint32_t capacity;
+    uint32_t count;
+    uint32_t dropped;
+  };
+
+  uint32_t cellX(float x) const;
+  uint32_t cellY(float y) const;
+
+  void queryRange(std::span<const CollisionHitbox> hitboxes,
+                  ContactSink &sink) const;
+  void queryCircle(const CollisionHitbox &hitbox, ContactSink &sink) const;
+  void queryCapsule(const CollisionHitbox &hitbox, ContactSink &sink) const;
+  void testCircle(uint32_t begin, uint32_t end, const CollisionHitbox &hitbox,
+                  ContactSink &sink) const;
+  void testCapsule(uint32_t begin, uint32_t end, const CollisionHitbox &hitbox,
+                   ContactSink &sink) const;
+  void emit(uint32_t sortedIndex, uint32_t hitbox, ContactSink &sink) const;
+
+  float minX_;
+  float minY_;
+  float invCellSize_;
+  uint32_t width_;
+  uint32_t height_;
+
+  uint32_t maxItems_;
+  uint32_t itemCount_ = 0;
+  float maxRadius_ = 0.0f;
+
+  /// Start of every cell in the sorted arrays, plus one past the end.
+  std::vector<uint32_t> cellStart_;
+  std::vector<uint32_t> cellCursor_;
+  std::vector<uint32_t> itemCell_;
+
+  // Items in cell order.
+  std::vector<float> sortedX_;
+  std::vector<float> sortedY_;
+  std::vector<float> sortedRadius_;
+  std::vector<uint32_t> sortedItem_;
+
+  std::vector<CollisionContact> contacts_;
+  uint32_t contactCount_ = 0;
+  uint32_t droppedContacts_ = 0;
+
+  // Per group buffers of queryParallel(), kept to avoid allocating every tick
+  std::vector<std::vector<CollisionContact>> groupContacts_;
+  std::vector<ContactSink> groupSinks_;
+};
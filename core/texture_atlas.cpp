@@ -0,0 +1,341 @@
+#include "texture_atlas.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <format>
+#include <limits>
+#include <stdexcept>
+#include <utility>
+
+// Only throws, hakkero-assetpack builds this file without the logger.
+namespace {
+template <typename T>
+void append(std::vector<std::byte> &out, const T *data, size_t count) {
+  const auto *bytes = reinterpret_cast<const std::byte *>(data);
+  out.insert(out.end(), bytes, bytes + count * sizeof(T));
+}
+
+// Checked before anything is allocated for the section, the counts come
+// straight from the blob.
+template <typename T>
+const std::byte *consume(std::span<const std::byte> data, size_t &offset,
+                         size_t count) {
+  if (offset > data.size() || count > (data.size() - offset) / sizeof(T)) {
+    throw std::runtime_error("The atlas blob is truncated.");
+  }
+
+  const std::byte *start = data.data() + offset;
+  offset += count * sizeof(T);
+  return start;
+}
+} // namespace
+
+AtlasRect unionRect(const AtlasRect &a, const AtlasRect &b) {
+  if (a.empty()) {
+    return b;
+  }
+
+  if (b.empty()) {
+    return a;
+  }
+
+  const uint32_t x0 = std::min(a.x, b.x);
+  const uint32_t y0 = std::min(a.y, b.y);
+  const uint32_t x1 = std::max(a.x + a.width, b.x + b.width);
+  const uint32_t y1 = std::max(a.y + a.height, b.y + b.height);
+  return {x0, y0, x1 - x0, y1 - y0};
+}
+
+SkylinePacker::SkylinePacker(uint32_t width, uint32_t height)
+    : width_(width), height_(height) {
+  reset();
+}
+
+SkylinePacker::SkylinePacker(uint32_t width, uint32_t height,
+                             std::vector<Node> skyline)
+    : width_(width), height_(height), skyline_(std::move(skyline)) {
+  // The segments have to cover the width without gaps, fit() relies on it.
+  uint32_t x = 0;
+  for (const Node &node : skyline_) {
+    if (node.x != x || node.width == 0 || node.y > height_) {
+      throw std::runtime_error("The skyline does not cover the atlas.");
+    }
+    x += node.width;
+  }
+
+  if (x != width_) {
+    throw std::runtime_error("The skyline does not cover the atlas.");
+  }
+}
+
+void SkylinePacker::reset() {
+  skyline_.clear();
+  if (width_ > 0 && height_ > 0) {
+    skyline_.push_back({0, 0, width_});
+  }
+}
+
+float SkylinePacker::occupancy() const {
+  if (width_ == 0 || height_ == 0) {
+    return 0.0f;
+  }
+
+  uint64_t area = 0;
+  for (const Node &node : skyline_) {
+    area += static_cast<uint64_t>(node.y) * node.width;
+  }
+  return static_cast<float>(area) /
+         (static_cast<float>(width_) * static_cast<float>(height_));
+}
+
+// The lowest y a rectangle starting at the segment can sit at.
+std::optional<uint32_t> SkylinePacker::fit(size_t index, uint32_t width,
+                                           uint32_t height) const {
+  const uint32_t x = skyline_[index].x;
+  if (width > width_ - x) {
+    return std::nullopt;
+  }
+
+  // The segments cover the whole width, so they never run out before the
+  // rectangle does.
+  uint32_t y = 0;
+  uint32_t remaining = width;
+  for (size_t i = index; remaining > 0; i++) {
+    y = std::max(y, skyline_[i].y);
+    if (height > height_ - y) {
+      return std::nullopt;
+    }
+    remaining -= std::min(remaining, skyline_[i].width);
+  }
+  return y;
+}
+
+std::optional<AtlasRect> SkylinePacker::insert(uint32_t width,
+                                               uint32_t height) {
+  if (width == 0 || height == 0) {
+    return std::nullopt;
+  }
+
+  // Lowest position first, the narrower segment on ties so wide gaps stay
+  // open for wide rectangles.
+  size_t best = skyline_.size();
+  uint32_t bestY = std::numeric_limits<uint32_t>::max();
+  uint32_t bestWidth = std::numeric_limits<uint32_t>::max();
+  for (size_t i = 0; i < skyline_.size(); i++) {
+    std::optional<uint32_t> y = fit(i, width, height);
+    if (y && (*y < bestY || (*y == bestY && skyline_[i].width < bestWidth))) {
+      best = i;
+      bestY = *y;
+      bestWidth = skyline_[i].width;
+    }
+  }
+
+  if (best == skyline_.size()) {
+    return std::nullopt;
+  }
+
+  const AtlasRect rect{skyline_[best].x, bestY, width, height};
+  skyline_.insert(skyline_.begin() + static_cast<ptrdiff_t>(best),
+                  {rect.x, rect.y + height, width});
+
+  // The segments the rectangle now covers shrink or go away.
+  const uint32_t end = rect.x + width;
+  for (size_t i = best + 1; i < skyline_.size();) {
+    Node &node = skyline_[i];
+    if (node.x >= end) {
+      break;
+    }
+
+    const uint32_t covered = end - node.x;
+    if (node.width <= covered) {
+      skyline_.erase(skyline_.begin() + static_cast<ptrdiff_t>(i));
+      continue;
+    }
+
+    node.x += covered;
+    node.width -= covered;
+    break;
+  }
+
+  for (size_t i = 0; i + 1 < skyline_.size();) {
+    if (skyline_[i].y == skyline_[i + 1].y) {
+      skyline_[i].width += skyline_[i + 1].width;
+      skyline_.erase(skyline_.begin() + static_cast<ptrdiff_t>(i + 1));
+    }
+
+    else {
+      i++;
+    }
+  }
+
+  return rect;
+}
+
+AtlasBuilder::AtlasBuilder(uint32_t width, uint32_t height, uint32_t padding)
+    : packer_(width, height), padding_(padding),
+      pixels_(static_cast<size_t>(width) * height, 0) {}
+
+AtlasBuilder AtlasBuilder::parse(std::span<const std::byte> data) {
+  size_t offset = 0;
+  AtlasFileHeader header;
+  std::memcpy(&header, consume<AtlasFileHeader>(data, offset, 1),
+              sizeof(header));
+  if (std::memcmp(header.magic, ATLAS_FILE_MAGIC, sizeof(header.magic)) !=
+          0 ||
+      header.version != ATLAS_FILE_VERSION) {
+    throw std::runtime_error(
+        std::format("Not a version {} atlas blob.", ATLAS_FILE_VERSION));
+  }
+
+  const std::byte *storedSprites =
+      consume<AtlasFileSprite>(data, offset, header.spriteCount);
+  std::vector<AtlasFileSprite> sprites(header.spriteCount);
+  std::memcpy(sprites.data(), storedSprites,
+              sprites.size() * sizeof(AtlasFileSprite));
+
+  const std::byte *storedSkyline =
+      consume<AtlasFileSkylineNode>(data, offset, header.skylineCount);
+  std::vector<SkylinePacker::Node> skyline(header.skylineCount);
+  for (size_t i = 0; i < skyline.size(); i++) {
+    AtlasFileSkylineNode stored;
+    std::memcpy(&stored, storedSkyline + i * sizeof(stored), sizeof(stored));
+    skyline[i] = {stored.x, stored.y, stored.width};
+  }
+
+  const char *names =
+      reinterpret_cast<const char *>(consume<char>(data, offset,
+                                                   header.namesSize));
+
+  const size_t pixelCount = static_cast<size_t>(header.width) * header.height;
+  const std::byte *storedPixels = consume<uint32_t>(data, offset, pixelCount);
+
+  AtlasBuilder atlas;
+  atlas.packer_ =
+      SkylinePacker(header.width, header.height, std::move(skyline));
+  atlas.padding_ = header.padding;
+  atlas.pixels_.resize(pixelCount);
+  std::memcpy(atlas.pixels_.data(), storedPixels,
+              pixelCount * sizeof(uint32_t));
+
+  for (const AtlasFileSprite &sprite : sprites) {
+    if (static_cast<uint64_t>(sprite.nameOffset) + sprite.nameLength >
+            header.namesSize ||
+        sprite.x > header.width || sprite.width > header.width - sprite.x ||
+        sprite.y > header.height || sprite.height > header.height - sprite.y) {
+      throw std::runtime_error("An atlas sprite points outside of the blob.");
+    }
+
+    atlas.sprites_.emplace(
+        std::string(names + sprite.nameOffset, sprite.nameLength),
+        AtlasRect{sprite.x, sprite.y, sprite.width, sprite.height});
+  }
+
+  // Nothing has been uploaded yet.
+  atlas.dirty_ = {0, 0, header.width, header.height};
+  return atlas;
+}
+
+std::optional<AtlasRect> AtlasBuilder::add(const uint32_t *pixels,
+                                           uint32_t width, uint32_t height,
+                                           uint32_t rowLength) {
+  if (width == 0 || height == 0) {
+    return std::nullopt;
+  }
+
+  std::optional<AtlasRect> padded =
+      packer_.insert(width + 2 * padding_, height + 2 * padding_);
+  if (!padded) {
+    return std::nullopt;
+  }
+
+  // The padding repeats the closest edge texel, the corners the corners.
+  const uint32_t stride = rowLength ? rowLength : width;
+  for (uint32_t y = 0; y < padded->height; y++) {
+    const uint32_t sourceY =
+        std::min(y > padding_ ? y - padding_ : 0, height - 1);
+    const uint32_t *source = pixels + static_cast<size_t>(sourceY) * stride;
+    uint32_t *row = pixels_.data() +
+                    static_cast<size_t>(padded->y + y) * packer_.width() +
+                    padded->x;
+
+    for (uint32_t x = 0; x < padded->width; x++) {
+      row[x] = source[std::min(x > padding_ ? x - padding_ : 0, width - 1)];
+    }
+  }
+
+  dirty_ = unionRect(dirty_, *padded);
+  return AtlasRect{padded->x + padding_, padded->y + padding_, width, height};
+}
+
+std::optional<AtlasRect> AtlasBuilder::add(const std::string &name,
+                                           const uint32_t *pixels,
+                                           uint32_t width, uint32_t height,
+                                           uint32_t rowLength) {
+  if (sprites_.contains(name)) {
+    throw std::runtime_error(
+        std::format("The atlas already has a sprite named {}.", name));
+  }
+
+  std::optional<AtlasRect> rect = add(pixels, width, height, rowLength);
+  if (rect) {
+    sprites_.emplace(name, *rect);
+  }
+  return rect;
+}
+
+std::optional<AtlasRect> AtlasBuilder::find(std::string_view name) const {
+  auto sprite = sprites_.find(name);
+  if (sprite == sprites_.end()) {
+    return std::nullopt;
+  }
+  return sprite->second;
+}
+
+std::array<float, 4> AtlasBuilder::uvRect(const AtlasRect &rect) const {
+  const float width = static_cast<float>(packer_.width());
+  const float height = static_cast<float>(packer_.height());
+  return {rect.x / width, rect.y / height, (rect.x + rect.width) / width,
+          (rect.y + rect.height) / height};
+}
+
+AtlasRect AtlasBuilder::takeDirty() { return std::exchange(dirty_, {}); }
+
+std::vector<std::byte> AtlasBuilder::serialize() const {
+  std::string names;
+  std::vector<AtlasFileSprite> sprites;
+  sprites.reserve(sprites_.size());
+  for (const auto &[name, rect] : sprites_) {
+    sprites.push_back({static_cast<uint32_t>(names.size()),
+                       static_cast<uint32_t>(name.size()), rect.x, rect.y,
+                       rect.width, rect.height});
+    names += name;
+  }
+  names.resize((names.size() + 3) & ~size_t{3}, '\0');
+
+  std::vector<AtlasFileSkylineNode> skyline;
+  skyline.reserve(packer_.skyline().size());
+  for (const SkylinePacker::Node &node : packer_.skyline()) {
+    skyline.push_back({node.x, node.y, node.width});
+  }
+
+  AtlasFileHeader header{};
+  std::memcpy(header.magic, ATLAS_FILE_MAGIC, sizeof(header.magic));
+  header.version = ATLAS_FILE_VERSION;
+  header.width = packer_.width();
+  header.height = packer_.height();
+  header.padding = padding_;
+  header.spriteCount = static_cast<uint32_t>(sprites.size());
+  header.skylineCount = static_cast<uint32_t>(skyline.size());
+  header.namesSize = static_cast<uint32_t>(names.size());
+
+  std::vector<std::byte> out;
+  out.reserve(sizeof(header) + sprites.size() * sizeof(AtlasFileSprite) +
+              skyline.size() * sizeof(AtlasFileSkylineNode) + names.size() +
+              pixels_.size() * sizeof(uint32_t));
+  append(out, &header, 1);
+  append(out, sprites.data(), sprites.size());
+  append(out, skyline.data(), skyline.size());
+  append(out, names.data(), names.size());
+  append(out, pixels_.data(), pixels_.size());
+  return out;
+}
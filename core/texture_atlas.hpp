@@ -0,0 +1,163 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <optional>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/// Layout of an atlas blob, written by hakkero-assetpack for atlas:name=dir
+/// arguments and by AtlasBuilder::serialize(). All integers are little endian.
+///
+///   AtlasFileHeader
+///   AtlasFileSprite[spriteCount], sorted by name
+///   AtlasFileSkylineNode[skylineCount]
+///   names, not null terminated, padded to 4 bytes (namesSize includes it)
+///   width * height RGBA8 pixels
+constexpr char ATLAS_FILE_MAGIC[8] = {'H', 'K', 'A', 'T', 'L', 'A', 'S', '1'};
+constexpr uint32_t ATLAS_FILE_VERSION = 1;
+
+struct AtlasFileHeader {
+  char magic[8];
+  uint32_t version;
+  uint32_t width;
+  uint32_t height;
+  uint32_t padding;
+  uint32_t spriteCount;
+  uint32_t skylineCount;
+  uint32_t namesSize;
+  uint32_t reserved[3];
+};
+static_assert(sizeof(AtlasFileHeader) == 48);
+
+struct AtlasFileSprite {
+  uint32_t nameOffset;
+  uint32_t nameLength;
+  uint32_t x;
+  uint32_t y;
+  uint32_t width;
+  uint32_t height;
+};
+static_assert(sizeof(AtlasFileSprite) == 24);
+
+/// @brief The packer's state is stored as well, so a loaded atlas can keep
+/// taking images at runtime.
+struct AtlasFileSkylineNode {
+  uint32_t x;
+  uint32_t y;
+  uint32_t width;
+};
+static_assert(sizeof(AtlasFileSkylineNode) == 12);
+
+/// @brief A rectangle in texels, the origin is the top left corner.
+struct AtlasRect {
+  uint32_t x = 0;
+  uint32_t y = 0;
+  uint32_t width = 0;
+  uint32_t height = 0;
+
+  bool empty() const { return width == 0 || height == 0; }
+  bool operator==(const AtlasRect &) const = default;
+};
+
+/// @brief The smallest rectangle containing both, empty ones are ignored.
+AtlasRect unionRect(const AtlasRect &a, const AtlasRect &b);
+
+/// Bottom-left skyline packer. The packed area is described by its top edge,
+/// a list of horizontal segments, and every rectangle goes where it ends up
+/// lowest. Inserting is linear in the number of segments, which stays small
+/// for sprite-sized rectangles, and space below the skyline is never reused.
+class SkylinePacker {
+public:
+  struct Node {
+    uint32_t x;
+    uint32_t y;
+    uint32_t width;
+  };
+
+  SkylinePacker() = default;
+  SkylinePacker(uint32_t width, uint32_t height);
+
+  /// @brief Restores a packer from its skyline(), e.g. a loaded atlas'.
+  SkylinePacker(uint32_t width, uint32_t height, std::vector<Node> skyline);
+
+  /// @brief Finds room for a width x height rectangle, nullopt if there is
+  /// none left.
+  std::optional<AtlasRect> insert(uint32_t width, uint32_t height);
+
+  /// @brief Forgets every rectangle.
+  void reset();
+
+  uint32_t width() const { return width_; }
+  uint32_t height() const { return height_; }
+  const std::vector<Node> &skyline() const { return skyline_; }
+
+  /// @brief Share of the area below the skyline, wasted space included.
+  float occupancy() const;
+
+private:
+  std::optional<uint32_t> fit(size_t index, uint32_t width,
+                              uint32_t height) const;
+
+  uint32_t width_ = 0;
+  uint32_t height_ = 0;
+  std::vector<Node> skyline_;
+};
+
+/// An RGBA8 atlas image in memory that small images get packed into, red in
+/// the lowest byte like packColor(). Every image is surrounded by padding
+/// texels repeating its edges, so neither linear filtering nor the smaller
+/// mips pull in the neighbours. Doesn't touch Vulkan, hakkero-assetpack uses
+/// it to bake atlases and TextureAtlas to upload them.
+class AtlasBuilder {
+public:
+  AtlasBuilder() = default;
+  AtlasBuilder(uint32_t width, uint32_t height, uint32_t padding = 2);
+
+  /// @brief Parses an atlas blob, throws if it is malformed.
+  static AtlasBuilder parse(std::span<const std::byte> data);
+
+  /// @brief Copies the image into the atlas. rowLength is the row length of
+  /// pixels in texels, 0 if tightly packed. Returns where the image ended up,
+  /// without the padding, or nullopt if the atlas is full.
+  std::optional<AtlasRect> add(const uint32_t *pixels, uint32_t width,
+                               uint32_t height, uint32_t rowLength = 0);
+
+  /// @brief Same, but the image can be looked up with find() later and is
+  /// written out by serialize(). Throws if the name is already taken.
+  std::optional<AtlasRect> add(const std::string &name, const uint32_t *pixels,
+                               uint32_t width, uint32_t height,
+                               uint32_t rowLength = 0);
+
+  std::optional<AtlasRect> find(std::string_view name) const;
+
+  /// @brief Texture coordinates of rect as in sprite_instance::uvRect.
+  std::array<float, 4> uvRect(const AtlasRect &rect) const;
+
+  /// @brief Everything written since the last call, padding included. Empty
+  /// if nothing changed.
+  AtlasRect takeDirty();
+  bool isDirty() const { return !dirty_.empty(); }
+
+  std::vector<std::byte> serialize() const;
+
+  uint32_t width() const { return packer_.width(); }
+  uint32_t height() const { return packer_.height(); }
+  uint32_t padding() const { return padding_; }
+  const std::vector<uint32_t> &pixels() const { return pixels_; }
+  const std::map<std::string, AtlasRect, std::less<>> &sprites() const {
+    return sprites_;
+  }
+  const SkylinePacker &packer() const { return packer_; }
+
+private:
+  SkylinePacker packer_;
+  uint32_t padding_ = 0;
+  std::vector<uint32_t> pixels_;
+  std::map<std::string, AtlasRect, std::less<>> sprites_;
+  AtlasRect dirty_;
+};
@@ -1,10 +1,16 @@
 #include "time_utils.hpp"
 #include <iomanip>
 #include <sstream>
+#include <thread>
 
 TimeUtils::TimeData TimeUtils::captureCurrentTime() {
+  return fromTimePoint(std::chrono::system_clock::now());
+}
+
+TimeUtils::TimeData
+TimeUtils::fromTimePoint(std::chrono::system_clock::time_point tp) {
   TimeData td;
-  td.timePoint = std::chrono::system_clock::now();
+  td.timePoint = tp;
   td.timeT = std::chrono::system_clock::to_time_t(td.timePoint);
   td.localTime = localtimeThreadSafe(td.timeT);
   return td;
@@ -27,3 +33,23 @@ std::string TimeUtils::formatAsHourMinSec(const TimeData &td) {
   ss << std::put_time(&td.localTime, "%H:%M:%S");
   return ss.str();
 }
+
+int64_t TimeUtils::steadyNowNs() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+void TimeUtils::preciseSleepUntil(
+    std::chrono::steady_clock::time_point deadline,
+    std::chrono::nanoseconds spinThreshold) {
+  if (deadline - std::chrono::steady_clock::now() > spinThreshold) {
+    std::this_thread::sleep_until(deadline - spinThreshold);
+  }
+
+  // Yielding keeps the spin from starving other threads on the core while
+  // still waking up within microseconds.
+  while (std::chrono::steady_clock::now() < deadline) {
+    std::this_thread::yield();
+  }
+}
@@ -1,5 +1,6 @@
 #pragma once
 #include <chrono>
+#include <cstdint>
 #include <ctime>
 #include <string>
 
@@ -12,10 +13,21 @@ public:
   };
 
   static TimeData captureCurrentTime();
+  static TimeData fromTimePoint(std::chrono::system_clock::time_point tp);
 
   static std::string formatAsDate(const TimeData &td);
   static std::string formatAsHourMinSec(const TimeData &td);
 
+  /// @brief Nanoseconds on the steady clock. Only meaningful as a difference.
+  static int64_t steadyNowNs();
+
+  /// @brief Sleeps until deadline, or returns right away if it passed. The OS
+  /// sleep overshoots by up to a scheduler tick, so it only sleeps until
+  /// spinThreshold before the deadline and spins for the rest.
+  static void preciseSleepUntil(std::chrono::steady_clock::time_point deadline,
+                                std::chrono::nanoseconds spinThreshold =
+                                    std::chrono::milliseconds(1));
+
 private:
   static std::tm localtimeThreadSafe(std::time_t t);
 };
@@ -0,0 +1,120 @@
+#include "vulkan_atlas.hpp"
+#include "asset_archive.hpp"
+#include "logger.hpp"
+
+#include <algorithm>
+#include <format>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+TextureAtlas::TextureAtlas(uint32_t width, uint32_t height, uint32_t padding,
+                           uint32_t mipLevels)
+    : TextureAtlas(AtlasBuilder(width, height, padding), mipLevels) {}
+
+TextureAtlas::TextureAtlas(AtlasBuilder builder, uint32_t mipLevels)
+    : builder_(std::move(builder)) {
+  // The first upload is the whole atlas, whatever is in it already.
+  texture_ = createTexture(builder_.pixels().data(), builder_.width(),
+                           builder_.height(), mipLevels);
+  builder_.takeDirty();
+}
+
+TextureAtlas TextureAtlas::load(std::string_view name, uint32_t mipLevels) {
+  AtlasBuilder builder;
+  try {
+    builder = AtlasBuilder::parse(getAssetArchive().read(name));
+  } catch (const std::exception &error) {
+    const std::string message =
+        std::format("Failed to load the atlas {}: {}", name, error.what());
+    LOG_ERROR(message);
+    throw std::runtime_error(message);
+  }
+
+  return TextureAtlas(std::move(builder), mipLevels);
+}
+
+TextureAtlas::~TextureAtlas() { destroyTexture(texture_); }
+
+TextureAtlas::TextureAtlas(TextureAtlas &&other) noexcept
+    : builder_(std::move(other.builder_)),
+      texture_(std::exchange(other.texture_, WHITE_TEXTURE)) {}
+
+TextureAtlas &TextureAtlas::operator=(TextureAtlas &&other) noexcept {
+  if (this != &other) {
+    destroyTexture(texture_);
+    builder_ = std::move(other.builder_);
+    texture_ = std::exchange(other.texture_, WHITE_TEXTURE);
+  }
+  return *this;
+}
+
+std::optional<atlas_region> TextureAtlas::add(const uint32_t *pixels,
+                                              uint32_t width, uint32_t height,
+                                              uint32_t rowLength) {
+  std::optional<AtlasRect> rect =
+      builder_.add(pixels, width, height, rowLength);
+  if (!rect) {
+    return std::nullopt;
+  }
+  return region(*rect);
+}
+
+std::optional<atlas_region> TextureAtlas::add(const std::string &name,
+                                              const uint32_t *pixels,
+                                              uint32_t width, uint32_t height,
+                                              uint32_t rowLength) {
+  std::optional<AtlasRect> rect =
+      builder_.add(name, pixels, width, height, rowLength);
+  if (!rect) {
+    return std::nullopt;
+  }
+  return region(*rect);
+}
+
+std::optional<atlas_region> TextureAtlas::find(std::string_view name) const {
+  std::optional<AtlasRect> rect = builder_.find(name);
+  if (!rect) {
+    return std::nullopt;
+  }
+  return region(*rect);
+}
+
+void TextureAtlas::flush() {
+  const AtlasRect dirty = builder_.takeDirty();
+  if (dirty.empty() || texture_ == WHITE_TEXTURE) {
+    return;
+  }
+
+  const VkRect2D target = {
+      {static_cast<int32_t>(dirty.x), static_cast<int32_t>(dirty.y)},
+      {dirty.width, dirty.height}};
+  const uint32_t *first = builder_.pixels().data() +
+                          static_cast<size_t>(dirty.y) * builder_.width() +
+                          dirty.x;
+
+  // Full rows are contiguous already. Otherwise the rows are gathered first,
+  // the staging ring would get the rest of every row as well.
+  if (dirty.width == builder_.width()) {
+    updateTexture(texture_, first, target);
+    return;
+  }
+
+  std::vector<uint32_t> rows(static_cast<size_t>(dirty.width) * dirty.height);
+  for (uint32_t y = 0; y < dirty.height; y++) {
+    std::copy_n(first + static_cast<size_t>(y) * builder_.width(),
+                dirty.width,
+                rows.data() + static_cast<size_t>(y) * dirty.width);
+  }
+  updateTexture(texture_, rows.data(), target);
+}
+
+atlas_region TextureAtlas::region(const AtlasRect &rect) const {
+  const std::array<float, 4> uv = builder_.uvRect(rect);
+
+  atlas_region result{};
+  result.rect = rect;
+  std::copy(uv.begin(), uv.end(), result.uvRect);
+  result.texture = texture_;
+  return result;
+}
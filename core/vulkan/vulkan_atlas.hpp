@@ -0,0 +1,78 @@
+#pragma once
+
+#include "texture_atlas.hpp"
+#include "vulkan_texture.hpp"
+
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+
+/// @brief Where an image ended up in a TextureAtlas, in the terms of
+/// sprite_instance.
+struct atlas_region {
+  AtlasRect rect;
+  float uvRect[4];
+  uint32_t texture;
+};
+
+/// One texture of the texture table backed by an AtlasBuilder. Images are
+/// packed on the CPU, flush() uploads only the rectangle that changed through
+/// the upload service's staging ring and the mips below it are blitted again
+/// on the GPU. Sprites sharing an atlas differ in their UVs only, so any mix
+/// of them stays one batch. On the texture array fallback the atlas has to fit
+/// into vulkan_texture_table::arrayExtent.
+class TextureAtlas {
+public:
+  TextureAtlas() = default;
+
+  /// @brief An empty atlas for images made at runtime, e.g. glyphs. Creates
+  /// the texture right away, so after vkInitialize() only.
+  TextureAtlas(uint32_t width, uint32_t height, uint32_t padding = 2,
+               uint32_t mipLevels = TEXTURE_MIP_CHAIN);
+
+  /// @brief Uploads an existing atlas, it can keep taking images.
+  explicit TextureAtlas(AtlasBuilder builder,
+                        uint32_t mipLevels = TEXTURE_MIP_CHAIN);
+
+  /// @brief Loads an atlas hakkero-assetpack baked into the mounted archive,
+  /// throws if it is missing or malformed.
+  static TextureAtlas load(std::string_view name,
+                           uint32_t mipLevels = TEXTURE_MIP_CHAIN);
+
+  ~TextureAtlas();
+
+  TextureAtlas(const TextureAtlas &) = delete;
+  TextureAtlas &operator=(const TextureAtlas &) = delete;
+  TextureAtlas(TextureAtlas &&other) noexcept;
+  TextureAtlas &operator=(TextureAtlas &&other) noexcept;
+
+  /// @brief Packs the image, see AtlasBuilder::add(). It shows up after the
+  /// next flush(), nullopt if the atlas is full.
+  std::optional<atlas_region> add(const uint32_t *pixels, uint32_t width,
+                                  uint32_t height, uint32_t rowLength = 0);
+  std::optional<atlas_region> add(const std::string &name,
+                                  const uint32_t *pixels, uint32_t width,
+                                  uint32_t height, uint32_t rowLength = 0);
+
+  std::optional<atlas_region> find(std::string_view name) const;
+
+  /// @brief Uploads everything added since the last call. Adding a batch of
+  /// images and flushing once keeps it to a single upload.
+  void flush();
+
+  /// @brief Whether the last flush() is visible to frames recorded from now
+  /// on.
+  bool isReady() const { return isTextureReady(texture_); }
+
+  uint32_t texture() const { return texture_; }
+  const AtlasBuilder &builder() const { return builder_; }
+
+private:
+  atlas_region region(const AtlasRect &rect) const;
+
+  AtlasBuilder builder_;
+
+  // WHITE_TEXTURE while there is no texture, destroyTexture() ignores it.
+  uint32_t texture_ = WHITE_TEXTURE;
+};
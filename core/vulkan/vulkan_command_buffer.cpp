@@ -1,70 +1,250 @@
 #include "vulkan_command_buffer.hpp"
+#include "job_system.hpp"
 #include "logger.hpp"
+#include "profiler.hpp"
+#include "vulkan_gpu_profiler.hpp"
+#include "vulkan_sprite.hpp"
+#include "vulkan_texture.hpp"
 #include "vulkan_types.hpp"
+#include "vulkan_upload.hpp"
 #include "vulkan_utils.hpp"
+#include <algorithm>
 #include <stdexcept>
 #include <vulkan/vulkan_core.h>
 
-void createCommandPool() {
+namespace {
+// Dynamic state is not inherited by secondary command buffers, so every one of
+// them sets it again.
+void setViewportAndScissor(VkCommandBuffer commandBuffer) {
+  vulkan_swapchain &vkSwapchain = getVulkanSwapchainStruct();
+
+  VkViewport viewport{};
+  viewport.x = 0.0f;
+  viewport.y = 0.0f;
+  viewport.width = static_cast<float>(vkSwapchain.extent.width);
+  viewport.height = static_cast<float>(vkSwapchain.extent.height);
+  viewport.minDepth = 0.0f;
+  viewport.maxDepth = 1.0f;
+  vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+
+  VkRect2D scissor{};
+  scissor.offset = {0, 0};
+  scissor.extent = vkSwapchain.extent;
+  vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+}
+
+// How many secondaries the sprites of this frame are split into, 0 records
+// them inline.
+uint32_t spriteSecondaryCount(const vulkan_frame_commands &frame) {
+  vulkan_command_buffer &vkCommandBuffer = getVulkanCommandBufferStruct();
+  vulkan_sprite_renderer &renderer = getVulkanSpriteRendererStruct();
+
+  const uint32_t threads = JobSystem::threadCount();
+  const uint32_t minBatches =
+      std::max(vkCommandBuffer.minBatchesPerSecondary, 1u);
+  const uint32_t batches = static_cast<uint32_t>(renderer.batches.size());
+
+  // Workers beyond the pools we created have nowhere to allocate from.
+  if (threads == 1 || threads > frame.threads.size() ||
+      batches < minBatches * 2) {
+    return 0;
+  }
+
+  return std::min(threads, batches / minBatches);
+}
+
+void recordSpritesParallel(uint32_t secondaryCount) {
+  vulkan_command_buffer &vkCommandBuffer = getVulkanCommandBufferStruct();
+  vulkan_sprite_renderer &renderer = getVulkanSpriteRendererStruct();
+
+  HK_ZONE("record sprites in parallel");
+  const uint32_t batches = static_cast<uint32_t>(renderer.batches.size());
+  const uint32_t perSecondary =
+      (batches + secondaryCount - 1) / secondaryCount;
+  vkCommandBuffer.recorded.assign(secondaryCount, VK_NULL_HANDLE);
+
+  JobSystem::parallelFor(
+      0, secondaryCount, 1,
+      [&vkCommandBuffer, perSecondary](uint32_t begin, uint32_t end) {
+        for (uint32_t i = begin; i < end; i++) {
+          VkCommandBuffer secondary = beginSecondaryCommandBuffer();
+          recordSprites(secondary, i * perSecondary, (i + 1) * perSecondary);
+          endSecondaryCommandBuffer(secondary);
+          vkCommandBuffer.recorded[i] = secondary;
+        }
+      },
+      1);
+}
+} // namespace
+
+void createCommandPools() {
   vulkan_device &vkDevice = getVulkanDeviceStruct();
+  vulkan_command_buffer &vkCommandBuffer = getVulkanCommandBufferStruct();
+  window_backend &vkWindow = getWindowBackendStruct();
+
+  const uint32_t threads = vkCommandBuffer.recordThreads != 0
+                               ? vkCommandBuffer.recordThreads
+                               : JobSystem::threadCount();
 
+  // The pools are only ever reset as a whole, so individual command buffers
+  // do not need to be resettable, which lets drivers use a simpler allocator.
   VkCommandPoolCreateInfo poolInfo{};
   poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
-  poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+  poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT;
   poolInfo.queueFamilyIndex = vkDevice.graphics_queue_index.value();
 
-  VkResult result = vkCreateCommandPool(vkDevice.logicalDevice, &poolInfo,
-                                        nullptr, &vkDevice.commandPool);
-  if (!checkVkResult(result)) {
-    LOG_ERROR(vkResultToString(result));
-    throw std::runtime_error(vkResultToString(result));
+  vkCommandBuffer.frames.resize(vkWindow.maxFramesInFlight);
+  for (vulkan_frame_commands &frame : vkCommandBuffer.frames) {
+    frame.threads.resize(threads);
+    for (vulkan_thread_commands &thread : frame.threads) {
+      VkResult result = vkCreateCommandPool(vkDevice.logicalDevice, &poolInfo,
+                                            nullptr, &thread.pool);
+      if (!checkVkResult(result)) {
+        LOG_ERROR(vkResultToString(result));
+        throw std::runtime_error(vkResultToString(result));
+      }
+    }
+
+    VkCommandBufferAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocInfo.commandPool = frame.threads[0].pool;
+    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+    allocInfo.commandBufferCount = 1;
+
+    VkResult result = vkAllocateCommandBuffers(vkDevice.logicalDevice,
+                                               &allocInfo, &frame.primary);
+    if (!checkVkResult(result)) {
+      LOG_ERROR(vkResultToString(result));
+      throw std::runtime_error(vkResultToString(result));
+    }
   }
 
-  else {
-    LOG_INFO("Created the command pool.");
+  LOG_INFOF("Created the command pools for {} recording threads.", threads);
+}
+
+void destroyCommandPools() {
+  vulkan_device &vkDevice = getVulkanDeviceStruct();
+  vulkan_command_buffer &vkCommandBuffer = getVulkanCommandBufferStruct();
+
+  // Destroying a pool also frees every command buffer allocated from it.
+  for (vulkan_frame_commands &frame : vkCommandBuffer.frames) {
+    for (vulkan_thread_commands &thread : frame.threads) {
+      vkDestroyCommandPool(vkDevice.logicalDevice, thread.pool, nullptr);
+    }
+  }
+
+  vkCommandBuffer.frames.clear();
+  vkCommandBuffer.recorded.clear();
+}
+
+void resetFrameCommandPools(uint32_t frame) {
+  vulkan_device &vkDevice = getVulkanDeviceStruct();
+  vulkan_command_buffer &vkCommandBuffer = getVulkanCommandBufferStruct();
+
+  for (vulkan_thread_commands &thread : vkCommandBuffer.frames[frame].threads) {
+    vkResetCommandPool(vkDevice.logicalDevice, thread.pool, 0);
+    thread.used = 0;
   }
 }
 
-void createCommandBuffer() {
+VkCommandBuffer beginSecondaryCommandBuffer() {
   vulkan_device &vkDevice = getVulkanDeviceStruct();
   vulkan_command_buffer &vkCommandBuffer = getVulkanCommandBufferStruct();
+  vulkan_pipeline &vkPipeline = getVulkanPipelineStruct();
+  window_backend &vkWindow = getWindowBackendStruct();
+
+  vulkan_frame_commands &frame = vkCommandBuffer.frames[vkWindow.currentFrame];
+  const uint32_t threadIndex = JobSystem::threadIndex();
+  if (threadIndex >= frame.threads.size()) {
+    LOG_ERROR("The recording thread has no command pool.");
+    throw std::runtime_error("The recording thread has no command pool.");
+  }
+
+  vulkan_thread_commands &thread = frame.threads[threadIndex];
+  if (thread.used == thread.secondaries.size()) {
+    VkCommandBufferAllocateInfo allocInfo{};
+    allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+    allocInfo.commandPool = thread.pool;
+    allocInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+    allocInfo.commandBufferCount = 1;
+
+    VkCommandBuffer commandBuffer;
+    VkResult result = vkAllocateCommandBuffers(vkDevice.logicalDevice,
+                                               &allocInfo, &commandBuffer);
+    if (!checkVkResult(result)) {
+      LOG_ERROR(vkResultToString(result));
+      throw std::runtime_error(vkResultToString(result));
+    }
+    thread.secondaries.push_back(commandBuffer);
+  }
 
-  VkCommandBufferAllocateInfo allocInfo{};
-  allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-  allocInfo.commandPool = vkDevice.commandPool;
-  allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
-  allocInfo.commandBufferCount = 1;
+  VkCommandBuffer commandBuffer = thread.secondaries[thread.used++];
 
-  VkResult result = vkAllocateCommandBuffers(vkDevice.logicalDevice, &allocInfo,
-                                             &vkCommandBuffer.buffer);
+  VkCommandBufferInheritanceInfo inheritanceInfo{};
+  inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+  inheritanceInfo.renderPass = vkPipeline.renderPass;
+  inheritanceInfo.subpass = 0;
+  inheritanceInfo.framebuffer = vkCommandBuffer.framebuffer;
+
+  VkCommandBufferBeginInfo beginInfo{};
+  beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+  beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT |
+                    VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT;
+  beginInfo.pInheritanceInfo = &inheritanceInfo;
+
+  VkResult result = vkBeginCommandBuffer(commandBuffer, &beginInfo);
   if (!checkVkResult(result)) {
     LOG_ERROR(vkResultToString(result));
     throw std::runtime_error(vkResultToString(result));
   }
 
-  else {
-    LOG_INFO("Allocated the command buffers.");
+  setViewportAndScissor(commandBuffer);
+  return commandBuffer;
+}
+
+void endSecondaryCommandBuffer(VkCommandBuffer commandBuffer) {
+  VkResult result = vkEndCommandBuffer(commandBuffer);
+  if (!checkVkResult(result)) {
+    LOG_ERROR(vkResultToString(result));
+    throw std::runtime_error(vkResultToString(result));
   }
 }
 
-void recordCommandBuffer(uint32_t imageIndex) {
-  vulkan_command_buffer &vkCommandBuffer = getVulkanCommandBufferStruct();
+void recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex) {
   vulkan_pipeline &vkPipeline = getVulkanPipelineStruct();
   vulkan_swapchain &vkSwapchain = getVulkanSwapchainStruct();
+  vulkan_command_buffer &vkCommandBuffer = getVulkanCommandBufferStruct();
+  window_backend &vkWindow = getWindowBackendStruct();
 
   VkCommandBufferBeginInfo beginInfo{};
   beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+  beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
 
-  VkResult result = vkBeginCommandBuffer(vkCommandBuffer.buffer, &beginInfo);
+  VkResult result = vkBeginCommandBuffer(commandBuffer, &beginInfo);
   if (!checkVkResult(result)) {
     LOG_ERROR(vkResultToString(result));
     throw std::runtime_error(vkResultToString(result));
   }
 
+  beginGpuProfilerFrame(commandBuffer);
+  beginGpuZone(commandBuffer, "frame");
+  recordUploadAcquires(commandBuffer);
+  recordTextureMips(commandBuffer);
+
+  vkCommandBuffer.framebuffer = vkPipeline.swapChainFramebuffers[imageIndex];
+  const uint32_t secondaryCount =
+      spriteSecondaryCount(vkCommandBuffer.frames[vkWindow.currentFrame]);
+
+  // The secondaries are recorded before the render pass begins, that way the
+  // primary only has to execute them.
+  if (secondaryCount > 0) {
+    recordSpritesParallel(secondaryCount);
+  }
+
   VkRenderPassBeginInfo renderPassInfo{};
   renderPassInfo.sType = VK_STRUCTURE_TYPE_RENDER_PASS_BEGIN_INFO;
   renderPassInfo.renderPass = vkPipeline.renderPass;
-  renderPassInfo.framebuffer = vkPipeline.swapChainFramebuffers[imageIndex];
+  renderPassInfo.framebuffer = vkCommandBuffer.framebuffer;
   renderPassInfo.renderArea.offset = {0, 0};
   renderPassInfo.renderArea.extent = vkSwapchain.extent;
 
@@ -72,32 +252,34 @@ void recordCommandBuffer(uint32_t imageIndex) {
   renderPassInfo.clearValueCount = 1;
   renderPassInfo.pClearValues = &clearColor;
 
-  vkCmdBeginRenderPass(vkCommandBuffer.buffer, &renderPassInfo,
-                       VK_SUBPASS_CONTENTS_INLINE);
+  beginGpuZone(commandBuffer, "main pass");
 
-  vkCmdBindPipeline(vkCommandBuffer.buffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
-                    vkPipeline.graphicsPipeline);
+  // A subpass with secondary contents may only execute command buffers, so
+  // there is no "sprites" zone in that case, "main pass" covers it.
+  if (secondaryCount > 0) {
+    vkCmdBeginRenderPass(commandBuffer, &renderPassInfo,
+                         VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+    vkCmdExecuteCommands(
+        commandBuffer, static_cast<uint32_t>(vkCommandBuffer.recorded.size()),
+        vkCommandBuffer.recorded.data());
+  }
 
-  VkViewport viewport{};
-  viewport.x = 0.0f;
-  viewport.y = 0.0f;
-  viewport.width = static_cast<float>(vkSwapchain.extent.width);
-  viewport.height = static_cast<float>(vkSwapchain.extent.height);
-  viewport.minDepth = 0.0f;
-  viewport.maxDepth = 1.0f;
-  vkCmdSetViewport(vkCommandBuffer.buffer, 0, 1, &viewport);
+  else {
+    vkCmdBeginRenderPass(commandBuffer, &renderPassInfo,
+                         VK_SUBPASS_CONTENTS_INLINE);
+    setViewportAndScissor(commandBuffer);
 
-  VkRect2D scissor{};
-  scissor.offset = {0, 0};
-  scissor.extent = vkSwapchain.extent;
-  vkCmdSetScissor(vkCommandBuffer.buffer, 0, 1, &scissor);
+    HK_GPU_ZONE(commandBuffer, "sprites");
+    recordSprites(commandBuffer);
+  }
 
-  vkCmdDraw(vkCommandBuffer.buffer, 3, 1, 0, 0);
-  vkCmdEndRenderPass(vkCommandBuffer.buffer);
+  vkCmdEndRenderPass(commandBuffer);
+  endGpuZone(commandBuffer); // main pass
+  endGpuZone(commandBuffer); // frame
 
-  VkResult endResult = vkEndCommandBuffer(vkCommandBuffer.buffer);
+  VkResult endResult = vkEndCommandBuffer(commandBuffer);
   if (!checkVkResult(endResult)) {
-    LOG_ERROR(vkResultToString(result));
-    throw std::runtime_error(vkResultToString(result));
+    LOG_ERROR(vkResultToString(endResult));
+    throw std::runtime_error(vkResultToString(endResult));
   }
 }
@@ -1,7 +1,23 @@
 #pragma once
 
 #include <stdint.h>
+#include <vulkan/vulkan.h>
 
-void createCommandPool();
-void createCommandBuffer();
-void recordCommandBuffer(uint32_t imageIndex);
+/// @brief Creates a command pool per recording thread for every frame in
+/// flight, and the primary command buffer of every frame slot.
+void createCommandPools();
+void destroyCommandPools();
+
+/// @brief Resets every command pool of the frame slot at once, which recycles
+/// all of its command buffers. The slot's fence must have signaled, done by
+/// beginFrame().
+void resetFrameCommandPools(uint32_t frame);
+
+/// @brief Begins a secondary command buffer from the calling thread's pool of
+/// the current frame slot. It continues the main render pass and has the
+/// viewport and scissor set already. Only valid while recordCommandBuffer()
+/// runs, from the thread that recorded the primary or a job system worker.
+VkCommandBuffer beginSecondaryCommandBuffer();
+void endSecondaryCommandBuffer(VkCommandBuffer commandBuffer);
+
+void recordCommandBuffer(VkCommandBuffer commandBuffer, uint32_t imageIndex);
@@ -3,8 +3,11 @@
 #include "vulkan_types.hpp"
 #include "vulkan_utils.hpp"
 
+#include <algorithm>
+#include <format>
 #include <set>
 #include <stdexcept>
+#include <string_view>
 #include <vulkan/vulkan.h>
 #include <vulkan/vulkan_core.h>
 
@@ -29,16 +32,59 @@ bool checkDeviceExtensionSupport(VkPhysicalDevice vkPhysDevice) {
   return requiredExtensions.empty();
 }
 
+bool isDeviceExtensionSupported(VkPhysicalDevice vkPhysDevice,
+                                const char *name) {
+  uint32_t extensionCount;
+  vkEnumerateDeviceExtensionProperties(vkPhysDevice, nullptr, &extensionCount,
+                                       nullptr);
+
+  std::vector<VkExtensionProperties> availableExtensions(extensionCount);
+  vkEnumerateDeviceExtensionProperties(vkPhysDevice, nullptr, &extensionCount,
+                                       availableExtensions.data());
+
+  return std::any_of(availableExtensions.begin(), availableExtensions.end(),
+                     [&](const VkExtensionProperties &extension) {
+                       return std::string_view(extension.extensionName) ==
+                              name;
+                     });
+}
+
 bool isSuitable(VkPhysicalDevice vkPhysDevice) {
+  // Nothing we render needs optional features like geometry shaders, so
+  // software rasterizers such as lavapipe qualify as well.
+  bool extensionsSupported = checkDeviceExtensionSupport(vkPhysDevice);
+
+  uint32_t queueFamilyCount = 0;
+  vkGetPhysicalDeviceQueueFamilyProperties(vkPhysDevice, &queueFamilyCount,
+                                           nullptr);
+  std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+  vkGetPhysicalDeviceQueueFamilyProperties(vkPhysDevice, &queueFamilyCount,
+                                           queueFamilies.data());
+
+  bool hasGraphicsQueue = false;
+  for (const auto &queueFamily : queueFamilies) {
+    hasGraphicsQueue |= (queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT) != 0;
+  }
+
+  return extensionsSupported && hasGraphicsQueue;
+}
+
+uint32_t scoreDevice(VkPhysicalDevice vkPhysDevice) {
   VkPhysicalDeviceProperties deviceProperties;
-  VkPhysicalDeviceFeatures deviceFeatures;
   vkGetPhysicalDeviceProperties(vkPhysDevice, &deviceProperties);
-  vkGetPhysicalDeviceFeatures(vkPhysDevice, &deviceFeatures);
 
-  // I wonder if copying the VkPhysicalDevice twice is a smart choice
-  bool extensionsSupported = checkDeviceExtensionSupport(vkPhysDevice);
-
-  return deviceFeatures.geometryShader && extensionsSupported;
+  switch (deviceProperties.deviceType) {
+  case VK_PHYSICAL_DEVICE_TYPE_DISCRETE_GPU:
+    return 4;
+  case VK_PHYSICAL_DEVICE_TYPE_INTEGRATED_GPU:
+    return 3;
+  case VK_PHYSICAL_DEVICE_TYPE_VIRTUAL_GPU:
+    return 2;
+  case VK_PHYSICAL_DEVICE_TYPE_CPU:
+    return 1;
+  default:
+    return 0;
+  }
 }
 
 void getDevice() {
@@ -59,10 +105,17 @@ void getDevice() {
   std::vector<VkPhysicalDevice> devices(deviceCount);
   vkEnumeratePhysicalDevices(context.instance, &deviceCount, devices.data());
 
+  // Prefer real GPUs, but take a CPU implementation if that's all there is.
+  uint32_t bestScore = 0;
   for (const auto &device : devices) {
-    if (isSuitable(device)) {
+    if (!isSuitable(device)) {
+      continue;
+    }
+
+    uint32_t score = scoreDevice(device);
+    if (vkDeviceStruct.vkPhysDevice == VK_NULL_HANDLE || score > bestScore) {
+      bestScore = score;
       vkDeviceStruct.vkPhysDevice = device;
-      break;
     }
   }
 
@@ -72,17 +125,25 @@ void getDevice() {
   }
 
   else {
-    LOG_INFO("Found a suitable GPU.");
+    VkPhysicalDeviceProperties deviceProperties;
+    vkGetPhysicalDeviceProperties(vkDeviceStruct.vkPhysDevice,
+                                  &deviceProperties);
+    LOG_INFOF("Found a suitable GPU: {}.", deviceProperties.deviceName);
   }
 }
 
 void createLogicalDevice() {
+  vulkan_context &context = getVulkanContextStruct();
   vulkan_device &vkDeviceStruct = getVulkanDeviceStruct();
+  vulkan_frame_pacing &framePacing = getVulkanFramePacingStruct();
+  vulkan_texture_table &textureTable = getVulkanTextureTableStruct();
+  window_backend &vkWindowBackend = getWindowBackendStruct();
 
   std::vector<VkDeviceQueueCreateInfo> queueCreateInfos;
   std::set<uint32_t> uniqueQueueFamilies = {
       vkDeviceStruct.graphics_queue_index.value(),
-      vkDeviceStruct.present_queue_index.value()};
+      vkDeviceStruct.present_queue_index.value(),
+      vkDeviceStruct.transfer_queue_index.value()};
 
   float queuePrio = 1.0f;
   for (uint32_t queueFamily : uniqueQueueFamilies) {
@@ -100,9 +161,92 @@ void createLogicalDevice() {
   createInfo.queueCreateInfoCount =
       static_cast<uint32_t>(queueCreateInfos.size());
 
-  createInfo.enabledExtensionCount =
-      static_cast<uint32_t>(vkDeviceStruct.deviceExtensions.size());
-  createInfo.ppEnabledExtensionNames = vkDeviceStruct.deviceExtensions.data();
+  VkPhysicalDeviceProperties deviceProperties;
+  vkGetPhysicalDeviceProperties(vkDeviceStruct.vkPhysDevice, &deviceProperties);
+  vkDeviceStruct.apiVersion =
+      std::min(context.apiVersion, deviceProperties.apiVersion);
+
+  // Present wait only makes sense with something to present to.
+  std::vector<const char *> extensions = vkDeviceStruct.deviceExtensions;
+  const bool presentExtensions =
+      framePacing.usePresentWait && vkWindowBackend.surface != VK_NULL_HANDLE &&
+      isDeviceExtensionSupported(vkDeviceStruct.vkPhysDevice,
+                                 VK_KHR_PRESENT_ID_EXTENSION_NAME) &&
+      isDeviceExtensionSupported(vkDeviceStruct.vkPhysDevice,
+                                 VK_KHR_PRESENT_WAIT_EXTENSION_NAME);
+
+  // Everything 1.2 adds is optional, older devices and drivers simply take
+  // the fallback paths.
+  VkPhysicalDeviceVulkan12Features supported12{};
+  supported12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+  VkPhysicalDevicePresentIdFeaturesKHR supportedPresentId{};
+  supportedPresentId.sType =
+      VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_ID_FEATURES_KHR;
+  VkPhysicalDevicePresentWaitFeaturesKHR supportedPresentWait{};
+  supportedPresentWait.sType =
+      VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_WAIT_FEATURES_KHR;
+  if (vkDeviceStruct.apiVersion >= VK_API_VERSION_1_1) {
+    VkPhysicalDeviceFeatures2 features2{};
+    features2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+    if (presentExtensions) {
+      supportedPresentId.pNext = &supportedPresentWait;
+      features2.pNext = &supportedPresentId;
+    }
+
+    if (vkDeviceStruct.apiVersion >= VK_API_VERSION_1_2) {
+      supported12.pNext = features2.pNext;
+      features2.pNext = &supported12;
+    }
+    vkGetPhysicalDeviceFeatures2(vkDeviceStruct.vkPhysDevice, &features2);
+  }
+
+  VkPhysicalDeviceVulkan12Features enabled12{};
+  enabled12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+  enabled12.timelineSemaphore = supported12.timelineSemaphore;
+  if (vkDeviceStruct.apiVersion >= VK_API_VERSION_1_2) {
+    createInfo.pNext = &enabled12;
+  }
+  vkDeviceStruct.timelineSemaphores = enabled12.timelineSemaphore == VK_TRUE;
+
+  // The bindless texture table indexes an unsized, partially bound array of
+  // samplers with a per-instance index and updates it while frames that use
+  // it are in flight.
+  vkDeviceStruct.descriptorIndexing =
+      textureTable.useDescriptorIndexing &&
+      supported12.runtimeDescriptorArray == VK_TRUE &&
+      supported12.descriptorBindingPartiallyBound == VK_TRUE &&
+      supported12.descriptorBindingSampledImageUpdateAfterBind == VK_TRUE &&
+      supported12.shaderSampledImageArrayNonUniformIndexing == VK_TRUE;
+  if (vkDeviceStruct.descriptorIndexing) {
+    enabled12.descriptorIndexing = supported12.descriptorIndexing;
+    enabled12.runtimeDescriptorArray = VK_TRUE;
+    enabled12.descriptorBindingPartiallyBound = VK_TRUE;
+    enabled12.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+    enabled12.shaderSampledImageArrayNonUniformIndexing = VK_TRUE;
+  }
+
+  VkPhysicalDevicePresentIdFeaturesKHR enabledPresentId{};
+  enabledPresentId.sType =
+      VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_ID_FEATURES_KHR;
+  enabledPresentId.presentId = VK_TRUE;
+  VkPhysicalDevicePresentWaitFeaturesKHR enabledPresentWait{};
+  enabledPresentWait.sType =
+      VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PRESENT_WAIT_FEATURES_KHR;
+  enabledPresentWait.presentWait = VK_TRUE;
+
+  framePacing.presentWait = presentExtensions &&
+                            supportedPresentId.presentId == VK_TRUE &&
+                            supportedPresentWait.presentWait == VK_TRUE;
+  if (framePacing.presentWait) {
+    extensions.push_back(VK_KHR_PRESENT_ID_EXTENSION_NAME);
+    extensions.push_back(VK_KHR_PRESENT_WAIT_EXTENSION_NAME);
+    enabledPresentWait.pNext = const_cast<void *>(createInfo.pNext);
+    enabledPresentId.pNext = &enabledPresentWait;
+    createInfo.pNext = &enabledPresentId;
+  }
+
+  createInfo.enabledExtensionCount = static_cast<uint32_t>(extensions.size());
+  createInfo.ppEnabledExtensionNames = extensions.data();
 
   VkResult result = vkCreateDevice(vkDeviceStruct.vkPhysDevice, &createInfo,
                                    nullptr, &vkDeviceStruct.logicalDevice);
@@ -113,6 +257,9 @@ void createLogicalDevice() {
   vkGetDeviceQueue(vkDeviceStruct.logicalDevice,
                    vkDeviceStruct.present_queue_index.value(), 0,
                    &vkDeviceStruct.presentQueue);
+  vkGetDeviceQueue(vkDeviceStruct.logicalDevice,
+                   vkDeviceStruct.transfer_queue_index.value(), 0,
+                   &vkDeviceStruct.transferQueue);
 
   if (!checkVkResult(result)) {
     LOG_ERROR(vkResultToString(result));
@@ -120,7 +267,14 @@ void createLogicalDevice() {
   }
 
   else {
-    LOG_INFO("Successfully created the logical vulkan device.");
+    LOG_INFOF("Successfully created the logical vulkan device (Vulkan {}.{}, "
+              "timeline semaphores {}, present wait {}, descriptor indexing "
+              "{}).",
+              VK_API_VERSION_MAJOR(vkDeviceStruct.apiVersion),
+              VK_API_VERSION_MINOR(vkDeviceStruct.apiVersion),
+              vkDeviceStruct.timelineSemaphores ? "on" : "off",
+              framePacing.presentWait ? "on" : "off",
+              vkDeviceStruct.descriptorIndexing ? "on" : "off");
   }
 }
 
@@ -140,10 +294,13 @@ void findQueueFamilies() {
   for (const auto &queueFamily : queueFamilies) {
     if (queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT) {
       vkDeviceStruct.graphics_queue_index = i;
-      VkBool32 presentSupport = false;
-      vkGetPhysicalDeviceSurfaceSupportKHR(vkDeviceStruct.vkPhysDevice, i,
-                                           vkWindowBackend.surface,
-                                           &presentSupport);
+      // Without a surface nothing is presented, any graphics queue will do.
+      VkBool32 presentSupport = vkWindowBackend.surface == VK_NULL_HANDLE;
+      if (!presentSupport) {
+        vkGetPhysicalDeviceSurfaceSupportKHR(vkDeviceStruct.vkPhysDevice, i,
+                                             vkWindowBackend.surface,
+                                             &presentSupport);
+      }
 
       if (presentSupport) {
         vkDeviceStruct.present_queue_index = i;
@@ -163,8 +320,31 @@ void findQueueFamilies() {
     throw std::runtime_error("Could not find a graphics queue family.");
   }
 
-  if (!vkDeviceStruct.graphics_queue_index.has_value()) {
+  if (!vkDeviceStruct.present_queue_index.has_value()) {
     LOG_ERROR("Could not find a present queue family.");
     throw std::runtime_error("Could not find a present queue family.");
   }
+
+  // A family that can transfer but neither draw nor compute is usually backed
+  // by the DMA engines, copies on it run alongside rendering.
+  vkDeviceStruct.transfer_queue_index.reset();
+  for (uint32_t family = 0; family < queueFamilyCount; family++) {
+    const VkQueueFlags flags = queueFamilies[family].queueFlags;
+    if ((flags & VK_QUEUE_TRANSFER_BIT) &&
+        !(flags & (VK_QUEUE_GRAPHICS_BIT | VK_QUEUE_COMPUTE_BIT))) {
+      vkDeviceStruct.transfer_queue_index = family;
+      break;
+    }
+  }
+
+  if (vkDeviceStruct.transfer_queue_index.has_value()) {
+    LOG_INFO("Found a dedicated transfer queue family.");
+  }
+
+  else {
+    vkDeviceStruct.transfer_queue_index =
+        vkDeviceStruct.graphics_queue_index.value();
+    LOG_INFO("No dedicated transfer queue family, uploads use the graphics "
+             "queue.");
+  }
 }
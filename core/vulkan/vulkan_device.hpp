@@ -4,7 +4,8 @@
 
 /// @brief Gets the available graphics card and stores it into
 /// VkPhysicalDevice handle
-/// Ideally it will choose dedicated graphics card (if it exists)
+/// Prefers a dedicated graphics card, then integrated, virtual and finally CPU
+/// implementations like lavapipe.
 void getDevice();
 
 void findQueueFamilies();
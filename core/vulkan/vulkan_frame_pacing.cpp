@@ -0,0 +1,268 @@
+#include "vulkan_frame_pacing.hpp"
+#include "logger.hpp"
+#include "profiler.hpp"
+#include "time_utils.hpp"
+#include "vulkan_render.hpp"
+#include "vulkan_swapchain.hpp"
+#include "vulkan_types.hpp"
+#include "vulkan_utils.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <format>
+#include <stdexcept>
+
+namespace {
+// Enough for every frame that can be in flight or queued for the display.
+constexpr size_t MIN_LATENCY_HISTORY = 16;
+
+// Weight of a new sample in averageLatencyMs.
+constexpr double LATENCY_SMOOTHING = 0.05;
+
+int64_t &inputSampleSlot(uint64_t frameNumber) {
+  vulkan_frame_pacing &pacing = getVulkanFramePacingStruct();
+  return pacing.inputSampleNs[frameNumber % pacing.inputSampleNs.size()];
+}
+
+void recordLatency(uint64_t frameNumber, int64_t nowNs) {
+  vulkan_frame_pacing &pacing = getVulkanFramePacingStruct();
+  int64_t &sample = inputSampleSlot(frameNumber);
+
+  const double latencyMs = static_cast<double>(nowNs - sample) / 1e6;
+  sample = 0;
+
+  pacing.latencyMs = latencyMs;
+  pacing.averageLatencyMs =
+      pacing.latencySamples == 0
+          ? latencyMs
+          : pacing.averageLatencyMs +
+                (latencyMs - pacing.averageLatencyMs) * LATENCY_SMOOTHING;
+  pacing.maxLatencyMs = std::max(pacing.maxLatencyMs, latencyMs);
+  pacing.latencySamples++;
+}
+
+// Whether the present with the given id was shown within timeoutNs. Presents
+// to an older swapchain can not be waited on and count as never shown.
+bool waitForPresentId(uint64_t presentId, uint64_t timeoutNs) {
+  vulkan_device &vkDevice = getVulkanDeviceStruct();
+  vulkan_swapchain &vkSwapchain = getVulkanSwapchainStruct();
+  vulkan_frame_pacing &pacing = getVulkanFramePacingStruct();
+
+  if (pacing.presentSwapchain != vkSwapchain.swapchain ||
+      presentId < pacing.swapchainFirstPresentId ||
+      presentId > pacing.lastPresentId) {
+    return false;
+  }
+
+  VkResult result = pacing.waitForPresent(
+      vkDevice.logicalDevice, vkSwapchain.swapchain, presentId, timeoutNs);
+
+  // drawFrame() recreates an out of date swapchain, the presents of the old
+  // one are simply lost.
+  if (result == VK_TIMEOUT || result == VK_ERROR_OUT_OF_DATE_KHR) {
+    return false;
+  }
+
+  if (!checkVkResult(result)) {
+    LOG_ERROR(vkResultToString(result));
+    throw std::runtime_error(vkResultToString(result));
+  }
+  return true;
+}
+
+// Measures every frame that reached the display, or finished on the GPU
+// without present wait, since the last call. Presents complete in order, so
+// this stops at the first one that did not. A frame is stamped when the poll
+// that saw it done returns, so the callers poll before anything blocks and
+// right after each wait.
+void measureLatencies() {
+  window_backend &vkWindow = getWindowBackendStruct();
+  vulkan_frame_pacing &pacing = getVulkanFramePacingStruct();
+
+  const uint64_t history = pacing.inputSampleNs.size();
+  if (vkWindow.frameNumber - pacing.nextMeasuredFrame > history) {
+    pacing.nextMeasuredFrame = vkWindow.frameNumber - history;
+  }
+
+  const bool presentWait = pacing.waitForPresent != nullptr;
+  for (; pacing.nextMeasuredFrame < vkWindow.frameNumber;
+       pacing.nextMeasuredFrame++) {
+    const uint64_t frame = pacing.nextMeasuredFrame;
+    int64_t &sample = inputSampleSlot(frame);
+    if (sample == 0) {
+      continue;
+    }
+
+    // Frames presented to a replaced swapchain will never report.
+    if (presentWait && frame + 1 < pacing.swapchainFirstPresentId) {
+      sample = 0;
+      continue;
+    }
+
+    const bool done =
+        presentWait ? waitForPresentId(frame + 1, 0) : isFrameComplete(frame);
+    const int64_t doneNs = TimeUtils::steadyNowNs();
+    if (!done) {
+      break;
+    }
+    recordLatency(frame, doneNs);
+  }
+}
+
+void limitFrameRate() {
+  vulkan_frame_pacing &pacing = getVulkanFramePacingStruct();
+
+  if (pacing.targetFrameRate <= 0.0) {
+    pacing.nextFrameStartNs = 0;
+    return;
+  }
+
+  const int64_t periodNs = static_cast<int64_t>(1e9 / pacing.targetFrameRate);
+  const int64_t deadlineNs = pacing.nextFrameStartNs;
+  int64_t nowNs = TimeUtils::steadyNowNs();
+
+  if (deadlineNs != 0 && nowNs < deadlineNs) {
+    HK_ZONE("frame limiter");
+    TimeUtils::preciseSleepUntil(
+        std::chrono::steady_clock::time_point(
+            std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+                std::chrono::nanoseconds(deadlineNs))),
+        std::chrono::nanoseconds(pacing.spinThresholdNs));
+    nowNs = TimeUtils::steadyNowNs();
+  }
+
+  // Keep the cadence while we are on time, but a frame that ran more than a
+  // period late must not make the following ones rush to catch up.
+  if (deadlineNs != 0 && nowNs - deadlineNs < periodNs) {
+    pacing.nextFrameStartNs = deadlineNs + periodNs;
+  }
+
+  else {
+    pacing.nextFrameStartNs = nowNs + periodNs;
+  }
+}
+} // namespace
+
+void createFramePacing() {
+  vulkan_device &vkDevice = getVulkanDeviceStruct();
+  window_backend &vkWindow = getWindowBackendStruct();
+  vulkan_frame_pacing &pacing = getVulkanFramePacingStruct();
+
+  pacing.inputSampleNs.assign(
+      std::max<size_t>(MIN_LATENCY_HISTORY, 2 * vkWindow.maxFramesInFlight), 0);
+  pacing.nextMeasuredFrame = vkWindow.frameNumber;
+  pacing.nextFrameStartNs = 0;
+
+  if (pacing.presentWait) {
+    pacing.waitForPresent = reinterpret_cast<PFN_vkWaitForPresentKHR>(
+        vkGetDeviceProcAddr(vkDevice.logicalDevice, "vkWaitForPresentKHR"));
+    if (pacing.waitForPresent == nullptr) {
+      pacing.presentWait = false;
+      LOG_WARN("vkWaitForPresentKHR could not be loaded, pacing frames on the "
+               "GPU instead.");
+    }
+  }
+
+  LOG_INFOF("Pacing frames with {}, {} queued frame(s) before sampling input.",
+            pacing.presentWait ? "present wait" : "GPU completion",
+            pacing.maxQueuedPresents);
+}
+
+void destroyFramePacing() {
+  vulkan_frame_pacing &pacing = getVulkanFramePacingStruct();
+
+  pacing.waitForPresent = nullptr;
+  pacing.presentWait = false;
+  pacing.presentSwapchain = VK_NULL_HANDLE;
+  pacing.inputSampleNs.clear();
+}
+
+void waitForInputSample() {
+  window_backend &vkWindow = getWindowBackendStruct();
+  vulkan_frame_pacing &pacing = getVulkanFramePacingStruct();
+
+  HK_ZONE("waitForInputSample");
+
+  // Frames shown since the last present are stamped before the wait below,
+  // which would otherwise add to their latency.
+  measureLatencies();
+
+  // Sampling input only once the display caught up keeps the frames queued
+  // behind it from adding their time to the latency.
+  const uint64_t queued = pacing.maxQueuedPresents;
+  if (queued > 0 && vkWindow.frameNumber >= queued) {
+    HK_ZONE("wait for present");
+    const uint64_t frame = vkWindow.frameNumber - queued;
+    if (pacing.waitForPresent != nullptr) {
+      waitForPresentId(frame + 1, pacing.presentWaitTimeoutNs);
+    }
+
+    else {
+      waitForFrame(frame);
+    }
+
+    // The frame waited for is stamped with the time the wait returned.
+    measureLatencies();
+  }
+
+  limitFrameRate();
+
+  inputSampleSlot(vkWindow.frameNumber) = TimeUtils::steadyNowNs();
+}
+
+void framePresented(uint64_t frameNumber, bool presented) {
+  vulkan_swapchain &vkSwapchain = getVulkanSwapchainStruct();
+  vulkan_frame_pacing &pacing = getVulkanFramePacingStruct();
+
+  if (pacing.inputSampleNs.empty()) {
+    return;
+  }
+
+  if (!presented) {
+    inputSampleSlot(frameNumber) = 0;
+    return;
+  }
+
+  if (pacing.presentSwapchain != vkSwapchain.swapchain) {
+    pacing.presentSwapchain = vkSwapchain.swapchain;
+    pacing.swapchainFirstPresentId = frameNumber + 1;
+  }
+  pacing.lastPresentId = frameNumber + 1;
+
+  // A second poll per frame, so frames shown while this one was recorded are
+  // not stamped a whole frame late.
+  measureLatencies();
+}
+
+void setPresentMode(VkPresentModeKHR presentMode) {
+  window_backend &vkWindow = getWindowBackendStruct();
+  vulkan_swapchain &vkSwapchain = getVulkanSwapchainStruct();
+  vulkan_frame_pacing &pacing = getVulkanFramePacingStruct();
+
+  // An unsupported request falls back to the mode the swapchain may already
+  // have, which needs no new swapchain.
+  pacing.presentMode = presentMode;
+  if (vkWindow.surface == VK_NULL_HANDLE ||
+      vkSwapchain.swapchain == VK_NULL_HANDLE ||
+      vkSwapchain.presentMode == resolvePresentMode(presentMode)) {
+    return;
+  }
+
+  recreateSwapchain();
+}
+
+void logFrameLatency() {
+  vulkan_frame_pacing &pacing = getVulkanFramePacingStruct();
+
+  if (pacing.latencySamples == 0) {
+    LOG_INFO("No input latency was measured, call waitForInputSample() before "
+             "polling input.");
+    return;
+  }
+
+  LOG_INFOF("Input to {} latency over {} frames: last {:.2f} ms, average "
+            "{:.2f} ms, worst {:.2f} ms.",
+            pacing.presentWait ? "present" : "GPU completion",
+            pacing.latencySamples, pacing.latencyMs, pacing.averageLatencyMs,
+            pacing.maxLatencyMs);
+}
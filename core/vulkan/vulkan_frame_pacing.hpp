@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstdint>
+#include <vulkan/vulkan.h>
+
+/// @brief Loads vkWaitForPresentKHR if present wait was enabled and sets up
+/// the latency history. Must be called after createLogicalDevice().
+void createFramePacing();
+void destroyFramePacing();
+
+/// @brief Call once per frame right before polling input. Waits until at most
+/// vulkan_frame_pacing::maxQueuedPresents frames are still queued for the
+/// display, or for the GPU when present wait is not available, holds the
+/// target frame rate and marks when input was sampled for the next frame.
+void waitForInputSample();
+
+/// @brief Records that a frame was handed to vkQueuePresentKHR with the
+/// present id frameNumber + 1. presented is false if the present failed.
+/// Called by drawFrame().
+void framePresented(uint64_t frameNumber, bool presented);
+
+/// @brief Switches the present mode, recreating the swapchain if the mode it
+/// ends up with changes.
+void setPresentMode(VkPresentModeKHR presentMode);
+
+/// @brief Logs the input to present latency measured so far.
+void logFrameLatency();
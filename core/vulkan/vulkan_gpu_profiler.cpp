@@ -0,0 +1,302 @@
+#include "vulkan_gpu_profiler.hpp"
+#include "logger.hpp"
+#include "vulkan_types.hpp"
+#include "vulkan_utils.hpp"
+
+#include <algorithm>
+#include <format>
+#include <fstream>
+#include <stdexcept>
+#include <vulkan/vulkan_core.h>
+
+namespace {
+uint32_t queryBase(const vulkan_gpu_profiler &profiler, uint32_t frame) {
+  return frame * profiler.maxQueriesPerFrame;
+}
+
+// Timestamps wrap around at timestampValidBits, masking the difference keeps
+// zones that straddle the wrap correct.
+double ticksToNs(const vulkan_gpu_profiler &profiler, uint64_t from,
+                 uint64_t to) {
+  return static_cast<double>((to - from) & profiler.timestampMask) *
+         profiler.timestampPeriod;
+}
+
+std::string jsonEscape(const char *text) {
+  std::string out;
+  for (; *text; text++) {
+    if (*text == '"' || *text == '\\') {
+      out += '\\';
+    }
+    out += *text;
+  }
+  return out;
+}
+} // namespace
+
+void createGpuProfiler() {
+  vulkan_gpu_profiler &profiler = getVulkanGpuProfilerStruct();
+  vulkan_device &vkDevice = getVulkanDeviceStruct();
+  window_backend &vkWindow = getWindowBackendStruct();
+
+  if (!profiler.enabled) {
+    return;
+  }
+
+  uint32_t queueFamilyCount = 0;
+  vkGetPhysicalDeviceQueueFamilyProperties(vkDevice.vkPhysDevice,
+                                           &queueFamilyCount, nullptr);
+  std::vector<VkQueueFamilyProperties> queueFamilies(queueFamilyCount);
+  vkGetPhysicalDeviceQueueFamilyProperties(
+      vkDevice.vkPhysDevice, &queueFamilyCount, queueFamilies.data());
+
+  const uint32_t validBits =
+      queueFamilies[vkDevice.graphics_queue_index.value()].timestampValidBits;
+  if (validBits == 0) {
+    LOG_WARN("The graphics queue does not support timestamps, the GPU "
+             "profiler is disabled.");
+    profiler.enabled = false;
+    return;
+  }
+
+  VkPhysicalDeviceProperties properties;
+  vkGetPhysicalDeviceProperties(vkDevice.vkPhysDevice, &properties);
+  profiler.timestampPeriod = properties.limits.timestampPeriod;
+  profiler.timestampMask = validBits >= 64 ? ~0ull : (1ull << validBits) - 1;
+
+  VkQueryPoolCreateInfo poolInfo{};
+  poolInfo.sType = VK_STRUCTURE_TYPE_QUERY_POOL_CREATE_INFO;
+  poolInfo.queryType = VK_QUERY_TYPE_TIMESTAMP;
+  poolInfo.queryCount =
+      profiler.maxQueriesPerFrame * vkWindow.maxFramesInFlight;
+
+  VkResult result = vkCreateQueryPool(vkDevice.logicalDevice, &poolInfo,
+                                      nullptr, &profiler.queryPool);
+  if (!checkVkResult(result)) {
+    LOG_ERROR(vkResultToString(result));
+    throw std::runtime_error(vkResultToString(result));
+  }
+
+  profiler.frames.assign(vkWindow.maxFramesInFlight, {});
+  for (vulkan_gpu_profiler_frame &frame : profiler.frames) {
+    frame.zones.reserve(profiler.maxQueriesPerFrame / 2);
+  }
+  profiler.openZones.reserve(32);
+  profiler.timestamps.resize(profiler.maxQueriesPerFrame);
+  profiler.results.reserve(profiler.maxQueriesPerFrame / 2);
+
+  LOG_INFOF("Created the GPU profiler ({} queries per frame, {} ns per tick).",
+            profiler.maxQueriesPerFrame, profiler.timestampPeriod);
+}
+
+void destroyGpuProfiler() {
+  vulkan_gpu_profiler &profiler = getVulkanGpuProfilerStruct();
+  vulkan_device &vkDevice = getVulkanDeviceStruct();
+
+  vkDestroyQueryPool(vkDevice.logicalDevice, profiler.queryPool, nullptr);
+  profiler.queryPool = VK_NULL_HANDLE;
+  profiler.frames.clear();
+  profiler.openZones.clear();
+}
+
+void beginGpuProfilerFrame(VkCommandBuffer commandBuffer) {
+  vulkan_gpu_profiler &profiler = getVulkanGpuProfilerStruct();
+  window_backend &vkWindow = getWindowBackendStruct();
+
+  if (profiler.queryPool == VK_NULL_HANDLE) {
+    return;
+  }
+
+  const uint32_t frame = vkWindow.currentFrame;
+  vulkan_gpu_profiler_frame &slot = profiler.frames[frame];
+  slot.zones.clear();
+  slot.queryCount = 0;
+  slot.frameNumber = vkWindow.frameNumber;
+  slot.pending = true;
+  profiler.openZones.clear();
+
+  vkCmdResetQueryPool(commandBuffer, profiler.queryPool,
+                      queryBase(profiler, frame), profiler.maxQueriesPerFrame);
+}
+
+void collectGpuProfilerFrame(uint32_t frame) {
+  vulkan_gpu_profiler &profiler = getVulkanGpuProfilerStruct();
+  vulkan_device &vkDevice = getVulkanDeviceStruct();
+
+  if (profiler.queryPool == VK_NULL_HANDLE) {
+    return;
+  }
+
+  vulkan_gpu_profiler_frame &slot = profiler.frames[frame];
+  if (!slot.pending || slot.queryCount == 0) {
+    slot.pending = false;
+    return;
+  }
+  slot.pending = false;
+
+  // No WAIT flag, if the driver says the results are not there yet we simply
+  // skip this frame instead of stalling.
+  VkResult result = vkGetQueryPoolResults(
+      vkDevice.logicalDevice, profiler.queryPool, queryBase(profiler, frame),
+      slot.queryCount, slot.queryCount * sizeof(uint64_t),
+      profiler.timestamps.data(), sizeof(uint64_t), VK_QUERY_RESULT_64_BIT);
+  if (result == VK_NOT_READY) {
+    return;
+  }
+
+  else if (!checkVkResult(result)) {
+    LOG_ERROR(vkResultToString(result));
+    throw std::runtime_error(vkResultToString(result));
+  }
+
+  const uint64_t *timestamps = profiler.timestamps.data();
+  const uint64_t frameStart = timestamps[slot.zones.front().beginQuery];
+  if (profiler.captureTrace && !profiler.traceOrigin) {
+    profiler.traceOrigin = frameStart;
+  }
+
+  profiler.results.clear();
+  profiler.resultsFrame = slot.frameNumber;
+  profiler.frameMs = 0.0;
+  const char *slowestName = "none";
+  double slowestMs = 0.0;
+
+  for (const vulkan_gpu_zone &zone : slot.zones) {
+    // A zone that was never closed has no end to measure.
+    if (zone.endQuery == UINT32_MAX) {
+      continue;
+    }
+
+    const uint64_t begin = timestamps[zone.beginQuery];
+    const uint64_t end = timestamps[zone.endQuery];
+
+    vulkan_gpu_zone_result &zoneResult = profiler.results.emplace_back();
+    zoneResult.name = zone.name;
+    zoneResult.depth = zone.depth;
+    zoneResult.startMs = ticksToNs(profiler, frameStart, begin) / 1e6;
+    zoneResult.durationMs = ticksToNs(profiler, begin, end) / 1e6;
+
+    if (zone.depth == 0) {
+      profiler.frameMs = std::max(profiler.frameMs,
+                                  zoneResult.startMs + zoneResult.durationMs);
+    }
+
+    if (zone.depth > 0 && zoneResult.durationMs > slowestMs) {
+      slowestMs = zoneResult.durationMs;
+      slowestName = zone.name;
+    }
+
+    if (profiler.captureTrace &&
+        profiler.trace.size() < profiler.maxTraceEvents) {
+      profiler.trace.push_back(
+          {zone.name, zone.depth, slot.frameNumber,
+           ticksToNs(profiler, *profiler.traceOrigin, begin),
+           ticksToNs(profiler, begin, end)});
+    }
+  }
+
+  if (profiler.frameBudgetMs > 0.0 &&
+      profiler.frameMs > profiler.frameBudgetMs) {
+    LOG_WARNF("GPU frame {} took {:.3f} ms of a {:.3f} ms budget, slowest "
+              "zone {} with {:.3f} ms.",
+              slot.frameNumber, profiler.frameMs, profiler.frameBudgetMs,
+              slowestName, slowestMs);
+  }
+}
+
+void beginGpuZone(VkCommandBuffer commandBuffer, const char *name) {
+  vulkan_gpu_profiler &profiler = getVulkanGpuProfilerStruct();
+  window_backend &vkWindow = getWindowBackendStruct();
+
+  if (profiler.queryPool == VK_NULL_HANDLE) {
+    return;
+  }
+
+  const uint32_t frame = vkWindow.currentFrame;
+  vulkan_gpu_profiler_frame &slot = profiler.frames[frame];
+
+  // Keep one query free for the end of every zone that is already open, so
+  // zones that got a start always get an end too.
+  const uint32_t reserved = static_cast<uint32_t>(profiler.openZones.size());
+  if (slot.queryCount + reserved + 2 > profiler.maxQueriesPerFrame) {
+    profiler.droppedZones++;
+    profiler.openZones.push_back(UINT32_MAX);
+    return;
+  }
+
+  vulkan_gpu_zone &zone = slot.zones.emplace_back();
+  zone.name = name;
+  zone.beginQuery = slot.queryCount++;
+  zone.depth = reserved;
+  profiler.openZones.push_back(static_cast<uint32_t>(slot.zones.size() - 1));
+
+  vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT,
+                      profiler.queryPool,
+                      queryBase(profiler, frame) + zone.beginQuery);
+}
+
+void endGpuZone(VkCommandBuffer commandBuffer) {
+  vulkan_gpu_profiler &profiler = getVulkanGpuProfilerStruct();
+  window_backend &vkWindow = getWindowBackendStruct();
+
+  if (profiler.queryPool == VK_NULL_HANDLE || profiler.openZones.empty()) {
+    return;
+  }
+
+  const uint32_t zoneIndex = profiler.openZones.back();
+  profiler.openZones.pop_back();
+  if (zoneIndex == UINT32_MAX) {
+    return;
+  }
+
+  const uint32_t frame = vkWindow.currentFrame;
+  vulkan_gpu_profiler_frame &slot = profiler.frames[frame];
+  vulkan_gpu_zone &zone = slot.zones[zoneIndex];
+  zone.endQuery = slot.queryCount++;
+
+  vkCmdWriteTimestamp(commandBuffer, VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT,
+                      profiler.queryPool,
+                      queryBase(profiler, frame) + zone.endQuery);
+}
+
+std::span<const vulkan_gpu_zone_result> getGpuZoneResults() {
+  return getVulkanGpuProfilerStruct().results;
+}
+
+void logGpuZones() {
+  vulkan_gpu_profiler &profiler = getVulkanGpuProfilerStruct();
+
+  LOG_INFOF("GPU frame {}: {:.3f} ms", profiler.resultsFrame,
+            profiler.frameMs);
+  for (const vulkan_gpu_zone_result &zone : profiler.results) {
+    LOG_INFOF("{:>{}}{}: {:.3f} ms (+{:.3f} ms)", "", zone.depth * 2 + 2,
+              zone.name, zone.durationMs, zone.startMs);
+  }
+}
+
+bool writeGpuTrace(const std::string &path) {
+  vulkan_gpu_profiler &profiler = getVulkanGpuProfilerStruct();
+
+  std::ofstream file(path, std::ios::trunc);
+  if (!file) {
+    LOG_ERRORF("Failed to open {} for the GPU trace.", path);
+    return false;
+  }
+
+  // Complete ("X") events on a single track, the viewer nests them by time.
+  file << "{\"traceEvents\":[\n";
+  file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,"
+          "\"args\":{\"name\":\"GPU\"}}";
+  for (size_t i = 0; i < profiler.trace.size(); i++) {
+    const vulkan_gpu_trace_event &event = profiler.trace[i];
+    file << std::format(",\n{{\"name\":\"{}\",\"cat\":\"gpu\",\"ph\":\"X\","
+                        "\"pid\":1,\"tid\":0,\"ts\":{:.3f},\"dur\":{:.3f},"
+                        "\"args\":{{\"frame\":{}}}}}",
+                        jsonEscape(event.name), event.startNs / 1000.0,
+                        event.durationNs / 1000.0, event.frameNumber);
+  }
+  file << "\n]}\n";
+
+  LOG_INFOF("Wrote {} GPU zones to {}.", profiler.trace.size(), path);
+  return static_cast<bool>(file);
+}
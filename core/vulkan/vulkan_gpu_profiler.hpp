@@ -0,0 +1,61 @@
+#pragma once
+
+#include "vulkan_types.hpp"
+
+#include <span>
+#include <string>
+#include <vulkan/vulkan.h>
+
+/// @brief Creates the timestamp query pool, one range of queries per frame in
+/// flight. Leaves the profiler disabled if the graphics queue cannot write
+/// timestamps. Must be called after createLogicalDevice().
+void createGpuProfiler();
+void destroyGpuProfiler();
+
+/// @brief Resets the query range of the current frame slot. Must be recorded
+/// before any zone of the frame and outside of a render pass, done by
+/// recordCommandBuffer().
+void beginGpuProfilerFrame(VkCommandBuffer commandBuffer);
+
+/// @brief Reads back the timestamps the given frame slot recorded
+/// maxFramesInFlight frames ago. Never waits, the slot's fence was already
+/// waited on by beginFrame() so the results are available.
+void collectGpuProfilerFrame(uint32_t frame);
+
+/// @brief Writes the start timestamp of a zone. Zones nest, every call needs
+/// a matching endGpuZone() in the same command buffer.
+void beginGpuZone(VkCommandBuffer commandBuffer, const char *name);
+void endGpuZone(VkCommandBuffer commandBuffer);
+
+/// @brief Zones of the most recently read back frame, in the order they began.
+std::span<const vulkan_gpu_zone_result> getGpuZoneResults();
+
+/// @brief Logs the zones of the most recently read back frame, indented by
+/// depth.
+void logGpuZones();
+
+/// @brief Writes the captured zones (see vulkan_gpu_profiler::captureTrace)
+/// as a Chrome trace, viewable in chrome://tracing or Perfetto.
+bool writeGpuTrace(const std::string &path);
+
+/// @brief Begins a zone and ends it when going out of scope.
+class GpuZone {
+public:
+  GpuZone(VkCommandBuffer commandBuffer, const char *name)
+      : commandBuffer_(commandBuffer) {
+    beginGpuZone(commandBuffer, name);
+  }
+
+  ~GpuZone() { endGpuZone(commandBuffer_); }
+
+  GpuZone(const GpuZone &) = delete;
+  GpuZone &operator=(const GpuZone &) = delete;
+
+private:
+  VkCommandBuffer commandBuffer_;
+};
+
+#define HK_GPU_ZONE_CONCAT_IMPL(a, b) a##b
+#define HK_GPU_ZONE_CONCAT(a, b) HK_GPU_ZONE_CONCAT_IMPL(a, b)
+#define HK_GPU_ZONE(commandBuffer, name)                                       \
+  GpuZone HK_GPU_ZONE_CONCAT(hkGpuZone, __LINE__)(commandBuffer, name)
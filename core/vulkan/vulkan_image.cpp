@@ -1,5 +1,6 @@
 #include "vulkan_image.hpp"
 #include "logger.hpp"
+#include "vulkan_memory.hpp"
 #include "vulkan_types.hpp"
 #include "vulkan_utils.hpp"
 #include <stdexcept>
@@ -40,3 +41,58 @@ void createImageViews() {
 
   LOG_INFO("Successfully created the image views.");
 }
+
+void createOffscreenTargets() {
+  vulkan_image &vkImage = getVulkanImageStruct();
+  vulkan_offscreen &vkOffscreen = getVulkanOffscreenStruct();
+  vulkan_swapchain &vkSwapchain = getVulkanSwapchainStruct();
+  window_backend &vkWindow = getWindowBackendStruct();
+
+  // Same format a window would most likely get, so the pipelines match.
+  vkSwapchain.format = {VK_FORMAT_B8G8R8A8_SRGB,
+                        VK_COLOR_SPACE_SRGB_NONLINEAR_KHR};
+
+  VkImageCreateInfo createInfo{};
+  createInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+  createInfo.imageType = VK_IMAGE_TYPE_2D;
+  createInfo.format = vkSwapchain.format.format;
+  createInfo.extent = {vkSwapchain.extent.width, vkSwapchain.extent.height, 1};
+  createInfo.mipLevels = 1;
+  createInfo.arrayLayers = 1;
+  createInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+  createInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+  // Transfer source so frames can be read back or blitted somewhere else.
+  createInfo.usage =
+      VK_IMAGE_USAGE_COLOR_ATTACHMENT_BIT | VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+  createInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+  createInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+  vkOffscreen.images.clear();
+  vkImage.swapChainImages.clear();
+  for (uint32_t i = 0; i < vkWindow.maxFramesInFlight; i++) {
+    vulkan_allocated_image image =
+        createImage(createInfo, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    vkOffscreen.images.push_back(image);
+    vkImage.swapChainImages.push_back(image.handle);
+  }
+
+  LOG_INFOF("Created {} offscreen render targets at {}x{}.",
+            vkOffscreen.images.size(), vkSwapchain.extent.width,
+            vkSwapchain.extent.height);
+}
+
+void destroyOffscreenTargets() {
+  vulkan_offscreen &vkOffscreen = getVulkanOffscreenStruct();
+
+  for (vulkan_retired_offscreen &retired : vkOffscreen.retired) {
+    for (vulkan_allocated_image &image : retired.images) {
+      destroyImage(image);
+    }
+  }
+  vkOffscreen.retired.clear();
+
+  for (vulkan_allocated_image &image : vkOffscreen.images) {
+    destroyImage(image);
+  }
+  vkOffscreen.images.clear();
+}
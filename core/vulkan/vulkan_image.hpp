@@ -1,3 +1,11 @@
 #pragma once
 
 void createImageViews();
+
+/// @brief Creates one color target per frame in flight for headless rendering
+/// without a surface and uses them as the swapchain images.
+void createOffscreenTargets();
+
+/// @brief Destroys the offscreen targets, including retired ones. The device
+/// has to be idle.
+void destroyOffscreenTargets();
@@ -1,30 +1,242 @@
 #include "vulkan_init.hpp"
+#include "logger.hpp"
 #include "vulkan_command_buffer.hpp"
 #include "vulkan_device.hpp"
+#include "vulkan_frame_pacing.hpp"
+#include "vulkan_gpu_profiler.hpp"
 #include "vulkan_image.hpp"
 #include "vulkan_instance.hpp"
+#include "vulkan_memory.hpp"
 #include "vulkan_pipeline.hpp"
+#include "vulkan_pipeline_cache.hpp"
+#include "vulkan_pipeline_registry.hpp"
 #include "vulkan_render.hpp"
+#include "vulkan_shader_reload.hpp"
+#include "vulkan_sprite.hpp"
 #include "vulkan_surface.hpp"
 #include "vulkan_swapchain.hpp"
+#include "vulkan_texture.hpp"
+#include "vulkan_types.hpp"
+#include "vulkan_upload.hpp"
+
+#include <algorithm>
+#include <string_view>
+
+namespace {
+// Everything from the render pass on is the same for every kind of target.
+void createFrameObjects() {
+  createImageViews();
+  createRenderPass();
+  createPipelineCache();
+  createGraphicsPipeline();
+  createFrameBuffers();
+  createCommandPools();
+  createSyncObjects();
+  createGpuProfiler();
+}
+
+void addExtension(std::vector<const char *> &extensions, const char *name) {
+  auto matches = [&](const char *extension) {
+    return std::string_view(extension) == name;
+  };
+
+  if (std::none_of(extensions.begin(), extensions.end(), matches)) {
+    extensions.push_back(name);
+  }
+}
+} // namespace
 
 void vkInitialize(GLFWwindow *window, VkInstanceCreateInfo createInfo) {
+  window_backend &vkWindow = getWindowBackendStruct();
+  if (vkWindow.maxFramesInFlight == 0) {
+    vkWindow.maxFramesInFlight = 1;
+  }
+
+  vkWindow.window = window;
+  glfwSetFramebufferSizeCallback(window, framebufferResizeCallback);
+
   getInstanceExtensions();
   createVkInstance(createInfo);
   createVkSurface(window); // This must be called BEFORE getting devices!!!
   getDevice();
   findQueueFamilies();
   createLogicalDevice();
+  createFramePacing();
+  createAllocator();
+  createUploadService();
+  createSpriteRenderer();
+  createTextureTable();
   querySwapchainSupport();
   chooseSwapSurfaceFormat();
   chooseSwapPresentMode();
   chooseSwapExtent(window);
   createSwapchain();
-  createImageViews();
-  createRenderPass();
-  createGraphicsPipeline();
-  createFrameBuffers();
-  createCommandPool();
-  createCommandBuffer();
-  createSyncObjects();
+  createFrameObjects();
+}
+
+void vkInitializeHeadless(VkInstanceCreateInfo createInfo, uint32_t width,
+                          uint32_t height) {
+  window_backend &vkWindow = getWindowBackendStruct();
+  vulkan_context &context = getVulkanContextStruct();
+  vulkan_device &vkDevice = getVulkanDeviceStruct();
+  if (vkWindow.maxFramesInFlight == 0) {
+    vkWindow.maxFramesInFlight = 1;
+  }
+
+  vkWindow.window = nullptr;
+  vkWindow.headless = true;
+  vkWindow.headlessExtent = {width, height};
+
+  const bool headlessSurface =
+      vkWindow.useHeadlessSurface &&
+      isInstanceExtensionSupported(VK_EXT_HEADLESS_SURFACE_EXTENSION_NAME);
+  if (vkWindow.useHeadlessSurface && !headlessSurface) {
+    LOG_WARN("VK_EXT_headless_surface is not supported, rendering into "
+             "offscreen images instead.");
+  }
+
+  // Keep whatever the caller enabled and add what the surface needs.
+  std::vector<const char *> &extensions = context.instanceExtensions;
+  extensions.assign(createInfo.ppEnabledExtensionNames,
+                    createInfo.ppEnabledExtensionNames +
+                        createInfo.enabledExtensionCount);
+
+  if (headlessSurface) {
+    addExtension(extensions, VK_KHR_SURFACE_EXTENSION_NAME);
+    addExtension(extensions, VK_EXT_HEADLESS_SURFACE_EXTENSION_NAME);
+    addExtension(vkDevice.deviceExtensions, VK_KHR_SWAPCHAIN_EXTENSION_NAME);
+  }
+
+  else {
+    // Nothing gets presented, so devices without a swapchain qualify too.
+    std::erase_if(vkDevice.deviceExtensions, [](const char *extension) {
+      return std::string_view(extension) == VK_KHR_SWAPCHAIN_EXTENSION_NAME;
+    });
+  }
+
+  createInfo.enabledExtensionCount = static_cast<uint32_t>(extensions.size());
+  createInfo.ppEnabledExtensionNames = extensions.data();
+
+  createVkInstance(createInfo);
+  if (headlessSurface) {
+    createHeadlessSurface();
+  }
+
+  getDevice();
+  findQueueFamilies();
+  createLogicalDevice();
+  createFramePacing();
+  createAllocator();
+  createUploadService();
+  createSpriteRenderer();
+  createTextureTable();
+
+  if (headlessSurface) {
+    querySwapchainSupport();
+    chooseSwapSurfaceFormat();
+    chooseSwapPresentMode();
+    chooseSwapExtent(nullptr);
+    createSwapchain();
+  }
+
+  else {
+    chooseSwapExtent(nullptr);
+    createOffscreenTargets();
+  }
+
+  createFrameObjects();
+
+  LOG_INFOF("Initialized headless rendering at {}x{} into {}.", width, height,
+            headlessSurface ? "a headless surface" : "offscreen images");
+}
+
+void vkShutdown() {
+  vulkan_context &context = getVulkanContextStruct();
+  vulkan_device &vkDevice = getVulkanDeviceStruct();
+  vulkan_swapchain &vkSwapchain = getVulkanSwapchainStruct();
+  vulkan_image &vkImage = getVulkanImageStruct();
+  vulkan_pipeline &vkPipeline = getVulkanPipelineStruct();
+  window_backend &vkWindow = getWindowBackendStruct();
+
+  if (vkDevice.logicalDevice == VK_NULL_HANDLE) {
+    return;
+  }
+
+  vkDeviceWaitIdle(vkDevice.logicalDevice);
+
+  stopShaderHotReload();
+  destroyPipelineRegistry();
+
+  savePipelineCache();
+  destroyPipelineCache();
+  destroyGpuProfiler();
+
+  for (VkSemaphore semaphore : vkWindow.imageAvailableSemaphores) {
+    vkDestroySemaphore(vkDevice.logicalDevice, semaphore, nullptr);
+  }
+
+  for (VkSemaphore semaphore : vkWindow.renderFinishedSemaphores) {
+    vkDestroySemaphore(vkDevice.logicalDevice, semaphore, nullptr);
+  }
+
+  for (VkFence fence : vkWindow.inFlightFences) {
+    vkDestroyFence(vkDevice.logicalDevice, fence, nullptr);
+  }
+
+  vkDestroySemaphore(vkDevice.logicalDevice, vkWindow.frameTimeline, nullptr);
+  vkWindow.frameTimeline = VK_NULL_HANDLE;
+
+  vkWindow.imageAvailableSemaphores.clear();
+  vkWindow.renderFinishedSemaphores.clear();
+  vkWindow.inFlightFences.clear();
+  vkWindow.imagesInFlight.clear();
+  vkWindow.imageTimelineValues.clear();
+
+  destroyCommandPools();
+  destroyFramePacing();
+
+  destroyRetiredSwapchains(true);
+
+  for (VkFramebuffer framebuffer : vkPipeline.swapChainFramebuffers) {
+    vkDestroyFramebuffer(vkDevice.logicalDevice, framebuffer, nullptr);
+  }
+  vkPipeline.swapChainFramebuffers.clear();
+
+  vkDestroyPipeline(vkDevice.logicalDevice, vkPipeline.graphicsPipeline,
+                    nullptr);
+  vkDestroyPipelineLayout(vkDevice.logicalDevice, vkPipeline.layout, nullptr);
+  vkDestroyRenderPass(vkDevice.logicalDevice, vkPipeline.renderPass, nullptr);
+  vkPipeline.graphicsPipeline = VK_NULL_HANDLE;
+  vkPipeline.layout = VK_NULL_HANDLE;
+  vkPipeline.renderPass = VK_NULL_HANDLE;
+
+  destroyTextureTable();
+
+  for (VkImageView imageView : vkImage.swapChainImageViews) {
+    vkDestroyImageView(vkDevice.logicalDevice, imageView, nullptr);
+  }
+  vkImage.swapChainImageViews.clear();
+  vkImage.swapChainImages.clear();
+
+  if (vkSwapchain.swapchain != VK_NULL_HANDLE) {
+    vkDestroySwapchainKHR(vkDevice.logicalDevice, vkSwapchain.swapchain,
+                          nullptr);
+    vkSwapchain.swapchain = VK_NULL_HANDLE;
+  }
+
+  destroyOffscreenTargets();
+  destroySpriteRenderer();
+  destroyUploadService();
+  destroyAllocator();
+
+  vkDestroyDevice(vkDevice.logicalDevice, nullptr);
+  vkDevice.logicalDevice = VK_NULL_HANDLE;
+
+  vkDestroySurfaceKHR(context.instance, vkWindow.surface, nullptr);
+  vkWindow.surface = VK_NULL_HANDLE;
+
+  vkDestroyInstance(context.instance, nullptr);
+  context.instance = VK_NULL_HANDLE;
+
+  LOG_INFO("Destroyed all vulkan objects.");
 }
@@ -4,3 +4,14 @@
 #include <vulkan/vulkan.h>
 
 void vkInitialize(GLFWwindow *window, VkInstanceCreateInfo createInfo);
+
+/// @brief Initializes the renderer without a window and without touching
+/// GLFW. Frames are rendered into offscreen images, or into a
+/// VK_EXT_headless_surface swapchain if window_backend::useHeadlessSurface is
+/// set and supported. The instance extensions of createInfo are kept.
+void vkInitializeHeadless(VkInstanceCreateInfo createInfo, uint32_t width,
+                          uint32_t height);
+
+/// @brief Waits for the GPU to finish, saves the pipeline cache and destroys
+/// every vulkan object created by vkInitialize().
+void vkShutdown();
@@ -6,6 +6,7 @@
 #include "vulkan_types.hpp"
 #include <GLFW/glfw3.h>
 
+#include <algorithm>
 #include <stdexcept>
 #include <string_view>
 #include <unordered_set>
@@ -19,7 +20,28 @@ void createVkInstance(VkInstanceCreateInfo &createInfo) {
     throw std::runtime_error("The vulkan instance already exists.");
   }
 
+  // Ask for Vulkan 1.2 when the loader has it, so optional 1.2 features like
+  // timeline semaphores can be used on devices that support them. Devices
+  // with an older version still work, the device version is checked later.
+  VkApplicationInfo appInfo{};
+  appInfo.sType = VK_STRUCTURE_TYPE_APPLICATION_INFO;
+  if (createInfo.pApplicationInfo) {
+    appInfo = *createInfo.pApplicationInfo;
+  }
+
+  uint32_t loaderVersion = VK_API_VERSION_1_0;
+  vkEnumerateInstanceVersion(&loaderVersion);
+  if (appInfo.apiVersion < VK_API_VERSION_1_2 &&
+      loaderVersion >= VK_API_VERSION_1_2) {
+    appInfo.apiVersion = VK_API_VERSION_1_2;
+  }
+
+  context.apiVersion = std::max(appInfo.apiVersion, VK_API_VERSION_1_0);
+  const VkApplicationInfo *callerAppInfo = createInfo.pApplicationInfo;
+  createInfo.pApplicationInfo = &appInfo;
+
   VkResult result = vkCreateInstance(&createInfo, nullptr, &context.instance);
+  createInfo.pApplicationInfo = callerAppInfo;
   std::string message = vkResultToString(result);
   if (!checkVkResult(result)) {
     LOG_FATAL(message);
@@ -31,10 +53,32 @@ void createVkInstance(VkInstanceCreateInfo &createInfo) {
   }
 }
 
+bool isInstanceExtensionSupported(std::string_view name) {
+  uint32_t extensionCount = 0;
+  vkEnumerateInstanceExtensionProperties(nullptr, &extensionCount, nullptr);
+
+  std::vector<VkExtensionProperties> extensions(extensionCount);
+  vkEnumerateInstanceExtensionProperties(nullptr, &extensionCount,
+                                         extensions.data());
+
+  for (const auto &extension : extensions) {
+    if (name == extension.extensionName) {
+      return true;
+    }
+  }
+
+  return false;
+}
+
 void getInstanceExtensions(std::initializer_list<std::string_view> optional) {
   vulkan_context &context = getVulkanContextStruct();
   uint32_t glfwCount = 0;
-  const char **glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwCount);
+  const char **glfwExtensions = nullptr;
+
+  // Headless runs never initialize GLFW, it has nothing to add then.
+  if (!getWindowBackendStruct().headless) {
+    glfwExtensions = glfwGetRequiredInstanceExtensions(&glfwCount);
+  }
 
   static thread_local std::vector<std::string> stringStorage;
   stringStorage.clear();
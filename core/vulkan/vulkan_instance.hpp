@@ -2,9 +2,12 @@
 
 #include <initializer_list>
 #include <string>
+#include <string_view>
 #include <vulkan/vulkan_core.h>
 
 void createVkInstance(VkInstanceCreateInfo &createInfo);
 
 void getInstanceExtensions(
     std::initializer_list<std::string_view> optional = {});
+
+bool isInstanceExtensionSupported(std::string_view name);
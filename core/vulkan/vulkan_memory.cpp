@@ -0,0 +1,484 @@
+#include "vulkan_memory.hpp"
+#include "logger.hpp"
+#include "vulkan_types.hpp"
+#include "vulkan_utils.hpp"
+
+#include <algorithm>
+#include <format>
+#include <stdexcept>
+#include <vulkan/vulkan_core.h>
+
+namespace {
+VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment) {
+  return (value + alignment - 1) & ~(alignment - 1);
+}
+
+VkDeviceSize preferredBlockSize(uint32_t memoryTypeIndex) {
+  vulkan_allocator &allocator = getVulkanAllocatorStruct();
+  uint32_t heapIndex =
+      allocator.memoryProperties.memoryTypes[memoryTypeIndex].heapIndex;
+  VkDeviceSize heapSize = allocator.memoryProperties.memoryHeaps[heapIndex].size;
+
+  // Small heaps (like the 256 MiB host visible BAR on most cards) would be
+  // eaten by a couple of blocks, so use a fraction of them instead.
+  VkDeviceSize blockSize = allocator.blockSize;
+  if (heapSize <= 1024ull * 1024 * 1024) {
+    blockSize = std::min(blockSize, heapSize / 8);
+  }
+
+  return alignUp(blockSize, TLSF_MIN_ALIGNMENT);
+}
+
+vulkan_memory_block *createBlock(uint32_t memoryTypeIndex,
+                                 vulkan_memory_kind kind, VkDeviceSize size,
+                                 VkDeviceSize minSize, bool dedicated) {
+  vulkan_device &vkDevice = getVulkanDeviceStruct();
+  vulkan_allocator &allocator = getVulkanAllocatorStruct();
+
+  if (allocator.deviceMemoryCount >= allocator.maxMemoryAllocationCount) {
+    LOG_ERROR("Reached maxMemoryAllocationCount.");
+    throw std::runtime_error("Reached maxMemoryAllocationCount.");
+  }
+
+  VkMemoryAllocateInfo allocInfo{};
+  allocInfo.sType = VK_STRUCTURE_TYPE_MEMORY_ALLOCATE_INFO;
+  allocInfo.memoryTypeIndex = memoryTypeIndex;
+
+  VkDeviceMemory memory = VK_NULL_HANDLE;
+  VkResult result;
+
+  // When the heap is getting full retry with smaller blocks, as long as they
+  // can still fit the allocation that asked for them.
+  while (true) {
+    allocInfo.allocationSize = size;
+    result =
+        vkAllocateMemory(vkDevice.logicalDevice, &allocInfo, nullptr, &memory);
+
+    if (result != VK_ERROR_OUT_OF_DEVICE_MEMORY || size / 2 < minSize) {
+      break;
+    }
+
+    size = alignUp(size / 2, TLSF_MIN_ALIGNMENT);
+  }
+
+  if (!checkVkResult(result)) {
+    LOG_ERROR(vkResultToString(result));
+    throw std::runtime_error(vkResultToString(result));
+  }
+
+  allocator.deviceMemoryCount++;
+
+  auto block = std::make_unique<vulkan_memory_block>();
+  block->memory = memory;
+  block->memoryTypeIndex = memoryTypeIndex;
+  block->kind = kind;
+  block->dedicated = dedicated;
+  tlsfInit(block->tlsf, size);
+
+  // Keeping host visible blocks mapped for their whole lifetime is free and
+  // saves a map/unmap pair around every upload.
+  if (allocator.memoryProperties.memoryTypes[memoryTypeIndex].propertyFlags &
+      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) {
+    result = vkMapMemory(vkDevice.logicalDevice, memory, 0, VK_WHOLE_SIZE, 0,
+                         &block->mapped);
+    if (!checkVkResult(result)) {
+      LOG_ERROR(vkResultToString(result));
+      throw std::runtime_error(vkResultToString(result));
+    }
+  }
+
+  allocator.blocks.push_back(std::move(block));
+  return allocator.blocks.back().get();
+}
+
+void destroyBlock(vulkan_memory_block *block) {
+  vulkan_device &vkDevice = getVulkanDeviceStruct();
+  vulkan_allocator &allocator = getVulkanAllocatorStruct();
+
+  // Freeing the memory implicitly unmaps it.
+  vkFreeMemory(vkDevice.logicalDevice, block->memory, nullptr);
+  allocator.deviceMemoryCount--;
+
+  std::erase_if(allocator.blocks,
+                [block](const std::unique_ptr<vulkan_memory_block> &other) {
+                  return other.get() == block;
+                });
+}
+
+vulkan_allocation makeAllocation(vulkan_memory_block *block, uint32_t node,
+                                 VkDeviceSize size) {
+  vulkan_allocation allocation{};
+  allocation.memory = block->memory;
+  allocation.offset = block->tlsf.nodes[node].offset;
+  allocation.size = size;
+  allocation.block = block;
+  allocation.node = node;
+
+  if (block->mapped) {
+    allocation.mapped = static_cast<char *>(block->mapped) + allocation.offset;
+  }
+
+  return allocation;
+}
+} // namespace
+
+void createAllocator() {
+  vulkan_device &vkDevice = getVulkanDeviceStruct();
+  vulkan_allocator &allocator = getVulkanAllocatorStruct();
+  window_backend &vkWindow = getWindowBackendStruct();
+
+  vkGetPhysicalDeviceMemoryProperties(vkDevice.vkPhysDevice,
+                                      &allocator.memoryProperties);
+
+  VkPhysicalDeviceProperties properties;
+  vkGetPhysicalDeviceProperties(vkDevice.vkPhysDevice, &properties);
+  allocator.bufferImageGranularity = properties.limits.bufferImageGranularity;
+  allocator.nonCoherentAtomSize = properties.limits.nonCoherentAtomSize;
+  allocator.maxMemoryAllocationCount =
+      properties.limits.maxMemoryAllocationCount;
+
+  vulkan_linear_pool &transient = allocator.transient;
+  transient.alignment = std::max<VkDeviceSize>(
+      {transient.alignment, properties.limits.minUniformBufferOffsetAlignment,
+       properties.limits.minStorageBufferOffsetAlignment});
+  transient.frameSize = alignUp(transient.frameSize, transient.alignment);
+  transient.buffer = createBuffer(
+      transient.frameSize * vkWindow.maxFramesInFlight,
+      VK_BUFFER_USAGE_VERTEX_BUFFER_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT |
+          VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT |
+          VK_BUFFER_USAGE_STORAGE_BUFFER_BIT |
+          VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+          VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+
+  LOG_INFOF("Created the memory allocator ({} memory types, "
+            "bufferImageGranularity {}).",
+            allocator.memoryProperties.memoryTypeCount,
+            allocator.bufferImageGranularity);
+}
+
+void destroyAllocator() {
+  vulkan_device &vkDevice = getVulkanDeviceStruct();
+  vulkan_allocator &allocator = getVulkanAllocatorStruct();
+
+  destroyBuffer(allocator.transient.buffer);
+
+  for (auto &block : allocator.blocks) {
+    if (block->tlsf.allocationCount > 0) {
+      LOG_WARNF("Freeing a memory block with {} live allocations.",
+                block->tlsf.allocationCount);
+    }
+
+    vkFreeMemory(vkDevice.logicalDevice, block->memory, nullptr);
+  }
+
+  allocator.blocks.clear();
+  allocator.deviceMemoryCount = 0;
+}
+
+uint32_t findMemoryType(uint32_t typeBits, VkMemoryPropertyFlags properties) {
+  vulkan_allocator &allocator = getVulkanAllocatorStruct();
+
+  for (uint32_t i = 0; i < allocator.memoryProperties.memoryTypeCount; i++) {
+    if ((typeBits & (1u << i)) &&
+        (allocator.memoryProperties.memoryTypes[i].propertyFlags &
+         properties) == properties) {
+      return i;
+    }
+  }
+
+  LOG_ERROR("Failed to find a suitable memory type.");
+  throw std::runtime_error("Failed to find a suitable memory type.");
+}
+
+vulkan_allocation allocateMemory(const VkMemoryRequirements &requirements,
+                                 VkMemoryPropertyFlags properties,
+                                 vulkan_memory_kind kind) {
+  vulkan_allocator &allocator = getVulkanAllocatorStruct();
+
+  uint32_t memoryTypeIndex =
+      findMemoryType(requirements.memoryTypeBits, properties);
+  VkMemoryPropertyFlags typeFlags =
+      allocator.memoryProperties.memoryTypes[memoryTypeIndex].propertyFlags;
+
+  // Flushes of non-coherent memory work on whole atoms, so allocations must
+  // not share one.
+  VkDeviceSize alignment = requirements.alignment;
+  if ((typeFlags & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT) &&
+      !(typeFlags & VK_MEMORY_PROPERTY_HOST_COHERENT_BIT)) {
+    alignment = std::max(alignment, allocator.nonCoherentAtomSize);
+  }
+
+  // Linear and optimal resources only conflict when the granularity is larger
+  // than one byte. Keeping them in separate blocks means we never have to pad
+  // between neighbours.
+  if (allocator.bufferImageGranularity <= 1) {
+    kind = vulkan_memory_kind::LINEAR;
+  }
+
+  VkDeviceSize blockSize = preferredBlockSize(memoryTypeIndex);
+  if (requirements.size > blockSize / 2) {
+    VkDeviceSize size = alignUp(requirements.size, TLSF_MIN_ALIGNMENT);
+    vulkan_memory_block *block =
+        createBlock(memoryTypeIndex, kind, size, size, true);
+
+    // The block is exactly as large as the request, a TLSF search would
+    // round it up past the block.
+    uint32_t node = tlsfAllocateWhole(block->tlsf);
+    if (node == TLSF_NONE) {
+      destroyBlock(block);
+      LOG_ERROR("Failed to allocate a dedicated memory block.");
+      throw std::runtime_error("Failed to allocate a dedicated memory block.");
+    }
+    return makeAllocation(block, node, requirements.size);
+  }
+
+  for (auto &block : allocator.blocks) {
+    if (block->dedicated || block->memoryTypeIndex != memoryTypeIndex ||
+        block->kind != kind) {
+      continue;
+    }
+
+    uint32_t node = tlsfAllocate(block->tlsf, requirements.size, alignment);
+    if (node != TLSF_NONE) {
+      return makeAllocation(block.get(), node, requirements.size);
+    }
+  }
+
+  vulkan_memory_block *block =
+      createBlock(memoryTypeIndex, kind, blockSize,
+                  alignUp(requirements.size + alignment, TLSF_MIN_ALIGNMENT),
+                  false);
+  uint32_t node = tlsfAllocate(block->tlsf, requirements.size, alignment);
+  if (node == TLSF_NONE) {
+    LOG_ERROR("Failed to sub-allocate from a fresh memory block.");
+    throw std::runtime_error(
+        "Failed to sub-allocate from a fresh memory block.");
+  }
+
+  return makeAllocation(block, node, requirements.size);
+}
+
+void freeMemory(vulkan_allocation &allocation) {
+  vulkan_allocator &allocator = getVulkanAllocatorStruct();
+  vulkan_memory_block *block = allocation.block;
+
+  if (block == nullptr) {
+    return;
+  }
+
+  tlsfFree(block->tlsf, allocation.node);
+  allocation = vulkan_allocation{};
+
+  if (block->dedicated) {
+    destroyBlock(block);
+    return;
+  }
+
+  // Keep one empty block per memory type around so that a resource being
+  // destroyed and recreated every frame doesn't hit vkAllocateMemory.
+  if (block->tlsf.allocationCount == 0) {
+    bool hasSpare = std::any_of(
+        allocator.blocks.begin(), allocator.blocks.end(),
+        [block](const std::unique_ptr<vulkan_memory_block> &other) {
+          return other.get() != block && !other->dedicated &&
+                 other->memoryTypeIndex == block->memoryTypeIndex &&
+                 other->kind == block->kind &&
+                 other->tlsf.allocationCount == 0;
+        });
+
+    if (hasSpare) {
+      destroyBlock(block);
+    }
+  }
+}
+
+vulkan_buffer createBuffer(VkDeviceSize size, VkBufferUsageFlags usage,
+                           VkMemoryPropertyFlags properties) {
+  vulkan_device &vkDevice = getVulkanDeviceStruct();
+
+  VkBufferCreateInfo bufferInfo{};
+  bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
+  bufferInfo.size = size;
+  bufferInfo.usage = usage;
+  bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+
+  vulkan_buffer buffer{};
+  buffer.size = size;
+
+  VkResult result = vkCreateBuffer(vkDevice.logicalDevice, &bufferInfo,
+                                   nullptr, &buffer.handle);
+  if (!checkVkResult(result)) {
+    LOG_ERROR(vkResultToString(result));
+    throw std::runtime_error(vkResultToString(result));
+  }
+
+  VkMemoryRequirements requirements;
+  vkGetBufferMemoryRequirements(vkDevice.logicalDevice, buffer.handle,
+                                &requirements);
+
+  buffer.allocation =
+      allocateMemory(requirements, properties, vulkan_memory_kind::LINEAR);
+
+  result = vkBindBufferMemory(vkDevice.logicalDevice, buffer.handle,
+                              buffer.allocation.memory,
+                              buffer.allocation.offset);
+  if (!checkVkResult(result)) {
+    LOG_ERROR(vkResultToString(result));
+    throw std::runtime_error(vkResultToString(result));
+  }
+
+  return buffer;
+}
+
+void destroyBuffer(vulkan_buffer &buffer) {
+  vulkan_device &vkDevice = getVulkanDeviceStruct();
+
+  if (buffer.handle != VK_NULL_HANDLE) {
+    vkDestroyBuffer(vkDevice.logicalDevice, buffer.handle, nullptr);
+  }
+
+  freeMemory(buffer.allocation);
+  buffer = vulkan_buffer{};
+}
+
+vulkan_allocated_image createImage(const VkImageCreateInfo &createInfo,
+                                   VkMemoryPropertyFlags properties) {
+  vulkan_device &vkDevice = getVulkanDeviceStruct();
+
+  vulkan_allocated_image image{};
+  VkResult result = vkCreateImage(vkDevice.logicalDevice, &createInfo, nullptr,
+                                  &image.handle);
+  if (!checkVkResult(result)) {
+    LOG_ERROR(vkResultToString(result));
+    throw std::runtime_error(vkResultToString(result));
+  }
+
+  VkMemoryRequirements requirements;
+  vkGetImageMemoryRequirements(vkDevice.logicalDevice, image.handle,
+                               &requirements);
+
+  image.allocation = allocateMemory(requirements, properties,
+                                    createInfo.tiling == VK_IMAGE_TILING_OPTIMAL
+                                        ? vulkan_memory_kind::OPTIMAL
+                                        : vulkan_memory_kind::LINEAR);
+
+  result = vkBindImageMemory(vkDevice.logicalDevice, image.handle,
+                             image.allocation.memory, image.allocation.offset);
+  if (!checkVkResult(result)) {
+    LOG_ERROR(vkResultToString(result));
+    throw std::runtime_error(vkResultToString(result));
+  }
+
+  return image;
+}
+
+void destroyImage(vulkan_allocated_image &image) {
+  vulkan_device &vkDevice = getVulkanDeviceStruct();
+
+  if (image.handle != VK_NULL_HANDLE) {
+    vkDestroyImage(vkDevice.logicalDevice, image.handle, nullptr);
+  }
+
+  freeMemory(image.allocation);
+  image = vulkan_allocated_image{};
+}
+
+void beginTransientFrame(uint32_t frame) {
+  vulkan_linear_pool &transient = getVulkanAllocatorStruct().transient;
+
+  transient.highWatermark =
+      std::max(transient.highWatermark, transient.frameOffset);
+  transient.currentFrame = frame;
+  transient.frameOffset = 0;
+}
+
+vulkan_transient_allocation allocateTransient(VkDeviceSize size,
+                                              VkDeviceSize alignment) {
+  vulkan_linear_pool &transient = getVulkanAllocatorStruct().transient;
+
+  VkDeviceSize offset =
+      alignUp(transient.frameOffset, std::max(alignment, transient.alignment));
+  if (offset + size > transient.frameSize) {
+    LOG_ERRORF("The transient pool ran out of memory ({} bytes per frame).",
+               transient.frameSize);
+    throw std::runtime_error("The transient pool ran out of memory.");
+  }
+
+  transient.frameOffset = offset + size;
+
+  vulkan_transient_allocation allocation{};
+  allocation.buffer = transient.buffer.handle;
+  allocation.offset = transient.currentFrame * transient.frameSize + offset;
+  allocation.size = size;
+  allocation.mapped =
+      static_cast<char *>(transient.buffer.allocation.mapped) +
+      allocation.offset;
+  return allocation;
+}
+
+vulkan_memory_stats getMemoryStats() {
+  vulkan_allocator &allocator = getVulkanAllocatorStruct();
+
+  vulkan_memory_stats stats{};
+  stats.deviceMemoryCount = allocator.deviceMemoryCount;
+  stats.transientHighWatermark = std::max(allocator.transient.highWatermark,
+                                          allocator.transient.frameOffset);
+  stats.heaps.resize(allocator.memoryProperties.memoryHeapCount);
+
+  std::vector<VkDeviceSize> freeBytes(stats.heaps.size(), 0);
+  std::vector<VkDeviceSize> largestFreeSum(stats.heaps.size(), 0);
+
+  for (uint32_t i = 0; i < stats.heaps.size(); i++) {
+    stats.heaps[i].heapSize = allocator.memoryProperties.memoryHeaps[i].size;
+  }
+
+  for (const auto &block : allocator.blocks) {
+    uint32_t heapIndex =
+        allocator.memoryProperties.memoryTypes[block->memoryTypeIndex]
+            .heapIndex;
+    vulkan_heap_stats &heap = stats.heaps[heapIndex];
+
+    VkDeviceSize largest = tlsfLargestFreeRange(block->tlsf);
+    heap.blockBytes += block->tlsf.size;
+    heap.usedBytes += block->tlsf.usedBytes;
+    heap.largestFreeRange = std::max(heap.largestFreeRange, largest);
+    heap.blockCount++;
+    heap.allocationCount += block->tlsf.allocationCount;
+
+    freeBytes[heapIndex] += block->tlsf.size - block->tlsf.usedBytes;
+    largestFreeSum[heapIndex] += largest;
+  }
+
+  for (uint32_t i = 0; i < stats.heaps.size(); i++) {
+    if (freeBytes[i] > 0) {
+      stats.heaps[i].fragmentation =
+          1.0f - static_cast<float>(largestFreeSum[i]) /
+                     static_cast<float>(freeBytes[i]);
+    }
+  }
+
+  return stats;
+}
+
+void logMemoryStats() {
+  vulkan_memory_stats stats = getMemoryStats();
+
+  for (uint32_t i = 0; i < stats.heaps.size(); i++) {
+    const vulkan_heap_stats &heap = stats.heaps[i];
+    if (heap.blockCount == 0) {
+      continue;
+    }
+
+    LOG_INFOF("Heap {}: {:.2f}/{:.2f} MiB used in {} blocks ({} "
+              "allocations, {:.1f}% fragmented, heap size {:.2f} "
+              "MiB).",
+              i, heap.usedBytes / (1024.0 * 1024.0),
+              heap.blockBytes / (1024.0 * 1024.0), heap.blockCount,
+              heap.allocationCount, heap.fragmentation * 100.0f,
+              heap.heapSize / (1024.0 * 1024.0));
+  }
+
+  LOG_INFOF("{} device memory objects, {} KiB transient high watermark.",
+            stats.deviceMemoryCount, stats.transientHighWatermark / 1024);
+}
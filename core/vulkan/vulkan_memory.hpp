@@ -0,0 +1,44 @@
+#pragma once
+
+#include "vulkan_types.hpp"
+
+#include <vulkan/vulkan.h>
+
+/// @brief Queries the memory layout of the device and creates the per-frame
+/// linear pool. Must be called after createLogicalDevice().
+void createAllocator();
+
+/// @brief Frees every block. All buffers and images have to be destroyed
+/// before this is called.
+void destroyAllocator();
+
+/// @brief Finds a memory type allowed by typeBits that has all the requested
+/// property flags.
+uint32_t findMemoryType(uint32_t typeBits, VkMemoryPropertyFlags properties);
+
+/// @brief Sub-allocates memory from a large block of a matching memory type.
+/// Allocations larger than half a block get a dedicated block instead.
+vulkan_allocation allocateMemory(const VkMemoryRequirements &requirements,
+                                 VkMemoryPropertyFlags properties,
+                                 vulkan_memory_kind kind);
+void freeMemory(vulkan_allocation &allocation);
+
+vulkan_buffer createBuffer(VkDeviceSize size, VkBufferUsageFlags usage,
+                           VkMemoryPropertyFlags properties);
+void destroyBuffer(vulkan_buffer &buffer);
+
+vulkan_allocated_image createImage(const VkImageCreateInfo &createInfo,
+                                   VkMemoryPropertyFlags properties);
+void destroyImage(vulkan_allocated_image &image);
+
+/// @brief Starts handing out transient memory from the region of the given
+/// frame slot. Only call it once the frame's fence has been waited on.
+void beginTransientFrame(uint32_t frame);
+
+/// @brief Bump allocates host visible memory that stays valid until the same
+/// frame slot comes around again.
+vulkan_transient_allocation allocateTransient(VkDeviceSize size,
+                                              VkDeviceSize alignment = 0);
+
+vulkan_memory_stats getMemoryStats();
+void logMemoryStats();
@@ -1,8 +1,12 @@
 #include "vulkan_pipeline.hpp"
+#include "asset_archive.hpp"
 #include "logger.hpp"
+#include "vulkan_sprite.hpp"
 #include "vulkan_types.hpp"
 #include "vulkan_utils.hpp"
 
+#include <chrono>
+#include <format>
 #include <fstream>
 #include <stdexcept>
 #include <vulkan/vulkan_core.h>
@@ -45,7 +49,7 @@ std::vector<char> readFile(const std::string &filename) {
   std::ifstream file(filename, std::ios::ate | std::ios::binary);
 
   if (!file.is_open()) {
-    LOG_ERROR(std::format("Failed to open the file: {}", filename));
+    LOG_ERRORF("Failed to open the file: {}", filename);
     throw std::runtime_error(
         std::format("Failed to open the file: {}", filename));
   }
@@ -61,6 +65,17 @@ std::vector<char> readFile(const std::string &filename) {
   return buffer;
 }
 
+std::span<const std::byte> loadShaderCode(const std::string &name,
+                                          std::vector<char> &storage) {
+  AssetArchive &archive = getAssetArchive();
+  if (archive.isOpen()) {
+    return archive.view("shaders/" + name);
+  }
+
+  storage = readFile(HAKKERO_SHADER_DIR "/" + name);
+  return std::as_bytes(std::span(storage));
+}
+
 void createRenderPass() {
   vulkan_swapchain &vkSwapchain = getVulkanSwapchainStruct();
   vulkan_device &vkDevice = getVulkanDeviceStruct();
@@ -74,7 +89,15 @@ void createRenderPass() {
   colorAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
   colorAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
   colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
-  colorAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+
+  // Offscreen targets are never presented, leave them ready to be copied out.
+  if (getWindowBackendStruct().surface == VK_NULL_HANDLE) {
+    colorAttachment.finalLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+  }
+
+  else {
+    colorAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+  }
 
   VkAttachmentReference colorAttachmentRef{};
   colorAttachmentRef.attachment = 0;
@@ -116,11 +139,57 @@ void createRenderPass() {
 
 void createGraphicsPipeline() {
   vulkan_device &vkDevice = getVulkanDeviceStruct();
-  // vulkan_swapchain &vkSwapchain = getVulkanSwapchainStruct();
   vulkan_pipeline &vkPipeline = getVulkanPipelineStruct();
 
-  auto vertShaderCode = readFile("../../../samples/shaders/vert.spv");
-  auto fragShaderCode = readFile("../../../samples/shaders/frag.spv");
+  VkPushConstantRange pushConstantRange{};
+  pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+  pushConstantRange.offset = 0;
+  pushConstantRange.size = sizeof(sprite_push_constants);
+
+  // Set 0 is the texture table.
+  VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
+  pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+  pipelineLayoutInfo.setLayoutCount = 1;
+  pipelineLayoutInfo.pSetLayouts = &getVulkanTextureTableStruct().setLayout;
+  pipelineLayoutInfo.pushConstantRangeCount = 1;
+  pipelineLayoutInfo.pPushConstantRanges = &pushConstantRange;
+
+  VkResult result = vkCreatePipelineLayout(
+      vkDevice.logicalDevice, &pipelineLayoutInfo, nullptr, &vkPipeline.layout);
+  if (!checkVkResult(result)) {
+    LOG_ERROR(vkResultToString(result));
+    throw std::runtime_error(vkResultToString(result));
+  }
+
+  else {
+    LOG_INFO("Created the pipeline layout.");
+  }
+
+  std::vector<char> vertStorage, fragStorage;
+  auto vertShaderCode = loadShaderCode("sprite.vert.spv", vertStorage);
+  auto fragShaderCode = loadShaderCode(getSpriteFragmentShader(), fragStorage);
+  vkPipeline.graphicsPipeline =
+      createSpritePipeline(vertShaderCode, fragShaderCode);
+}
+
+std::string getSpriteFragmentShader() {
+  return getVulkanTextureTableStruct().bindless ? "sprite.frag.spv"
+                                                : "sprite_array.frag.spv";
+}
+
+VkPipeline createSpritePipeline(std::span<const std::byte> vertShaderCode,
+                                std::span<const std::byte> fragShaderCode) {
+  pipeline_desc desc{};
+  desc.renderPass = getVulkanPipelineStruct().renderPass;
+  return createPipeline(desc, vertShaderCode, fragShaderCode);
+}
+
+VkPipeline createPipeline(const pipeline_desc &desc,
+                          std::span<const std::byte> vertShaderCode,
+                          std::span<const std::byte> fragShaderCode) {
+  vulkan_device &vkDevice = getVulkanDeviceStruct();
+  vulkan_pipeline &vkPipeline = getVulkanPipelineStruct();
+  vulkan_pipeline_cache &vkPipelineCache = getVulkanPipelineCacheStruct();
 
   VkShaderModule vertShaderModule = createShaderModule(vertShaderCode);
   VkShaderModule fragShaderModule = createShaderModule(fragShaderCode);
@@ -142,16 +211,24 @@ void createGraphicsPipeline() {
   VkPipelineShaderStageCreateInfo shaderStages[] = {vertShaderStageInfo,
                                                     fragShaderStageInfo};
 
+  // Binding 0 is the unit quad, binding 1 steps once per sprite instance.
+  VkVertexInputBindingDescription bindings[] = {getSpriteVertexBinding(),
+                                                getSpriteInstanceBinding()};
+  auto attributes = getSpriteAttributes();
+
   VkPipelineVertexInputStateCreateInfo vertexInputInfo{};
   vertexInputInfo.sType =
       VK_STRUCTURE_TYPE_PIPELINE_VERTEX_INPUT_STATE_CREATE_INFO;
-  vertexInputInfo.vertexBindingDescriptionCount = 0;
-  vertexInputInfo.vertexAttributeDescriptionCount = 0;
+  vertexInputInfo.vertexBindingDescriptionCount = 2;
+  vertexInputInfo.pVertexBindingDescriptions = bindings;
+  vertexInputInfo.vertexAttributeDescriptionCount =
+      static_cast<uint32_t>(attributes.size());
+  vertexInputInfo.pVertexAttributeDescriptions = attributes.data();
 
   VkPipelineInputAssemblyStateCreateInfo inputAssembly{};
   inputAssembly.sType =
       VK_STRUCTURE_TYPE_PIPELINE_INPUT_ASSEMBLY_STATE_CREATE_INFO;
-  inputAssembly.topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+  inputAssembly.topology = static_cast<VkPrimitiveTopology>(desc.topology);
   inputAssembly.primitiveRestartEnable = VK_FALSE;
 
   std::vector<VkDynamicState> dynamicStates = {VK_DYNAMIC_STATE_VIEWPORT,
@@ -171,9 +248,11 @@ void createGraphicsPipeline() {
   rasterizer.sType = VK_STRUCTURE_TYPE_PIPELINE_RASTERIZATION_STATE_CREATE_INFO;
   rasterizer.depthClampEnable = VK_FALSE;
   rasterizer.rasterizerDiscardEnable = VK_FALSE;
-  rasterizer.polygonMode = VK_POLYGON_MODE_FILL;
+  rasterizer.polygonMode = static_cast<VkPolygonMode>(desc.polygonMode);
   rasterizer.lineWidth = 1.0f;
-  rasterizer.cullMode = VK_CULL_MODE_BACK_BIT;
+  // Sprites can be mirrored with a negative scale, so they aren't culled by
+  // default.
+  rasterizer.cullMode = desc.cullMode;
   rasterizer.frontFace = VK_FRONT_FACE_CLOCKWISE;
   rasterizer.depthBiasEnable = VK_FALSE;
 
@@ -187,7 +266,33 @@ void createGraphicsPipeline() {
   colorBlendAttachment.colorWriteMask =
       VK_COLOR_COMPONENT_R_BIT | VK_COLOR_COMPONENT_G_BIT |
       VK_COLOR_COMPONENT_B_BIT | VK_COLOR_COMPONENT_A_BIT;
-  colorBlendAttachment.blendEnable = VK_FALSE;
+  colorBlendAttachment.blendEnable = VK_TRUE;
+  colorBlendAttachment.srcColorBlendFactor = VK_BLEND_FACTOR_SRC_ALPHA;
+  colorBlendAttachment.dstColorBlendFactor =
+      VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+  colorBlendAttachment.colorBlendOp = VK_BLEND_OP_ADD;
+  colorBlendAttachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+  colorBlendAttachment.dstAlphaBlendFactor =
+      VK_BLEND_FACTOR_ONE_MINUS_SRC_ALPHA;
+  colorBlendAttachment.alphaBlendOp = VK_BLEND_OP_ADD;
+
+  switch (desc.blend) {
+  case SpriteBlendMode::ALPHA:
+    break;
+  case SpriteBlendMode::ADDITIVE:
+    colorBlendAttachment.dstColorBlendFactor = VK_BLEND_FACTOR_ONE;
+    colorBlendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+    break;
+  case SpriteBlendMode::MULTIPLY:
+    colorBlendAttachment.srcColorBlendFactor = VK_BLEND_FACTOR_DST_COLOR;
+    colorBlendAttachment.dstColorBlendFactor = VK_BLEND_FACTOR_ZERO;
+    colorBlendAttachment.srcAlphaBlendFactor = VK_BLEND_FACTOR_ZERO;
+    colorBlendAttachment.dstAlphaBlendFactor = VK_BLEND_FACTOR_ONE;
+    break;
+  case SpriteBlendMode::OPAQUE:
+    colorBlendAttachment.blendEnable = VK_FALSE;
+    break;
+  }
 
   VkPipelineColorBlendStateCreateInfo colorBlending{};
   colorBlending.sType =
@@ -197,20 +302,6 @@ void createGraphicsPipeline() {
   colorBlending.attachmentCount = 1;
   colorBlending.pAttachments = &colorBlendAttachment;
 
-  VkPipelineLayoutCreateInfo pipelineLayoutInfo{};
-  pipelineLayoutInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-
-  VkResult result = vkCreatePipelineLayout(
-      vkDevice.logicalDevice, &pipelineLayoutInfo, nullptr, &vkPipeline.layout);
-  if (!checkVkResult(result)) {
-    LOG_ERROR(vkResultToString(result));
-    throw std::runtime_error(vkResultToString(result));
-  }
-
-  else {
-    LOG_INFO("Created the pipeline layout.");
-  }
-
   VkGraphicsPipelineCreateInfo pipelineInfo{};
   pipelineInfo.sType = VK_STRUCTURE_TYPE_GRAPHICS_PIPELINE_CREATE_INFO;
   pipelineInfo.stageCount = 2;
@@ -223,26 +314,41 @@ void createGraphicsPipeline() {
   pipelineInfo.pColorBlendState = &colorBlending;
   pipelineInfo.pDynamicState = &dynamicState;
   pipelineInfo.layout = vkPipeline.layout;
-  pipelineInfo.renderPass = vkPipeline.renderPass;
+  pipelineInfo.renderPass = desc.renderPass;
   pipelineInfo.subpass = 0;
 
-  VkResult pipelineResult = vkCreateGraphicsPipelines(
-      vkDevice.logicalDevice, VK_NULL_HANDLE, 1, &pipelineInfo, nullptr,
-      &vkPipeline.graphicsPipeline);
+  auto compileStart = std::chrono::steady_clock::now();
+
+  VkPipeline pipeline = VK_NULL_HANDLE;
+  VkResult pipelineResult =
+      vkCreateGraphicsPipelines(vkDevice.logicalDevice, vkPipelineCache.handle,
+                                1, &pipelineInfo, nullptr, &pipeline);
+
+  // The modules are only needed while the pipeline is created.
+  vkDestroyShaderModule(vkDevice.logicalDevice, fragShaderModule, nullptr);
+  vkDestroyShaderModule(vkDevice.logicalDevice, vertShaderModule, nullptr);
+
   if (!checkVkResult(pipelineResult)) {
     LOG_ERROR(vkResultToString(pipelineResult));
     throw std::runtime_error(vkResultToString(pipelineResult));
   }
 
   else {
-    LOG_INFO("Created the graphics pipeline.");
+    std::chrono::duration<double, std::milli> compileTime =
+        std::chrono::steady_clock::now() - compileStart;
+    LOG_INFOF("Created the graphics pipeline in {:.3f} ms ({} pipeline cache).",
+              compileTime.count(),
+              vkPipelineCache.loadedFromDisk ? "warm" : "cold");
   }
 
-  vkDestroyShaderModule(vkDevice.logicalDevice, fragShaderModule, nullptr);
-  vkDestroyShaderModule(vkDevice.logicalDevice, vertShaderModule, nullptr);
+  return pipeline;
 }
 
 VkShaderModule createShaderModule(const std::vector<char> &code) {
+  return createShaderModule(std::as_bytes(std::span(code)));
+}
+
+VkShaderModule createShaderModule(std::span<const std::byte> code) {
   vulkan_device &vkDevice = getVulkanDeviceStruct();
 
   VkShaderModuleCreateInfo createInfo{};
@@ -1,12 +1,77 @@
 #pragma once
 
+#include <cstddef>
+#include <cstdint>
+#include <span>
 #include <string>
 #include <vector>
 #include <vulkan/vulkan.h>
 
+enum class SpriteBlendMode : uint8_t {
+  /// @brief Regular alpha blending, what graphicsPipeline uses.
+  ALPHA,
+  /// @brief Adds the color weighted by its alpha, for glowing bullets.
+  ADDITIVE,
+  /// @brief Darkens by the color, for shadows.
+  MULTIPLY,
+  /// @brief No blending at all.
+  OPAQUE,
+};
+
+/// @brief Every piece of state a sprite pipeline varies in, packed without
+/// padding so it can be hashed and compared as raw bytes. Pipelines with
+/// equal descriptions are interchangeable.
+struct pipeline_desc {
+  /// @brief hashAssetName() of the SPIR-V names, see loadShaderCode().
+  uint64_t vertexShader = 0;
+  uint64_t fragmentShader = 0;
+
+  VkRenderPass renderPass = VK_NULL_HANDLE;
+
+  SpriteBlendMode blend = SpriteBlendMode::ALPHA;
+
+  /// @brief VkPrimitiveTopology, VkPolygonMode and VkCullModeFlags.
+  uint8_t topology = VK_PRIMITIVE_TOPOLOGY_TRIANGLE_LIST;
+  uint8_t polygonMode = VK_POLYGON_MODE_FILL;
+  uint8_t cullMode = VK_CULL_MODE_NONE;
+
+  /// @brief The vertex layout, only the sprite quad and instance (0) exists.
+  uint8_t vertexLayout = 0;
+  uint8_t reserved[3] = {};
+
+  bool operator==(const pipeline_desc &) const = default;
+};
+static_assert(sizeof(pipeline_desc) == 32);
+
 void createGraphicsPipeline();
+
+/// @brief The SPIR-V name of the sprite fragment shader that matches the
+/// texture table, sprite.frag.spv with descriptor indexing and
+/// sprite_array.frag.spv without.
+std::string getSpriteFragmentShader();
+
+/// @brief Builds the sprite pipeline from SPIR-V through the pipeline cache,
+/// for vulkan_pipeline::layout and renderPass. Safe to call from any thread.
+VkPipeline createSpritePipeline(std::span<const std::byte> vertShaderCode,
+                                std::span<const std::byte> fragShaderCode);
+
+/// @brief createSpritePipeline() with the state of desc. The shader hashes of
+/// desc are not used, the code is passed in. Safe to call from any thread.
+VkPipeline createPipeline(const pipeline_desc &desc,
+                          std::span<const std::byte> vertShaderCode,
+                          std::span<const std::byte> fragShaderCode);
 void createRenderPass();
 void createFrameBuffers();
 VkShaderModule createShaderModule(const std::vector<char> &code);
 
+/// @brief code has to be 4-byte aligned, which assets from an AssetArchive
+/// always are.
+VkShaderModule createShaderModule(std::span<const std::byte> code);
+
+/// @brief Returns the shader from the mounted asset archive without copying
+/// it, or reads it from the build tree into storage if no archive is mounted.
+/// name is relative to the shader directory, e.g. "sprite.vert.spv".
+std::span<const std::byte> loadShaderCode(const std::string &name,
+                                          std::vector<char> &storage);
+
 std::vector<char> readFile(const std::string &filename);
@@ -0,0 +1,230 @@
+#include "vulkan_pipeline_cache.hpp"
+#include "logger.hpp"
+#include "vulkan_types.hpp"
+#include "vulkan_utils.hpp"
+
+#include <cstring>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+#include <vulkan/vulkan_core.h>
+
+namespace {
+constexpr uint32_t PIPELINE_CACHE_MAGIC = 0x43504b48; // "HKPC"
+constexpr uint32_t PIPELINE_CACHE_FILE_VERSION = 1;
+
+/// Our own header in front of the driver blob. The driver blob has its own
+/// header as well, but we also want the driver version and a checksum since
+/// some drivers happily crash on stale or corrupted data.
+struct pipeline_cache_file_header {
+  uint32_t magic;
+  uint32_t fileVersion;
+  uint32_t vendorID;
+  uint32_t deviceID;
+  uint32_t driverVersion;
+  uint8_t pipelineCacheUUID[VK_UUID_SIZE];
+  uint64_t dataSize;
+  uint64_t dataHash;
+};
+
+uint64_t hashData(const char *data, size_t size) {
+  // FNV-1a, we only need to catch truncated or corrupted files.
+  uint64_t hash = 0xcbf29ce484222325ull;
+  for (size_t i = 0; i < size; i++) {
+    hash ^= static_cast<uint8_t>(data[i]);
+    hash *= 0x100000001b3ull;
+  }
+  return hash;
+}
+
+bool isCompatible(const pipeline_cache_file_header &header,
+                  const std::vector<char> &data,
+                  const VkPhysicalDeviceProperties &properties) {
+  if (header.magic != PIPELINE_CACHE_MAGIC ||
+      header.fileVersion != PIPELINE_CACHE_FILE_VERSION) {
+    LOG_WARN("Pipeline cache file has an unknown format.");
+    return false;
+  }
+
+  if (header.vendorID != properties.vendorID ||
+      header.deviceID != properties.deviceID ||
+      header.driverVersion != properties.driverVersion ||
+      std::memcmp(header.pipelineCacheUUID, properties.pipelineCacheUUID,
+                  VK_UUID_SIZE) != 0) {
+    LOG_INFO("Pipeline cache was written by a different device or driver.");
+    return false;
+  }
+
+  if (header.dataSize != data.size() ||
+      header.dataHash != hashData(data.data(), data.size())) {
+    LOG_WARN("Pipeline cache file is corrupted.");
+    return false;
+  }
+
+  // Validate the header the driver put in front of its own data too.
+  VkPipelineCacheHeaderVersionOne driverHeader;
+  if (data.size() < sizeof(driverHeader)) {
+    LOG_WARN("Pipeline cache data is too small.");
+    return false;
+  }
+
+  std::memcpy(&driverHeader, data.data(), sizeof(driverHeader));
+  if (driverHeader.headerSize < sizeof(driverHeader) ||
+      driverHeader.headerVersion != VK_PIPELINE_CACHE_HEADER_VERSION_ONE ||
+      driverHeader.vendorID != properties.vendorID ||
+      driverHeader.deviceID != properties.deviceID ||
+      std::memcmp(driverHeader.pipelineCacheUUID, properties.pipelineCacheUUID,
+                  VK_UUID_SIZE) != 0) {
+    LOG_WARN("Pipeline cache data has a mismatching driver header.");
+    return false;
+  }
+
+  return true;
+}
+
+std::vector<char> loadCacheData(const std::string &path,
+                                const VkPhysicalDeviceProperties &properties) {
+  std::ifstream file(path, std::ios::ate | std::ios::binary);
+  if (!file.is_open()) {
+    LOG_INFO("No pipeline cache on disk, starting with an empty one.");
+    return {};
+  }
+
+  size_t fileSize = static_cast<size_t>(file.tellg());
+  pipeline_cache_file_header header;
+  if (fileSize < sizeof(header)) {
+    LOG_WARN("Pipeline cache file is too small.");
+    return {};
+  }
+
+  file.seekg(0);
+  file.read(reinterpret_cast<char *>(&header), sizeof(header));
+
+  std::vector<char> data(fileSize - sizeof(header));
+  file.read(data.data(), data.size());
+
+  if (!file || !isCompatible(header, data, properties)) {
+    return {};
+  }
+
+  return data;
+}
+} // namespace
+
+void createPipelineCache() {
+  vulkan_device &vkDevice = getVulkanDeviceStruct();
+  vulkan_pipeline_cache &vkPipelineCache = getVulkanPipelineCacheStruct();
+
+  VkPhysicalDeviceProperties properties;
+  vkGetPhysicalDeviceProperties(vkDevice.vkPhysDevice, &properties);
+
+  std::vector<char> data = loadCacheData(vkPipelineCache.path, properties);
+
+  VkPipelineCacheCreateInfo createInfo{};
+  createInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+  createInfo.initialDataSize = data.size();
+  createInfo.pInitialData = data.empty() ? nullptr : data.data();
+
+  VkResult result = vkCreatePipelineCache(vkDevice.logicalDevice, &createInfo,
+                                          nullptr, &vkPipelineCache.handle);
+
+  // The driver may still reject data that passed our checks. In that case we
+  // would rather start cold than fail to start at all.
+  if (!checkVkResult(result) && !data.empty()) {
+    LOG_WARN("The driver rejected the pipeline cache data.");
+    createInfo.initialDataSize = 0;
+    createInfo.pInitialData = nullptr;
+    data.clear();
+    result = vkCreatePipelineCache(vkDevice.logicalDevice, &createInfo, nullptr,
+                                   &vkPipelineCache.handle);
+  }
+
+  if (!checkVkResult(result)) {
+    LOG_ERROR(vkResultToString(result));
+    throw std::runtime_error(vkResultToString(result));
+  }
+
+  vkPipelineCache.loadedFromDisk = !data.empty();
+
+  LOG_INFOF("Created the pipeline cache ({} bytes loaded from {}).",
+            data.size(), vkPipelineCache.path);
+}
+
+void savePipelineCache() {
+  vulkan_device &vkDevice = getVulkanDeviceStruct();
+  vulkan_pipeline_cache &vkPipelineCache = getVulkanPipelineCacheStruct();
+
+  if (vkPipelineCache.handle == VK_NULL_HANDLE) {
+    return;
+  }
+
+  size_t dataSize = 0;
+  VkResult result = vkGetPipelineCacheData(
+      vkDevice.logicalDevice, vkPipelineCache.handle, &dataSize, nullptr);
+
+  std::vector<char> data(dataSize);
+  if (checkVkResult(result)) {
+    result = vkGetPipelineCacheData(vkDevice.logicalDevice,
+                                    vkPipelineCache.handle, &dataSize,
+                                    data.data());
+  }
+
+  if (!checkVkResult(result) || result == VK_INCOMPLETE) {
+    LOG_ERROR(vkResultToString(result));
+    return;
+  }
+
+  data.resize(dataSize);
+
+  VkPhysicalDeviceProperties properties;
+  vkGetPhysicalDeviceProperties(vkDevice.vkPhysDevice, &properties);
+
+  pipeline_cache_file_header header{};
+  header.magic = PIPELINE_CACHE_MAGIC;
+  header.fileVersion = PIPELINE_CACHE_FILE_VERSION;
+  header.vendorID = properties.vendorID;
+  header.deviceID = properties.deviceID;
+  header.driverVersion = properties.driverVersion;
+  std::memcpy(header.pipelineCacheUUID, properties.pipelineCacheUUID,
+              VK_UUID_SIZE);
+  header.dataSize = data.size();
+  header.dataHash = hashData(data.data(), data.size());
+
+  // Write everything to a temporary file and swap it in with a rename, which
+  // is atomic. A crash mid-write leaves the old cache untouched.
+  std::string tempPath = vkPipelineCache.path + ".tmp";
+  {
+    std::ofstream file(tempPath, std::ios::binary | std::ios::trunc);
+    file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+    file.write(data.data(), data.size());
+    file.flush();
+
+    if (!file) {
+      LOG_ERRORF("Failed to write the pipeline cache: {}", tempPath);
+      return;
+    }
+  }
+
+  std::error_code error;
+  std::filesystem::rename(tempPath, vkPipelineCache.path, error);
+  if (error) {
+    LOG_ERRORF("Failed to replace the pipeline cache: {}", error.message());
+    return;
+  }
+
+  LOG_INFOF("Saved the pipeline cache ({} bytes to {}).", data.size(),
+            vkPipelineCache.path);
+}
+
+void destroyPipelineCache() {
+  vulkan_device &vkDevice = getVulkanDeviceStruct();
+  vulkan_pipeline_cache &vkPipelineCache = getVulkanPipelineCacheStruct();
+
+  if (vkPipelineCache.handle != VK_NULL_HANDLE) {
+    vkDestroyPipelineCache(vkDevice.logicalDevice, vkPipelineCache.handle,
+                           nullptr);
+    vkPipelineCache.handle = VK_NULL_HANDLE;
+  }
+}
@@ -0,0 +1,13 @@
+#pragma once
+
+#include <vulkan/vulkan.h>
+
+/// @brief Creates the pipeline cache, seeding it with the data saved by a
+/// previous run if it was written by the same device and driver.
+void createPipelineCache();
+
+/// @brief Writes the pipeline cache back to disk. The file is written to a
+/// temporary path first and then renamed, so a crash never leaves a torn file.
+void savePipelineCache();
+
+void destroyPipelineCache();
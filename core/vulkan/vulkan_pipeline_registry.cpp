@@ -0,0 +1,378 @@
+#include "vulkan_pipeline_registry.hpp"
+#include "asset_archive.hpp"
+#include "logger.hpp"
+#include "profiler.hpp"
+#include "vulkan_types.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <format>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <shared_mutex>
+#include <span>
+#include <stdexcept>
+#include <string_view>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+enum class PipelineState : uint8_t { COMPILING, READY, FAILED };
+
+struct PipelineEntry {
+  pipeline_desc desc;
+  std::string vertexShader;
+  std::string fragmentShader;
+
+  // pipeline is written before state turns READY. Afterwards only
+  // swapPipelineVariant() replaces it, on shader hot reload.
+  std::atomic<PipelineState> state{PipelineState::COMPILING};
+  std::atomic<VkPipeline> pipeline{VK_NULL_HANDLE};
+};
+
+struct PipelineDescHash {
+  size_t operator()(const pipeline_desc &desc) const {
+    // The description has no padding, so its bytes are the whole state.
+    return static_cast<size_t>(hashAssetName(std::string_view(
+        reinterpret_cast<const char *>(&desc), sizeof(desc))));
+  }
+};
+
+struct RegistryState {
+  std::shared_mutex mutex;
+  std::unordered_map<pipeline_desc, std::unique_ptr<PipelineEntry>,
+                     PipelineDescHash>
+      entries;
+
+  // SPIR-V names by hashAssetName(), filled by describeSpritePipeline().
+  std::unordered_map<uint64_t, std::string> shaderNames;
+
+  // SPIR-V from shader hot reload by hashAssetName(), used instead of the
+  // shipped code by every compile that starts afterwards.
+  std::unordered_map<uint64_t, std::vector<char>> reloadedCode;
+
+  // Variants waiting for the compile thread. The frame thread never runs a
+  // compile itself, not even while it waits for jobs. outstanding counts the
+  // queued variants and the one being compiled.
+  std::thread compileThread;
+  std::mutex queueMutex;
+  std::condition_variable queueChanged;
+  std::deque<PipelineEntry *> queue;
+  uint32_t outstanding = 0;
+  bool stopping = false;
+
+  std::atomic<uint64_t> requests{0};
+  std::atomic<uint64_t> hits{0};
+
+  std::mutex statsMutex;
+  double totalCompileMs = 0.0;
+  double maxCompileMs = 0.0;
+};
+
+RegistryState s_registry;
+
+// The reloaded SPIR-V if there is one, the shipped one otherwise.
+std::span<const std::byte> shaderCode(uint64_t hash, const std::string &name,
+                                      std::vector<char> &storage) {
+  {
+    std::shared_lock lock(s_registry.mutex);
+    auto reloaded = s_registry.reloadedCode.find(hash);
+    if (reloaded != s_registry.reloadedCode.end()) {
+      storage = reloaded->second;
+      return std::as_bytes(std::span(storage));
+    }
+  }
+  return loadShaderCode(name, storage);
+}
+
+void compilePipeline(PipelineEntry *entry) {
+  const auto start = std::chrono::steady_clock::now();
+
+  try {
+    std::vector<char> vertStorage, fragStorage;
+    auto vertShaderCode = shaderCode(entry->desc.vertexShader,
+                                     entry->vertexShader, vertStorage);
+    auto fragShaderCode = shaderCode(entry->desc.fragmentShader,
+                                     entry->fragmentShader, fragStorage);
+    entry->pipeline.store(
+        createPipeline(entry->desc, vertShaderCode, fragShaderCode),
+        std::memory_order_relaxed);
+  } catch (const std::exception &error) {
+    LOG_ERRORF("Failed to compile a pipeline variant of {} and {}, drawing "
+               "with the default pipeline instead: {}",
+               entry->vertexShader, entry->fragmentShader, error.what());
+
+    entry->state.store(PipelineState::FAILED, std::memory_order_release);
+    return;
+  }
+
+  std::chrono::duration<double, std::milli> elapsed =
+      std::chrono::steady_clock::now() - start;
+  {
+    std::lock_guard lock(s_registry.statsMutex);
+    s_registry.totalCompileMs += elapsed.count();
+    s_registry.maxCompileMs =
+        std::max(s_registry.maxCompileMs, elapsed.count());
+  }
+
+  entry->state.store(PipelineState::READY, std::memory_order_release);
+}
+
+// Body of the compile thread, drains the queue until it is stopped.
+void compileVariants() {
+  HK_THREAD_NAME("Pipeline compiler");
+
+  std::unique_lock lock(s_registry.queueMutex);
+  while (true) {
+    s_registry.queueChanged.wait(lock, [] {
+      return s_registry.stopping || !s_registry.queue.empty();
+    });
+    if (s_registry.queue.empty()) {
+      return;
+    }
+
+    PipelineEntry *entry = s_registry.queue.front();
+    s_registry.queue.pop_front();
+
+    lock.unlock();
+    compilePipeline(entry);
+    lock.lock();
+
+    s_registry.outstanding--;
+    s_registry.queueChanged.notify_all();
+  }
+}
+
+const std::string &shaderName(uint64_t hash) {
+  auto name = s_registry.shaderNames.find(hash);
+  if (name == s_registry.shaderNames.end()) {
+    const std::string message = std::format(
+        "No shader is known by the hash {:#x}, describe pipelines with "
+        "describeSpritePipeline().",
+        hash);
+    LOG_ERROR(message);
+    throw std::runtime_error(message);
+  }
+  return name->second;
+}
+} // namespace
+
+pipeline_desc describeSpritePipeline(const std::string &vertexShader,
+                                     const std::string &fragmentShader,
+                                     SpriteBlendMode blend) {
+  pipeline_desc desc{};
+  desc.vertexShader = hashAssetName(vertexShader);
+  desc.fragmentShader = hashAssetName(fragmentShader);
+  desc.renderPass = getVulkanPipelineStruct().renderPass;
+  desc.blend = blend;
+
+  std::unique_lock lock(s_registry.mutex);
+  s_registry.shaderNames.try_emplace(desc.vertexShader, vertexShader);
+  s_registry.shaderNames.try_emplace(desc.fragmentShader, fragmentShader);
+  return desc;
+}
+
+VkPipeline requestPipeline(const pipeline_desc &desc) {
+  s_registry.requests.fetch_add(1, std::memory_order_relaxed);
+
+  PipelineEntry *entry = nullptr;
+  {
+    std::shared_lock lock(s_registry.mutex);
+    auto found = s_registry.entries.find(desc);
+    if (found != s_registry.entries.end()) {
+      entry = found->second.get();
+    }
+  }
+
+  if (entry == nullptr) {
+    bool inserted = false;
+    {
+      std::unique_lock lock(s_registry.mutex);
+      auto found = s_registry.entries.find(desc);
+      if (found != s_registry.entries.end()) {
+        // Somebody else got here first and already started the compile.
+        entry = found->second.get();
+      }
+
+      else {
+        auto created = std::make_unique<PipelineEntry>();
+        created->desc = desc;
+        created->vertexShader = shaderName(desc.vertexShader);
+        created->fragmentShader = shaderName(desc.fragmentShader);
+        entry = created.get();
+        s_registry.entries.emplace(desc, std::move(created));
+        inserted = true;
+      }
+    }
+
+    if (inserted) {
+      std::lock_guard lock(s_registry.queueMutex);
+      if (!s_registry.compileThread.joinable()) {
+        s_registry.compileThread = std::thread(compileVariants);
+      }
+
+      s_registry.queue.push_back(entry);
+      s_registry.outstanding++;
+      s_registry.queueChanged.notify_all();
+    }
+  }
+
+  if (entry->state.load(std::memory_order_acquire) != PipelineState::READY) {
+    return VK_NULL_HANDLE;
+  }
+
+  s_registry.hits.fetch_add(1, std::memory_order_relaxed);
+  return entry->pipeline.load(std::memory_order_acquire);
+}
+
+void waitForPipelines() {
+  std::unique_lock lock(s_registry.queueMutex);
+  s_registry.queueChanged.wait(lock,
+                               [] { return s_registry.outstanding == 0; });
+}
+
+bool isPipelineRegistryShader(const std::string &name) {
+  std::shared_lock lock(s_registry.mutex);
+  return s_registry.shaderNames.contains(hashAssetName(name));
+}
+
+std::vector<pipeline_variant>
+rebuildPipelineVariants(const std::map<std::string, std::vector<char>> &code) {
+  std::vector<std::pair<pipeline_desc, const PipelineEntry *>> affected;
+  {
+    std::unique_lock lock(s_registry.mutex);
+    for (const auto &[name, spirv] : code) {
+      s_registry.reloadedCode[hashAssetName(name)] = spirv;
+    }
+
+    for (const auto &[desc, entry] : s_registry.entries) {
+      if (s_registry.reloadedCode.contains(desc.vertexShader) ||
+          s_registry.reloadedCode.contains(desc.fragmentShader)) {
+        affected.emplace_back(desc, entry.get());
+      }
+    }
+  }
+
+  // Entries are only erased by destroyPipelineRegistry(), which stops the
+  // reload first.
+  std::vector<pipeline_variant> rebuilt;
+  for (const auto &[desc, entry] : affected) {
+    try {
+      std::vector<char> vertStorage, fragStorage;
+      auto vertShaderCode =
+          shaderCode(desc.vertexShader, entry->vertexShader, vertStorage);
+      auto fragShaderCode =
+          shaderCode(desc.fragmentShader, entry->fragmentShader, fragStorage);
+      rebuilt.push_back(
+          {desc, createPipeline(desc, vertShaderCode, fragShaderCode)});
+    } catch (const std::exception &error) {
+      LOG_ERRORF("Failed to rebuild a pipeline variant of {} and {}, keeping "
+                 "the old one: {}",
+                 entry->vertexShader, entry->fragmentShader, error.what());
+    }
+  }
+  return rebuilt;
+}
+
+bool swapPipelineVariant(const pipeline_variant &variant, VkPipeline &old) {
+  PipelineEntry *entry = nullptr;
+  {
+    std::shared_lock lock(s_registry.mutex);
+    auto found = s_registry.entries.find(variant.desc);
+    if (found != s_registry.entries.end()) {
+      entry = found->second.get();
+    }
+  }
+
+  // Its first compile still writes the pipeline and the state.
+  if (entry == nullptr ||
+      entry->state.load(std::memory_order_acquire) ==
+          PipelineState::COMPILING) {
+    return false;
+  }
+
+  old = entry->pipeline.exchange(variant.pipeline, std::memory_order_acq_rel);
+  entry->state.store(PipelineState::READY, std::memory_order_release);
+  return true;
+}
+
+pipeline_registry_stats getPipelineRegistryStats() {
+  pipeline_registry_stats stats{};
+  stats.requests = s_registry.requests.load(std::memory_order_relaxed);
+  stats.hits = s_registry.hits.load(std::memory_order_relaxed);
+
+  {
+    std::shared_lock lock(s_registry.mutex);
+    stats.variants = static_cast<uint32_t>(s_registry.entries.size());
+    for (const auto &[desc, entry] : s_registry.entries) {
+      PipelineState state = entry->state.load(std::memory_order_acquire);
+      stats.pending += state == PipelineState::COMPILING;
+      stats.failed += state == PipelineState::FAILED;
+    }
+  }
+
+  std::lock_guard lock(s_registry.statsMutex);
+  stats.totalCompileMs = s_registry.totalCompileMs;
+  stats.maxCompileMs = s_registry.maxCompileMs;
+  return stats;
+}
+
+void logPipelineRegistryStats() {
+  pipeline_registry_stats stats = getPipelineRegistryStats();
+
+  if (stats.requests == 0) {
+    LOG_INFO("No pipeline variants were requested.");
+    return;
+  }
+
+  const uint32_t compiled = stats.variants - stats.pending - stats.failed;
+  LOG_INFOF("{} pipeline variants ({} compiling, {} failed), compiled in "
+            "{:.2f} ms on average and {:.2f} ms at worst. {:.2f}% of {} "
+            "requests hit a finished pipeline.",
+            stats.variants, stats.pending, stats.failed,
+            compiled > 0 ? stats.totalCompileMs / compiled : 0.0,
+            stats.maxCompileMs,
+            100.0 * static_cast<double>(stats.hits) /
+                static_cast<double>(stats.requests),
+            stats.requests);
+}
+
+void destroyPipelineRegistry() {
+  vulkan_device &vkDevice = getVulkanDeviceStruct();
+
+  waitForPipelines();
+
+  {
+    std::unique_lock queueLock(s_registry.queueMutex);
+    s_registry.stopping = true;
+    s_registry.queueChanged.notify_all();
+  }
+
+  if (s_registry.compileThread.joinable()) {
+    s_registry.compileThread.join();
+  }
+  s_registry.stopping = false;
+
+  std::unique_lock lock(s_registry.mutex);
+  for (const auto &[desc, entry] : s_registry.entries) {
+    VkPipeline pipeline = entry->pipeline.load(std::memory_order_relaxed);
+    if (pipeline != VK_NULL_HANDLE) {
+      vkDestroyPipeline(vkDevice.logicalDevice, pipeline, nullptr);
+    }
+  }
+
+  s_registry.entries.clear();
+  s_registry.shaderNames.clear();
+  s_registry.reloadedCode.clear();
+  s_registry.requests = 0;
+  s_registry.hits = 0;
+
+  std::lock_guard statsLock(s_registry.statsMutex);
+  s_registry.totalCompileMs = 0.0;
+  s_registry.maxCompileMs = 0.0;
+}
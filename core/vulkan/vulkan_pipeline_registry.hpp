@@ -0,0 +1,74 @@
+#pragma once
+
+#include "vulkan_pipeline.hpp"
+
+#include <cstdint>
+#include <map>
+#include <string>
+#include <vector>
+#include <vulkan/vulkan.h>
+
+struct pipeline_registry_stats {
+  /// @brief requestPipeline() calls, and how many of them got a finished
+  /// pipeline back.
+  uint64_t requests = 0;
+  uint64_t hits = 0;
+
+  /// @brief Distinct descriptions seen, and how many of them are still
+  /// compiling or failed to.
+  uint32_t variants = 0;
+  uint32_t pending = 0;
+  uint32_t failed = 0;
+
+  double totalCompileMs = 0.0;
+  double maxCompileMs = 0.0;
+};
+
+/// @brief Describes a sprite pipeline with the given shaders, names as for
+/// loadShaderCode(), and the render pass of vulkan_pipeline. Remembers the
+/// names so the registry can load the shaders later.
+pipeline_desc describeSpritePipeline(const std::string &vertexShader,
+                                     const std::string &fragmentShader,
+                                     SpriteBlendMode blend);
+
+/// @brief Returns the pipeline for desc, or VK_NULL_HANDLE while it is still
+/// being compiled on the registry's compile thread. The first request for a
+/// description queues the compile, identical descriptions share one pipeline.
+/// The calling thread never compiles, also not inside JobSystem::wait() or
+/// without workers. Passing the result to reserveSprites() as-is draws with
+/// graphicsPipeline until the pipeline is ready, so a new variant never
+/// stalls a frame. Safe to call from any thread, hits only take a shared lock.
+VkPipeline requestPipeline(const pipeline_desc &desc);
+
+/// @brief Blocks until every compile that was started has finished.
+void waitForPipelines();
+
+/// @brief A pipeline rebuilt for a registered description.
+struct pipeline_variant {
+  pipeline_desc desc;
+  VkPipeline pipeline;
+};
+
+/// @brief Whether a description passed to describeSpritePipeline() uses the
+/// shader, named as for loadShaderCode().
+bool isPipelineRegistryShader(const std::string &name);
+
+/// @brief Shader hot reload: every compile from now on uses the given SPIR-V,
+/// keyed by name as for loadShaderCode(), instead of the shipped one. Rebuilds
+/// the registered variants using any of it on the calling thread and returns
+/// them for swapPipelineVariant(), the pipelines in use are left alone.
+std::vector<pipeline_variant>
+rebuildPipelineVariants(const std::map<std::string, std::vector<char>> &code);
+
+/// @brief Makes requestPipeline() return the rebuilt pipeline and hands back
+/// the replaced one in old, VK_NULL_HANDLE if its compile had failed. The
+/// caller retires old once no frame in flight uses it. Returns false while
+/// the variant's first compile is still running, try again next frame.
+bool swapPipelineVariant(const pipeline_variant &variant, VkPipeline &old);
+
+pipeline_registry_stats getPipelineRegistryStats();
+void logPipelineRegistryStats();
+
+/// @brief Waits for the compiles, stops the compile thread and destroys every
+/// registered pipeline. Called by vkShutdown().
+void destroyPipelineRegistry();
@@ -1,67 +1,280 @@
 #include "vulkan_render.hpp"
 #include "logger.hpp"
+#include "profiler.hpp"
 #include "vulkan_command_buffer.hpp"
+#include "vulkan_frame_pacing.hpp"
+#include "vulkan_gpu_profiler.hpp"
+#include "vulkan_memory.hpp"
+#include "vulkan_shader_reload.hpp"
+#include "vulkan_sprite.hpp"
+#include "vulkan_swapchain.hpp"
+#include "vulkan_texture.hpp"
 #include "vulkan_types.hpp"
+#include "vulkan_upload.hpp"
 #include "vulkan_utils.hpp"
+#include <format>
 #include <stdexcept>
 #include <vulkan/vulkan.h>
 #include <vulkan/vulkan_core.h>
 
+namespace {
+// Waits until the frame timeline reached value. Logs whenever the GPU takes
+// longer than frameWaitTimeoutNs, so a hang shows up in the log instead of
+// freezing silently.
+void waitForTimelineValue(uint64_t value) {
+  vulkan_device &vkDevice = getVulkanDeviceStruct();
+  window_backend &vkWindow = getWindowBackendStruct();
+
+  VkSemaphoreWaitInfo waitInfo{};
+  waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+  waitInfo.semaphoreCount = 1;
+  waitInfo.pSemaphores = &vkWindow.frameTimeline;
+  waitInfo.pValues = &value;
+
+  while (true) {
+    VkResult result = vkWaitSemaphores(vkDevice.logicalDevice, &waitInfo,
+                                       vkWindow.frameWaitTimeoutNs);
+    if (result == VK_TIMEOUT) {
+      LOG_WARNF("Still waiting for frame {} to finish on the GPU.", value - 1);
+      continue;
+    }
+
+    if (!checkVkResult(result)) {
+      LOG_ERROR(vkResultToString(result));
+      throw std::runtime_error(vkResultToString(result));
+    }
+    return;
+  }
+}
+} // namespace
+
+void beginFrame() {
+  vulkan_device &vkDevice = getVulkanDeviceStruct();
+  window_backend &vkWindow = getWindowBackendStruct();
+
+  if (vkWindow.frameBegun) {
+    return;
+  }
+
+  HK_ZONE("beginFrame");
+  const uint32_t frame = vkWindow.currentFrame;
+
+  // Only wait for the frame that used this slot maxFramesInFlight frames ago,
+  // the more recent ones can keep running on the GPU while we record.
+  {
+    HK_ZONE("wait for frame slot");
+    if (vkWindow.frameTimeline != VK_NULL_HANDLE) {
+      if (vkWindow.frameNumber >= vkWindow.maxFramesInFlight) {
+        waitForTimelineValue(vkWindow.frameNumber + 1 -
+                             vkWindow.maxFramesInFlight);
+      }
+    }
+
+    else {
+      vkWaitForFences(vkDevice.logicalDevice, 1,
+                      &vkWindow.inFlightFences[frame], VK_TRUE, UINT64_MAX);
+    }
+  }
+  collectGpuProfilerFrame(frame);
+  resetFrameCommandPools(frame);
+  collectUploads();
+  destroyRetiredSwapchains();
+  applyShaderReload();
+  collectTextures();
+  beginTransientFrame(frame);
+  beginSpriteFrame(frame);
+
+  vkWindow.frameBegun = true;
+}
+
 void drawFrame() {
   vulkan_device &vkDevice = getVulkanDeviceStruct();
   vulkan_swapchain &vkSwapchain = getVulkanSwapchainStruct();
   vulkan_command_buffer &vkCommandBuffer = getVulkanCommandBufferStruct();
   window_backend &vkWindow = getWindowBackendStruct();
 
-  vkWaitForFences(vkDevice.logicalDevice, 1, &vkWindow.inFlightFence, VK_TRUE,
-                  UINT64_MAX);
-  vkResetFences(vkDevice.logicalDevice, 1, &vkWindow.inFlightFence);
+  HK_ZONE("drawFrame");
+  beginFrame();
+
+  const uint32_t frame = vkWindow.currentFrame;
+  const bool timeline = vkWindow.frameTimeline != VK_NULL_HANDLE;
+  const uint64_t frameValue = vkWindow.frameNumber + 1;
+  VkFence frameFence =
+      timeline ? VK_NULL_HANDLE : vkWindow.inFlightFences[frame];
+
+  // Headless without a surface there is one offscreen target per frame slot
+  // and nothing to acquire or present.
+  const bool offscreen = vkWindow.surface == VK_NULL_HANDLE;
+
+  uint32_t imageIndex = frame;
+  VkResult acquireResult = VK_SUCCESS;
+  if (!offscreen) {
+    acquireResult = vkAcquireNextImageKHR(
+        vkDevice.logicalDevice, vkSwapchain.swapchain, UINT64_MAX,
+        vkWindow.imageAvailableSemaphores[frame], VK_NULL_HANDLE, &imageIndex);
+  }
+
+  // Nothing was signaled and the fence is still untouched, so we can simply
+  // rebuild the swapchain and try again next frame. The frame stays begun, so
+  // whatever was written for it gets drawn then. A suboptimal swapchain can
+  // still be presented to, it gets recreated after the present below.
+  if (acquireResult == VK_ERROR_OUT_OF_DATE_KHR) {
+    recreateSwapchain();
+    return;
+  }
+
+  else if (!checkVkResult(acquireResult)) {
+    LOG_ERROR(vkResultToString(acquireResult));
+    throw std::runtime_error(vkResultToString(acquireResult));
+  }
+
+  // The swapchain does not have to return images in order, so the image we
+  // got may still be rendered into by a different frame slot.
+  if (timeline) {
+    const uint64_t imageValue = vkWindow.imageTimelineValues[imageIndex];
+    if (imageValue != 0) {
+      waitForTimelineValue(imageValue);
+    }
+    vkWindow.imageTimelineValues[imageIndex] = frameValue;
+  }
+
+  else {
+    if (vkWindow.imagesInFlight[imageIndex] != VK_NULL_HANDLE &&
+        vkWindow.imagesInFlight[imageIndex] != frameFence) {
+      vkWaitForFences(vkDevice.logicalDevice, 1,
+                      &vkWindow.imagesInFlight[imageIndex], VK_TRUE,
+                      UINT64_MAX);
+    }
+    vkWindow.imagesInFlight[imageIndex] = frameFence;
 
-  uint32_t imageIndex;
-  vkAcquireNextImageKHR(vkDevice.logicalDevice, vkSwapchain.swapchain,
-                        UINT64_MAX, vkWindow.imageAvailableSemaphore,
-                        VK_NULL_HANDLE, &imageIndex);
+    vkResetFences(vkDevice.logicalDevice, 1, &frameFence);
+  }
 
-  vkResetCommandBuffer(vkCommandBuffer.buffer, 0);
+  // The pools of this frame slot were reset by beginFrame().
+  VkCommandBuffer commandBuffer = vkCommandBuffer.frames[frame].primary;
+  {
+    HK_ZONE("record");
+    recordCommandBuffer(commandBuffer, imageIndex);
+  }
 
-  // TODO: There will be multiple command buffers later most likely. So we'll
-  // want to pass the one we want to record.
-  recordCommandBuffer(imageIndex);
+  // Uploads on the graphics queue have to land before the frame that uses
+  // them.
+  flushUploads();
 
   VkSubmitInfo submitInfo{};
   submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
 
-  VkSemaphore waitSemaphores[] = {vkWindow.imageAvailableSemaphore};
-  VkPipelineStageFlags waitStages[] = {
-      VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT};
-  submitInfo.waitSemaphoreCount = 1;
+  VkSemaphore waitSemaphores[2];
+  VkPipelineStageFlags waitStages[2];
+  uint64_t waitValues[2] = {0, 0};
+  uint32_t waitCount = 0;
+  if (!offscreen) {
+    waitSemaphores[waitCount] = vkWindow.imageAvailableSemaphores[frame];
+    waitStages[waitCount++] = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
+  }
+
+  // Uploads from the transfer queue that this frame acquired. They finished
+  // already, the wait only orders the memory accesses.
+  vulkan_upload_service &upload = getVulkanUploadStruct();
+  if (upload.frameWaitValue != 0) {
+    waitSemaphores[waitCount] = upload.timeline;
+    waitStages[waitCount] = upload.frameWaitStages;
+    waitValues[waitCount++] = upload.frameWaitValue;
+  }
+
+  VkSemaphore signalSemaphores[2];
+  uint64_t signalValues[2] = {0, 0};
+  uint32_t signalCount = 0;
+  if (!offscreen) {
+    signalSemaphores[signalCount++] =
+        vkWindow.renderFinishedSemaphores[imageIndex];
+  }
+
+  if (timeline) {
+    signalSemaphores[signalCount] = vkWindow.frameTimeline;
+    signalValues[signalCount++] = frameValue;
+  }
+
+  // Values of binary semaphores are ignored, but every semaphore needs one
+  // as soon as a timeline semaphore is part of the submit.
+  VkTimelineSemaphoreSubmitInfo timelineInfo{};
+  timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+  timelineInfo.waitSemaphoreValueCount = waitCount;
+  timelineInfo.pWaitSemaphoreValues = waitValues;
+  timelineInfo.signalSemaphoreValueCount = signalCount;
+  timelineInfo.pSignalSemaphoreValues = signalValues;
+  if (timeline || upload.frameWaitValue != 0) {
+    submitInfo.pNext = &timelineInfo;
+  }
+
+  submitInfo.waitSemaphoreCount = waitCount;
   submitInfo.pWaitSemaphores = waitSemaphores;
   submitInfo.pWaitDstStageMask = waitStages;
   submitInfo.commandBufferCount = 1;
-  submitInfo.pCommandBuffers = &vkCommandBuffer.buffer;
-
-  VkSemaphore signalSemaphores[] = {vkWindow.renderFinishedSemaphore};
-  submitInfo.signalSemaphoreCount = 1;
+  submitInfo.pCommandBuffers = &commandBuffer;
+  submitInfo.signalSemaphoreCount = signalCount;
   submitInfo.pSignalSemaphores = signalSemaphores;
 
-  VkResult result = vkQueueSubmit(vkDevice.graphicsQueue, 1, &submitInfo,
-                                  vkWindow.inFlightFence);
+  VkResult result =
+      vkQueueSubmit(vkDevice.graphicsQueue, 1, &submitInfo, frameFence);
   if (!checkVkResult(result)) {
     LOG_ERROR(vkResultToString(result));
     throw std::runtime_error(vkResultToString(result));
   }
 
+  if (offscreen) {
+    vkWindow.currentFrame = (frame + 1) % vkWindow.maxFramesInFlight;
+    vkWindow.frameNumber++;
+    vkWindow.frameBegun = false;
+    return;
+  }
+
   VkPresentInfoKHR presentInfo{};
   presentInfo.sType = VK_STRUCTURE_TYPE_PRESENT_INFO_KHR;
   presentInfo.waitSemaphoreCount = 1;
-  presentInfo.pWaitSemaphores = signalSemaphores;
+  presentInfo.pWaitSemaphores = &vkWindow.renderFinishedSemaphores[imageIndex];
 
   VkSwapchainKHR swapChains[] = {vkSwapchain.swapchain};
   presentInfo.swapchainCount = 1;
   presentInfo.pSwapchains = swapChains;
   presentInfo.pImageIndices = &imageIndex;
 
-  vkQueuePresentKHR(vkDevice.presentQueue, &presentInfo);
+  // Lets waitForInputSample() wait until this frame is actually shown.
+  const uint64_t presentIdValue = vkWindow.frameNumber + 1;
+  VkPresentIdKHR presentId{};
+  presentId.sType = VK_STRUCTURE_TYPE_PRESENT_ID_KHR;
+  presentId.swapchainCount = 1;
+  presentId.pPresentIds = &presentIdValue;
+  if (getVulkanFramePacingStruct().presentWait) {
+    presentInfo.pNext = &presentId;
+  }
+
+  VkResult presentResult;
+  {
+    HK_ZONE("present");
+    presentResult = vkQueuePresentKHR(vkDevice.presentQueue, &presentInfo);
+  }
+  const bool presented =
+      presentResult == VK_SUCCESS || presentResult == VK_SUBOPTIMAL_KHR;
+  framePresented(vkWindow.frameNumber, presented);
+  if (presented) {
+    swapchainPresented(vkWindow.frameNumber);
+  }
+
+  vkWindow.currentFrame = (frame + 1) % vkWindow.maxFramesInFlight;
+  vkWindow.frameNumber++;
+  vkWindow.frameBegun = false;
+
+  if (presentResult == VK_ERROR_OUT_OF_DATE_KHR ||
+      presentResult == VK_SUBOPTIMAL_KHR || vkWindow.framebufferResized) {
+    vkWindow.framebufferResized = false;
+    recreateSwapchain();
+  }
+
+  else if (!checkVkResult(presentResult)) {
+    LOG_ERROR(vkResultToString(presentResult));
+    throw std::runtime_error(vkResultToString(presentResult));
+  }
 }
 
 void createSyncObjects() {
@@ -77,29 +290,133 @@ void createSyncObjects() {
   fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
   fenceInfo.flags = VK_FENCE_CREATE_SIGNALED_BIT;
 
-  VkResult imageResult =
-      vkCreateSemaphore(vkDevice.logicalDevice, &semaphoreInfo, nullptr,
-                        &vkWindow.imageAvailableSemaphore);
+  // One timeline replaces all the fences, frame N signals N + 1.
+  const bool timeline =
+      vkWindow.useTimelineSemaphore && vkDevice.timelineSemaphores;
+  if (timeline) {
+    VkSemaphoreTypeCreateInfo typeInfo{};
+    typeInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+    typeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+    typeInfo.initialValue = vkWindow.frameNumber;
+
+    VkSemaphoreCreateInfo timelineInfo{};
+    timelineInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    timelineInfo.pNext = &typeInfo;
+
+    VkResult timelineResult =
+        vkCreateSemaphore(vkDevice.logicalDevice, &timelineInfo, nullptr,
+                          &vkWindow.frameTimeline);
+    if (!checkVkResult(timelineResult)) {
+      LOG_ERROR(vkResultToString(timelineResult));
+      throw std::runtime_error("Failed to create the semaphores.");
+    }
+  }
 
-  VkResult renderFinishResult =
-      vkCreateSemaphore(vkDevice.logicalDevice, &semaphoreInfo, nullptr,
-                        &vkWindow.renderFinishedSemaphore);
+  vkWindow.imageAvailableSemaphores.resize(vkWindow.maxFramesInFlight);
+  vkWindow.inFlightFences.resize(timeline ? 0 : vkWindow.maxFramesInFlight);
 
-  VkResult fenceResult = vkCreateFence(vkDevice.logicalDevice, &fenceInfo,
-                                       nullptr, &vkWindow.inFlightFence);
+  for (uint32_t i = 0; i < vkWindow.maxFramesInFlight; i++) {
+    VkResult imageResult =
+        vkCreateSemaphore(vkDevice.logicalDevice, &semaphoreInfo, nullptr,
+                          &vkWindow.imageAvailableSemaphores[i]);
 
-  if (!checkVkResult(imageResult) || !checkVkResult(renderFinishResult)) {
-    LOG_ERROR(vkResultToString(imageResult));
-    LOG_ERROR(vkResultToString(renderFinishResult));
-    throw std::runtime_error("Failed to create the semaphores.");
+    if (!checkVkResult(imageResult)) {
+      LOG_ERROR(vkResultToString(imageResult));
+      throw std::runtime_error("Failed to create the semaphores.");
+    }
+
+    if (timeline) {
+      continue;
+    }
+
+    VkResult fenceResult = vkCreateFence(vkDevice.logicalDevice, &fenceInfo,
+                                         nullptr, &vkWindow.inFlightFences[i]);
+
+    if (!checkVkResult(fenceResult)) {
+      LOG_ERROR(vkResultToString(fenceResult));
+      throw std::runtime_error(vkResultToString(fenceResult));
+    }
   }
 
-  else {
-    LOG_INFO("Successfully created the semaphores.");
+  createImageSyncObjects();
+
+  LOG_INFOF("Successfully created the sync objects for {} frames in flight, "
+            "paced with {}.",
+            vkWindow.maxFramesInFlight,
+            timeline ? "a timeline semaphore" : "fences");
+}
+
+bool isFrameComplete(uint64_t frameNumber) {
+  vulkan_device &vkDevice = getVulkanDeviceStruct();
+  window_backend &vkWindow = getWindowBackendStruct();
+
+  if (frameNumber >= vkWindow.frameNumber) {
+    return false;
+  }
+
+  if (vkWindow.frameTimeline != VK_NULL_HANDLE) {
+    uint64_t value = 0;
+    vkGetSemaphoreCounterValue(vkDevice.logicalDevice, vkWindow.frameTimeline,
+                               &value);
+    return value > frameNumber;
+  }
+
+  // Once a later frame reused the slot, beginFrame() already waited for it.
+  if (frameNumber + vkWindow.maxFramesInFlight < vkWindow.frameNumber ||
+      (vkWindow.frameBegun &&
+       frameNumber + vkWindow.maxFramesInFlight == vkWindow.frameNumber)) {
+    return true;
+  }
+
+  VkFence fence =
+      vkWindow.inFlightFences[frameNumber % vkWindow.maxFramesInFlight];
+  return vkGetFenceStatus(vkDevice.logicalDevice, fence) == VK_SUCCESS;
+}
+
+void waitForFrame(uint64_t frameNumber) {
+  vulkan_device &vkDevice = getVulkanDeviceStruct();
+  window_backend &vkWindow = getWindowBackendStruct();
+
+  if (frameNumber >= vkWindow.frameNumber || isFrameComplete(frameNumber)) {
+    return;
   }
 
-  if (!checkVkResult(fenceResult)) {
-    LOG_ERROR(vkResultToString(fenceResult));
-    throw std::runtime_error(vkResultToString(fenceResult));
+  if (vkWindow.frameTimeline != VK_NULL_HANDLE) {
+    waitForTimelineValue(frameNumber + 1);
+    return;
   }
+
+  VkFence fence =
+      vkWindow.inFlightFences[frameNumber % vkWindow.maxFramesInFlight];
+  vkWaitForFences(vkDevice.logicalDevice, 1, &fence, VK_TRUE, UINT64_MAX);
+}
+
+void createImageSyncObjects() {
+  vulkan_device &vkDevice = getVulkanDeviceStruct();
+  vulkan_image &vkImage = getVulkanImageStruct();
+  window_backend &vkWindow = getWindowBackendStruct();
+
+  VkSemaphoreCreateInfo semaphoreInfo{};
+  semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+
+  // The semaphores of the old images were retired with their swapchain, a
+  // pending present may still wait on them. Every new image gets a fresh one.
+  const size_t imageCount = vkImage.swapChainImages.size();
+  for (size_t i = vkWindow.renderFinishedSemaphores.size(); i < imageCount;
+       i++) {
+    VkSemaphore semaphore;
+    VkResult renderFinishResult = vkCreateSemaphore(
+        vkDevice.logicalDevice, &semaphoreInfo, nullptr, &semaphore);
+
+    if (!checkVkResult(renderFinishResult)) {
+      LOG_ERROR(vkResultToString(renderFinishResult));
+      throw std::runtime_error("Failed to create the semaphores.");
+    }
+
+    vkWindow.renderFinishedSemaphores.push_back(semaphore);
+  }
+
+  // The new images were never rendered into by any frame.
+  vkWindow.imagesInFlight.assign(imageCount, VK_NULL_HANDLE);
+  vkWindow.imageTimelineValues.assign(imageCount, 0);
 }
@@ -1,4 +1,27 @@
 #pragma once
 
+#include <cstdint>
+
+/// @brief Waits until the next frame slot is free and resets its per-frame
+/// memory. Call it before writing sprites or transient data for a frame,
+/// drawFrame() calls it itself if you didn't.
+void beginFrame();
+
 void drawFrame();
+
+/// @brief Creates the per-frame sync objects. Frames are paced with one
+/// timeline semaphore when window_backend::useTimelineSemaphore is set and the
+/// device supports it, with a fence per frame slot otherwise.
 void createSyncObjects();
+
+/// @brief (Re)creates the sync objects that are tracked per swapchain image.
+/// Called again whenever the swapchain is recreated.
+void createImageSyncObjects();
+
+/// @brief Whether the GPU finished the frame with the given number, as counted
+/// by window_backend::frameNumber. Never waits.
+bool isFrameComplete(uint64_t frameNumber);
+
+/// @brief Blocks until the GPU finished the frame with the given number.
+/// Returns right away for frames that were not submitted.
+void waitForFrame(uint64_t frameNumber);
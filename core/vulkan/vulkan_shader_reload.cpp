@@ -0,0 +1,380 @@
+#include "vulkan_shader_reload.hpp"
+#include "asset_archive.hpp"
+#include "logger.hpp"
+#include "vulkan_pipeline.hpp"
+#include "vulkan_pipeline_registry.hpp"
+#include "vulkan_render.hpp"
+#include "vulkan_types.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <format>
+#include <map>
+#include <mutex>
+#include <poll.h>
+#include <set>
+#include <stdexcept>
+#include <span>
+#include <string>
+#include <sys/inotify.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+// A pipeline that gets rebuilt when one of its shaders changes.
+struct ReloadablePipeline {
+  const char *name;
+  const char *vertexShader;
+  const char *fragmentShader;
+  VkPipeline (*build)(std::span<const std::byte>, std::span<const std::byte>);
+  VkPipeline &(*slot)();
+
+  // Whether the pipeline is built from these shaders on this device.
+  bool (*active)();
+};
+
+VkPipeline &spritePipeline() {
+  return getVulkanPipelineStruct().graphicsPipeline;
+}
+
+const ReloadablePipeline RELOADABLE_PIPELINES[] = {
+    {"sprite", "sprite.vert", "sprite.frag", createSpritePipeline,
+     spritePipeline,
+     []() { return getVulkanTextureTableStruct().bindless; }},
+    {"sprite", "sprite.vert", "sprite_array.frag", createSpritePipeline,
+     spritePipeline,
+     []() { return !getVulkanTextureTableStruct().bindless; }},
+};
+
+struct ReadyPipeline {
+  size_t index;
+  VkPipeline pipeline;
+};
+
+struct ReloadState {
+  int inotifyFd = -1;
+  std::thread thread;
+  std::atomic<bool> running{false};
+
+  // Rebuilt pipelines waiting for the next frame boundary.
+  std::mutex mutex;
+  std::vector<ReadyPipeline> ready;
+  std::vector<pipeline_variant> variants;
+
+  // Latest SPIR-V per source file, only touched by the watcher thread.
+  std::map<std::string, std::vector<char>> compiled;
+};
+
+ReloadState s_reload;
+
+// Compiles one GLSL file with glslc. The SPIR-V also replaces the one in the
+// build tree, which a restart only picks up without an asset archive, a
+// mounted one keeps the packed SPIR-V until HakkeroAssets packs it again.
+bool compileShader(const std::string &compiler, const std::string &sourceDir,
+                   const std::string &name) {
+  const std::string output = HAKKERO_SHADER_DIR "/" + name + ".spv";
+  const std::string command = std::format("\"{}\" \"{}/{}\" -o \"{}\" 2>&1",
+                                          compiler, sourceDir, name, output);
+
+  FILE *pipe = ::popen(command.c_str(), "r");
+  if (pipe == nullptr) {
+    LOG_ERRORF("Failed to run {}.", compiler);
+    return false;
+  }
+
+  std::string messages;
+  char buffer[256];
+  while (std::fgets(buffer, sizeof(buffer), pipe) != nullptr) {
+    messages += buffer;
+  }
+
+  if (::pclose(pipe) != 0) {
+    LOG_ERRORF("Failed to compile {}, keeping the old pipelines:\n{}", name,
+               messages);
+    return false;
+  }
+
+  s_reload.compiled[name] = readFile(output);
+  return true;
+}
+
+// The freshly compiled SPIR-V if there is one, the shipped one otherwise.
+std::span<const std::byte> shaderCode(const std::string &name,
+                                      std::vector<char> &storage) {
+  auto compiled = s_reload.compiled.find(name);
+  if (compiled != s_reload.compiled.end()) {
+    return std::as_bytes(std::span(compiled->second));
+  }
+  return loadShaderCode(name + ".spv", storage);
+}
+
+void rebuildPipelines(const std::string &compiler, const std::string &sourceDir,
+                      const std::set<std::string> &changed) {
+  // The registry's variants by their SPIR-V names.
+  std::map<std::string, std::vector<char>> variantCode;
+  for (const std::string &name : changed) {
+    const bool variantShader = isPipelineRegistryShader(name + ".spv");
+    bool used = variantShader;
+    for (const ReloadablePipeline &reloadable : RELOADABLE_PIPELINES) {
+      used |= reloadable.active() && (name == reloadable.vertexShader ||
+                                      name == reloadable.fragmentShader);
+    }
+
+    if (used && !compileShader(compiler, sourceDir, name)) {
+      return;
+    }
+
+    if (variantShader) {
+      variantCode[name + ".spv"] = s_reload.compiled[name];
+    }
+  }
+
+  for (size_t i = 0; i < std::size(RELOADABLE_PIPELINES); i++) {
+    const ReloadablePipeline &reloadable = RELOADABLE_PIPELINES[i];
+    if (!reloadable.active() ||
+        (!changed.contains(reloadable.vertexShader) &&
+         !changed.contains(reloadable.fragmentShader))) {
+      continue;
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+    VkPipeline pipeline = VK_NULL_HANDLE;
+    try {
+      std::vector<char> vertStorage, fragStorage;
+      pipeline = reloadable.build(
+          shaderCode(reloadable.vertexShader, vertStorage),
+          shaderCode(reloadable.fragmentShader, fragStorage));
+    } catch (const std::exception &error) {
+      LOG_ERRORF("Failed to rebuild the {} pipeline: {}", reloadable.name,
+                 error.what());
+      continue;
+    }
+
+    std::chrono::duration<double, std::milli> elapsed =
+        std::chrono::steady_clock::now() - start;
+    LOG_INFOF("Rebuilt the {} pipeline in {:.1f} ms.", reloadable.name,
+              elapsed.count());
+
+    // A rebuild that was never swapped in is simply replaced.
+    std::lock_guard lock(s_reload.mutex);
+    for (ReadyPipeline &ready : s_reload.ready) {
+      if (ready.index == i) {
+        vkDestroyPipeline(getVulkanDeviceStruct().logicalDevice,
+                          ready.pipeline, nullptr);
+        ready.pipeline = pipeline;
+        pipeline = VK_NULL_HANDLE;
+      }
+    }
+
+    if (pipeline != VK_NULL_HANDLE) {
+      s_reload.ready.push_back({i, pipeline});
+    }
+  }
+
+  if (variantCode.empty()) {
+    return;
+  }
+
+  const auto start = std::chrono::steady_clock::now();
+  std::vector<pipeline_variant> variants = rebuildPipelineVariants(variantCode);
+  std::chrono::duration<double, std::milli> elapsed =
+      std::chrono::steady_clock::now() - start;
+  LOG_INFOF("Rebuilt {} pipeline variant(s) in {:.1f} ms.", variants.size(),
+            elapsed.count());
+
+  std::lock_guard lock(s_reload.mutex);
+  for (pipeline_variant &variant : variants) {
+    auto waiting = std::find_if(
+        s_reload.variants.begin(), s_reload.variants.end(),
+        [&](const pipeline_variant &other) {
+          return other.desc == variant.desc;
+        });
+    if (waiting != s_reload.variants.end()) {
+      vkDestroyPipeline(getVulkanDeviceStruct().logicalDevice,
+                        waiting->pipeline, nullptr);
+      waiting->pipeline = variant.pipeline;
+    }
+
+    else {
+      s_reload.variants.push_back(variant);
+    }
+  }
+}
+
+void watchShaders(std::string compiler, std::string sourceDir,
+                  std::chrono::milliseconds debounce) {
+  std::set<std::string> changed;
+  std::chrono::steady_clock::time_point lastChange;
+  alignas(inotify_event) char buffer[4096];
+
+  while (s_reload.running.load(std::memory_order_relaxed)) {
+    // Short timeouts so stopShaderHotReload() never waits long.
+    pollfd descriptor{s_reload.inotifyFd, POLLIN, 0};
+    if (::poll(&descriptor, 1, 20) > 0) {
+      const ssize_t length = ::read(s_reload.inotifyFd, buffer, sizeof(buffer));
+      for (ssize_t offset = 0; offset < length;) {
+        const auto *event =
+            reinterpret_cast<const inotify_event *>(buffer + offset);
+        if (event->len > 0) {
+          changed.insert(event->name);
+        }
+        offset += sizeof(inotify_event) + event->len;
+      }
+      lastChange = std::chrono::steady_clock::now();
+      continue;
+    }
+
+    if (changed.empty() ||
+        std::chrono::steady_clock::now() - lastChange < debounce) {
+      continue;
+    }
+
+    // A failed reload must never take the game down with it.
+    try {
+      rebuildPipelines(compiler, sourceDir, changed);
+    } catch (const std::exception &error) {
+      LOG_ERRORF("Shader reload failed: {}", error.what());
+    }
+    changed.clear();
+  }
+}
+} // namespace
+
+void startShaderHotReload() {
+  vulkan_shader_reload &reload = getVulkanShaderReloadStruct();
+
+  if (s_reload.running.load()) {
+    return;
+  }
+
+  const std::string sourceDir =
+      reload.sourceDir.empty() ? HAKKERO_SHADER_SOURCE_DIR : reload.sourceDir;
+  const std::string compiler =
+      reload.compiler.empty() ? HAKKERO_GLSLC : reload.compiler;
+
+  s_reload.inotifyFd = ::inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+  if (s_reload.inotifyFd < 0) {
+    LOG_ERROR("Failed to initialize inotify, shader hot reload is off.");
+    return;
+  }
+
+  // Editors either write the file in place or rename a new one over it.
+  if (::inotify_add_watch(s_reload.inotifyFd, sourceDir.c_str(),
+                          IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+    LOG_ERRORF("Failed to watch {}, shader hot reload is off.", sourceDir);
+    ::close(s_reload.inotifyFd);
+    s_reload.inotifyFd = -1;
+    return;
+  }
+
+  s_reload.running = true;
+  s_reload.thread = std::thread(watchShaders, compiler, sourceDir,
+                                std::chrono::milliseconds(reload.debounceMs));
+
+  LOG_INFOF("Watching {} for shader changes.", sourceDir);
+  if (getAssetArchive().isOpen()) {
+    LOG_WARNF("Shaders are loaded from {}, reloaded ones are lost on restart "
+              "until it is packed again.",
+              getAssetArchive().path());
+  }
+}
+
+void stopShaderHotReload() {
+  vulkan_device &vkDevice = getVulkanDeviceStruct();
+  vulkan_shader_reload &reload = getVulkanShaderReloadStruct();
+
+  if (s_reload.thread.joinable()) {
+    s_reload.running = false;
+    s_reload.thread.join();
+  }
+
+  if (s_reload.inotifyFd >= 0) {
+    ::close(s_reload.inotifyFd);
+    s_reload.inotifyFd = -1;
+  }
+
+  // Only called with the device idle.
+  for (const ReadyPipeline &ready : s_reload.ready) {
+    vkDestroyPipeline(vkDevice.logicalDevice, ready.pipeline, nullptr);
+  }
+
+  for (const pipeline_variant &variant : s_reload.variants) {
+    vkDestroyPipeline(vkDevice.logicalDevice, variant.pipeline, nullptr);
+  }
+
+  for (const vulkan_retired_pipeline &retired : reload.retired) {
+    vkDestroyPipeline(vkDevice.logicalDevice, retired.pipeline, nullptr);
+  }
+
+  s_reload.ready.clear();
+  s_reload.variants.clear();
+  s_reload.compiled.clear();
+  reload.retired.clear();
+}
+
+void applyShaderReload() {
+  vulkan_device &vkDevice = getVulkanDeviceStruct();
+  vulkan_shader_reload &reload = getVulkanShaderReloadStruct();
+  window_backend &vkWindow = getWindowBackendStruct();
+
+  std::erase_if(reload.retired, [&](const vulkan_retired_pipeline &retired) {
+    if (retired.retireFrame != 0 && !isFrameComplete(retired.retireFrame - 1)) {
+      return false;
+    }
+
+    vkDestroyPipeline(vkDevice.logicalDevice, retired.pipeline, nullptr);
+    return true;
+  });
+
+  if (!s_reload.running.load(std::memory_order_relaxed)) {
+    return;
+  }
+
+  std::vector<ReadyPipeline> ready;
+  std::vector<pipeline_variant> variants;
+  {
+    std::lock_guard lock(s_reload.mutex);
+    ready.swap(s_reload.ready);
+    variants.swap(s_reload.variants);
+  }
+
+  // Frames up to the previous one may still be running with the old
+  // pipeline, this one and every later one record with the new pipeline.
+  for (const ReadyPipeline &swap : ready) {
+    VkPipeline &slot = RELOADABLE_PIPELINES[swap.index].slot();
+    reload.retired.push_back({slot, vkWindow.frameNumber});
+    slot = swap.pipeline;
+
+    LOG_INFOF("Swapped in the reloaded {} pipeline.",
+              RELOADABLE_PIPELINES[swap.index].name);
+  }
+
+  // Registry variants retire the same way. One still on its first compile
+  // waits for the next frame.
+  std::vector<pipeline_variant> waiting;
+  for (const pipeline_variant &variant : variants) {
+    VkPipeline old = VK_NULL_HANDLE;
+    if (!swapPipelineVariant(variant, old)) {
+      waiting.push_back(variant);
+      continue;
+    }
+
+    if (old != VK_NULL_HANDLE) {
+      reload.retired.push_back({old, vkWindow.frameNumber});
+    }
+  }
+
+  if (variants.size() > waiting.size()) {
+    LOG_INFOF("Swapped in {} reloaded pipeline variant(s).",
+              variants.size() - waiting.size());
+  }
+
+  if (!waiting.empty()) {
+    std::lock_guard lock(s_reload.mutex);
+    s_reload.variants.insert(s_reload.variants.begin(), waiting.begin(),
+                             waiting.end());
+  }
+}
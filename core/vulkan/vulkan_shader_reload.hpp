@@ -0,0 +1,16 @@
+#pragma once
+
+/// @brief Development mode shader hot reload. Watches the GLSL sources with
+/// inotify, compiles the ones that change with glslc on a background thread
+/// and rebuilds the affected pipelines there through the pipeline cache,
+/// the pipeline registry's variants included. Call it after vkInitialize().
+void startShaderHotReload();
+
+/// @brief Stops the watcher and destroys the pipelines it still holds. Called
+/// by vkShutdown().
+void stopShaderHotReload();
+
+/// @brief Swaps in the pipelines rebuilt since the last frame and destroys
+/// the replaced ones once no frame in flight uses them, so the device never
+/// has to idle. Called by beginFrame().
+void applyShaderReload();
@@ -0,0 +1,203 @@
+#include "vulkan_sprite.hpp"
+#include "logger.hpp"
+#include "vulkan_memory.hpp"
+#include "vulkan_texture.hpp"
+#include "vulkan_types.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstring>
+#include <format>
+#include <vulkan/vulkan_core.h>
+
+namespace {
+constexpr float QUAD_CORNERS[] = {-0.5f, -0.5f, 0.5f, -0.5f,
+                                  0.5f,  0.5f,  -0.5f, 0.5f};
+constexpr uint16_t QUAD_INDICES[] = {0, 1, 2, 2, 3, 0};
+} // namespace
+
+void createSpriteRenderer() {
+  vulkan_sprite_renderer &renderer = getVulkanSpriteRendererStruct();
+  window_backend &vkWindow = getWindowBackendStruct();
+
+  // The quad is tiny and never changes, host visible memory is fine for it
+  // and saves us from needing a staging upload.
+  constexpr VkMemoryPropertyFlags hostMemory =
+      VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+      VK_MEMORY_PROPERTY_HOST_COHERENT_BIT;
+
+  renderer.vertexBuffer = createBuffer(
+      sizeof(QUAD_CORNERS), VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, hostMemory);
+  std::memcpy(renderer.vertexBuffer.allocation.mapped, QUAD_CORNERS,
+              sizeof(QUAD_CORNERS));
+
+  renderer.indexBuffer = createBuffer(
+      sizeof(QUAD_INDICES), VK_BUFFER_USAGE_INDEX_BUFFER_BIT, hostMemory);
+  std::memcpy(renderer.indexBuffer.allocation.mapped, QUAD_INDICES,
+              sizeof(QUAD_INDICES));
+
+  // Every frame in flight writes its own region, so the CPU never touches
+  // instances the GPU may still be reading.
+  VkDeviceSize regionSize =
+      static_cast<VkDeviceSize>(renderer.maxInstancesPerFrame) *
+      sizeof(sprite_instance);
+  renderer.instanceBuffer =
+      createBuffer(regionSize * vkWindow.maxFramesInFlight,
+                   VK_BUFFER_USAGE_VERTEX_BUFFER_BIT, hostMemory);
+
+  renderer.batches.reserve(64);
+  beginSpriteFrame(0);
+
+  LOG_INFOF("Created the sprite renderer ({} instances per frame).",
+            renderer.maxInstancesPerFrame);
+}
+
+void destroySpriteRenderer() {
+  vulkan_sprite_renderer &renderer = getVulkanSpriteRendererStruct();
+
+  destroyBuffer(renderer.instanceBuffer);
+  destroyBuffer(renderer.indexBuffer);
+  destroyBuffer(renderer.vertexBuffer);
+  renderer.instances = nullptr;
+}
+
+void beginSpriteFrame(uint32_t frame) {
+  vulkan_sprite_renderer &renderer = getVulkanSpriteRendererStruct();
+
+  renderer.currentFrame = frame;
+  renderer.instanceCount = 0;
+  renderer.batches.clear();
+  renderer.instances =
+      static_cast<sprite_instance *>(renderer.instanceBuffer.allocation.mapped) +
+      static_cast<size_t>(frame) * renderer.maxInstancesPerFrame;
+}
+
+sprite_instance *reserveSprites(uint32_t count, VkPipeline pipeline) {
+  vulkan_sprite_renderer &renderer = getVulkanSpriteRendererStruct();
+
+  if (count > renderer.maxInstancesPerFrame - renderer.instanceCount) {
+    return nullptr;
+  }
+
+  if (pipeline == VK_NULL_HANDLE) {
+    pipeline = getVulkanPipelineStruct().graphicsPipeline;
+  }
+
+  // Extend the last batch when the state matches, so a scene submitting its
+  // bullets in many small chunks still ends up with a single draw.
+  if (renderer.batches.empty() ||
+      renderer.batches.back().pipeline != pipeline) {
+    vulkan_sprite_batch batch{};
+    batch.pipeline = pipeline;
+    batch.firstInstance = renderer.instanceCount;
+    renderer.batches.push_back(batch);
+  }
+
+  sprite_instance *instances = renderer.instances + renderer.instanceCount;
+  renderer.batches.back().instanceCount += count;
+  renderer.instanceCount += count;
+  return instances;
+}
+
+uint32_t submitSprites(std::span<const sprite_instance> sprites,
+                       VkPipeline pipeline) {
+  vulkan_sprite_renderer &renderer = getVulkanSpriteRendererStruct();
+
+  uint32_t count = static_cast<uint32_t>(
+      std::min<size_t>(sprites.size(), renderer.maxInstancesPerFrame -
+                                           renderer.instanceCount));
+  if (count == 0) {
+    return 0;
+  }
+
+  sprite_instance *instances = reserveSprites(count, pipeline);
+  std::memcpy(instances, sprites.data(), count * sizeof(sprite_instance));
+  return count;
+}
+
+void recordSprites(VkCommandBuffer commandBuffer) {
+  vulkan_sprite_renderer &renderer = getVulkanSpriteRendererStruct();
+
+  recordSprites(commandBuffer, 0,
+                static_cast<uint32_t>(renderer.batches.size()));
+}
+
+void recordSprites(VkCommandBuffer commandBuffer, uint32_t firstBatch,
+                   uint32_t endBatch) {
+  vulkan_sprite_renderer &renderer = getVulkanSpriteRendererStruct();
+  vulkan_pipeline &vkPipeline = getVulkanPipelineStruct();
+  vulkan_swapchain &vkSwapchain = getVulkanSwapchainStruct();
+
+  endBatch = std::min(endBatch, static_cast<uint32_t>(renderer.batches.size()));
+  if (firstBatch >= endBatch) {
+    return;
+  }
+
+  VkBuffer vertexBuffers[] = {renderer.vertexBuffer.handle,
+                              renderer.instanceBuffer.handle};
+  VkDeviceSize offsets[] = {0, static_cast<VkDeviceSize>(renderer.currentFrame) *
+                                   renderer.maxInstancesPerFrame *
+                                   sizeof(sprite_instance)};
+  vkCmdBindVertexBuffers(commandBuffer, 0, 2, vertexBuffers, offsets);
+  vkCmdBindIndexBuffer(commandBuffer, renderer.indexBuffer.handle, 0,
+                       VK_INDEX_TYPE_UINT16);
+
+  sprite_push_constants pushConstants{};
+  pushConstants.viewportScale[0] = 2.0f / vkSwapchain.extent.width;
+  pushConstants.viewportScale[1] = 2.0f / vkSwapchain.extent.height;
+  vkCmdPushConstants(commandBuffer, vkPipeline.layout,
+                     VK_SHADER_STAGE_VERTEX_BIT, 0, sizeof(pushConstants),
+                     &pushConstants);
+
+  // Every texture is in the one set, so it stays bound for all batches.
+  bindTextureTable(commandBuffer, vkPipeline.layout);
+
+  VkPipeline boundPipeline = VK_NULL_HANDLE;
+  for (uint32_t i = firstBatch; i < endBatch; i++) {
+    const vulkan_sprite_batch &batch = renderer.batches[i];
+    if (batch.pipeline != boundPipeline) {
+      vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                        batch.pipeline);
+      boundPipeline = batch.pipeline;
+    }
+
+    vkCmdDrawIndexed(commandBuffer, 6, batch.instanceCount, 0, 0,
+                     batch.firstInstance);
+  }
+}
+
+VkVertexInputBindingDescription getSpriteVertexBinding() {
+  VkVertexInputBindingDescription binding{};
+  binding.binding = 0;
+  binding.stride = 2 * sizeof(float);
+  binding.inputRate = VK_VERTEX_INPUT_RATE_VERTEX;
+  return binding;
+}
+
+VkVertexInputBindingDescription getSpriteInstanceBinding() {
+  VkVertexInputBindingDescription binding{};
+  binding.binding = 1;
+  binding.stride = sizeof(sprite_instance);
+  binding.inputRate = VK_VERTEX_INPUT_RATE_INSTANCE;
+  return binding;
+}
+
+std::array<VkVertexInputAttributeDescription, 7> getSpriteAttributes() {
+  std::array<VkVertexInputAttributeDescription, 7> attributes{};
+
+  attributes[0] = {0, 0, VK_FORMAT_R32G32_SFLOAT, 0};
+  attributes[1] = {1, 1, VK_FORMAT_R32G32_SFLOAT,
+                   offsetof(sprite_instance, position)};
+  attributes[2] = {2, 1, VK_FORMAT_R32G32_SFLOAT,
+                   offsetof(sprite_instance, scale)};
+  attributes[3] = {3, 1, VK_FORMAT_R32_SFLOAT,
+                   offsetof(sprite_instance, rotation)};
+  attributes[4] = {4, 1, VK_FORMAT_R8G8B8A8_UNORM,
+                   offsetof(sprite_instance, color)};
+  attributes[5] = {5, 1, VK_FORMAT_R32G32B32A32_SFLOAT,
+                   offsetof(sprite_instance, uvRect)};
+  attributes[6] = {6, 1, VK_FORMAT_R32_UINT,
+                   offsetof(sprite_instance, texture)};
+
+  return attributes;
+}
@@ -0,0 +1,53 @@
+#pragma once
+
+#include "vulkan_types.hpp"
+
+#include <array>
+#include <span>
+#include <vulkan/vulkan.h>
+
+/// @brief Push constants of the sprite pipeline.
+struct sprite_push_constants {
+  /// @brief 2 / framebuffer size, maps pixel coordinates to clip space.
+  float viewportScale[2];
+};
+
+/// @brief Creates the quad buffers and the per-frame instance ring. Must be
+/// called after createAllocator().
+void createSpriteRenderer();
+void destroySpriteRenderer();
+
+/// @brief Points the instance ring at the region of the given frame slot and
+/// clears the previous batches. Called by beginFrame().
+void beginSpriteFrame(uint32_t frame);
+
+/// @brief Reserves count instances in the mapped instance buffer and returns a
+/// pointer to them, so callers can write straight into GPU visible memory.
+/// Returns nullptr if the frame is out of instances. Sprites only start a new
+/// batch when the pipeline changes, every instance picks its own texture.
+sprite_instance *reserveSprites(uint32_t count,
+                                VkPipeline pipeline = VK_NULL_HANDLE);
+
+/// @brief Copies the sprites into the instance buffer. Returns how many fit.
+uint32_t submitSprites(std::span<const sprite_instance> sprites,
+                       VkPipeline pipeline = VK_NULL_HANDLE);
+
+/// @brief Records one indexed, instanced draw per batch. Must be called inside
+/// the render pass.
+void recordSprites(VkCommandBuffer commandBuffer);
+
+/// @brief recordSprites() for the batches in [firstBatch, endBatch) only.
+/// Binds all state it needs, so ranges can be recorded into different
+/// secondary command buffers in parallel.
+void recordSprites(VkCommandBuffer commandBuffer, uint32_t firstBatch,
+                   uint32_t endBatch);
+
+VkVertexInputBindingDescription getSpriteVertexBinding();
+VkVertexInputBindingDescription getSpriteInstanceBinding();
+std::array<VkVertexInputAttributeDescription, 7> getSpriteAttributes();
+
+/// @brief Packs a color into the layout sprite_instance::color expects.
+constexpr uint32_t packColor(uint8_t r, uint8_t g, uint8_t b, uint8_t a) {
+  return static_cast<uint32_t>(r) | (static_cast<uint32_t>(g) << 8) |
+         (static_cast<uint32_t>(b) << 16) | (static_cast<uint32_t>(a) << 24);
+}
@@ -21,3 +21,30 @@ void createVkSurface(GLFWwindow *window) {
     LOG_INFO("Successfully created the vulkan surface.");
   }
 }
+
+void createHeadlessSurface() {
+  vulkan_context &context = getVulkanContextStruct();
+  window_backend &vkWindowBackend = getWindowBackendStruct();
+
+  // Extension functions are not exported by the loader.
+  auto createSurface = reinterpret_cast<PFN_vkCreateHeadlessSurfaceEXT>(
+      vkGetInstanceProcAddr(context.instance, "vkCreateHeadlessSurfaceEXT"));
+  if (!createSurface) {
+    LOG_ERROR("vkCreateHeadlessSurfaceEXT is not available.");
+    throw std::runtime_error("vkCreateHeadlessSurfaceEXT is not available.");
+  }
+
+  VkHeadlessSurfaceCreateInfoEXT createInfo{};
+  createInfo.sType = VK_STRUCTURE_TYPE_HEADLESS_SURFACE_CREATE_INFO_EXT;
+
+  VkResult result = createSurface(context.instance, &createInfo, nullptr,
+                                  &vkWindowBackend.surface);
+  if (!checkVkResult(result)) {
+    LOG_ERROR(vkResultToString(result));
+    throw std::runtime_error(vkResultToString(result));
+  }
+
+  else {
+    LOG_INFO("Successfully created the headless vulkan surface.");
+  }
+}
@@ -4,3 +4,7 @@
 #include <vulkan/vulkan.h>
 
 void createVkSurface(GLFWwindow *window);
+
+/// @brief Creates a VK_EXT_headless_surface. The extension has to be enabled
+/// on the instance.
+void createHeadlessSurface();
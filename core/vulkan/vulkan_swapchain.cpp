@@ -1,8 +1,14 @@
 #include "vulkan_swapchain.hpp"
 #include "logger.hpp"
+#include "vulkan_image.hpp"
+#include "vulkan_memory.hpp"
+#include "vulkan_pipeline.hpp"
+#include "vulkan_render.hpp"
 #include "vulkan_types.hpp"
 #include "vulkan_utils.hpp"
 #include <GLFW/glfw3.h>
+#include <algorithm>
+#include <format>
 #include <limits>
 #include <stdexcept>
 #include <vulkan/vulkan_core.h>
@@ -74,21 +80,34 @@ void chooseSwapSurfaceFormat() {
   }
 }
 
-void chooseSwapPresentMode() {
+VkPresentModeKHR resolvePresentMode(VkPresentModeKHR requested) {
   vulkan_swapchain_support_info &swapSupport =
       getVulkanSwapchainSupportStruct();
-  vulkan_swapchain &swapchainStruct = getVulkanSwapchainStruct();
 
+  // FIFO is the only mode every surface has to support.
   for (const auto &availablePresentMode : swapSupport.presentModes) {
-    if (availablePresentMode == VK_PRESENT_MODE_MAILBOX_KHR) {
-      swapchainStruct.presentMode = availablePresentMode;
-      LOG_INFO("Using mailbox presentation mode for the swapchain.");
+    if (availablePresentMode == requested) {
+      return availablePresentMode;
     }
   }
+  return VK_PRESENT_MODE_FIFO_KHR;
+}
+
+void chooseSwapPresentMode() {
+  vulkan_swapchain &swapchainStruct = getVulkanSwapchainStruct();
+  vulkan_frame_pacing &framePacing = getVulkanFramePacingStruct();
+
+  swapchainStruct.presentMode = resolvePresentMode(framePacing.presentMode);
+
+  if (swapchainStruct.presentMode != framePacing.presentMode) {
+    LOG_WARNF("The surface does not support {}, falling back to {}.",
+              presentModeToString(framePacing.presentMode),
+              presentModeToString(swapchainStruct.presentMode));
+  }
 
-  if (swapchainStruct.presentMode != VK_PRESENT_MODE_MAILBOX_KHR) {
-    swapchainStruct.presentMode = VK_PRESENT_MODE_FIFO_KHR;
-    LOG_INFO("Using FIFO presentation mode for the swapchain.");
+  else {
+    LOG_INFOF("Using {} presentation mode for the swapchain.",
+              presentModeToString(swapchainStruct.presentMode));
   }
 }
 
@@ -96,19 +115,29 @@ void chooseSwapExtent(GLFWwindow *window) {
   vulkan_swapchain_support_info &swapSupport =
       getVulkanSwapchainSupportStruct();
   vulkan_swapchain &vkSwapchain = getVulkanSwapchainStruct();
+  window_backend &vkWindowBackend = getWindowBackendStruct();
 
-  if (swapSupport.capabilities.currentExtent.width !=
-      std::numeric_limits<uint32_t>::max()) {
+  // Offscreen targets have no surface limits to respect.
+  if (vkWindowBackend.surface == VK_NULL_HANDLE) {
+    vkSwapchain.extent = vkWindowBackend.headlessExtent;
+    LOG_INFO("Chosen the offscreen 2D image extent.");
+  }
+
+  else if (swapSupport.capabilities.currentExtent.width !=
+           std::numeric_limits<uint32_t>::max()) {
     vkSwapchain.extent = swapSupport.capabilities.currentExtent;
     LOG_INFO("Chosen the swapchain 2D image extent.");
   }
 
   else {
-    int width, height;
-    glfwGetFramebufferSize(window, &width, &height);
-
-    VkExtent2D actualExtent = {static_cast<uint32_t>(width),
-                               static_cast<uint32_t>(height)};
+    // A headless surface leaves the size up to us.
+    VkExtent2D actualExtent = vkWindowBackend.headlessExtent;
+    if (window) {
+      int width, height;
+      glfwGetFramebufferSize(window, &width, &height);
+      actualExtent = {static_cast<uint32_t>(width),
+                      static_cast<uint32_t>(height)};
+    }
 
     actualExtent.width = std::clamp(
         actualExtent.width, swapSupport.capabilities.minImageExtent.width,
@@ -167,7 +196,10 @@ void createSwapchain() {
   createInfo.compositeAlpha = VK_COMPOSITE_ALPHA_OPAQUE_BIT_KHR;
   createInfo.presentMode = vkSwapchain.presentMode;
   createInfo.clipped = VK_TRUE;
-  createInfo.oldSwapchain = VK_NULL_HANDLE;
+
+  // This is VK_NULL_HANDLE on the first call. When recreating, passing the old
+  // swapchain lets the driver reuse its resources and finish presenting it.
+  createInfo.oldSwapchain = vkSwapchain.swapchain;
 
   VkResult result = vkCreateSwapchainKHR(vkDevice.logicalDevice, &createInfo,
                                          nullptr, &vkSwapchain.swapchain);
@@ -187,3 +219,155 @@ void createSwapchain() {
   vkGetSwapchainImagesKHR(vkDevice.logicalDevice, vkSwapchain.swapchain,
                           &imageCount, vkImage.swapChainImages.data());
 }
+
+void recreateSwapchain() {
+  window_backend &vkWindowBackend = getWindowBackendStruct();
+  vulkan_swapchain_support_info &swapSupport =
+      getVulkanSwapchainSupportStruct();
+  vulkan_swapchain &vkSwapchain = getVulkanSwapchainStruct();
+  vulkan_device &vkDevice = getVulkanDeviceStruct();
+  vulkan_image &vkImage = getVulkanImageStruct();
+  vulkan_pipeline &vkPipeline = getVulkanPipelineStruct();
+  vulkan_offscreen &vkOffscreen = getVulkanOffscreenStruct();
+
+  // A minimized window has a zero sized framebuffer and we cannot create a
+  // swapchain for it, so just wait until it comes back.
+  if (vkWindowBackend.window) {
+    int width = 0, height = 0;
+    glfwGetFramebufferSize(vkWindowBackend.window, &width, &height);
+    while (width == 0 || height == 0) {
+      glfwWaitEvents();
+      glfwGetFramebufferSize(vkWindowBackend.window, &width, &height);
+    }
+  }
+
+  const bool offscreen = vkWindowBackend.surface == VK_NULL_HANDLE;
+  if (!offscreen) {
+    VkResult result = vkGetPhysicalDeviceSurfaceCapabilitiesKHR(
+        vkDevice.vkPhysDevice, vkWindowBackend.surface,
+        &swapSupport.capabilities);
+    if (!checkVkResult(result)) {
+      LOG_ERROR(vkResultToString(result));
+      throw std::runtime_error(vkResultToString(result));
+    }
+
+    // setPresentMode() may have asked for a different mode.
+    chooseSwapPresentMode();
+  }
+
+  // Frames that are still in flight reference the old objects, so we only
+  // retire them here. destroyRetiredSwapchains() frees them once it is safe.
+  vulkan_retired_swapchain retired{};
+  retired.swapchain = vkSwapchain.swapchain;
+  retired.imageViews = std::move(vkImage.swapChainImageViews);
+  retired.framebuffers = std::move(vkPipeline.swapChainFramebuffers);
+  retired.renderFinishedSemaphores =
+      std::move(vkWindowBackend.renderFinishedSemaphores);
+  vkWindowBackend.renderFinishedSemaphores.clear();
+  retired.retireFrame = vkWindowBackend.frameNumber;
+
+  chooseSwapExtent(vkWindowBackend.window);
+  if (offscreen) {
+    vkOffscreen.retired.push_back(
+        {std::move(vkOffscreen.images), vkWindowBackend.frameNumber});
+    createOffscreenTargets();
+  }
+
+  else {
+    createSwapchain();
+  }
+  vkSwapchain.retired.push_back(std::move(retired));
+
+  createImageViews();
+  createFrameBuffers();
+  createImageSyncObjects();
+
+  LOG_INFOF("Recreated the swapchain at {}x{}.", vkSwapchain.extent.width,
+            vkSwapchain.extent.height);
+}
+
+void destroyRetiredSwapchains(bool deviceIdle) {
+  window_backend &vkWindowBackend = getWindowBackendStruct();
+  vulkan_swapchain &vkSwapchain = getVulkanSwapchainStruct();
+  vulkan_offscreen &vkOffscreen = getVulkanOffscreenStruct();
+  vulkan_device &vkDevice = getVulkanDeviceStruct();
+
+  // Every frame slot waits on its fence before being reused, so after
+  // maxFramesInFlight more frames nothing can reference the old objects.
+  auto inUse = [&](uint64_t retireFrame) {
+    return !deviceIdle && vkWindowBackend.frameNumber <
+                              retireFrame + vkWindowBackend.maxFramesInFlight;
+  };
+
+  std::erase_if(vkOffscreen.retired, [&](vulkan_retired_offscreen &retired) {
+    if (inUse(retired.retireFrame)) {
+      return false;
+    }
+
+    for (vulkan_allocated_image &image : retired.images) {
+      destroyImage(image);
+    }
+    return true;
+  });
+
+  std::erase_if(vkSwapchain.retired, [&](vulkan_retired_swapchain &retired) {
+    if (inUse(retired.retireFrame)) {
+      return false;
+    }
+
+    // A present to the old swapchain may still wait on its semaphores and
+    // read its images after every frame finished. One to a newer swapchain
+    // was queued behind them, so once that one went through they are done.
+    if (!deviceIdle && retired.swapchain != VK_NULL_HANDLE &&
+        (!retired.presentedAfter || !isFrameComplete(retired.presentFrame))) {
+      return false;
+    }
+
+    for (VkFramebuffer framebuffer : retired.framebuffers) {
+      vkDestroyFramebuffer(vkDevice.logicalDevice, framebuffer, nullptr);
+    }
+
+    for (VkImageView imageView : retired.imageViews) {
+      vkDestroyImageView(vkDevice.logicalDevice, imageView, nullptr);
+    }
+
+    for (VkSemaphore semaphore : retired.renderFinishedSemaphores) {
+      vkDestroySemaphore(vkDevice.logicalDevice, semaphore, nullptr);
+    }
+
+    // Offscreen targets have no swapchain and VK_KHR_swapchain may not even
+    // be enabled.
+    if (retired.swapchain != VK_NULL_HANDLE) {
+      vkDestroySwapchainKHR(vkDevice.logicalDevice, retired.swapchain,
+                            nullptr);
+    }
+    return true;
+  });
+}
+
+void swapchainPresented(uint64_t frameNumber) {
+  vulkan_swapchain &vkSwapchain = getVulkanSwapchainStruct();
+
+  for (vulkan_retired_swapchain &retired : vkSwapchain.retired) {
+    if (!retired.presentedAfter) {
+      retired.presentedAfter = true;
+      retired.presentFrame = frameNumber;
+    }
+  }
+}
+
+void resizeHeadless(uint32_t width, uint32_t height) {
+  window_backend &vkWindowBackend = getWindowBackendStruct();
+  if (!vkWindowBackend.headless) {
+    LOG_ERROR("resizeHeadless() was called for a window.");
+    throw std::runtime_error("resizeHeadless() was called for a window.");
+  }
+
+  vkWindowBackend.headlessExtent = {width, height};
+  recreateSwapchain();
+}
+
+void framebufferResizeCallback(GLFWwindow * /*window*/, int /*width*/,
+                               int /*height*/) {
+  getWindowBackendStruct().framebufferResized = true;
+}
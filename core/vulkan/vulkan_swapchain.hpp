@@ -7,5 +7,29 @@
 void querySwapchainSupport();
 void chooseSwapSurfaceFormat();
 void chooseSwapPresentMode();
+
+/// @brief The mode chooseSwapPresentMode() ends up with for a request, FIFO
+/// if the surface does not support it.
+VkPresentModeKHR resolvePresentMode(VkPresentModeKHR requested);
 void chooseSwapExtent(GLFWwindow *window);
 void createSwapchain();
+
+/// @brief Rebuilds the swapchain and the objects depending on its images after
+/// a resize or when presentation reports it as out of date. The old swapchain
+/// is handed to the driver and destroyed later, so the device is never idled.
+void recreateSwapchain();
+
+/// @brief Destroys the retired swapchains no frame in flight can reference
+/// anymore. Pass true if the device is known to be idle to destroy all of them.
+void destroyRetiredSwapchains(bool deviceIdle = false);
+
+/// @brief Records that the frame was successfully presented to the current
+/// swapchain. The retired swapchains are only destroyed after such a present
+/// finished. Called by drawFrame().
+void swapchainPresented(uint64_t frameNumber);
+
+/// @brief Changes the size of the headless render targets, the headless
+/// counterpart of a window resize.
+void resizeHeadless(uint32_t width, uint32_t height);
+
+void framebufferResizeCallback(GLFWwindow *window, int width, int height);
@@ -0,0 +1,688 @@
+#include "vulkan_texture.hpp"
+#include "logger.hpp"
+#include "vulkan_memory.hpp"
+#include "vulkan_render.hpp"
+#include "vulkan_upload.hpp"
+#include "vulkan_utils.hpp"
+
+#include <algorithm>
+#include <bit>
+#include <cstring>
+#include <format>
+#include <stdexcept>
+#include <vector>
+
+namespace {
+constexpr VkFormat TEXTURE_FORMAT = VK_FORMAT_R8G8B8A8_SRGB;
+constexpr VkDeviceSize TEXEL_SIZE = 4;
+
+[[noreturn]] void fail(const std::string &message) {
+  LOG_ERROR(message);
+  throw std::runtime_error(message);
+}
+
+void checkResult(VkResult result) {
+  if (!checkVkResult(result)) {
+    LOG_ERROR(vkResultToString(result));
+    throw std::runtime_error(vkResultToString(result));
+  }
+}
+
+// With a dedicated transfer queue the images are shared by both families, so
+// updates can keep the contents the graphics queue already samples.
+bool sharedImages() { return getVulkanUploadStruct().dedicatedQueue; }
+
+VkImageCreateInfo textureImageInfo(uint32_t width, uint32_t height,
+                                   uint32_t mipLevels, uint32_t layers,
+                                   const uint32_t (&families)[2]) {
+  VkImageCreateInfo imageInfo{};
+  imageInfo.sType = VK_STRUCTURE_TYPE_IMAGE_CREATE_INFO;
+  imageInfo.imageType = VK_IMAGE_TYPE_2D;
+  imageInfo.format = TEXTURE_FORMAT;
+  imageInfo.extent = {width, height, 1};
+  imageInfo.mipLevels = mipLevels;
+  imageInfo.arrayLayers = layers;
+  imageInfo.samples = VK_SAMPLE_COUNT_1_BIT;
+  imageInfo.tiling = VK_IMAGE_TILING_OPTIMAL;
+  imageInfo.usage =
+      VK_IMAGE_USAGE_SAMPLED_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT;
+  if (mipLevels > 1) {
+    imageInfo.usage |= VK_IMAGE_USAGE_TRANSFER_SRC_BIT;
+  }
+  imageInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+  if (sharedImages()) {
+    imageInfo.sharingMode = VK_SHARING_MODE_CONCURRENT;
+    imageInfo.queueFamilyIndexCount = 2;
+    imageInfo.pQueueFamilyIndices = families;
+  }
+
+  else {
+    imageInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;
+  }
+
+  return imageInfo;
+}
+
+VkImageView createTextureView(VkImage image, VkImageViewType type,
+                              uint32_t mipLevels, uint32_t layers) {
+  vulkan_device &vkDevice = getVulkanDeviceStruct();
+
+  VkImageViewCreateInfo viewInfo{};
+  viewInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
+  viewInfo.image = image;
+  viewInfo.viewType = type;
+  viewInfo.format = TEXTURE_FORMAT;
+  viewInfo.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, mipLevels, 0,
+                               layers};
+
+  VkImageView view = VK_NULL_HANDLE;
+  checkResult(
+      vkCreateImageView(vkDevice.logicalDevice, &viewInfo, nullptr, &view));
+  return view;
+}
+
+vulkan_image_upload textureUpload(uint32_t texture, VkImageLayout oldLayout,
+                                  const VkRect2D &region, uint32_t rowLength) {
+  vulkan_texture_table &table = getVulkanTextureTableStruct();
+
+  vulkan_image_upload upload{};
+  upload.image = table.bindless ? table.textures[texture].image.handle
+                                : table.array.handle;
+  upload.arrayLayer = table.bindless ? 0 : texture;
+  upload.oldLayout = oldLayout;
+  upload.offset = {region.offset.x, region.offset.y, 0};
+  upload.extent = {region.extent.width, region.extent.height, 1};
+  upload.rowLength = rowLength;
+  upload.concurrent = sharedImages();
+
+  // The mip blits read level 0 right after the copy.
+  if (table.textures[texture].mipLevels > 1) {
+    upload.dstStage |= VK_PIPELINE_STAGE_TRANSFER_BIT;
+    upload.dstAccess |= VK_ACCESS_TRANSFER_READ_BIT;
+  }
+  return upload;
+}
+
+// Queues the mips below region of level 0 for recordTextureMips().
+void requestMips(uint32_t index, const VkRect2D &region) {
+  vulkan_texture_table &table = getVulkanTextureTableStruct();
+  vulkan_texture &texture = table.textures[index];
+
+  if (texture.mipLevels == 1) {
+    return;
+  }
+
+  if (!texture.mipsPending) {
+    texture.mipRegion = region;
+    texture.mipsPending = true;
+    table.pendingMips.push_back(index);
+    return;
+  }
+
+  VkRect2D &pending = texture.mipRegion;
+  const int32_t x1 =
+      std::max(pending.offset.x + static_cast<int32_t>(pending.extent.width),
+               region.offset.x + static_cast<int32_t>(region.extent.width));
+  const int32_t y1 =
+      std::max(pending.offset.y + static_cast<int32_t>(pending.extent.height),
+               region.offset.y + static_cast<int32_t>(region.extent.height));
+  pending.offset.x = std::min(pending.offset.x, region.offset.x);
+  pending.offset.y = std::min(pending.offset.y, region.offset.y);
+  pending.extent.width = static_cast<uint32_t>(x1 - pending.offset.x);
+  pending.extent.height = static_cast<uint32_t>(y1 - pending.offset.y);
+}
+
+// Every level is blitted from the one above it, only as far as the region
+// reaches. Frames before this one may still sample any of the levels.
+void recordMipChain(VkCommandBuffer commandBuffer,
+                    const vulkan_texture &texture) {
+  VkImageMemoryBarrier barrier{};
+  barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+  barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.image = texture.image.handle;
+
+  // The first time there is nothing below level 0 worth keeping.
+  VkImageMemoryBarrier toTransfer[2] = {barrier, barrier};
+  toTransfer[0].dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+  toTransfer[0].oldLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+  toTransfer[0].newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+  toTransfer[0].subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, 1, 0, 1};
+  toTransfer[1].dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  toTransfer[1].oldLayout = texture.mipsDefined
+                                ? VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL
+                                : VK_IMAGE_LAYOUT_UNDEFINED;
+  toTransfer[1].newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+  toTransfer[1].subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 1,
+                                    texture.mipLevels - 1, 0, 1};
+  vkCmdPipelineBarrier(
+      commandBuffer,
+      VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT | VK_PIPELINE_STAGE_TRANSFER_BIT,
+      VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0, nullptr, 2,
+      toTransfer);
+
+  const VkRect2D &region = texture.mipRegion;
+  const uint32_t x0 = static_cast<uint32_t>(region.offset.x);
+  const uint32_t y0 = static_cast<uint32_t>(region.offset.y);
+  const uint32_t x1 = x0 + region.extent.width;
+  const uint32_t y1 = y0 + region.extent.height;
+
+  for (uint32_t level = 1; level < texture.mipLevels; level++) {
+    const uint32_t srcWidth = std::max(texture.width >> (level - 1), 1u);
+    const uint32_t srcHeight = std::max(texture.height >> (level - 1), 1u);
+    const uint32_t dstWidth = std::max(texture.width >> level, 1u);
+    const uint32_t dstHeight = std::max(texture.height >> level, 1u);
+
+    // Rounded outwards, every texel the region touches at this level. The
+    // last column and row of an odd sized level have no texel of their own
+    // below.
+    const uint32_t round = (1u << level) - 1;
+    const uint32_t dstX0 = std::min(x0 >> level, dstWidth - 1);
+    const uint32_t dstY0 = std::min(y0 >> level, dstHeight - 1);
+    const uint32_t dstX1 = std::min((x1 + round) >> level, dstWidth);
+    const uint32_t dstY1 = std::min((y1 + round) >> level, dstHeight);
+
+    VkImageBlit blit{};
+    blit.srcSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, level - 1, 0, 1};
+    blit.srcOffsets[0] = {static_cast<int32_t>(dstX0 * 2),
+                          static_cast<int32_t>(dstY0 * 2), 0};
+    blit.srcOffsets[1] = {static_cast<int32_t>(std::min(dstX1 * 2, srcWidth)),
+                          static_cast<int32_t>(std::min(dstY1 * 2, srcHeight)),
+                          1};
+    blit.dstSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, level, 0, 1};
+    blit.dstOffsets[0] = {static_cast<int32_t>(dstX0),
+                          static_cast<int32_t>(dstY0), 0};
+    blit.dstOffsets[1] = {static_cast<int32_t>(dstX1),
+                          static_cast<int32_t>(dstY1), 1};
+    vkCmdBlitImage(commandBuffer, texture.image.handle,
+                   VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, texture.image.handle,
+                   VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &blit,
+                   VK_FILTER_LINEAR);
+
+    // The next level reads this one.
+    VkImageMemoryBarrier toSource = barrier;
+    toSource.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+    toSource.dstAccessMask = VK_ACCESS_TRANSFER_READ_BIT;
+    toSource.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+    toSource.newLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+    toSource.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, level, 1, 0, 1};
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0,
+                         nullptr, 1, &toSource);
+  }
+
+  VkImageMemoryBarrier toShader = barrier;
+  toShader.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  toShader.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+  toShader.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL;
+  toShader.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+  toShader.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, 0, texture.mipLevels,
+                               0, 1};
+  vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                       VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, 0, 0, nullptr, 0,
+                       nullptr, 1, &toShader);
+}
+
+void writeTextureDescriptor(uint32_t texture, VkImageView view) {
+  vulkan_device &vkDevice = getVulkanDeviceStruct();
+  vulkan_texture_table &table = getVulkanTextureTableStruct();
+
+  VkDescriptorImageInfo imageInfo{};
+  imageInfo.sampler = table.sampler;
+  imageInfo.imageView = view;
+  imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+  VkWriteDescriptorSet write{};
+  write.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+  write.dstSet = table.set;
+  write.dstBinding = 0;
+  write.dstArrayElement = texture;
+  write.descriptorCount = 1;
+  write.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+  write.pImageInfo = &imageInfo;
+  vkUpdateDescriptorSets(vkDevice.logicalDevice, 1, &write, 0, nullptr);
+}
+
+// One update-after-bind array of sampled images, textures are written into it
+// while frames using other elements are in flight.
+void createBindlessLayout() {
+  vulkan_device &vkDevice = getVulkanDeviceStruct();
+  vulkan_texture_table &table = getVulkanTextureTableStruct();
+
+  VkPhysicalDeviceVulkan12Properties properties12{};
+  properties12.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_PROPERTIES;
+  VkPhysicalDeviceProperties2 properties{};
+  properties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_PROPERTIES_2;
+  properties.pNext = &properties12;
+  vkGetPhysicalDeviceProperties2(vkDevice.vkPhysDevice, &properties);
+
+  table.maxTextures = std::min(
+      {table.maxTextures,
+       properties12.maxDescriptorSetUpdateAfterBindSampledImages,
+       properties12.maxDescriptorSetUpdateAfterBindSamplers,
+       properties12.maxPerStageDescriptorUpdateAfterBindSampledImages,
+       properties12.maxPerStageDescriptorUpdateAfterBindSamplers,
+       properties12.maxPerStageUpdateAfterBindResources});
+
+  VkDescriptorSetLayoutBinding binding{};
+  binding.binding = 0;
+  binding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+  binding.descriptorCount = table.maxTextures;
+  binding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+  // Unused elements may hold nothing or a destroyed texture.
+  const VkDescriptorBindingFlags bindingFlags =
+      VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT |
+      VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT;
+  VkDescriptorSetLayoutBindingFlagsCreateInfo flagsInfo{};
+  flagsInfo.sType =
+      VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO;
+  flagsInfo.bindingCount = 1;
+  flagsInfo.pBindingFlags = &bindingFlags;
+
+  VkDescriptorSetLayoutCreateInfo layoutInfo{};
+  layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+  layoutInfo.pNext = &flagsInfo;
+  layoutInfo.flags =
+      VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT;
+  layoutInfo.bindingCount = 1;
+  layoutInfo.pBindings = &binding;
+  checkResult(vkCreateDescriptorSetLayout(vkDevice.logicalDevice, &layoutInfo,
+                                          nullptr, &table.setLayout));
+
+  VkDescriptorPoolSize poolSize{VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER,
+                                table.maxTextures};
+  VkDescriptorPoolCreateInfo poolInfo{};
+  poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+  poolInfo.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT;
+  poolInfo.maxSets = 1;
+  poolInfo.poolSizeCount = 1;
+  poolInfo.pPoolSizes = &poolSize;
+  checkResult(vkCreateDescriptorPool(vkDevice.logicalDevice, &poolInfo,
+                                     nullptr, &table.pool));
+}
+
+// A single texture array, plus how much of its layer every texture covers so
+// sprites can keep using UVs relative to their own texture.
+void createArrayLayout() {
+  vulkan_device &vkDevice = getVulkanDeviceStruct();
+  vulkan_texture_table &table = getVulkanTextureTableStruct();
+
+  VkPhysicalDeviceProperties properties;
+  vkGetPhysicalDeviceProperties(vkDevice.vkPhysDevice, &properties);
+  table.arrayLayers =
+      std::min({table.arrayLayers, TEXTURE_ARRAY_MAX_LAYERS,
+                properties.limits.maxImageArrayLayers});
+  table.arrayExtent =
+      std::min(table.arrayExtent, properties.limits.maxImageDimension2D);
+
+  VkDescriptorSetLayoutBinding bindings[2]{};
+  bindings[0].binding = 0;
+  bindings[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+  bindings[0].descriptorCount = 1;
+  bindings[0].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+  bindings[1].binding = 1;
+  bindings[1].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+  bindings[1].descriptorCount = 1;
+  bindings[1].stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
+
+  VkDescriptorSetLayoutCreateInfo layoutInfo{};
+  layoutInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+  layoutInfo.bindingCount = 2;
+  layoutInfo.pBindings = bindings;
+  checkResult(vkCreateDescriptorSetLayout(vkDevice.logicalDevice, &layoutInfo,
+                                          nullptr, &table.setLayout));
+
+  VkDescriptorPoolSize poolSizes[] = {
+      {VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER, 1},
+      {VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER, 1}};
+  VkDescriptorPoolCreateInfo poolInfo{};
+  poolInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+  poolInfo.maxSets = 1;
+  poolInfo.poolSizeCount = 2;
+  poolInfo.pPoolSizes = poolSizes;
+  checkResult(vkCreateDescriptorPool(vkDevice.logicalDevice, &poolInfo,
+                                     nullptr, &table.pool));
+
+  const uint32_t families[2] = {vkDevice.graphics_queue_index.value(),
+                                vkDevice.transfer_queue_index.value()};
+  table.array = createImage(textureImageInfo(table.arrayExtent,
+                                             table.arrayExtent, 1,
+                                             table.arrayLayers, families),
+                            VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+  table.arrayView = createTextureView(
+      table.array.handle, VK_IMAGE_VIEW_TYPE_2D_ARRAY, 1, table.arrayLayers);
+
+  // Always the size sprite_array.frag declares, unused entries stay zero.
+  table.layerScales =
+      createBuffer(TEXTURE_ARRAY_MAX_LAYERS * 4 * sizeof(float),
+                   VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+                   VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                       VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+  std::memset(table.layerScales.allocation.mapped, 0, table.layerScales.size);
+}
+} // namespace
+
+void createTextureTable() {
+  vulkan_device &vkDevice = getVulkanDeviceStruct();
+  vulkan_texture_table &table = getVulkanTextureTableStruct();
+
+  table.bindless = vkDevice.descriptorIndexing;
+
+  // Mips are blitted down from level 0. The texture array shares one image
+  // between textures of different sizes, so it has no mips at all.
+  VkFormatProperties formatProperties;
+  vkGetPhysicalDeviceFormatProperties(vkDevice.vkPhysDevice, TEXTURE_FORMAT,
+                                      &formatProperties);
+  const VkFormatFeatureFlags blitFeatures =
+      VK_FORMAT_FEATURE_BLIT_SRC_BIT | VK_FORMAT_FEATURE_BLIT_DST_BIT |
+      VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT;
+  table.mipmaps =
+      table.bindless &&
+      (formatProperties.optimalTilingFeatures & blitFeatures) == blitFeatures;
+
+  VkSamplerCreateInfo samplerInfo{};
+  samplerInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+  samplerInfo.magFilter = VK_FILTER_LINEAR;
+  samplerInfo.minFilter = VK_FILTER_LINEAR;
+  samplerInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR;
+  samplerInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+  samplerInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+  samplerInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+  samplerInfo.maxLod = VK_LOD_CLAMP_NONE;
+  checkResult(vkCreateSampler(vkDevice.logicalDevice, &samplerInfo, nullptr,
+                              &table.sampler));
+
+  if (table.bindless) {
+    createBindlessLayout();
+  }
+
+  else {
+    createArrayLayout();
+  }
+
+  VkDescriptorSetAllocateInfo allocateInfo{};
+  allocateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+  allocateInfo.descriptorPool = table.pool;
+  allocateInfo.descriptorSetCount = 1;
+  allocateInfo.pSetLayouts = &table.setLayout;
+  checkResult(vkAllocateDescriptorSets(vkDevice.logicalDevice, &allocateInfo,
+                                       &table.set));
+
+  if (!table.bindless) {
+    VkDescriptorImageInfo imageInfo{};
+    imageInfo.sampler = table.sampler;
+    imageInfo.imageView = table.arrayView;
+    imageInfo.imageLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+    VkDescriptorBufferInfo bufferInfo{};
+    bufferInfo.buffer = table.layerScales.handle;
+    bufferInfo.range = VK_WHOLE_SIZE;
+
+    VkWriteDescriptorSet writes[2]{};
+    writes[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    writes[0].dstSet = table.set;
+    writes[0].dstBinding = 0;
+    writes[0].descriptorCount = 1;
+    writes[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+    writes[0].pImageInfo = &imageInfo;
+    writes[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+    writes[1].dstSet = table.set;
+    writes[1].dstBinding = 1;
+    writes[1].descriptorCount = 1;
+    writes[1].descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
+    writes[1].pBufferInfo = &bufferInfo;
+    vkUpdateDescriptorSets(vkDevice.logicalDevice, 2, writes, 0, nullptr);
+
+    // The view covers every layer, so every layer needs a defined layout
+    // before the first draw, textures or not.
+    std::vector<uint32_t> black(static_cast<size_t>(table.arrayExtent) *
+                                table.arrayExtent);
+    for (uint32_t layer = 0; layer < table.arrayLayers; layer++) {
+      vulkan_image_upload upload{};
+      upload.image = table.array.handle;
+      upload.arrayLayer = layer;
+      upload.extent = {table.arrayExtent, table.arrayExtent, 1};
+      upload.concurrent = sharedImages();
+      uploadImage(black.data(), black.size() * TEXEL_SIZE, upload);
+    }
+  }
+
+  const uint32_t white = 0xffffffff;
+  createTexture(&white, 1, 1);
+
+  if (table.bindless) {
+    LOG_INFOF("Created the bindless texture table ({} textures).",
+              table.maxTextures);
+  }
+
+  else {
+    LOG_INFOF("Created the texture array fallback ({} layers of {}x{}).",
+              table.arrayLayers, table.arrayExtent, table.arrayExtent);
+  }
+}
+
+void destroyTextureTable() {
+  vulkan_device &vkDevice = getVulkanDeviceStruct();
+  vulkan_texture_table &table = getVulkanTextureTableStruct();
+
+  for (vulkan_texture &texture : table.textures) {
+    if (texture.view != VK_NULL_HANDLE) {
+      vkDestroyImageView(vkDevice.logicalDevice, texture.view, nullptr);
+      destroyImage(texture.image);
+    }
+  }
+
+  if (table.arrayView != VK_NULL_HANDLE) {
+    vkDestroyImageView(vkDevice.logicalDevice, table.arrayView, nullptr);
+    destroyImage(table.array);
+    destroyBuffer(table.layerScales);
+  }
+
+  // Destroying the pool frees the set as well.
+  vkDestroyDescriptorPool(vkDevice.logicalDevice, table.pool, nullptr);
+  vkDestroyDescriptorSetLayout(vkDevice.logicalDevice, table.setLayout,
+                               nullptr);
+  vkDestroySampler(vkDevice.logicalDevice, table.sampler, nullptr);
+
+  table.textures.clear();
+  table.freeTextures.clear();
+  table.pendingMips.clear();
+  table.retired.clear();
+  table.arrayView = VK_NULL_HANDLE;
+  table.pool = VK_NULL_HANDLE;
+  table.set = VK_NULL_HANDLE;
+  table.setLayout = VK_NULL_HANDLE;
+  table.sampler = VK_NULL_HANDLE;
+}
+
+uint32_t createTexture(const void *pixels, uint32_t width, uint32_t height,
+                       uint32_t mipLevels) {
+  vulkan_device &vkDevice = getVulkanDeviceStruct();
+  vulkan_texture_table &table = getVulkanTextureTableStruct();
+
+  if (width == 0 || height == 0) {
+    fail("Textures can't be empty.");
+  }
+
+  if (!table.bindless &&
+      (width > table.arrayExtent || height > table.arrayExtent)) {
+    fail(std::format("A {}x{} texture does not fit into the {}x{} layers of "
+                     "the texture array.",
+                     width, height, table.arrayExtent, table.arrayExtent));
+  }
+
+  const uint32_t capacity =
+      table.bindless ? table.maxTextures : table.arrayLayers;
+  uint32_t index = 0;
+  if (!table.freeTextures.empty()) {
+    index = table.freeTextures.back();
+    table.freeTextures.pop_back();
+  }
+
+  else if (table.textures.size() < capacity) {
+    index = static_cast<uint32_t>(table.textures.size());
+    table.textures.emplace_back();
+  }
+
+  else {
+    fail(std::format("The texture table is full ({} textures).", capacity));
+  }
+
+  vulkan_texture &texture = table.textures[index];
+  texture = {};
+  texture.width = width;
+  texture.height = height;
+  texture.mipLevels =
+      table.mipmaps ? std::clamp(mipLevels, 1u,
+                                 static_cast<uint32_t>(
+                                     std::bit_width(std::max(width, height))))
+                    : 1;
+  texture.mipsDefined = texture.mipLevels == 1;
+  texture.used = true;
+
+  if (table.bindless) {
+    const uint32_t families[2] = {vkDevice.graphics_queue_index.value(),
+                                  vkDevice.transfer_queue_index.value()};
+    texture.image = createImage(
+        textureImageInfo(width, height, texture.mipLevels, 1, families),
+        VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+    texture.view = createTextureView(texture.image.handle,
+                                     VK_IMAGE_VIEW_TYPE_2D,
+                                     texture.mipLevels, 1);
+    writeTextureDescriptor(index, texture.view);
+  }
+
+  else {
+    float *scale =
+        static_cast<float *>(table.layerScales.allocation.mapped) + index * 4;
+    scale[0] = static_cast<float>(width) / table.arrayExtent;
+    scale[1] = static_cast<float>(height) / table.arrayExtent;
+  }
+
+  const VkRect2D region = {{0, 0}, {width, height}};
+  texture.uploadTicket = uploadImage(
+      pixels, static_cast<VkDeviceSize>(width) * height * TEXEL_SIZE,
+      textureUpload(index, VK_IMAGE_LAYOUT_UNDEFINED, region, 0));
+  requestMips(index, region);
+  return index;
+}
+
+uint64_t updateTexture(uint32_t texture, const void *pixels,
+                       const VkRect2D &region, uint32_t rowLength) {
+  vulkan_texture_table &table = getVulkanTextureTableStruct();
+
+  if (texture >= table.textures.size() || !table.textures[texture].used) {
+    fail(std::format("There is no texture {}.", texture));
+  }
+
+  vulkan_texture &entry = table.textures[texture];
+  if (region.offset.x < 0 || region.offset.y < 0 ||
+      region.offset.x + region.extent.width > entry.width ||
+      region.offset.y + region.extent.height > entry.height) {
+    fail(std::format("The region is outside of the {}x{} texture {}.",
+                     entry.width, entry.height, texture));
+  }
+
+  const VkDeviceSize rowTexels = rowLength ? rowLength : region.extent.width;
+  const VkDeviceSize size =
+      region.extent.height == 0
+          ? 0
+          : ((region.extent.height - 1) * rowTexels + region.extent.width) *
+                TEXEL_SIZE;
+
+  entry.uploadTicket = uploadImage(
+      pixels, size,
+      textureUpload(texture, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, region,
+                    rowLength));
+  if (region.extent.width > 0 && region.extent.height > 0) {
+    requestMips(texture, region);
+  }
+  return entry.uploadTicket;
+}
+
+bool isTextureReady(uint32_t texture) {
+  vulkan_texture_table &table = getVulkanTextureTableStruct();
+
+  return texture < table.textures.size() && table.textures[texture].used &&
+         table.textures[texture].mipsDefined &&
+         isUploadReady(table.textures[texture].uploadTicket);
+}
+
+void recordTextureMips(VkCommandBuffer commandBuffer) {
+  vulkan_texture_table &table = getVulkanTextureTableStruct();
+
+  if (table.pendingMips.empty()) {
+    return;
+  }
+
+  // Textures whose upload is still in flight wait for a later frame. The
+  // entries of destroyed ones are dropped.
+  std::vector<uint32_t> waiting;
+  for (uint32_t index : table.pendingMips) {
+    vulkan_texture &texture = table.textures[index];
+    if (!texture.used || !texture.mipsPending) {
+      continue;
+    }
+
+    if (!isUploadReady(texture.uploadTicket)) {
+      waiting.push_back(index);
+      continue;
+    }
+
+    recordMipChain(commandBuffer, texture);
+    texture.mipsPending = false;
+    texture.mipsDefined = true;
+  }
+
+  table.pendingMips.swap(waiting);
+}
+
+void destroyTexture(uint32_t texture) {
+  vulkan_texture_table &table = getVulkanTextureTableStruct();
+  window_backend &vkWindow = getWindowBackendStruct();
+
+  if (texture == WHITE_TEXTURE || texture >= table.textures.size() ||
+      !table.textures[texture].used) {
+    return;
+  }
+
+  // The frame being recorded may have drawn with it already, and it only
+  // completes once the next one begins.
+  table.textures[texture].used = false;
+  table.retired.push_back(
+      {texture, vkWindow.frameNumber + (vkWindow.frameBegun ? 1 : 0)});
+}
+
+void collectTextures() {
+  vulkan_device &vkDevice = getVulkanDeviceStruct();
+  vulkan_texture_table &table = getVulkanTextureTableStruct();
+
+  std::erase_if(table.retired, [&](const vulkan_retired_texture &retired) {
+    if (retired.retireFrame != 0 && !isFrameComplete(retired.retireFrame - 1)) {
+      return false;
+    }
+
+    vulkan_texture &texture = table.textures[retired.texture];
+    if (texture.view != VK_NULL_HANDLE) {
+      // Nothing samples the element anymore, so it can be pointed at a live
+      // view again.
+      writeTextureDescriptor(retired.texture,
+                             table.textures[WHITE_TEXTURE].view);
+      vkDestroyImageView(vkDevice.logicalDevice, texture.view, nullptr);
+      destroyImage(texture.image);
+    }
+
+    texture = {};
+    table.freeTextures.push_back(retired.texture);
+    return true;
+  });
+}
+
+void bindTextureTable(VkCommandBuffer commandBuffer, VkPipelineLayout layout) {
+  vulkan_texture_table &table = getVulkanTextureTableStruct();
+
+  vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS,
+                          layout, 0, 1, &table.set, 0, nullptr);
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include "vulkan_types.hpp"
+
+#include <cstdint>
+#include <vulkan/vulkan.h>
+
+/// @brief The texture every table starts with, a single white texel.
+/// Untextured sprites use it.
+constexpr uint32_t WHITE_TEXTURE = 0;
+
+/// @brief Mip level count asking createTexture() for the full chain.
+constexpr uint32_t TEXTURE_MIP_CHAIN = UINT32_MAX;
+
+/// @brief Creates the descriptor set every sprite samples its texture from.
+/// With descriptor indexing that is one update-after-bind array of sampled
+/// images, so a texture index per instance is all a sprite needs and any mix
+/// of textures goes into a single draw. Without it every texture is a layer of
+/// one texture array. Must be called after createUploadService().
+void createTextureTable();
+
+/// @brief Destroys every texture. The device has to be idle.
+void destroyTextureTable();
+
+/// @brief Creates a texture from tightly packed sRGB RGBA8 pixels and returns
+/// its index for sprite_instance::texture. Indices stay the same until the
+/// texture is destroyed. The pixels are uploaded in the background, sample the
+/// texture once isTextureReady() says so. mipLevels is clamped to the full
+/// chain, the smaller levels are blitted from the pixels on the GPU. Without
+/// vulkan_texture_table::mipmaps every texture has a single level.
+uint32_t createTexture(const void *pixels, uint32_t width, uint32_t height,
+                       uint32_t mipLevels = 1);
+
+/// @brief Replaces a region of the texture, keeping the rest, and regenerates
+/// the mips below it. rowLength is the row length of pixels in texels, 0 if
+/// tightly packed. Returns the upload's ticket.
+///
+/// Frames may sample the texture while it is updated. With a dedicated
+/// transfer queue the copy waits for every frame submitted before the batch,
+/// and the frames submitted until it was acquired wait for the copy on the
+/// GPU, so an update stalls the graphics queue for as long as the copy takes.
+/// Without frame timeline semaphores the CPU waits for the last submitted
+/// frame instead. Batch the regions, e.g. with TextureAtlas::flush().
+uint64_t updateTexture(uint32_t texture, const void *pixels,
+                       const VkRect2D &region, uint32_t rowLength = 0);
+
+/// @brief Whether the last upload into the texture is visible to frames
+/// recorded from now on, and its mips exist.
+bool isTextureReady(uint32_t texture);
+
+/// @brief Blits the mips of textures whose uploads finished. Called by
+/// recordCommandBuffer() before the render pass.
+void recordTextureMips(VkCommandBuffer commandBuffer);
+
+/// @brief Frees the texture once the frames in flight, and the one being
+/// recorded if called between beginFrame() and drawFrame(), are done with it.
+/// Its index may be handed out again after that.
+void destroyTexture(uint32_t texture);
+
+/// @brief Frees the destroyed textures no frame in flight uses anymore.
+/// Called by beginFrame().
+void collectTextures();
+
+/// @brief Binds the texture table as set 0 of layout.
+void bindTextureTable(VkCommandBuffer commandBuffer, VkPipelineLayout layout);
@@ -0,0 +1,251 @@
+#include "vulkan_tlsf.hpp"
+
+#include <algorithm>
+#include <bit>
+
+namespace {
+uint64_t alignUp(uint64_t value, uint64_t alignment) {
+  return (value + alignment - 1) & ~(alignment - 1);
+}
+
+void mapping(uint64_t size, uint32_t &fl, uint32_t &sl) {
+  if (size < (1ull << TLSF_SMALL_LOG2)) {
+    fl = 0;
+    sl = static_cast<uint32_t>(size / TLSF_MIN_ALIGNMENT);
+  }
+
+  else {
+    uint32_t log2 = static_cast<uint32_t>(std::bit_width(size)) - 1;
+    sl = static_cast<uint32_t>(size >> (log2 - TLSF_SL_LOG2)) &
+         (TLSF_SL_COUNT - 1);
+    fl = log2 - TLSF_SMALL_LOG2 + 1;
+  }
+}
+
+uint32_t newNode(vulkan_tlsf &tlsf) {
+  if (tlsf.unusedNodes != TLSF_NONE) {
+    uint32_t index = tlsf.unusedNodes;
+    tlsf.unusedNodes = tlsf.nodes[index].nextFree;
+    tlsf.nodes[index] = vulkan_tlsf_node{};
+    return index;
+  }
+
+  tlsf.nodes.emplace_back();
+  return static_cast<uint32_t>(tlsf.nodes.size() - 1);
+}
+
+void releaseNode(vulkan_tlsf &tlsf, uint32_t index) {
+  tlsf.nodes[index] = vulkan_tlsf_node{};
+  tlsf.nodes[index].nextFree = tlsf.unusedNodes;
+  tlsf.unusedNodes = index;
+}
+
+void insertFree(vulkan_tlsf &tlsf, uint32_t index) {
+  uint32_t fl, sl;
+  mapping(tlsf.nodes[index].size, fl, sl);
+
+  uint32_t &head = tlsf.freeLists[fl * TLSF_SL_COUNT + sl];
+  vulkan_tlsf_node &node = tlsf.nodes[index];
+  node.free = true;
+  node.prevFree = TLSF_NONE;
+  node.nextFree = head;
+  if (head != TLSF_NONE) {
+    tlsf.nodes[head].prevFree = index;
+  }
+  head = index;
+
+  tlsf.firstLevelBitmap |= 1ull << fl;
+  tlsf.secondLevelBitmaps[fl] |= 1u << sl;
+}
+
+void removeFree(vulkan_tlsf &tlsf, uint32_t index) {
+  uint32_t fl, sl;
+  mapping(tlsf.nodes[index].size, fl, sl);
+
+  vulkan_tlsf_node &node = tlsf.nodes[index];
+  if (node.prevFree != TLSF_NONE) {
+    tlsf.nodes[node.prevFree].nextFree = node.nextFree;
+  }
+
+  else {
+    tlsf.freeLists[fl * TLSF_SL_COUNT + sl] = node.nextFree;
+  }
+
+  if (node.nextFree != TLSF_NONE) {
+    tlsf.nodes[node.nextFree].prevFree = node.prevFree;
+  }
+
+  node.free = false;
+  node.prevFree = TLSF_NONE;
+  node.nextFree = TLSF_NONE;
+
+  if (tlsf.freeLists[fl * TLSF_SL_COUNT + sl] == TLSF_NONE) {
+    tlsf.secondLevelBitmaps[fl] &= ~(1u << sl);
+    if (tlsf.secondLevelBitmaps[fl] == 0) {
+      tlsf.firstLevelBitmap &= ~(1ull << fl);
+    }
+  }
+}
+
+uint32_t findFree(const vulkan_tlsf &tlsf, uint64_t size) {
+  // Round the size up to the next list boundary so that every range in the
+  // list we land on is guaranteed to be large enough (good fit, not best fit).
+  if (size >= (1ull << TLSF_SMALL_LOG2)) {
+    uint32_t log2 = static_cast<uint32_t>(std::bit_width(size)) - 1;
+    size += (1ull << (log2 - TLSF_SL_LOG2)) - 1;
+  }
+
+  uint32_t fl, sl;
+  mapping(size, fl, sl);
+  if (fl >= TLSF_FL_COUNT) {
+    return TLSF_NONE;
+  }
+
+  uint32_t slMap = tlsf.secondLevelBitmaps[fl] & (~0u << sl);
+  if (slMap == 0) {
+    uint64_t flMap =
+        fl + 1 < 64 ? tlsf.firstLevelBitmap & (~0ull << (fl + 1)) : 0;
+    if (flMap == 0) {
+      return TLSF_NONE;
+    }
+
+    fl = static_cast<uint32_t>(std::countr_zero(flMap));
+    slMap = tlsf.secondLevelBitmaps[fl];
+  }
+
+  sl = static_cast<uint32_t>(std::countr_zero(slMap));
+  return tlsf.freeLists[fl * TLSF_SL_COUNT + sl];
+}
+
+/// Cuts the first `size` bytes off `index` and turns the rest into a new
+/// range placed right after it. Returns the new range.
+uint32_t split(vulkan_tlsf &tlsf, uint32_t index, uint64_t size) {
+  uint32_t rest = newNode(tlsf);
+  vulkan_tlsf_node &node = tlsf.nodes[index];
+  vulkan_tlsf_node &restNode = tlsf.nodes[rest];
+
+  restNode.offset = node.offset + size;
+  restNode.size = node.size - size;
+  restNode.prevPhysical = index;
+  restNode.nextPhysical = node.nextPhysical;
+  if (node.nextPhysical != TLSF_NONE) {
+    tlsf.nodes[node.nextPhysical].prevPhysical = rest;
+  }
+
+  node.size = size;
+  node.nextPhysical = rest;
+  return rest;
+}
+
+/// Folds `next` into `index`, they must be physical neighbours.
+void merge(vulkan_tlsf &tlsf, uint32_t index, uint32_t next) {
+  vulkan_tlsf_node &node = tlsf.nodes[index];
+  const vulkan_tlsf_node &nextNode = tlsf.nodes[next];
+
+  node.size += nextNode.size;
+  node.nextPhysical = nextNode.nextPhysical;
+  if (nextNode.nextPhysical != TLSF_NONE) {
+    tlsf.nodes[nextNode.nextPhysical].prevPhysical = index;
+  }
+
+  releaseNode(tlsf, next);
+}
+} // namespace
+
+void tlsfInit(vulkan_tlsf &tlsf, uint64_t size) {
+  tlsf = vulkan_tlsf{};
+  tlsf.size = size & ~(TLSF_MIN_ALIGNMENT - 1);
+  tlsf.freeLists.fill(TLSF_NONE);
+
+  uint32_t index = newNode(tlsf);
+  tlsf.nodes[index].offset = 0;
+  tlsf.nodes[index].size = tlsf.size;
+  insertFree(tlsf, index);
+}
+
+uint32_t tlsfAllocate(vulkan_tlsf &tlsf, uint64_t size, uint64_t alignment) {
+  size = alignUp(std::max<uint64_t>(size, 1), TLSF_MIN_ALIGNMENT);
+  alignment = std::max(alignment, TLSF_MIN_ALIGNMENT);
+
+  // Ask for enough slack to be able to align the start inside the range.
+  uint64_t request = size + (alignment - TLSF_MIN_ALIGNMENT);
+  uint32_t index = findFree(tlsf, request);
+  if (index == TLSF_NONE) {
+    return TLSF_NONE;
+  }
+
+  removeFree(tlsf, index);
+
+  // Give the alignment padding in front back as its own free range.
+  uint64_t padding =
+      alignUp(tlsf.nodes[index].offset, alignment) - tlsf.nodes[index].offset;
+  if (padding > 0) {
+    uint32_t aligned = split(tlsf, index, padding);
+    insertFree(tlsf, index);
+    index = aligned;
+  }
+
+  if (tlsf.nodes[index].size - size >= TLSF_MIN_ALIGNMENT) {
+    uint32_t rest = split(tlsf, index, size);
+    insertFree(tlsf, rest);
+  }
+
+  tlsf.usedBytes += tlsf.nodes[index].size;
+  tlsf.allocationCount++;
+  return index;
+}
+
+uint32_t tlsfAllocateWhole(vulkan_tlsf &tlsf) {
+  // Without allocations every range is merged back into one.
+  uint32_t fl, sl;
+  mapping(tlsf.size, fl, sl);
+  uint32_t index = tlsf.freeLists[fl * TLSF_SL_COUNT + sl];
+  if (tlsf.allocationCount != 0 || index == TLSF_NONE ||
+      tlsf.nodes[index].size != tlsf.size) {
+    return TLSF_NONE;
+  }
+
+  removeFree(tlsf, index);
+  tlsf.usedBytes += tlsf.nodes[index].size;
+  tlsf.allocationCount++;
+  return index;
+}
+
+void tlsfFree(vulkan_tlsf &tlsf, uint32_t index) {
+  tlsf.usedBytes -= tlsf.nodes[index].size;
+  tlsf.allocationCount--;
+
+  uint32_t prev = tlsf.nodes[index].prevPhysical;
+  if (prev != TLSF_NONE && tlsf.nodes[prev].free) {
+    removeFree(tlsf, prev);
+    merge(tlsf, prev, index);
+    index = prev;
+  }
+
+  uint32_t next = tlsf.nodes[index].nextPhysical;
+  if (next != TLSF_NONE && tlsf.nodes[next].free) {
+    removeFree(tlsf, next);
+    merge(tlsf, index, next);
+  }
+
+  insertFree(tlsf, index);
+}
+
+uint64_t tlsfLargestFreeRange(const vulkan_tlsf &tlsf) {
+  if (tlsf.firstLevelBitmap == 0) {
+    return 0;
+  }
+
+  // The largest range has to be in the highest non-empty list.
+  uint32_t fl =
+      63 - static_cast<uint32_t>(std::countl_zero(tlsf.firstLevelBitmap));
+  uint32_t sl =
+      31 - static_cast<uint32_t>(std::countl_zero(tlsf.secondLevelBitmaps[fl]));
+
+  uint64_t largest = 0;
+  for (uint32_t index = tlsf.freeLists[fl * TLSF_SL_COUNT + sl];
+       index != TLSF_NONE; index = tlsf.nodes[index].nextFree) {
+    largest = std::max(largest, tlsf.nodes[index].size);
+  }
+  return largest;
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+/// Two-level segregated fit (TLSF) bookkeeping for sub-allocating a single
+/// device memory block. It only deals with offsets, never touches the memory
+/// itself, and both allocation and free are O(1).
+
+constexpr uint32_t TLSF_NONE = UINT32_MAX;
+
+/// @brief log2 of the number of second level lists per first level list.
+constexpr uint32_t TLSF_SL_LOG2 = 4;
+constexpr uint32_t TLSF_SL_COUNT = 1u << TLSF_SL_LOG2;
+
+/// @brief Sizes below this all live in the first list, split linearly.
+constexpr uint32_t TLSF_SMALL_LOG2 = 8;
+constexpr uint32_t TLSF_FL_COUNT = 64 - TLSF_SMALL_LOG2 + 1;
+
+/// @brief Every offset and size handed out is a multiple of this.
+constexpr uint64_t TLSF_MIN_ALIGNMENT =
+    (1ull << TLSF_SMALL_LOG2) / TLSF_SL_COUNT;
+
+struct vulkan_tlsf_node {
+  /// @brief Offset of the range from the start of the block.
+  uint64_t offset = 0;
+
+  /// @brief Size of the range in bytes.
+  uint64_t size = 0;
+
+  /// @brief Neighbouring ranges in memory order.
+  uint32_t prevPhysical = TLSF_NONE;
+  uint32_t nextPhysical = TLSF_NONE;
+
+  /// @brief Links of the free list this range is in. nextFree also links
+  /// unused node slots together.
+  uint32_t prevFree = TLSF_NONE;
+  uint32_t nextFree = TLSF_NONE;
+
+  bool free = false;
+};
+
+struct vulkan_tlsf {
+  /// @brief Total size of the managed range.
+  uint64_t size = 0;
+
+  /// @brief Bytes currently handed out, including alignment rounding.
+  uint64_t usedBytes = 0;
+
+  /// @brief Number of live allocations.
+  uint32_t allocationCount = 0;
+
+  /// @brief Bit N is set when any list of first level N is non-empty.
+  uint64_t firstLevelBitmap = 0;
+
+  /// @brief Bit N is set when second level list N is non-empty.
+  std::array<uint32_t, TLSF_FL_COUNT> secondLevelBitmaps{};
+
+  /// @brief Heads of the segregated free lists.
+  std::array<uint32_t, TLSF_FL_COUNT * TLSF_SL_COUNT> freeLists{};
+
+  /// @brief Storage for every range node, indexed by the handles we return.
+  std::vector<vulkan_tlsf_node> nodes;
+
+  /// @brief Head of the list of node slots that can be reused.
+  uint32_t unusedNodes = TLSF_NONE;
+};
+
+void tlsfInit(vulkan_tlsf &tlsf, uint64_t size);
+
+/// @brief Returns the node of the new allocation or TLSF_NONE if there is no
+/// free range large enough. alignment must be a power of two.
+uint32_t tlsfAllocate(vulkan_tlsf &tlsf, uint64_t size, uint64_t alignment);
+
+/// @brief Hands out the whole range as one allocation, TLSF_NONE unless
+/// nothing is allocated. tlsfAllocate() rounds requests up to the next list,
+/// so it can not fill a range of exactly the requested size, e.g. a dedicated
+/// block.
+uint32_t tlsfAllocateWhole(vulkan_tlsf &tlsf);
+
+void tlsfFree(vulkan_tlsf &tlsf, uint32_t node);
+
+/// @brief Size of the largest free range. Walks the free lists from the top,
+/// so it is cheap but not meant for hot paths.
+uint64_t tlsfLargestFreeRange(const vulkan_tlsf &tlsf);
@@ -8,10 +8,19 @@ static vulkan_context s_context;
 static vulkan_device s_device;
 static vulkan_swapchain s_swapchain;
 static vulkan_swapchain_support_info s_swapchainSupport;
+static vulkan_frame_pacing s_framePacing;
 static vulkan_image s_image;
 static vulkan_shader s_shader;
 static vulkan_pipeline s_pipeline;
+static vulkan_pipeline_cache s_pipelineCache;
+static vulkan_shader_reload s_shaderReload;
 static vulkan_command_buffer s_command_buffer;
+static vulkan_allocator s_allocator;
+static vulkan_upload_service s_upload;
+static vulkan_sprite_renderer s_spriteRenderer;
+static vulkan_texture_table s_textureTable;
+static vulkan_offscreen s_offscreen;
+static vulkan_gpu_profiler s_gpuProfiler;
 static window_backend s_window;
 
 static bool initialized = false;
@@ -57,6 +66,12 @@ vulkan_swapchain_support_info &getVulkanSwapchainSupportStruct() {
   return s_swapchainSupport;
 }
 
+vulkan_frame_pacing &getVulkanFramePacingStruct() {
+  checkInit();
+
+  return s_framePacing;
+}
+
 vulkan_image &getVulkanImageStruct() {
   checkInit();
 
@@ -75,12 +90,60 @@ vulkan_pipeline &getVulkanPipelineStruct() {
   return s_pipeline;
 }
 
+vulkan_pipeline_cache &getVulkanPipelineCacheStruct() {
+  checkInit();
+
+  return s_pipelineCache;
+}
+
+vulkan_shader_reload &getVulkanShaderReloadStruct() {
+  checkInit();
+
+  return s_shaderReload;
+}
+
 vulkan_command_buffer &getVulkanCommandBufferStruct() {
   checkInit();
 
   return s_command_buffer;
 }
 
+vulkan_allocator &getVulkanAllocatorStruct() {
+  checkInit();
+
+  return s_allocator;
+}
+
+vulkan_upload_service &getVulkanUploadStruct() {
+  checkInit();
+
+  return s_upload;
+}
+
+vulkan_sprite_renderer &getVulkanSpriteRendererStruct() {
+  checkInit();
+
+  return s_spriteRenderer;
+}
+
+vulkan_texture_table &getVulkanTextureTableStruct() {
+  checkInit();
+
+  return s_textureTable;
+}
+
+vulkan_offscreen &getVulkanOffscreenStruct() {
+  checkInit();
+
+  return s_offscreen;
+}
+
+vulkan_gpu_profiler &getVulkanGpuProfilerStruct() {
+  checkInit();
+
+  return s_gpuProfiler;
+}
+
 window_backend &getWindowBackendStruct() {
   checkInit();
 
@@ -1,29 +1,131 @@
 #ifndef VULKAN_TYPES_HPP
 #define VULKAN_TYPES_HPP
 
+#include <memory>
 #include <optional>
+#include <string>
 #include <vector>
 #include <vulkan/vulkan.h>
 #include <vulkan/vulkan_core.h>
 
+#include "vulkan_tlsf.hpp"
+
+struct GLFWwindow;
+
 struct window_backend {
-  /// @brief A vulkan surface for the window that we can draw into.
+  /// @brief The window we are presenting into. Needed to query the framebuffer
+  /// size when the swapchain gets recreated.
+  GLFWwindow *window = nullptr;
+
+  /// @brief A vulkan surface for the window that we can draw into. Stays
+  /// VK_NULL_HANDLE when rendering headless into offscreen images.
   VkSurfaceKHR surface = VK_NULL_HANDLE;
 
-  /// @brief The semaphore to indicate image availability.
-  VkSemaphore imageAvailableSemaphore;
+  /// @brief Set by vkInitializeHeadless(). There is no window and nothing
+  /// calls into GLFW, set it early if getInstanceExtensions() is used for a
+  /// headless instance.
+  bool headless = false;
+
+  /// @brief Present through a VK_EXT_headless_surface swapchain instead of
+  /// rendering into plain images, if the instance supports it. Exercises the
+  /// acquire and present path too. Set it before vkInitializeHeadless().
+  bool useHeadlessSurface = false;
+
+  /// @brief Size of the render targets when running headless.
+  VkExtent2D headlessExtent = {1280, 720};
+
+  /// @brief Set by the framebuffer resize callback. Some platforms (Wayland)
+  /// never report VK_ERROR_OUT_OF_DATE_KHR so we have to track it ourselves.
+  bool framebufferResized = false;
+
+  /// @brief Total number of frames submitted so far.
+  uint64_t frameNumber = 0;
+
+  /// @brief Whether beginFrame() already waited for the current frame slot.
+  bool frameBegun = false;
+
+  /// @brief How many frames the CPU is allowed to record ahead of the GPU.
+  /// Set it before calling vkInitialize(). 2 or 3 is usually what you want.
+  uint32_t maxFramesInFlight = 2;
+
+  /// @brief Index of the frame slot that is currently being recorded.
+  uint32_t currentFrame = 0;
+
+  /// @brief Per-frame semaphores to indicate image availability.
+  std::vector<VkSemaphore> imageAvailableSemaphores;
+
+  /// @brief Per-swapchain-image semaphores to indicate finished image
+  /// rendering. These are indexed by the image and not by the frame because the
+  /// presentation engine keeps waiting on them until the image is re-acquired.
+  std::vector<VkSemaphore> renderFinishedSemaphores;
+
+  /// @brief Per-frame fences used to indicate whether or not a frame slot is
+  /// busy/ready. Empty when frameTimeline is used.
+  std::vector<VkFence> inFlightFences;
 
-  /// @brief The semaphore to indicate finished image rendering.
-  VkSemaphore renderFinishedSemaphore;
+  /// @brief The fence of the frame that last rendered into each swapchain
+  /// image, or VK_NULL_HANDLE if the image was never used.
+  std::vector<VkFence> imagesInFlight;
 
-  /// @brief The in-flight fence is used to indicate whether or not a frame is
-  /// busy/ready.
-  VkFence inFlightFence;
+  /// @brief Pace frames with one timeline semaphore instead of a fence per
+  /// frame slot, if the device supports timeline semaphores. Set it before
+  /// vkInitialize().
+  bool useTimelineSemaphore = true;
+
+  /// @brief Signaled with frameNumber + 1 when a frame finished on the GPU,
+  /// VK_NULL_HANDLE when the fences are used instead.
+  VkSemaphore frameTimeline = VK_NULL_HANDLE;
+
+  /// @brief Timeline value of the frame that last rendered into each
+  /// swapchain image, 0 if the image was never used.
+  std::vector<uint64_t> imageTimelineValues;
+
+  /// @brief How long CPU waits on the timeline block before logging that the
+  /// GPU is late. They keep waiting afterwards.
+  uint64_t frameWaitTimeoutNs = 2'000'000'000;
+};
+
+struct vulkan_thread_commands {
+  /// @brief Command pool of one recording thread in one frame slot. Reset as
+  /// a whole by beginFrame() once the slot's fence signaled.
+  VkCommandPool pool = VK_NULL_HANDLE;
+
+  /// @brief Secondary command buffers allocated from the pool so far. They are
+  /// handed out again every time the frame slot comes around.
+  std::vector<VkCommandBuffer> secondaries;
+
+  /// @brief How many of the secondaries were handed out this frame.
+  uint32_t used = 0;
+};
+
+struct vulkan_frame_commands {
+  /// @brief The primary command buffer of the frame slot, allocated from the
+  /// pool of thread 0.
+  VkCommandBuffer primary = VK_NULL_HANDLE;
+
+  /// @brief One pool per recording thread, indexed by
+  /// JobSystem::threadIndex().
+  std::vector<vulkan_thread_commands> threads;
 };
 
 struct vulkan_command_buffer {
-  /// @brief Opaque handle to a command buffer object.
-  VkCommandBuffer buffer;
+  /// @brief Command pools and buffers of every frame in flight.
+  std::vector<vulkan_frame_commands> frames;
+
+  /// @brief Threads that may record secondary command buffers. 0 takes
+  /// JobSystem::threadCount() at the time the pools are created, so start the
+  /// job system first. Set it before vkInitialize().
+  uint32_t recordThreads = 0;
+
+  /// @brief Fewest sprite batches a secondary command buffer gets. Frames with
+  /// less than twice as many batches are recorded inline into the primary.
+  uint32_t minBatchesPerSecondary = 64;
+
+  /// @brief Framebuffer the current frame renders into, secondaries inherit it.
+  VkFramebuffer framebuffer = VK_NULL_HANDLE;
+
+  /// @brief Secondaries recorded for the current frame, in execution order.
+  std::vector<VkCommandBuffer> recorded;
 };
 
 struct vulkan_shader {
@@ -45,6 +147,43 @@ struct vulkan_pipeline {
   std::vector<VkFramebuffer> swapChainFramebuffers;
 };
 
+struct vulkan_retired_pipeline {
+  VkPipeline pipeline = VK_NULL_HANDLE;
+
+  /// @brief Frames before this one may still use the pipeline.
+  uint64_t retireFrame = 0;
+};
+
+struct vulkan_shader_reload {
+  /// @brief Directory with the GLSL sources to watch. The samples' shader
+  /// directory if empty.
+  std::string sourceDir;
+
+  /// @brief glslc to compile with. The one CMake found if empty.
+  std::string compiler;
+
+  /// @brief How long a changed file has to stay untouched before it gets
+  /// compiled, editors tend to save in several writes.
+  uint32_t debounceMs = 50;
+
+  /// @brief Pipelines replaced by a reload, destroyed by applyShaderReload()
+  /// once no frame in flight can use them anymore.
+  std::vector<vulkan_retired_pipeline> retired;
+};
+
+struct vulkan_pipeline_cache {
+  /// @brief Opaque handle to a pipeline cache object. Every pipeline should be
+  /// created through it.
+  VkPipelineCache handle = VK_NULL_HANDLE;
+
+  /// @brief Where the cache is loaded from and saved to. Set it before calling
+  /// vkInitialize() if the default location does not fit.
+  std::string path = "pipeline_cache.bin";
+
+  /// @brief Whether valid data from a previous run was found on disk.
+  bool loadedFromDisk = false;
+};
+
 struct vulkan_image {
   /// @brief Handles of the internal image objects.
   std::vector<VkImage> swapChainImages;
@@ -64,6 +203,31 @@ struct vulkan_swapchain_support_info {
   std::vector<VkPresentModeKHR> presentModes;
 };
 
+struct vulkan_retired_swapchain {
+  /// @brief The old swapchain handle.
+  VkSwapchainKHR swapchain = VK_NULL_HANDLE;
+
+  /// @brief Image views that were created for the old swapchain images.
+  std::vector<VkImageView> imageViews;
+
+  /// @brief Framebuffers that were created for the old swapchain images.
+  std::vector<VkFramebuffer> framebuffers;
+
+  /// @brief The renderFinishedSemaphores of the old images. Presents to the
+  /// old swapchain may still be waiting on them.
+  std::vector<VkSemaphore> renderFinishedSemaphores;
+
+  /// @brief The frame number at which the swapchain was retired. Frames
+  /// recorded before it may still be using these objects.
+  uint64_t retireFrame = 0;
+
+  /// @brief The first frame that was successfully presented to a newer
+  /// swapchain, once presentedAfter is set. The old presents were queued
+  /// before it, fences alone say nothing about them.
+  uint64_t presentFrame = 0;
+  bool presentedAfter = false;
+};
+
 struct vulkan_swapchain {
   /// @brief The swapchain handle.
   VkSwapchainKHR swapchain = VK_NULL_HANDLE;
@@ -76,6 +240,628 @@ struct vulkan_swapchain {
 
   /// @brief The resolution of swap images.
   VkExtent2D extent;
+
+  /// @brief Swapchains replaced by recreateSwapchain() that are waiting for
+  /// the frames in flight to finish before they get destroyed.
+  std::vector<vulkan_retired_swapchain> retired;
+};
+
+struct vulkan_frame_pacing {
+  /// @brief Present mode to ask the surface for. IMMEDIATE has the lowest
+  /// latency but tears, MAILBOX replaces queued images instead of waiting,
+  /// FIFO and FIFO_RELAXED wait for the vertical blank. Falls back to FIFO,
+  /// which every surface supports. Use setPresentMode() at runtime.
+  VkPresentModeKHR presentMode = VK_PRESENT_MODE_MAILBOX_KHR;
+
+  /// @brief Enable VK_KHR_present_wait if the device supports it. Set it
+  /// before vkInitialize().
+  bool usePresentWait = true;
+
+  /// @brief Whether VK_KHR_present_id and VK_KHR_present_wait were enabled.
+  bool presentWait = false;
+
+  /// @brief Loaded by createFramePacing() when presentWait is set.
+  PFN_vkWaitForPresentKHR waitForPresent = nullptr;
+
+  /// @brief How many presented frames may still be waiting for the display
+  /// when waitForInputSample() returns. 1 samples input right after the last
+  /// frame was shown, 0 turns the wait off.
+  uint32_t maxQueuedPresents = 1;
+
+  /// @brief Gives up on a present after this long. A present to a swapchain
+  /// that went out of date may never complete.
+  uint64_t presentWaitTimeoutNs = 100'000'000;
+
+  /// @brief Frame rate the limiter holds, 0 for no limit.
+  double targetFrameRate = 0.0;
+
+  /// @brief The limiter spins instead of sleeping this close to the deadline.
+  uint64_t spinThresholdNs = 1'000'000;
+
+  /// @brief Steady clock time in ns the limiter lets the next frame start at,
+  /// 0 before the first frame.
+  int64_t nextFrameStartNs = 0;
+
+  /// @brief When input was sampled for the recent frames, indexed by frame
+  /// number modulo the size. 0 once measured or if it never was sampled.
+  std::vector<int64_t> inputSampleNs;
+
+  /// @brief Present ids are frameNumber + 1. The highest one presented and the
+  /// first one presented to the current swapchain, older ones can not be
+  /// waited on anymore.
+  uint64_t lastPresentId = 0;
+  uint64_t swapchainFirstPresentId = 0;
+  VkSwapchainKHR presentSwapchain = VK_NULL_HANDLE;
+
+  /// @brief The oldest frame whose latency was not measured yet.
+  uint64_t nextMeasuredFrame = 0;
+
+  /// @brief Time from sampling input to the frame being shown, in ms. Without
+  /// present wait it ends when the GPU finished the frame instead.
+  double latencyMs = 0.0;
+  double averageLatencyMs = 0.0;
+  double maxLatencyMs = 0.0;
+  uint64_t latencySamples = 0;
+};
+
+/// @brief Resources that must not share a memory block when the device has a
+/// bufferImageGranularity larger than 1.
+enum class vulkan_memory_kind { LINEAR, OPTIMAL };
+
+struct vulkan_memory_block {
+  /// @brief The device memory object backing the block.
+  VkDeviceMemory memory = VK_NULL_HANDLE;
+
+  /// @brief The memory type the block was allocated from.
+  uint32_t memoryTypeIndex = 0;
+
+  /// @brief Which kind of resources are placed in this block.
+  vulkan_memory_kind kind = vulkan_memory_kind::LINEAR;
+
+  /// @brief Dedicated blocks hold exactly one large allocation and are freed
+  /// together with it.
+  bool dedicated = false;
+
+  /// @brief Persistent mapping of the whole block for host visible memory.
+  void *mapped = nullptr;
+
+  /// @brief Sub-allocation bookkeeping.
+  vulkan_tlsf tlsf;
+};
+
+struct vulkan_allocation {
+  /// @brief The device memory object the allocation lives in.
+  VkDeviceMemory memory = VK_NULL_HANDLE;
+
+  /// @brief Offset of the allocation inside memory.
+  VkDeviceSize offset = 0;
+
+  /// @brief Size that was requested.
+  VkDeviceSize size = 0;
+
+  /// @brief Host pointer to the start of the allocation if the memory is
+  /// host visible, nullptr otherwise.
+  void *mapped = nullptr;
+
+  /// @brief The block the allocation was carved out of.
+  vulkan_memory_block *block = nullptr;
+
+  /// @brief TLSF node of the allocation inside the block.
+  uint32_t node = TLSF_NONE;
+};
+
+struct vulkan_buffer {
+  /// @brief Opaque handle to a buffer object.
+  VkBuffer handle = VK_NULL_HANDLE;
+
+  /// @brief The memory bound to the buffer.
+  vulkan_allocation allocation;
+
+  /// @brief Size of the buffer in bytes.
+  VkDeviceSize size = 0;
+};
+
+struct vulkan_allocated_image {
+  /// @brief Opaque handle to an image object.
+  VkImage handle = VK_NULL_HANDLE;
+
+  /// @brief The memory bound to the image.
+  vulkan_allocation allocation;
+};
+
+struct vulkan_transient_allocation {
+  /// @brief The buffer the memory belongs to, bind it with offset.
+  VkBuffer buffer = VK_NULL_HANDLE;
+
+  /// @brief Offset of the allocation inside the buffer.
+  VkDeviceSize offset = 0;
+
+  /// @brief Size of the allocation in bytes.
+  VkDeviceSize size = 0;
+
+  /// @brief Host pointer to the start of the allocation.
+  void *mapped = nullptr;
+};
+
+struct vulkan_linear_pool {
+  /// @brief One host visible buffer split into a region per frame in flight.
+  vulkan_buffer buffer;
+
+  /// @brief Size of every per-frame region. Set it before vkInitialize().
+  VkDeviceSize frameSize = 8ull * 1024 * 1024;
+
+  /// @brief Alignment every transient allocation gets at least.
+  VkDeviceSize alignment = 256;
+
+  /// @brief The frame slot allocations are currently taken from.
+  uint32_t currentFrame = 0;
+
+  /// @brief Bump offset inside the current frame's region.
+  VkDeviceSize frameOffset = 0;
+
+  /// @brief Most bytes ever used by a single frame.
+  VkDeviceSize highWatermark = 0;
+};
+
+struct vulkan_heap_stats {
+  /// @brief Size of the heap as reported by the device.
+  VkDeviceSize heapSize = 0;
+
+  /// @brief Bytes of device memory allocated from the heap.
+  VkDeviceSize blockBytes = 0;
+
+  /// @brief Bytes of that memory handed out to resources.
+  VkDeviceSize usedBytes = 0;
+
+  /// @brief The largest contiguous free range in any block of the heap.
+  VkDeviceSize largestFreeRange = 0;
+
+  /// @brief Number of device memory blocks allocated from the heap.
+  uint32_t blockCount = 0;
+
+  /// @brief Number of live allocations in the heap.
+  uint32_t allocationCount = 0;
+
+  /// @brief 0 when all free memory of a block is contiguous, approaching 1
+  /// the more it is scattered. Averaged over the blocks, weighted by free
+  /// bytes.
+  float fragmentation = 0.0f;
+};
+
+struct vulkan_memory_stats {
+  /// @brief Statistics of every memory heap, indexed like the device heaps.
+  std::vector<vulkan_heap_stats> heaps;
+
+  /// @brief Live VkDeviceMemory objects, compare with
+  /// maxMemoryAllocationCount.
+  uint32_t deviceMemoryCount = 0;
+
+  /// @brief Most bytes ever used by a single frame of the linear pool.
+  VkDeviceSize transientHighWatermark = 0;
+};
+
+struct vulkan_allocator {
+  /// @brief Memory types and heaps of the physical device.
+  VkPhysicalDeviceMemoryProperties memoryProperties;
+
+  /// @brief Granularity at which linear and optimal resources may not alias.
+  VkDeviceSize bufferImageGranularity = 1;
+
+  /// @brief Alignment for flushing host visible non-coherent memory.
+  VkDeviceSize nonCoherentAtomSize = 1;
+
+  /// @brief The device limit for live VkDeviceMemory objects.
+  uint32_t maxMemoryAllocationCount = 4096;
+
+  /// @brief Live VkDeviceMemory objects.
+  uint32_t deviceMemoryCount = 0;
+
+  /// @brief Preferred size of new blocks. Set it before vkInitialize().
+  VkDeviceSize blockSize = 64ull * 1024 * 1024;
+
+  /// @brief Every block, pointers stay valid for the lifetime of the block.
+  std::vector<std::unique_ptr<vulkan_memory_block>> blocks;
+
+  /// @brief Per-frame bump allocator for transient data.
+  vulkan_linear_pool transient;
+};
+
+struct vulkan_buffer_copy {
+  /// @brief Destination buffer, copies into the same buffer are recorded as
+  /// one vkCmdCopyBuffer with several regions.
+  VkBuffer buffer = VK_NULL_HANDLE;
+
+  VkBufferCopy region{};
+};
+
+struct vulkan_image_upload {
+  /// @brief The image to write into. Only the color aspect is uploaded.
+  VkImage image = VK_NULL_HANDLE;
+
+  /// @brief Layout the image is in right now. UNDEFINED discards the previous
+  /// contents of the whole subresource, anything else keeps them.
+  VkImageLayout oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+
+  /// @brief Layout the image is left in.
+  VkImageLayout finalLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+
+  uint32_t mipLevel = 0;
+  uint32_t arrayLayer = 0;
+
+  /// @brief Region of the subresource that is written.
+  VkOffset3D offset = {0, 0, 0};
+  VkExtent3D extent = {0, 0, 1};
+
+  /// @brief Row length of the source data in texels, 0 if tightly packed.
+  uint32_t rowLength = 0;
+
+  /// @brief Where the graphics queue first uses the image.
+  VkPipelineStageFlags dstStage = VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT;
+  VkAccessFlags dstAccess = VK_ACCESS_SHADER_READ_BIT;
+
+  /// @brief The image was created with VK_SHARING_MODE_CONCURRENT for the
+  /// graphics and transfer families, so no ownership transfer is needed.
+  /// Required to keep the contents (oldLayout != UNDEFINED) of an image that
+  /// the graphics queue already used, when the transfer queue is dedicated.
+  bool concurrent = false;
+};
+
+struct vulkan_upload_batch {
+  /// @brief Transfer commands of the batch.
+  VkCommandBuffer commandBuffer = VK_NULL_HANDLE;
+
+  /// @brief Signaled when the batch finished, only used without timeline
+  /// semaphores.
+  VkFence fence = VK_NULL_HANDLE;
+
+  /// @brief Value the batch signals on the timeline.
+  uint64_t value = 0;
+
+  /// @brief Staging ring offset right after the batch's data. Everything
+  /// before it may be reused once the batch finished.
+  VkDeviceSize stagingEnd = 0;
+
+  /// @brief Ownership acquire barriers the graphics queue has to record once
+  /// the batch finished. Empty without a dedicated transfer queue.
+  std::vector<VkBufferMemoryBarrier> bufferAcquires;
+  std::vector<VkImageMemoryBarrier> imageAcquires;
+
+  /// @brief Stages of the graphics queue that use the uploaded data.
+  VkPipelineStageFlags acquireStages = 0;
+};
+
+struct vulkan_upload_service {
+  /// @brief Size of the host visible staging ring. Every single upload must
+  /// fit into it. Set it before vkInitialize().
+  VkDeviceSize stagingSize = 32ull * 1024 * 1024;
+
+  /// @brief Upload batches that may be in flight at once. Set it before
+  /// vkInitialize().
+  uint32_t maxBatches = 4;
+
+  vulkan_buffer staging;
+
+  /// @brief Write offset in the staging ring and the start of the oldest
+  /// data that is still in use.
+  VkDeviceSize stagingHead = 0;
+  VkDeviceSize stagingTail = 0;
+
+  /// @brief Whether uploads go through a dedicated transfer queue. Needs
+  /// timeline semaphores, without them the graphics queue is used.
+  bool dedicatedQueue = false;
+
+  /// @brief Command pool on the family of the upload queue.
+  VkCommandPool commandPool = VK_NULL_HANDLE;
+
+  /// @brief Ring of batches, the one being filled is at index
+  /// (nextValue - 1) % maxBatches.
+  std::vector<vulkan_upload_batch> batches;
+
+  /// @brief Every batch signals its value on it when it finished.
+  VkSemaphore timeline = VK_NULL_HANDLE;
+
+  /// @brief Value the batch being filled will signal.
+  uint64_t nextValue = 1;
+
+  /// @brief Highest value known to have finished.
+  uint64_t completedValue = 0;
+
+  /// @brief Highest value whose data the graphics queue may use, either
+  /// because it went through the graphics queue itself or because a recorded
+  /// frame acquired it.
+  uint64_t readyValue = 0;
+
+  /// @brief Requests of the batch being filled, recorded by flushUploads().
+  std::vector<vulkan_buffer_copy> bufferCopies;
+  std::vector<VkBufferMemoryBarrier> bufferReleases;
+  std::vector<vulkan_image_upload> imageUploads;
+  std::vector<VkDeviceSize> imageOffsets;
+
+  /// @brief Destination stages of the batch being filled.
+  VkPipelineStageFlags pendingStages = 0;
+
+  /// @brief Acquires of finished batches, recorded into the next frame.
+  std::vector<VkBufferMemoryBarrier> readyBufferAcquires;
+  std::vector<VkImageMemoryBarrier> readyImageAcquires;
+  VkPipelineStageFlags readyStages = 0;
+  uint64_t readyAcquireValue = 0;
+
+  /// @brief Timeline value and stages the current frame's submit waits on,
+  /// 0 if it does not have to wait.
+  uint64_t frameWaitValue = 0;
+  VkPipelineStageFlags frameWaitStages = 0;
+
+  /// @brief Last batch on the dedicated queue that overwrote images the
+  /// graphics queue may be using (oldLayout != UNDEFINED), and the stages
+  /// that use them. Frames submitted until it was acquired wait for it.
+  uint64_t overwriteValue = 0;
+  VkPipelineStageFlags overwriteStages = 0;
+
+  /// @brief Bytes uploaded and batches submitted since the start.
+  uint64_t uploadedBytes = 0;
+  uint64_t submittedBatches = 0;
+};
+
+/// @brief Per-instance data of a sprite. Positions and scales are in pixels,
+/// the rotation is in radians. Mirrors the inputs of sprite.vert.
+struct sprite_instance {
+  float position[2];
+  float scale[2];
+  float rotation;
+
+  /// @brief Packed RGBA8 color, red in the lowest byte.
+  uint32_t color;
+
+  /// @brief Texture coordinates of the top left and bottom right corners.
+  float uvRect[4];
+
+  /// @brief Index of the texture in the texture table, see createTexture().
+  /// 0 is plain white.
+  uint32_t texture;
+};
+
+struct vulkan_sprite_batch {
+  /// @brief The pipeline the batch is drawn with.
+  VkPipeline pipeline = VK_NULL_HANDLE;
+
+  /// @brief Index of the first instance of the batch in the frame's region.
+  uint32_t firstInstance = 0;
+
+  /// @brief Number of instances in the batch.
+  uint32_t instanceCount = 0;
+};
+
+struct vulkan_sprite_renderer {
+  /// @brief How many sprites can be drawn in a single frame. Set it before
+  /// calling vkInitialize().
+  uint32_t maxInstancesPerFrame = 131072;
+
+  /// @brief The corners of the unit quad.
+  vulkan_buffer vertexBuffer;
+
+  /// @brief The two triangles of the unit quad.
+  vulkan_buffer indexBuffer;
+
+  /// @brief Persistently mapped ring with one region per frame in flight.
+  vulkan_buffer instanceBuffer;
+
+  /// @brief Mapped pointer to the current frame's region.
+  sprite_instance *instances = nullptr;
+
+  /// @brief Number of instances written this frame.
+  uint32_t instanceCount = 0;
+
+  /// @brief Draw calls of this frame, consecutive sprites sharing a pipeline
+  /// end up in the same batch. Textures are picked per instance.
+  std::vector<vulkan_sprite_batch> batches;
+
+  /// @brief The frame slot currently being written.
+  uint32_t currentFrame = 0;
+};
+
+/// @brief Most layers the texture array fallback can have, sprite_array.frag
+/// sizes its layer scales with it.
+constexpr uint32_t TEXTURE_ARRAY_MAX_LAYERS = 256;
+
+struct vulkan_texture {
+  /// @brief The texture's own image, only used with descriptor indexing. On
+  /// the texture array path the texture is a layer of
+  /// vulkan_texture_table::array.
+  vulkan_allocated_image image;
+  VkImageView view = VK_NULL_HANDLE;
+
+  uint32_t width = 0;
+  uint32_t height = 0;
+  uint32_t mipLevels = 1;
+
+  /// @brief Ticket of the last upload into the texture.
+  uint64_t uploadTicket = 0;
+
+  /// @brief Region of level 0 the smaller mips have to be regenerated from,
+  /// once the upload is done. mipsDefined turns true after the first time.
+  VkRect2D mipRegion = {};
+  bool mipsPending = false;
+  bool mipsDefined = false;
+
+  /// @brief Whether the slot holds a texture.
+  bool used = false;
+};
+
+struct vulkan_retired_texture {
+  uint32_t texture = 0;
+
+  /// @brief Frames before this one may still sample the texture.
+  uint64_t retireFrame = 0;
+};
+
+struct vulkan_texture_table {
+  /// @brief Use descriptor indexing when the device supports it, the texture
+  /// array is used otherwise. Set it before vkInitialize().
+  bool useDescriptorIndexing = true;
+
+  /// @brief Whether the table is one update-after-bind array of sampled
+  /// images (bindless) rather than a single texture array.
+  bool bindless = false;
+
+  /// @brief Size of the bindless array, lowered to what the device allows.
+  /// Set it before vkInitialize().
+  uint32_t maxTextures = 4096;
+
+  /// @brief Whether textures can have mip chains. Needs descriptor indexing
+  /// and linear blits of the texture format.
+  bool mipmaps = false;
+
+  /// @brief Layer size and count of the texture array fallback. Textures
+  /// larger than arrayExtent can't be created on that path. Set them before
+  /// vkInitialize().
+  uint32_t arrayExtent = 512;
+  uint32_t arrayLayers = 16;
+
+  VkDescriptorSetLayout setLayout = VK_NULL_HANDLE;
+  VkDescriptorPool pool = VK_NULL_HANDLE;
+
+  /// @brief The one descriptor set every sprite draw binds.
+  VkDescriptorSet set = VK_NULL_HANDLE;
+  VkSampler sampler = VK_NULL_HANDLE;
+
+  /// @brief The texture array fallback, with one layer per texture, and how
+  /// much of its layer every texture covers.
+  vulkan_allocated_image array;
+  VkImageView arrayView = VK_NULL_HANDLE;
+  vulkan_buffer layerScales;
+
+  /// @brief Indexed by the texture index.
+  std::vector<vulkan_texture> textures;
+  std::vector<uint32_t> freeTextures;
+
+  /// @brief Textures waiting for recordTextureMips(), may hold stale or
+  /// repeated indices.
+  std::vector<uint32_t> pendingMips;
+
+  /// @brief Destroyed textures, freed once no frame in flight can sample
+  /// them anymore.
+  std::vector<vulkan_retired_texture> retired;
+};
+
+struct vulkan_retired_offscreen {
+  /// @brief Render targets of the previous size.
+  std::vector<vulkan_allocated_image> images;
+
+  /// @brief Same as vulkan_retired_swapchain::retireFrame.
+  uint64_t retireFrame = 0;
+};
+
+struct vulkan_offscreen {
+  /// @brief Render targets used in place of swapchain images when running
+  /// headless without a surface, one per frame in flight. Their handles are
+  /// mirrored in vulkan_image::swapChainImages so the rest of the renderer
+  /// does not have to care.
+  std::vector<vulkan_allocated_image> images;
+
+  /// @brief Targets replaced by a resize that frames in flight may still use.
+  std::vector<vulkan_retired_offscreen> retired;
+};
+
+struct vulkan_gpu_zone {
+  /// @brief Name shown in the results. Must outlive the profiler, string
+  /// literals are what you want.
+  const char *name = nullptr;
+
+  /// @brief Queries holding the start and end timestamps, relative to the
+  /// frame's range. endQuery stays UINT32_MAX until the zone is closed.
+  uint32_t beginQuery = 0;
+  uint32_t endQuery = UINT32_MAX;
+
+  /// @brief How many zones were open when this one began.
+  uint32_t depth = 0;
+};
+
+struct vulkan_gpu_zone_result {
+  const char *name = nullptr;
+  uint32_t depth = 0;
+
+  /// @brief Start of the zone in milliseconds after the first timestamp of
+  /// its frame.
+  double startMs = 0.0;
+
+  double durationMs = 0.0;
+};
+
+struct vulkan_gpu_trace_event {
+  const char *name = nullptr;
+  uint32_t depth = 0;
+  uint64_t frameNumber = 0;
+
+  /// @brief Start in nanoseconds after the first captured timestamp.
+  double startNs = 0.0;
+
+  double durationNs = 0.0;
+};
+
+struct vulkan_gpu_profiler_frame {
+  /// @brief Zones recorded into the frame slot, in the order they began.
+  std::vector<vulkan_gpu_zone> zones;
+
+  /// @brief Queries written in this frame slot.
+  uint32_t queryCount = 0;
+
+  /// @brief Number of the frame that last recorded into this slot.
+  uint64_t frameNumber = 0;
+
+  /// @brief Whether the slot holds queries that were not read back yet.
+  bool pending = false;
+};
+
+struct vulkan_gpu_profiler {
+  /// @brief Set it to false before vkInitialize() to skip the profiler.
+  bool enabled = true;
+
+  /// @brief Timestamp queries available to every frame slot. Zones beyond
+  /// that are dropped. Set it before vkInitialize().
+  uint32_t maxQueriesPerFrame = 256;
+
+  /// @brief A warning is logged for every frame whose GPU time exceeds this,
+  /// 0 disables it.
+  double frameBudgetMs = 0.0;
+
+  /// @brief One range of maxQueriesPerFrame queries per frame in flight.
+  VkQueryPool queryPool = VK_NULL_HANDLE;
+
+  /// @brief Nanoseconds per timestamp tick.
+  double timestampPeriod = 1.0;
+
+  /// @brief Timestamps only have timestampValidBits bits, the rest is
+  /// undefined.
+  uint64_t timestampMask = ~0ull;
+
+  std::vector<vulkan_gpu_profiler_frame> frames;
+
+  /// @brief Zones of the current frame that were begun but not ended yet.
+  std::vector<uint32_t> openZones;
+
+  /// @brief Scratch space for vkGetQueryPoolResults().
+  std::vector<uint64_t> timestamps;
+
+  /// @brief Zones of the most recently read back frame.
+  std::vector<vulkan_gpu_zone_result> results;
+
+  /// @brief Number of the frame results belongs to.
+  uint64_t resultsFrame = 0;
+
+  /// @brief GPU time of the most recently read back frame in milliseconds.
+  double frameMs = 0.0;
+
+  /// @brief Zones that did not fit into maxQueriesPerFrame.
+  uint64_t droppedZones = 0;
+
+  /// @brief Keep every read back zone for writeGpuTrace(), up to
+  /// maxTraceEvents.
+  bool captureTrace = false;
+  size_t maxTraceEvents = 1 << 16;
+  std::vector<vulkan_gpu_trace_event> trace;
+
+  /// @brief Timestamp the trace is relative to, set by the first capture.
+  std::optional<uint64_t> traceOrigin;
 };
 
 struct vulkan_context {
@@ -84,6 +870,10 @@ struct vulkan_context {
 
   /// @brief Required instance extensions.
   std::vector<const char *> instanceExtensions;
+
+  /// @brief The Vulkan version the instance was created with. Raised to 1.2
+  /// by createVkInstance() when the loader supports it.
+  uint32_t apiVersion = VK_API_VERSION_1_0;
 };
 
 struct vulkan_device {
@@ -106,14 +896,30 @@ struct vulkan_device {
   /// @brief Index of the present queue.
   std::optional<uint32_t> present_queue_index;
 
+  /// @brief Index of the queue family uploads go through. A transfer-only
+  /// family if the device has one, the graphics family otherwise.
+  std::optional<uint32_t> transfer_queue_index;
+
+  /// @brief The Vulkan version usable with the device, the lower of the
+  /// instance's and the device's.
+  uint32_t apiVersion = VK_API_VERSION_1_0;
+
+  /// @brief Whether timeline semaphores were enabled on the device.
+  bool timelineSemaphores = false;
+
+  /// @brief Whether the descriptor indexing features the bindless texture
+  /// table needs were enabled on the device.
+  bool descriptorIndexing = false;
+
   /// @brief A handle to the graphics queue.
   VkQueue graphicsQueue = VK_NULL_HANDLE;
 
   /// @brief A handle to the present queue.
   VkQueue presentQueue = VK_NULL_HANDLE;
 
-  /// @brief Opaque handle to a command pool object
-  VkCommandPool commandPool = VK_NULL_HANDLE;
+  /// @brief A handle to the transfer queue. Same as graphicsQueue when there
+  /// is no dedicated transfer family.
+  VkQueue transferQueue = VK_NULL_HANDLE;
 };
 
 void initializeVkStructs();
@@ -121,10 +927,19 @@ vulkan_context &getVulkanContextStruct();
 vulkan_device &getVulkanDeviceStruct();
 vulkan_swapchain &getVulkanSwapchainStruct();
 vulkan_swapchain_support_info &getVulkanSwapchainSupportStruct();
+vulkan_frame_pacing &getVulkanFramePacingStruct();
 vulkan_image &getVulkanImageStruct();
 vulkan_shader &getVulkanShaderStruct();
 vulkan_pipeline &getVulkanPipelineStruct();
+vulkan_pipeline_cache &getVulkanPipelineCacheStruct();
+vulkan_shader_reload &getVulkanShaderReloadStruct();
 vulkan_command_buffer &getVulkanCommandBufferStruct();
+vulkan_allocator &getVulkanAllocatorStruct();
+vulkan_upload_service &getVulkanUploadStruct();
+vulkan_sprite_renderer &getVulkanSpriteRendererStruct();
+vulkan_texture_table &getVulkanTextureTableStruct();
+vulkan_offscreen &getVulkanOffscreenStruct();
+vulkan_gpu_profiler &getVulkanGpuProfilerStruct();
 window_backend &getWindowBackendStruct();
 
 #endif
@@ -0,0 +1,685 @@
+#include "vulkan_upload.hpp"
+#include "logger.hpp"
+#include "profiler.hpp"
+#include "vulkan_memory.hpp"
+#include "vulkan_render.hpp"
+#include "vulkan_types.hpp"
+#include "vulkan_utils.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <format>
+#include <map>
+#include <stdexcept>
+#include <tuple>
+#include <vulkan/vulkan_core.h>
+
+namespace {
+// Covers the texel size of every color format, which copies into images need
+// their source offset to be a multiple of.
+constexpr VkDeviceSize STAGING_ALIGNMENT = 16;
+
+VkDeviceSize alignUp(VkDeviceSize value, VkDeviceSize alignment) {
+  return (value + alignment - 1) & ~(alignment - 1);
+}
+
+vulkan_upload_batch &batchFor(uint64_t value) {
+  vulkan_upload_service &upload = getVulkanUploadStruct();
+
+  return upload.batches[(value - 1) % upload.batches.size()];
+}
+
+bool hasPendingUploads() {
+  vulkan_upload_service &upload = getVulkanUploadStruct();
+
+  return !upload.bufferCopies.empty() || !upload.imageUploads.empty();
+}
+
+uint64_t queryCompletedValue() {
+  vulkan_device &vkDevice = getVulkanDeviceStruct();
+  vulkan_upload_service &upload = getVulkanUploadStruct();
+
+  if (upload.timeline != VK_NULL_HANDLE) {
+    uint64_t value = upload.completedValue;
+    vkGetSemaphoreCounterValue(vkDevice.logicalDevice, upload.timeline,
+                               &value);
+    return value;
+  }
+
+  // Batches finish in submission order, stop at the first unfinished one.
+  uint64_t value = upload.completedValue;
+  while (value + 1 < upload.nextValue &&
+         vkGetFenceStatus(vkDevice.logicalDevice,
+                          batchFor(value + 1).fence) == VK_SUCCESS) {
+    value++;
+  }
+  return value;
+}
+
+bool waitForValue(uint64_t value, uint64_t timeoutNs) {
+  vulkan_device &vkDevice = getVulkanDeviceStruct();
+  vulkan_upload_service &upload = getVulkanUploadStruct();
+
+  VkResult result;
+  if (upload.timeline != VK_NULL_HANDLE) {
+    VkSemaphoreWaitInfo waitInfo{};
+    waitInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_WAIT_INFO;
+    waitInfo.semaphoreCount = 1;
+    waitInfo.pSemaphores = &upload.timeline;
+    waitInfo.pValues = &value;
+    result = vkWaitSemaphores(vkDevice.logicalDevice, &waitInfo, timeoutNs);
+  }
+
+  else {
+    result = vkWaitForFences(vkDevice.logicalDevice, 1, &batchFor(value).fence,
+                             VK_TRUE, timeoutNs);
+  }
+
+  if (result == VK_TIMEOUT) {
+    return false;
+  }
+
+  if (!checkVkResult(result)) {
+    LOG_ERROR(vkResultToString(result));
+    throw std::runtime_error(vkResultToString(result));
+  }
+
+  collectUploads();
+  return true;
+}
+
+// Hands out size bytes of the staging ring, waiting for old batches when it
+// is full.
+VkDeviceSize allocateStaging(VkDeviceSize size) {
+  vulkan_upload_service &upload = getVulkanUploadStruct();
+
+  if (size > upload.stagingSize) {
+    LOG_ERRORF("An upload of {} bytes does not fit into the {} byte staging "
+               "ring.",
+               size, upload.stagingSize);
+    throw std::runtime_error("The upload does not fit into the staging ring.");
+  }
+
+  while (true) {
+    collectUploads();
+    if (upload.completedValue + 1 == upload.nextValue && !hasPendingUploads()) {
+      upload.stagingHead = 0;
+      upload.stagingTail = 0;
+    }
+
+    const VkDeviceSize offset = alignUp(upload.stagingHead, STAGING_ALIGNMENT);
+    if (upload.stagingHead >= upload.stagingTail) {
+      // Used is [tail, head), there is room behind it and in front of tail.
+      if (offset + size <= upload.stagingSize) {
+        upload.stagingHead = offset + size;
+        return offset;
+      }
+
+      if (size < upload.stagingTail) {
+        upload.stagingHead = size;
+        return 0;
+      }
+    }
+
+    // Used is [tail, end) and [0, head), the gap in between is free.
+    else if (offset + size < upload.stagingTail) {
+      upload.stagingHead = offset + size;
+      return offset;
+    }
+
+    // The ring is full, submit what we have and wait for the oldest batch.
+    if (hasPendingUploads()) {
+      flushUploads();
+    }
+
+    HK_ZONE("wait for staging memory");
+    waitForValue(upload.completedValue + 1, UINT64_MAX);
+  }
+}
+
+// The batch being filled must not be in flight anymore.
+void reserveBatch() {
+  vulkan_upload_service &upload = getVulkanUploadStruct();
+
+  if (upload.nextValue > upload.batches.size() &&
+      upload.completedValue + upload.batches.size() < upload.nextValue) {
+    HK_ZONE("wait for upload batch");
+    waitForValue(upload.nextValue - upload.batches.size(), UINT64_MAX);
+  }
+}
+
+uint32_t graphicsFamily() {
+  return getVulkanDeviceStruct().graphics_queue_index.value();
+}
+
+uint32_t transferFamily() {
+  return getVulkanDeviceStruct().transfer_queue_index.value();
+}
+} // namespace
+
+void createUploadService() {
+  vulkan_device &vkDevice = getVulkanDeviceStruct();
+  vulkan_upload_service &upload = getVulkanUploadStruct();
+
+  upload.dedicatedQueue =
+      transferFamily() != graphicsFamily() && vkDevice.timelineSemaphores;
+  if (transferFamily() != graphicsFamily() && !upload.dedicatedQueue) {
+    LOG_INFO("Timeline semaphores are not supported, uploads use the graphics "
+             "queue instead of the transfer queue.");
+  }
+
+  upload.staging = createBuffer(upload.stagingSize,
+                                VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
+                                VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT |
+                                    VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+
+  VkCommandPoolCreateInfo poolInfo{};
+  poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+  poolInfo.flags = VK_COMMAND_POOL_CREATE_TRANSIENT_BIT |
+                   VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+  poolInfo.queueFamilyIndex =
+      upload.dedicatedQueue ? transferFamily() : graphicsFamily();
+
+  VkResult result = vkCreateCommandPool(vkDevice.logicalDevice, &poolInfo,
+                                        nullptr, &upload.commandPool);
+  if (!checkVkResult(result)) {
+    LOG_ERROR(vkResultToString(result));
+    throw std::runtime_error(vkResultToString(result));
+  }
+
+  upload.batches.assign(std::max(upload.maxBatches, 1u), {});
+
+  std::vector<VkCommandBuffer> commandBuffers(upload.batches.size());
+  VkCommandBufferAllocateInfo allocInfo{};
+  allocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+  allocInfo.commandPool = upload.commandPool;
+  allocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY;
+  allocInfo.commandBufferCount = static_cast<uint32_t>(commandBuffers.size());
+
+  result = vkAllocateCommandBuffers(vkDevice.logicalDevice, &allocInfo,
+                                    commandBuffers.data());
+  if (!checkVkResult(result)) {
+    LOG_ERROR(vkResultToString(result));
+    throw std::runtime_error(vkResultToString(result));
+  }
+
+  for (size_t i = 0; i < upload.batches.size(); i++) {
+    upload.batches[i].commandBuffer = commandBuffers[i];
+  }
+
+  if (vkDevice.timelineSemaphores) {
+    VkSemaphoreTypeCreateInfo typeInfo{};
+    typeInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_TYPE_CREATE_INFO;
+    typeInfo.semaphoreType = VK_SEMAPHORE_TYPE_TIMELINE;
+    typeInfo.initialValue = 0;
+
+    VkSemaphoreCreateInfo semaphoreInfo{};
+    semaphoreInfo.sType = VK_STRUCTURE_TYPE_SEMAPHORE_CREATE_INFO;
+    semaphoreInfo.pNext = &typeInfo;
+
+    result = vkCreateSemaphore(vkDevice.logicalDevice, &semaphoreInfo, nullptr,
+                               &upload.timeline);
+    if (!checkVkResult(result)) {
+      LOG_ERROR(vkResultToString(result));
+      throw std::runtime_error(vkResultToString(result));
+    }
+  }
+
+  else {
+    VkFenceCreateInfo fenceInfo{};
+    fenceInfo.sType = VK_STRUCTURE_TYPE_FENCE_CREATE_INFO;
+
+    for (vulkan_upload_batch &batch : upload.batches) {
+      result = vkCreateFence(vkDevice.logicalDevice, &fenceInfo, nullptr,
+                             &batch.fence);
+      if (!checkVkResult(result)) {
+        LOG_ERROR(vkResultToString(result));
+        throw std::runtime_error(vkResultToString(result));
+      }
+    }
+  }
+
+  LOG_INFOF("Created the upload service ({} MiB staging, {} queue).",
+            upload.stagingSize / (1024 * 1024),
+            upload.dedicatedQueue ? "dedicated transfer" : "graphics");
+}
+
+void destroyUploadService() {
+  vulkan_device &vkDevice = getVulkanDeviceStruct();
+  vulkan_upload_service &upload = getVulkanUploadStruct();
+
+  for (vulkan_upload_batch &batch : upload.batches) {
+    vkDestroyFence(vkDevice.logicalDevice, batch.fence, nullptr);
+  }
+  upload.batches.clear();
+
+  vkDestroySemaphore(vkDevice.logicalDevice, upload.timeline, nullptr);
+  upload.timeline = VK_NULL_HANDLE;
+
+  // Destroying the pool also frees the batches' command buffers.
+  vkDestroyCommandPool(vkDevice.logicalDevice, upload.commandPool, nullptr);
+  upload.commandPool = VK_NULL_HANDLE;
+
+  destroyBuffer(upload.staging);
+}
+
+uint64_t uploadBuffer(const void *data, VkDeviceSize size, VkBuffer buffer,
+                      VkDeviceSize offset, VkPipelineStageFlags dstStage,
+                      VkAccessFlags dstAccess) {
+  vulkan_upload_service &upload = getVulkanUploadStruct();
+
+  if (size == 0) {
+    return upload.nextValue - 1;
+  }
+
+  // Running out of staging memory may submit the batch being filled, so the
+  // batch is only picked afterwards.
+  const VkDeviceSize stagingOffset = allocateStaging(size);
+  reserveBatch();
+  std::memcpy(static_cast<char *>(upload.staging.allocation.mapped) +
+                  stagingOffset,
+              data, size);
+
+  upload.bufferCopies.push_back({buffer, {stagingOffset, offset, size}});
+
+  VkBufferMemoryBarrier barrier{};
+  barrier.sType = VK_STRUCTURE_TYPE_BUFFER_MEMORY_BARRIER;
+  barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+  barrier.dstAccessMask = dstAccess;
+  barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+  barrier.buffer = buffer;
+  barrier.offset = offset;
+  barrier.size = size;
+
+  // The transfer queue gives the range up, the graphics queue takes it once
+  // the batch finished. Both barriers have to describe the same transfer.
+  if (upload.dedicatedQueue) {
+    barrier.srcQueueFamilyIndex = transferFamily();
+    barrier.dstQueueFamilyIndex = graphicsFamily();
+
+    VkBufferMemoryBarrier acquire = barrier;
+    acquire.srcAccessMask = 0;
+    batchFor(upload.nextValue).bufferAcquires.push_back(acquire);
+    batchFor(upload.nextValue).acquireStages |= dstStage;
+    barrier.dstAccessMask = 0;
+  }
+
+  upload.bufferReleases.push_back(barrier);
+  upload.pendingStages |= dstStage;
+  upload.uploadedBytes += size;
+  return upload.nextValue;
+}
+
+uint64_t uploadImage(const void *data, VkDeviceSize size,
+                     const vulkan_image_upload &image) {
+  vulkan_upload_service &upload = getVulkanUploadStruct();
+
+  if (size == 0) {
+    return upload.nextValue - 1;
+  }
+
+  // Running out of staging memory may submit the batch being filled, so the
+  // batch is only picked afterwards.
+  const VkDeviceSize stagingOffset = allocateStaging(size);
+  reserveBatch();
+  std::memcpy(static_cast<char *>(upload.staging.allocation.mapped) +
+                  stagingOffset,
+              data, size);
+
+  upload.imageUploads.push_back(image);
+  upload.imageOffsets.push_back(stagingOffset);
+  upload.pendingStages |= image.dstStage;
+  upload.uploadedBytes += size;
+
+  // The acquires are added by flushUploads(), one per subresource.
+  if (upload.dedicatedQueue) {
+    batchFor(upload.nextValue).acquireStages |= image.dstStage;
+  }
+
+  return upload.nextValue;
+}
+
+uint64_t flushUploads() {
+  vulkan_device &vkDevice = getVulkanDeviceStruct();
+  vulkan_upload_service &upload = getVulkanUploadStruct();
+
+  if (!hasPendingUploads()) {
+    return upload.nextValue - 1;
+  }
+
+  HK_ZONE("flushUploads");
+  const uint64_t value = upload.nextValue;
+  vulkan_upload_batch &batch = batchFor(value);
+  VkCommandBuffer commandBuffer = batch.commandBuffer;
+
+  VkCommandBufferBeginInfo beginInfo{};
+  beginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+  beginInfo.flags = VK_COMMAND_BUFFER_USAGE_ONE_TIME_SUBMIT_BIT;
+
+  vkResetCommandBuffer(commandBuffer, 0);
+  VkResult result = vkBeginCommandBuffer(commandBuffer, &beginInfo);
+  if (!checkVkResult(result)) {
+    LOG_ERROR(vkResultToString(result));
+    throw std::runtime_error(vkResultToString(result));
+  }
+
+  // Stages after the copies, the transfer queue only knows about transfers.
+  VkPipelineStageFlags dstStages = upload.pendingStages;
+  if (upload.dedicatedQueue || dstStages == 0) {
+    dstStages = upload.dedicatedQueue ? VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT
+                                      : VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+  }
+
+  if (!upload.bufferCopies.empty()) {
+    // One copy command per destination buffer.
+    std::stable_sort(
+        upload.bufferCopies.begin(), upload.bufferCopies.end(),
+        [](const vulkan_buffer_copy &a, const vulkan_buffer_copy &b) {
+          return a.buffer < b.buffer;
+        });
+
+    std::vector<VkBufferCopy> regions;
+    for (size_t i = 0; i < upload.bufferCopies.size();) {
+      const VkBuffer buffer = upload.bufferCopies[i].buffer;
+      regions.clear();
+      for (; i < upload.bufferCopies.size() &&
+             upload.bufferCopies[i].buffer == buffer;
+           i++) {
+        regions.push_back(upload.bufferCopies[i].region);
+      }
+
+      vkCmdCopyBuffer(commandBuffer, upload.staging.handle, buffer,
+                      static_cast<uint32_t>(regions.size()), regions.data());
+    }
+
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         dstStages, 0, 0, nullptr,
+                         static_cast<uint32_t>(upload.bufferReleases.size()),
+                         upload.bufferReleases.data(), 0, nullptr);
+  }
+
+  // Stages of the graphics queue that use images the batch overwrites.
+  VkPipelineStageFlags overwriteStages = 0;
+  if (!upload.imageUploads.empty()) {
+    // Several uploads may write the same subresource, e.g. a cleared atlas
+    // and a glyph added right after. The subresource is transitioned into
+    // TRANSFER_DST_OPTIMAL by its first upload and out of it after its last,
+    // copies in between wait for the ones before them.
+    std::map<std::tuple<VkImage, uint32_t, uint32_t>, uint32_t> subresources;
+    std::vector<uint32_t> barrierIndices(upload.imageUploads.size());
+    std::vector<bool> rewrites(upload.imageUploads.size(), false);
+    std::vector<VkAccessFlags> accesses;
+
+    // Images that keep their contents may still be read by earlier work.
+    VkPipelineStageFlags srcStages = VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT;
+    std::vector<VkImageMemoryBarrier> barriers;
+    for (size_t i = 0; i < upload.imageUploads.size(); i++) {
+      const vulkan_image_upload &image = upload.imageUploads[i];
+      const auto [it, first] = subresources.try_emplace(
+          {image.image, image.mipLevel, image.arrayLayer},
+          static_cast<uint32_t>(barriers.size()));
+      barrierIndices[i] = it->second;
+      rewrites[i] = !first;
+      if (!first) {
+        continue;
+      }
+
+      accesses.push_back(0);
+      VkImageMemoryBarrier &barrier = barriers.emplace_back();
+      barrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+      barrier.srcAccessMask = 0;
+      barrier.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+      barrier.oldLayout = image.oldLayout;
+      barrier.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+      barrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+      barrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+      barrier.image = image.image;
+      barrier.subresourceRange = {VK_IMAGE_ASPECT_COLOR_BIT, image.mipLevel, 1,
+                                  image.arrayLayer, 1};
+
+      if (image.oldLayout != VK_IMAGE_LAYOUT_UNDEFINED) {
+        srcStages = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+        overwriteStages |= image.dstStage;
+      }
+    }
+
+    vkCmdPipelineBarrier(commandBuffer, srcStages,
+                         VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0,
+                         nullptr, static_cast<uint32_t>(barriers.size()),
+                         barriers.data());
+
+    for (size_t i = 0; i < upload.imageUploads.size(); i++) {
+      const vulkan_image_upload &image = upload.imageUploads[i];
+      VkImageMemoryBarrier &barrier = barriers[barrierIndices[i]];
+
+      if (rewrites[i]) {
+        VkImageMemoryBarrier rewrite = barrier;
+        rewrite.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        rewrite.dstAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+        rewrite.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        rewrite.newLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+        rewrite.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        rewrite.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+        vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                             VK_PIPELINE_STAGE_TRANSFER_BIT, 0, 0, nullptr, 0,
+                             nullptr, 1, &rewrite);
+      }
+
+      VkBufferImageCopy region{};
+      region.bufferOffset = upload.imageOffsets[i];
+      region.bufferRowLength = image.rowLength;
+      region.imageSubresource = {VK_IMAGE_ASPECT_COLOR_BIT, image.mipLevel,
+                                 image.arrayLayer, 1};
+      region.imageOffset = image.offset;
+      region.imageExtent = image.extent;
+
+      vkCmdCopyBufferToImage(commandBuffer, upload.staging.handle, image.image,
+                             VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &region);
+
+      // Either the release half of the ownership transfer or the transition
+      // straight into the final layout. The last upload picks the layout.
+      accesses[barrierIndices[i]] |= image.dstAccess;
+      barrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT;
+      barrier.dstAccessMask =
+          upload.dedicatedQueue ? 0 : accesses[barrierIndices[i]];
+      barrier.oldLayout = VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL;
+      barrier.newLayout = image.finalLayout;
+      if (upload.dedicatedQueue && !image.concurrent) {
+        barrier.srcQueueFamilyIndex = transferFamily();
+        barrier.dstQueueFamilyIndex = graphicsFamily();
+      }
+    }
+
+    vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT,
+                         dstStages, 0, 0, nullptr, 0, nullptr,
+                         static_cast<uint32_t>(barriers.size()),
+                         barriers.data());
+
+    // The graphics queue takes each released subresource once.
+    for (size_t i = 0; i < barriers.size(); i++) {
+      if (barriers[i].srcQueueFamilyIndex == VK_QUEUE_FAMILY_IGNORED) {
+        continue;
+      }
+
+      VkImageMemoryBarrier acquire = barriers[i];
+      acquire.srcAccessMask = 0;
+      acquire.dstAccessMask = accesses[i];
+      batch.imageAcquires.push_back(acquire);
+    }
+  }
+
+  result = vkEndCommandBuffer(commandBuffer);
+  if (!checkVkResult(result)) {
+    LOG_ERROR(vkResultToString(result));
+    throw std::runtime_error(vkResultToString(result));
+  }
+
+  VkTimelineSemaphoreSubmitInfo timelineInfo{};
+  timelineInfo.sType = VK_STRUCTURE_TYPE_TIMELINE_SEMAPHORE_SUBMIT_INFO;
+  timelineInfo.signalSemaphoreValueCount = 1;
+  timelineInfo.pSignalSemaphoreValues = &value;
+
+  VkSubmitInfo submitInfo{};
+  submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+  submitInfo.commandBufferCount = 1;
+  submitInfo.pCommandBuffers = &commandBuffer;
+
+  // The transfer queue is not ordered with the graphics queue. Overwriting an
+  // image that submitted frames sample or blit mips of has to wait for them,
+  // frames submitted later wait for the batch instead, see
+  // recordUploadAcquires().
+  window_backend &vkWindow = getWindowBackendStruct();
+  const bool overwrites =
+      upload.dedicatedQueue && overwriteStages != 0 && vkWindow.frameNumber > 0;
+  const uint64_t lastFrameValue = vkWindow.frameNumber;
+  const VkPipelineStageFlags frameWaitStage = VK_PIPELINE_STAGE_TRANSFER_BIT;
+  if (overwrites && vkWindow.frameTimeline != VK_NULL_HANDLE) {
+    timelineInfo.waitSemaphoreValueCount = 1;
+    timelineInfo.pWaitSemaphoreValues = &lastFrameValue;
+    submitInfo.waitSemaphoreCount = 1;
+    submitInfo.pWaitSemaphores = &vkWindow.frameTimeline;
+    submitInfo.pWaitDstStageMask = &frameWaitStage;
+  }
+
+  else if (overwrites) {
+    HK_ZONE("wait for frames using the image");
+    waitForFrame(vkWindow.frameNumber - 1);
+  }
+
+  if (upload.timeline != VK_NULL_HANDLE) {
+    submitInfo.pNext = &timelineInfo;
+    submitInfo.signalSemaphoreCount = 1;
+    submitInfo.pSignalSemaphores = &upload.timeline;
+  }
+
+  else {
+    vkResetFences(vkDevice.logicalDevice, 1, &batch.fence);
+  }
+
+  VkQueue queue =
+      upload.dedicatedQueue ? vkDevice.transferQueue : vkDevice.graphicsQueue;
+  result = vkQueueSubmit(queue, 1, &submitInfo, batch.fence);
+  if (!checkVkResult(result)) {
+    LOG_ERROR(vkResultToString(result));
+    throw std::runtime_error(vkResultToString(result));
+  }
+
+  batch.value = value;
+  batch.stagingEnd = upload.stagingHead;
+  upload.nextValue++;
+  upload.submittedBatches++;
+
+  // On the graphics queue everything submitted after the batch already sees
+  // its writes.
+  if (!upload.dedicatedQueue) {
+    upload.readyValue = value;
+  }
+
+  // drawFrame() flushes after recording, the frame is about to be submitted.
+  if (overwriteStages != 0 && upload.dedicatedQueue) {
+    upload.overwriteValue = value;
+    upload.overwriteStages |= overwriteStages;
+    if (vkWindow.frameBegun) {
+      upload.frameWaitValue = std::max(upload.frameWaitValue, value);
+      upload.frameWaitStages |= overwriteStages;
+    }
+  }
+
+  upload.bufferCopies.clear();
+  upload.bufferReleases.clear();
+  upload.imageUploads.clear();
+  upload.imageOffsets.clear();
+  upload.pendingStages = 0;
+  return value;
+}
+
+void collectUploads() {
+  vulkan_upload_service &upload = getVulkanUploadStruct();
+
+  const uint64_t completed = queryCompletedValue();
+  for (uint64_t value = upload.completedValue + 1; value <= completed;
+       value++) {
+    vulkan_upload_batch &batch = batchFor(value);
+    upload.stagingTail = batch.stagingEnd;
+
+    upload.readyBufferAcquires.insert(upload.readyBufferAcquires.end(),
+                                      batch.bufferAcquires.begin(),
+                                      batch.bufferAcquires.end());
+    upload.readyImageAcquires.insert(upload.readyImageAcquires.end(),
+                                     batch.imageAcquires.begin(),
+                                     batch.imageAcquires.end());
+    upload.readyStages |= batch.acquireStages;
+    upload.readyAcquireValue = value;
+
+    batch.bufferAcquires.clear();
+    batch.imageAcquires.clear();
+    batch.acquireStages = 0;
+  }
+  upload.completedValue = std::max(upload.completedValue, completed);
+}
+
+void recordUploadAcquires(VkCommandBuffer commandBuffer) {
+  vulkan_upload_service &upload = getVulkanUploadStruct();
+
+  upload.frameWaitValue = 0;
+  upload.frameWaitStages = 0;
+
+  // An overwrite may still be running, the frame must not read the image
+  // before it finished. Waiting stalls the frame, but only until the copy is
+  // done.
+  if (upload.overwriteValue > upload.readyValue) {
+    upload.frameWaitValue = upload.overwriteValue;
+    upload.frameWaitStages = upload.overwriteStages;
+  }
+
+  else {
+    upload.overwriteStages = 0;
+  }
+
+  if (!upload.dedicatedQueue || upload.readyAcquireValue <= upload.readyValue) {
+    return;
+  }
+
+  // Waiting on the timeline gives the frame the memory dependency on the
+  // copies. The batch already finished, so the wait never stalls the GPU.
+  if (upload.readyStages == 0) {
+    upload.readyStages = VK_PIPELINE_STAGE_ALL_COMMANDS_BIT;
+  }
+  upload.frameWaitValue =
+      std::max(upload.frameWaitValue, upload.readyAcquireValue);
+  upload.frameWaitStages |= upload.readyStages;
+
+  if (!upload.readyBufferAcquires.empty() ||
+      !upload.readyImageAcquires.empty()) {
+    vkCmdPipelineBarrier(
+        commandBuffer, VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, upload.readyStages, 0,
+        0, nullptr, static_cast<uint32_t>(upload.readyBufferAcquires.size()),
+        upload.readyBufferAcquires.data(),
+        static_cast<uint32_t>(upload.readyImageAcquires.size()),
+        upload.readyImageAcquires.data());
+  }
+
+  upload.readyValue = upload.readyAcquireValue;
+  upload.readyBufferAcquires.clear();
+  upload.readyImageAcquires.clear();
+  upload.readyStages = 0;
+}
+
+bool isUploadReady(uint64_t ticket) {
+  return ticket <= getVulkanUploadStruct().readyValue;
+}
+
+bool waitForUpload(uint64_t ticket, uint64_t timeoutNs) {
+  vulkan_upload_service &upload = getVulkanUploadStruct();
+
+  if (ticket >= upload.nextValue) {
+    flushUploads();
+  }
+
+  if (ticket <= upload.completedValue) {
+    return true;
+  }
+
+  return waitForValue(ticket, timeoutNs);
+}
@@ -0,0 +1,52 @@
+#pragma once
+
+#include "vulkan_types.hpp"
+
+#include <vulkan/vulkan.h>
+
+/// @brief Creates the staging ring and the upload batches. Uploads go through
+/// the dedicated transfer queue when the device has one and supports timeline
+/// semaphores, through the graphics queue otherwise. Must be called after
+/// createAllocator().
+void createUploadService();
+void destroyUploadService();
+
+/// @brief Copies data into the staging ring and queues a copy into buffer at
+/// offset. dstStage and dstAccess describe the first use on the graphics
+/// queue. Returns a ticket for isUploadReady().
+///
+/// Uploads are not thread safe, call them from the thread that draws.
+uint64_t uploadBuffer(const void *data, VkDeviceSize size, VkBuffer buffer,
+                      VkDeviceSize offset, VkPipelineStageFlags dstStage,
+                      VkAccessFlags dstAccess);
+
+/// @brief uploadBuffer() for a region of an image, see vulkan_image_upload.
+/// size is the number of bytes read from data. Uploads to the same
+/// subresource land in the order they were made. On the dedicated queue an
+/// upload that keeps the contents is ordered against the frames around it,
+/// see vulkan_upload_service::overwriteValue.
+uint64_t uploadImage(const void *data, VkDeviceSize size,
+                     const vulkan_image_upload &upload);
+
+/// @brief Submits the queued uploads as one batch. Returns the batch's ticket,
+/// or the last one if nothing was queued. drawFrame() calls it before
+/// submitting the frame.
+uint64_t flushUploads();
+
+/// @brief Retires finished batches and frees their staging memory. Never
+/// waits, called by beginFrame().
+void collectUploads();
+
+/// @brief Records the ownership acquires of every batch that finished since
+/// the last frame and sets the timeline value the frame has to wait on.
+/// Called by recordCommandBuffer() outside of the render pass.
+void recordUploadAcquires(VkCommandBuffer commandBuffer);
+
+/// @brief Whether the graphics queue may use what the upload wrote, in this
+/// and every later frame.
+bool isUploadReady(uint64_t ticket);
+
+/// @brief Blocks until the batch of the ticket finished on the GPU, flushing
+/// it first if needed. Returns false on timeout. With a dedicated transfer
+/// queue the data is ready after the next recorded frame.
+bool waitForUpload(uint64_t ticket, uint64_t timeoutNs = UINT64_MAX);
@@ -202,3 +202,18 @@ bool checkVkResult(VkResult result) {
     return false;
   }
 }
+
+std::string presentModeToString(VkPresentModeKHR presentMode) {
+  switch (presentMode) {
+  case VK_PRESENT_MODE_IMMEDIATE_KHR:
+    return "immediate";
+  case VK_PRESENT_MODE_MAILBOX_KHR:
+    return "mailbox";
+  case VK_PRESENT_MODE_FIFO_KHR:
+    return "FIFO";
+  case VK_PRESENT_MODE_FIFO_RELAXED_KHR:
+    return "relaxed FIFO";
+  default:
+    return "an unknown";
+  }
+}
@@ -5,3 +5,4 @@
 
 std::string vkResultToString(VkResult result);
 bool checkVkResult(VkResult result);
+std::string presentModeToString(VkPresentModeKHR presentMode);
@@ -25,6 +25,7 @@
         entt
         glm
         shaderc
+        zstd
       ];
 
       LD_LIBRARY_PATH = "${pkgs.vulkan-loader}/lib";
@@ -3,10 +3,26 @@
 #include <vulkan/vulkan_render.hpp>
 #define GLFW_INCLUDE_VULKAN
 #include <GLFW/glfw3.h>
+#include <algorithm>
+#include <asset_archive.hpp>
+#include <bullet_pool.hpp>
+#include <bullet_render.hpp>
+#include <cmath>
+#include <cstdint>
 #include <cstring>
+#include <filesystem>
+#include <job_system.hpp>
+#include <main_loop.hpp>
 #include <stdexcept>
+#include <vector>
+#include <vulkan_atlas.hpp>
+#include <vulkan_frame_pacing.hpp>
 #include <vulkan_init.hpp>
 #include <vulkan_instance.hpp>
+#include <vulkan_pipeline_registry.hpp>
+#include <vulkan_shader_reload.hpp>
+#include <vulkan_sprite.hpp>
+#include <vulkan_texture.hpp>
 #include <vulkan_types.hpp>
 
 int main() {
@@ -22,6 +38,7 @@ int main() {
   // turns out to be amazing I guess lol).
 
   initializeVkStructs();
+  JobSystem::init();
   vulkan_context &context = getVulkanContextStruct();
   vulkan_device &vkDeviceStruct = getVulkanDeviceStruct();
 
@@ -56,10 +73,85 @@ int main() {
    */
   vkDeviceStruct.deviceExtensions = {VK_KHR_SWAPCHAIN_EXTENSION_NAME};
 
+  // One mapping for every shader, without it they are read from the build
+  // tree one by one.
+  if (std::filesystem::exists(HAKKERO_ASSET_ARCHIVE)) {
+    mountAssetArchive(HAKKERO_ASSET_ARCHIVE);
+  }
+
   vkInitialize(window, createInfo);
 
-  while (!glfwWindowShouldClose(window)) {
-    glfwPollEvents();
-    drawFrame();
+#ifndef NDEBUG
+  // Saving a shader in samples/shaders swaps it in while the game runs.
+  startShaderHotReload();
+#endif
+
+  // The bullets move at a fixed 60 ticks per second however fast the display
+  // is, frames in between draw them interpolated.
+  BulletPool bullets(8192);
+  bullets.setBounds({0.0f, 0.0f, float(WIDTH), float(HEIGHT)});
+
+  float spiral = 0.0f;
+  MainLoopCallbacks callbacks;
+  callbacks.tick = [&](float dt) {
+    constexpr uint32_t ARMS = 4;
+    for (uint32_t i = 0; i < ARMS; i++) {
+      float angle = spiral + i * (6.2831853f / ARMS);
+      BulletDesc bullet;
+      bullet.x = WIDTH / 2.0f;
+      bullet.y = HEIGHT / 2.0f;
+      bullet.vx = std::cos(angle) * 150.0f;
+      bullet.vy = std::sin(angle) * 150.0f;
+      bullet.angle = angle;
+      bullet.size = 12.0f;
+      bullet.color = packColor(255, 96, 160, 255);
+      bullets.spawn(bullet);
+    }
+    spiral += 0.1f;
+
+    bullets.update(dt);
+  };
+
+  // The bullets glow. The additive variant compiles on a worker, until it is
+  // done they are drawn with the regular alpha blended pipeline.
+  const pipeline_desc glowing = describeSpritePipeline(
+      "sprite.vert.spv", getSpriteFragmentShader(), SpriteBlendMode::ADDITIVE);
+
+  // A soft round bullet, white so the bullet color tints it.
+  constexpr uint32_t BULLET_SIZE = 32;
+  std::vector<uint32_t> bulletPixels(BULLET_SIZE * BULLET_SIZE);
+  for (uint32_t y = 0; y < BULLET_SIZE; y++) {
+    for (uint32_t x = 0; x < BULLET_SIZE; x++) {
+      float dx = (x + 0.5f) / BULLET_SIZE * 2.0f - 1.0f;
+      float dy = (y + 0.5f) / BULLET_SIZE * 2.0f - 1.0f;
+      float falloff = std::clamp(1.0f - std::sqrt(dx * dx + dy * dy), 0.0f,
+                                 1.0f);
+      bulletPixels[y * BULLET_SIZE + x] =
+          packColor(255, 255, 255, static_cast<uint8_t>(falloff * 255.0f));
+    }
   }
+
+  // Bullet graphics share one atlas, so every kind of bullet is still a
+  // single batch. Baked atlases come from TextureAtlas::load() instead.
+  TextureAtlas sprites(256, 256);
+  const atlas_region bullet = *sprites.add(
+      "bullet", bulletPixels.data(), BULLET_SIZE, BULLET_SIZE);
+  sprites.flush();
+
+  callbacks.render = [&](float alpha) {
+    const uint32_t texture =
+        sprites.isReady() ? bullet.texture : WHITE_TEXTURE;
+    drawBullets(bullets, bullet.uvRect, texture, alpha,
+                requestPipeline(glowing));
+  };
+
+  FixedTimestep timestep(60.0);
+  runMainLoop(window, timestep, callbacks);
+
+  logFrameLatency();
+  logPipelineRegistryStats();
+  vkShutdown();
+  glfwDestroyWindow(window);
+  glfwTerminate();
+  JobSystem::shutdown();
 }
@@ -0,0 +1,17 @@
+#version 450
+#extension GL_EXT_nonuniform_qualifier : require
+
+// The bindless texture table, indexed by sprite_instance::texture.
+layout(set = 0, binding = 0) uniform sampler2D textures[];
+
+layout(location = 0) in vec4 fragColor;
+layout(location = 1) in vec2 fragUV;
+layout(location = 2) flat in uint fragTexture;
+
+layout(location = 0) out vec4 outColor;
+
+void main() {
+    // Neighbouring pixels may belong to sprites with different textures.
+    vec4 texel = texture(textures[nonuniformEXT(fragTexture)], fragUV);
+    outColor = fragColor * texel;
+}
@@ -0,0 +1,34 @@
+#version 450
+
+layout(push_constant) uniform PushConstants {
+    // 2 / framebuffer size, maps pixel coordinates to normalized device ones.
+    vec2 viewportScale;
+} pc;
+
+// Per-vertex: corner of the unit quad, centered on the origin.
+layout(location = 0) in vec2 inCorner;
+
+// Per-instance data, see sprite_instance in vulkan_types.hpp.
+layout(location = 1) in vec2 inPosition;
+layout(location = 2) in vec2 inScale;
+layout(location = 3) in float inRotation;
+layout(location = 4) in vec4 inColor;
+layout(location = 5) in vec4 inUVRect;
+layout(location = 6) in uint inTexture;
+
+layout(location = 0) out vec4 fragColor;
+layout(location = 1) out vec2 fragUV;
+layout(location = 2) flat out uint fragTexture;
+
+void main() {
+    float s = sin(inRotation);
+    float c = cos(inRotation);
+    vec2 local = inCorner * inScale;
+    vec2 world = inPosition + vec2(local.x * c - local.y * s,
+                                   local.x * s + local.y * c);
+
+    gl_Position = vec4(world * pc.viewportScale - 1.0, 0.0, 1.0);
+    fragColor = inColor;
+    fragUV = mix(inUVRect.xy, inUVRect.zw, inCorner + 0.5);
+    fragTexture = inTexture;
+}
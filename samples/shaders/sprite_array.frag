@@ -0,0 +1,20 @@
+#version 450
+
+// The texture table without descriptor indexing, every texture is a layer.
+layout(set = 0, binding = 0) uniform sampler2DArray textures;
+
+// How much of its layer every texture covers, TEXTURE_ARRAY_MAX_LAYERS long.
+layout(set = 0, binding = 1) uniform LayerScales {
+    vec4 layerScale[256];
+};
+
+layout(location = 0) in vec4 fragColor;
+layout(location = 1) in vec2 fragUV;
+layout(location = 2) flat in uint fragTexture;
+
+layout(location = 0) out vec4 outColor;
+
+void main() {
+    vec2 uv = fragUV * layerScale[fragTexture].xy;
+    outColor = fragColor * texture(textures, vec3(uv, float(fragTexture)));
+}
@@ -0,0 +1,410 @@
+#include <asset_archive.hpp>
+#include <texture_atlas.hpp>
+
+#include <algorithm>
+#include <cctype>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#ifdef HAKKERO_ZSTD
+#include <zstd.h>
+#endif
+
+// Packs files into a .hkpak archive for AssetArchive.
+//
+//   hakkero-assetpack [--zstd] [--atlas-size N] output.hkpak
+//                     (directory | name=file | atlas:name=directory)...
+//
+// A directory adds every file below it, named after the directory and the
+// path inside it, e.g. shaders/sprite.vert.spv. name=file adds one file under
+// the given name. atlas:name=directory packs every .pam and .ppm image below
+// the directory into one N x N atlas blob (2048 by default) for
+// TextureAtlas::load(), the sprites are named after their path without the
+// extension. Only 8-bit binary netpbm images are read, anything else can be
+// converted first, e.g. with `magick bullet.png bullet.pam`. --zstd
+// compresses every asset that gets smaller from it, those can only be read()
+// and not view()ed.
+namespace {
+struct InputFile {
+  std::string name;
+  std::filesystem::path path;
+  uint64_t hash = 0;
+
+  // Generated assets have no path and carry their contents instead.
+  std::vector<char> contents = {};
+};
+
+struct Image {
+  uint32_t width = 0;
+  uint32_t height = 0;
+  std::vector<uint32_t> pixels;
+};
+
+std::vector<char> readWholeFile(const std::filesystem::path &path) {
+  std::ifstream file(path, std::ios::ate | std::ios::binary);
+  if (!file.is_open()) {
+    throw std::runtime_error("Failed to open " + path.string());
+  }
+
+  std::vector<char> data(static_cast<size_t>(file.tellg()));
+  file.seekg(0);
+  file.read(data.data(), static_cast<std::streamsize>(data.size()));
+  return data;
+}
+
+// The next netpbm header token, skipping whitespace and comments.
+std::string nextToken(const std::vector<char> &data, size_t &offset) {
+  while (offset < data.size()) {
+    if (data[offset] == '#') {
+      while (offset < data.size() && data[offset] != '\n') {
+        offset++;
+      }
+    }
+
+    else if (std::isspace(static_cast<unsigned char>(data[offset]))) {
+      offset++;
+    }
+
+    else {
+      break;
+    }
+  }
+
+  const size_t start = offset;
+  while (offset < data.size() &&
+         !std::isspace(static_cast<unsigned char>(data[offset]))) {
+    offset++;
+  }
+  return std::string(data.data() + start, offset - start);
+}
+
+// Binary PPM (P6) or PAM (P7) with 8-bit channels. PAM may be grayscale, with
+// or without alpha, as well.
+Image readNetpbm(const std::filesystem::path &path) {
+  const std::vector<char> data = readWholeFile(path);
+  size_t offset = 0;
+  uint32_t width = 0;
+  uint32_t height = 0;
+  uint32_t depth = 0;
+  uint32_t maxValue = 0;
+
+  const std::string magic = nextToken(data, offset);
+  if (magic == "P6") {
+    width = static_cast<uint32_t>(std::stoul(nextToken(data, offset)));
+    height = static_cast<uint32_t>(std::stoul(nextToken(data, offset)));
+    maxValue = static_cast<uint32_t>(std::stoul(nextToken(data, offset)));
+    depth = 3;
+  }
+
+  else if (magic == "P7") {
+    for (std::string key = nextToken(data, offset); key != "ENDHDR";
+         key = nextToken(data, offset)) {
+      const std::string value = nextToken(data, offset);
+      if (key.empty() || value.empty()) {
+        throw std::runtime_error(path.string() + " has no ENDHDR");
+      }
+
+      if (key == "WIDTH") {
+        width = static_cast<uint32_t>(std::stoul(value));
+      }
+
+      else if (key == "HEIGHT") {
+        height = static_cast<uint32_t>(std::stoul(value));
+      }
+
+      else if (key == "DEPTH") {
+        depth = static_cast<uint32_t>(std::stoul(value));
+      }
+
+      else if (key == "MAXVAL") {
+        maxValue = static_cast<uint32_t>(std::stoul(value));
+      }
+    }
+  }
+
+  // A single whitespace character separates the header from the texels.
+  offset++;
+  if (width == 0 || height == 0 || depth == 0 || depth > 4 ||
+      maxValue != 255) {
+    throw std::runtime_error(path.string() +
+                             " is not an 8-bit binary PPM or PAM image");
+  }
+
+  const size_t texels = static_cast<size_t>(width) * height;
+  if (offset > data.size() || data.size() - offset < texels * depth) {
+    throw std::runtime_error(path.string() + " is truncated");
+  }
+
+  Image image{width, height, std::vector<uint32_t>(texels)};
+  const auto *source = reinterpret_cast<const uint8_t *>(data.data() + offset);
+  for (size_t i = 0; i < texels; i++, source += depth) {
+    const uint32_t r = source[0];
+    const uint32_t g = depth >= 3 ? source[1] : r;
+    const uint32_t b = depth >= 3 ? source[2] : r;
+    const uint32_t a = depth % 2 == 0 ? source[depth - 1] : 255;
+    image.pixels[i] = r | (g << 8) | (b << 16) | (a << 24);
+  }
+  return image;
+}
+
+InputFile packAtlas(const std::string &name,
+                    const std::filesystem::path &directory, uint32_t size) {
+  struct Sprite {
+    std::string name;
+    Image image;
+  };
+
+  std::vector<Sprite> sprites;
+  for (const auto &entry :
+       std::filesystem::recursive_directory_iterator(directory)) {
+    const std::filesystem::path extension = entry.path().extension();
+    if (!entry.is_regular_file() ||
+        (extension != ".pam" && extension != ".ppm")) {
+      continue;
+    }
+
+    std::filesystem::path relative =
+        std::filesystem::relative(entry.path(), directory);
+    sprites.push_back({relative.replace_extension().generic_string(),
+                       readNetpbm(entry.path())});
+  }
+
+  if (sprites.empty()) {
+    throw std::runtime_error("There are no .pam or .ppm images in " +
+                             directory.string());
+  }
+
+  // Tallest first keeps the skyline flat. Names break ties so the output
+  // does not depend on the order the files were found in.
+  std::sort(sprites.begin(), sprites.end(),
+            [](const Sprite &a, const Sprite &b) {
+              return a.image.height != b.image.height
+                         ? a.image.height > b.image.height
+                         : a.name < b.name;
+            });
+
+  AtlasBuilder atlas(size, size);
+  for (const Sprite &sprite : sprites) {
+    if (!atlas.add(sprite.name, sprite.image.pixels.data(),
+                   sprite.image.width, sprite.image.height)) {
+      throw std::runtime_error("The images in " + directory.string() +
+                               " don't fit into a " + std::to_string(size) +
+                               "x" + std::to_string(size) + " atlas");
+    }
+  }
+
+  const std::vector<std::byte> blob = atlas.serialize();
+  std::printf("Packed %zu images into the atlas %s (%.1f%% used)\n",
+              sprites.size(), name.c_str(),
+              100.0 * atlas.packer().occupancy());
+
+  InputFile input;
+  input.name = name;
+  input.contents.assign(reinterpret_cast<const char *>(blob.data()),
+                        reinterpret_cast<const char *>(blob.data()) +
+                            blob.size());
+  return input;
+}
+
+void collectDirectory(const std::filesystem::path &directory,
+                      std::vector<InputFile> &inputs) {
+  const std::string prefix = directory.filename().string();
+  for (const auto &entry :
+       std::filesystem::recursive_directory_iterator(directory)) {
+    if (!entry.is_regular_file()) {
+      continue;
+    }
+
+    // generic_string() uses '/' on every platform.
+    std::string relative =
+        std::filesystem::relative(entry.path(), directory).generic_string();
+    inputs.push_back({prefix + "/" + relative, entry.path()});
+  }
+}
+
+uint64_t alignUp(uint64_t value, uint64_t alignment) {
+  return (value + alignment - 1) & ~(alignment - 1);
+}
+
+void pad(std::ofstream &out, uint64_t offset) {
+  static const char zeros[ASSET_BLOB_ALIGNMENT] = {};
+  const uint64_t current = static_cast<uint64_t>(out.tellp());
+  out.write(zeros, static_cast<std::streamsize>(offset - current));
+}
+
+bool pack(const std::filesystem::path &output, std::vector<InputFile> inputs,
+          bool compress) {
+  for (InputFile &input : inputs) {
+    input.hash = hashAssetName(input.name);
+  }
+
+  // Sorted by hash for the lookup, equal hashes by name so the output does
+  // not depend on the order the files were found in.
+  std::sort(inputs.begin(), inputs.end(),
+            [](const InputFile &a, const InputFile &b) {
+              return a.hash != b.hash ? a.hash < b.hash : a.name < b.name;
+            });
+
+  for (size_t i = 1; i < inputs.size(); i++) {
+    if (inputs[i].name == inputs[i - 1].name) {
+      std::fprintf(stderr, "%s was added twice\n", inputs[i].name.c_str());
+      return false;
+    }
+  }
+
+  std::string names;
+  std::vector<AssetArchiveEntry> entries(inputs.size());
+  for (size_t i = 0; i < inputs.size(); i++) {
+    entries[i].hash = inputs[i].hash;
+    entries[i].nameOffset = static_cast<uint32_t>(names.size());
+    entries[i].nameLength = static_cast<uint32_t>(inputs[i].name.size());
+    names += inputs[i].name;
+  }
+
+  AssetArchiveHeader header{};
+  std::memcpy(header.magic, ASSET_ARCHIVE_MAGIC, sizeof(header.magic));
+  header.version = ASSET_ARCHIVE_VERSION;
+  header.entryCount = static_cast<uint32_t>(entries.size());
+  header.entriesOffset = sizeof(AssetArchiveHeader);
+  header.namesOffset =
+      header.entriesOffset + entries.size() * sizeof(AssetArchiveEntry);
+  header.namesSize = names.size();
+
+  std::ofstream out(output, std::ios::binary | std::ios::trunc);
+  if (!out.is_open()) {
+    std::fprintf(stderr, "Failed to create %s\n", output.string().c_str());
+    return false;
+  }
+
+  // The index is written last, once every blob's offset and size is known.
+  uint64_t offset = alignUp(header.namesOffset + header.namesSize,
+                            ASSET_BLOB_ALIGNMENT);
+  uint64_t rawBytes = 0;
+  out.seekp(static_cast<std::streamoff>(offset));
+  for (size_t i = 0; i < inputs.size(); i++) {
+    std::vector<char> data = inputs[i].path.empty()
+                                 ? std::move(inputs[i].contents)
+                                 : readWholeFile(inputs[i].path);
+    AssetArchiveEntry &entry = entries[i];
+    entry.offset = offset;
+    entry.size = data.size();
+    entry.compression = AssetCompression::NONE;
+    rawBytes += data.size();
+
+#ifdef HAKKERO_ZSTD
+    if (compress && !data.empty()) {
+      std::vector<char> packed(ZSTD_compressBound(data.size()));
+      const size_t packedSize =
+          ZSTD_compress(packed.data(), packed.size(), data.data(),
+                        data.size(), ZSTD_maxCLevel());
+      if (!ZSTD_isError(packedSize) && packedSize < data.size()) {
+        packed.resize(packedSize);
+        data = std::move(packed);
+        entry.compression = AssetCompression::ZSTD;
+      }
+    }
+#else
+    (void)compress;
+#endif
+
+    entry.storedSize = data.size();
+    out.write(data.data(), static_cast<std::streamsize>(data.size()));
+    offset = alignUp(offset + data.size(), ASSET_BLOB_ALIGNMENT);
+    pad(out, offset);
+  }
+
+  header.fileSize = offset;
+  out.seekp(0);
+  out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+  out.write(reinterpret_cast<const char *>(entries.data()),
+            static_cast<std::streamsize>(entries.size() *
+                                         sizeof(AssetArchiveEntry)));
+  out.write(names.data(), static_cast<std::streamsize>(names.size()));
+
+  if (!out.good()) {
+    std::fprintf(stderr, "Failed to write %s\n", output.string().c_str());
+    return false;
+  }
+
+  std::printf("Packed %zu assets (%llu bytes) into %s (%llu bytes)\n",
+              inputs.size(), static_cast<unsigned long long>(rawBytes),
+              output.string().c_str(),
+              static_cast<unsigned long long>(header.fileSize));
+  return true;
+}
+} // namespace
+
+int main(int argc, char **argv) {
+  bool compress = false;
+  uint32_t atlasSize = 2048;
+  int first = 1;
+  for (; first < argc && std::strncmp(argv[first], "--", 2) == 0; first++) {
+    if (std::strcmp(argv[first], "--zstd") == 0) {
+#ifndef HAKKERO_ZSTD
+      std::fprintf(stderr, "This build has no zstd support\n");
+      return EXIT_FAILURE;
+#endif
+      compress = true;
+    }
+
+    else if (std::strcmp(argv[first], "--atlas-size") == 0 &&
+             first + 1 < argc) {
+      atlasSize = static_cast<uint32_t>(std::strtoul(argv[++first], nullptr,
+                                                     10));
+    }
+
+    else {
+      std::fprintf(stderr, "Unknown option %s\n", argv[first]);
+      return EXIT_FAILURE;
+    }
+  }
+
+  if (argc - first < 2 || atlasSize == 0) {
+    std::fprintf(stderr,
+                 "Usage: %s [--zstd] [--atlas-size N] output.hkpak "
+                 "(directory | name=file | atlas:name=directory)...\n",
+                 argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  try {
+    std::vector<InputFile> inputs;
+    for (int i = first + 1; i < argc; i++) {
+      const std::string argument = argv[i];
+      const size_t separator = argument.find('=');
+      if (argument.starts_with("atlas:") && separator != std::string::npos) {
+        inputs.push_back(packAtlas(argument.substr(6, separator - 6),
+                                   argument.substr(separator + 1),
+                                   atlasSize));
+      }
+
+      else if (separator != std::string::npos) {
+        inputs.push_back({argument.substr(0, separator),
+                          argument.substr(separator + 1)});
+      }
+
+      else if (std::filesystem::is_directory(argument)) {
+        collectDirectory(argument, inputs);
+      }
+
+      else {
+        std::fprintf(stderr,
+                     "%s is not a directory, name=file or "
+                     "atlas:name=directory\n",
+                     argument.c_str());
+        return EXIT_FAILURE;
+      }
+    }
+
+    return pack(argv[first], std::move(inputs), compress) ? EXIT_SUCCESS
+                                                          : EXIT_FAILURE;
+  } catch (const std::exception &error) {
+    std::fprintf(stderr, "%s\n", error.what());
+    return EXIT_FAILURE;
+  }
+}
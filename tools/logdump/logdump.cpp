@@ -0,0 +1,344 @@
+#include <log_binary.hpp>
+#include <logger.hpp>
+#include <time_utils.hpp>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <string>
+#include <variant>
+#include <vector>
+
+// Decodes logs written with LogFileFormat::BINARY into the same text the
+// TEXT format produces.
+//
+//   hakkero-logdump [file.hklog | directory]...
+//
+// A directory decodes every .hklog file in it, no arguments decodes the most
+// recent logs/<date>/ directory.
+namespace {
+using LogArg = std::variant<int64_t, uint64_t, float, double, bool, char,
+                            std::string, const void *>;
+
+struct FormatEntry {
+  std::string file;
+  uint32_t line = 0;
+  std::string format;
+};
+
+struct Reader {
+  const char *data;
+  size_t size;
+  size_t pos = 0;
+  bool failed = false;
+
+  template <typename T> T read() {
+    T value{};
+    if (pos + sizeof(T) > size) {
+      failed = true;
+      return value;
+    }
+    std::memcpy(&value, data + pos, sizeof(T));
+    pos += sizeof(T);
+    return value;
+  }
+
+  std::string readString(uint32_t length) {
+    if (pos + length > size) {
+      failed = true;
+      return {};
+    }
+    std::string value(data + pos, length);
+    pos += length;
+    return value;
+  }
+};
+
+std::string formatArg(LogArg &arg, std::string_view spec) {
+  std::string format = std::format("{{:{}}}", spec);
+  try {
+    return std::visit(
+        [&](auto &value) {
+          return std::vformat(format, std::make_format_args(value));
+        },
+        arg);
+  } catch (const std::format_error &) {
+    return std::format("{{?{}}}", spec);
+  }
+}
+
+// Substitutes the replacement fields of a std::format string. Only the
+// argument index and the format spec are supported, which covers everything
+// the engine logs.
+std::string formatMessage(std::string_view format, std::vector<LogArg> &args) {
+  std::string out;
+  size_t nextArg = 0;
+
+  for (size_t i = 0; i < format.size(); i++) {
+    char c = format[i];
+    if (c == '}' && i + 1 < format.size() && format[i + 1] == '}') {
+      out += '}';
+      i++;
+      continue;
+    }
+
+    if (c != '{') {
+      out += c;
+      continue;
+    }
+
+    if (i + 1 < format.size() && format[i + 1] == '{') {
+      out += '{';
+      i++;
+      continue;
+    }
+
+    size_t end = format.find('}', i);
+    if (end == std::string_view::npos) {
+      out += format.substr(i);
+      break;
+    }
+
+    std::string_view field = format.substr(i + 1, end - i - 1);
+    std::string_view spec;
+    size_t colon = field.find(':');
+    if (colon != std::string_view::npos) {
+      spec = field.substr(colon + 1);
+      field = field.substr(0, colon);
+    }
+
+    size_t index = nextArg++;
+    if (!field.empty()) {
+      index = std::stoul(std::string(field));
+    }
+
+    if (index < args.size()) {
+      out += formatArg(args[index], spec);
+    }
+
+    else {
+      out += "{missing}";
+    }
+
+    i = end;
+  }
+
+  return out;
+}
+
+bool readArgs(Reader &reader, std::vector<LogArg> &args) {
+  args.clear();
+
+  while (!reader.failed && reader.pos < reader.size) {
+    auto tag = static_cast<LogArgTag>(reader.read<uint8_t>());
+    switch (tag) {
+    case LogArgTag::INT:
+      args.emplace_back(reader.read<int64_t>());
+      break;
+    case LogArgTag::UINT:
+      args.emplace_back(reader.read<uint64_t>());
+      break;
+    case LogArgTag::FLOAT:
+      args.emplace_back(reader.read<float>());
+      break;
+    case LogArgTag::DOUBLE:
+      args.emplace_back(reader.read<double>());
+      break;
+    case LogArgTag::BOOL:
+      args.emplace_back(reader.read<uint8_t>() != 0);
+      break;
+    case LogArgTag::CHAR:
+      args.emplace_back(reader.read<char>());
+      break;
+    case LogArgTag::STRING:
+      args.emplace_back(reader.readString(reader.read<uint32_t>()));
+      break;
+    case LogArgTag::POINTER:
+      args.emplace_back(
+          reinterpret_cast<const void *>(reader.read<uint64_t>()));
+      break;
+    default:
+      return false;
+    }
+  }
+
+  return !reader.failed;
+}
+
+std::string formatTime(const LogBinaryHeader &header, int64_t ticks) {
+  // Ticks to nanoseconds without overflowing for long sessions
+  long double ns = static_cast<long double>(ticks - header.steadyAnchor) *
+                   header.tickNum * 1e9L / header.tickDen;
+  std::chrono::nanoseconds wall(header.systemAnchorNs +
+                                static_cast<int64_t>(ns));
+  std::chrono::system_clock::time_point timePoint(
+      std::chrono::duration_cast<std::chrono::system_clock::duration>(wall));
+  return TimeUtils::formatAsHourMinSec(TimeUtils::fromTimePoint(timePoint));
+}
+
+bool dumpFile(const std::filesystem::path &path) {
+  std::ifstream file(path, std::ios::binary);
+  if (!file) {
+    std::fprintf(stderr, "Failed to open %s\n", path.c_str());
+    return false;
+  }
+
+  std::vector<char> data((std::istreambuf_iterator<char>(file)),
+                         std::istreambuf_iterator<char>());
+  Reader reader{data.data(), data.size()};
+
+  auto header = reader.read<LogBinaryHeader>();
+  if (reader.failed ||
+      std::memcmp(header.magic, LOG_BINARY_MAGIC, sizeof(header.magic)) != 0 ||
+      header.version != LOG_BINARY_VERSION || header.tickDen == 0) {
+    std::fprintf(stderr, "%s is not a binary log file\n", path.c_str());
+    return false;
+  }
+
+  std::vector<FormatEntry> formats;
+  std::vector<LogArg> args;
+  std::string out;
+
+  while (reader.pos < reader.size) {
+    size_t entryStart = reader.pos;
+    auto type = static_cast<LogEntryType>(reader.read<uint8_t>());
+    std::string message;
+    LogLevel level = LogLevel::INFO;
+    int64_t ticks = 0;
+
+    if (type == LogEntryType::FORMAT) {
+      uint32_t id = reader.read<uint32_t>();
+      FormatEntry entry;
+      entry.line = reader.read<uint32_t>();
+      uint32_t fileLength = reader.read<uint32_t>();
+      uint32_t formatLength = reader.read<uint32_t>();
+      entry.file = reader.readString(fileLength);
+      entry.format = reader.readString(formatLength);
+      if (!reader.failed) {
+        formats.resize(std::max<size_t>(formats.size(), id + 1));
+        formats[id] = std::move(entry);
+      }
+    }
+
+    else if (type == LogEntryType::MESSAGE) {
+      level = static_cast<LogLevel>(reader.read<uint8_t>());
+      ticks = reader.read<int64_t>();
+      uint32_t id = reader.read<uint32_t>();
+      uint32_t argBytes = reader.read<uint32_t>();
+      if (!reader.failed && reader.pos + argBytes <= reader.size) {
+        Reader argReader{reader.data + reader.pos, argBytes};
+        reader.pos += argBytes;
+
+        if (id >= formats.size() || !readArgs(argReader, args)) {
+          message = std::format("<undecodable message, format {}>", id);
+        }
+
+        else {
+          message = formatMessage(formats[id].format, args);
+        }
+      }
+
+      else {
+        reader.failed = true;
+      }
+    }
+
+    else if (type == LogEntryType::TEXT) {
+      level = static_cast<LogLevel>(reader.read<uint8_t>());
+      ticks = reader.read<int64_t>();
+      message = reader.readString(reader.read<uint32_t>());
+    }
+
+    else {
+      std::fprintf(stderr, "%s: unknown entry at offset %zu\n", path.c_str(),
+                   entryStart);
+      break;
+    }
+
+    if (reader.failed) {
+      // Usually a crash in the middle of a write
+      std::fprintf(stderr, "%s: truncated entry at offset %zu\n",
+                   path.c_str(), entryStart);
+      break;
+    }
+
+    if (type != LogEntryType::FORMAT) {
+      out += std::format("[{}] [{}]: {}\n", formatTime(header, ticks),
+                         logLevelToString(level), message);
+    }
+
+    if (out.size() > (1 << 20)) {
+      std::fwrite(out.data(), 1, out.size(), stdout);
+      out.clear();
+    }
+  }
+
+  std::fwrite(out.data(), 1, out.size(), stdout);
+  return true;
+}
+
+std::vector<std::filesystem::path>
+collectFiles(const std::filesystem::path &directory) {
+  std::vector<std::filesystem::path> files;
+  for (const auto &entry : std::filesystem::directory_iterator(directory)) {
+    if (entry.path().extension() == ".hklog") {
+      files.push_back(entry.path());
+    }
+  }
+
+  // Files are numbered in creation order
+  std::sort(files.begin(), files.end(), [](const auto &a, const auto &b) {
+    return std::stoi(a.stem().string()) < std::stoi(b.stem().string());
+  });
+  return files;
+}
+} // namespace
+
+int main(int argc, char **argv) {
+  std::vector<std::filesystem::path> files;
+
+  try {
+    if (argc < 2) {
+      std::vector<std::filesystem::path> dates;
+      for (const auto &entry : std::filesystem::directory_iterator("logs")) {
+        if (entry.is_directory()) {
+          dates.push_back(entry.path());
+        }
+      }
+
+      if (dates.empty()) {
+        std::fprintf(stderr, "No log directories found in logs/\n");
+        return EXIT_FAILURE;
+      }
+
+      // Directories are named YYYY-MM-DD
+      files = collectFiles(*std::max_element(dates.begin(), dates.end()));
+    }
+
+    for (int i = 1; i < argc; i++) {
+      std::filesystem::path path(argv[i]);
+      if (std::filesystem::is_directory(path)) {
+        auto directoryFiles = collectFiles(path);
+        files.insert(files.end(), directoryFiles.begin(),
+                     directoryFiles.end());
+      }
+
+      else {
+        files.push_back(path);
+      }
+    }
+  } catch (const std::exception &error) {
+    std::fprintf(stderr, "%s\n", error.what());
+    return EXIT_FAILURE;
+  }
+
+  bool success = true;
+  for (const auto &path : files) {
+    success &= dumpFile(path);
+  }
+
+  return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}